@@ -25,6 +25,13 @@
 #include <osgEarth/Notify>
 #include <osgEarth/Registry>
 #include <osgEarth/TerrainEngineNode>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/Containers>
+#include <osgEarth/SingleFlight>
+#include <osgEarth/StringUtils>
 #include <osgEarthUtil/ExampleResources>
 #include <osgDB/ReaderWriter>
 #include <osgDB/ReadFile>
@@ -49,6 +56,8 @@
 #include <Poco/Util/OptionSet.h>
 #include <Poco/Util/HelpFormatter.h>
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 
 using Poco::Net::ServerSocket;
 using Poco::Net::HTTPRequestHandler;
@@ -296,6 +305,14 @@ usage(const char* name)
 {
     OE_NOTICE 
         << "\nUsage: " << name << " file.earth" << std::endl
+        << "    --port <num>        : port to listen on (default = 8000)" << std::endl
+        << "    --threads <num>     : number of request threads (default = number of CPUs)" << std::endl
+        << "    --headless          : composite tiles on the CPU instead of rendering them;" << std::endl
+        << "                          also serves terrain-RGB at /terrain/{z}/{x}/{y}.png" << std::endl
+        << "                          and request metrics at /stats" << std::endl
+        << "    --tile-size <num>   : headless tile size in pixels (default = 256)" << std::endl
+        << "    --cache-size <num>  : headless tiles to keep in memory (default = 4096)" << std::endl
+        << "    --xyz               : headless row 0 is at the top (default is TMS, row 0 at the bottom)" << std::endl
         << MapNodeHelper().usage() << std::endl;
 
     return 0;
@@ -461,7 +478,236 @@ public:
 };
 
 
+/**
+ * Serves tiles without a graphics context. Imagery is composited on the
+ * CPU from the map's image layers, and elevation is served as terrain-RGB
+ * (height = -10000 + (R*65536 + G*256 + B) * 0.1). Encoded tiles are kept
+ * in an LRU cache, and concurrent requests for the same tile share one
+ * result. Safe to call from many threads at once.
+ */
+class HeadlessTileServer
+{
+public:
+    HeadlessTileServer(const Map* map, unsigned tileSize, unsigned cacheSize, bool tms) :
+      _map(map),
+      _tileSize(tileSize),
+      _tms(tms),
+      _cache(true, cacheSize)
+      {
+          //nop
+      }
+
+      /**
+       * Encoded tile for a request, from the cache if possible.
+       * Returns false if there is no data for the tile.
+       */
+      bool getTile(bool terrain, unsigned int z, unsigned int x, unsigned int y, const std::string& ext,
+                   std::string& out, bool& cacheHit)
+      {
+          if (z > 30u)
+              return false;
+
+          std::string cacheKey = Stringify() << (terrain ? "terrain/" : "") << z << "/" << x << "/" << y << "." << ext;
+
+          TileCache::Record record;
+          cacheHit = _cache.get(cacheKey, record);
+          if (cacheHit)
+          {
+              out = record.value();
+              return true;
+          }
+
+          TileFlights::Scope flight(_flights, cacheKey, 0L);
+          if (!flight.isLeader())
+          {
+              out = flight.get();
+              return !out.empty();
+          }
+
+          const Profile* profile = _map->getProfile();
+          unsigned cols=0, rows=0;
+          profile->getNumTiles( z, cols, rows );
+          if (x >= cols || y >= rows)
+          {
+              flight.resolve(out);
+              return false;
+          }
+
+          // Invert the y
+          if (_tms)
+              y = rows - y - 1;
+
+          TileKey key(z, x, y, profile);
+
+          osg::ref_ptr<osg::Image> image = terrain ? createTerrainRGB(key) : createImage(key);
+          if (image.valid())
+          {
+              encode(image.get(), ext, out);
+          }
+
+          if (!out.empty())
+          {
+              _cache.insert(cacheKey, out);
+          }
+
+          flight.resolve(out);
+          return !out.empty();
+      }
+
+      CacheStats getCacheStats() const { return _cache.getStats(); }
+
+private:
+      // Blends the visible image layers into one RGBA image, bottom layer first.
+      osg::Image* createImage(const TileKey& key)
+      {
+          ImageLayerVector layers;
+          _map->getLayers(layers);
+
+          osg::ref_ptr<osg::Image> result;
+
+          for (ImageLayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+          {
+              ImageLayer* layer = i->get();
+              if (!layer->getEnabled() || !layer->getVisible() || layer->isShared())
+                  continue;
+
+              GeoImage geoImage = layer->createImage(key, 0L);
+              if (!geoImage.valid())
+                  continue;
+
+              osg::ref_ptr<osg::Image> image = geoImage.getImage();
+              if (image->s() != (int)_tileSize || image->t() != (int)_tileSize)
+              {
+                  osg::ref_ptr<osg::Image> resized;
+                  if (!ImageUtils::resizeImage(image.get(), _tileSize, _tileSize, resized))
+                      continue;
+                  image = resized.get();
+              }
+
+              if (!result.valid())
+              {
+                  result = ImageUtils::createEmptyImage(_tileSize, _tileSize);
+              }
+
+              ImageUtils::mix(result.get(), image.get(), layer->getOpacity());
+          }
+
+          return result.release();
+      }
+
+      // Encodes the elevation layers as a terrain-RGB image.
+      osg::Image* createTerrainRGB(const TileKey& key)
+      {
+          ElevationLayerVector layers;
+          _map->getLayers(layers);
+          if (layers.empty())
+              return 0L;
+
+          osg::ref_ptr<osg::HeightField> hf = HeightFieldUtils::createReferenceHeightField(
+              key.getExtent(), _tileSize, _tileSize, 0, true);
+
+          if (!layers.populateHeightFieldAndNormalMap(hf.get(), 0L, key, _map->getProfileNoVDatum(), INTERP_BILINEAR, 0L))
+              return 0L;
+
+          osg::Image* image = new osg::Image();
+          image->allocateImage(_tileSize, _tileSize, 1, GL_RGB, GL_UNSIGNED_BYTE);
+
+          for (unsigned t = 0; t < _tileSize; ++t)
+          {
+              for (unsigned s = 0; s < _tileSize; ++s)
+              {
+                  float h = hf->getHeight(s, t);
+                  if (h == NO_DATA_VALUE)
+                      h = 0.0f;
+
+                  unsigned v = (unsigned)osg::clampBetween((h + 10000.0)*10.0 + 0.5, 0.0, 16777215.0);
+                  unsigned char* p = image->data(s, t);
+                  p[0] = (v >> 16) & 0xff;
+                  p[1] = (v >> 8) & 0xff;
+                  p[2] = v & 0xff;
+              }
+          }
+
+          return image;
+      }
+
+      bool encode(const osg::Image* image, const std::string& ext, std::string& out)
+      {
+          osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
+          if (!rw)
+              return false;
+
+          // JPEG has no alpha channel.
+          osg::ref_ptr<const osg::Image> source = image;
+          if (ext == "jpg" || ext == "jpeg")
+          {
+              source = ImageUtils::convertToRGB8(image);
+              if (!source.valid())
+                  return false;
+          }
+
+          std::stringstream buf;
+          if (!rw->writeImage(*source.get(), buf).success())
+              return false;
+
+          out = buf.str();
+          return true;
+      }
+
+      typedef LRUCache<std::string, std::string> TileCache;
+      typedef SingleFlight<std::string, std::string> TileFlights;
+
+      osg::ref_ptr<const Map> _map;
+      unsigned                _tileSize;
+      bool                    _tms;
+      TileCache               _cache;
+      TileFlights             _flights;
+};
+
+
+/**
+ * Request counts and latencies, reported at /stats.
+ */
+class RequestStats
+{
+public:
+    RequestStats() : _count(0), _hits(0), _notFound(0), _totalTime(0.0), _maxTime(0.0) { }
+
+    void record(double seconds, bool found, bool cacheHit)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        ++_count;
+        if (cacheHit) ++_hits;
+        if (!found) ++_notFound;
+        _totalTime += seconds;
+        _maxTime = osg::maximum(_maxTime, seconds);
+    }
+
+    Config getConfig() const
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        Config conf("stats");
+        conf.set("requests", _count);
+        conf.set("cache_hits", _hits);
+        conf.set("not_found", _notFound);
+        conf.set("mean_ms", _count > 0 ? 1000.0*_totalTime/(double)_count : 0.0);
+        conf.set("max_ms", 1000.0*_maxTime);
+        return conf;
+    }
+
+private:
+    mutable Threading::Mutex _mutex;
+    unsigned                 _count;
+    unsigned                 _hits;
+    unsigned                 _notFound;
+    double                   _totalTime;
+    double                   _maxTime;
+};
+
+
 static TileImageServer* _server;
+static HeadlessTileServer* _headlessServer;
+static RequestStats _stats;
 
 class TileRequestHandler: public HTTPRequestHandler
 {
@@ -473,48 +719,92 @@ public:
     void handleRequest(HTTPServerRequest& request,
                        HTTPServerResponse& response)
     {
-        StringTokenizer tok("/");
+        OE_START_TIMER(request);
+
+        std::string path = request.getURI();
+        path = path.substr(0, path.find('?'));
+
         StringVector tized;
-        tok.tokenize(request.getURI(), tized);            
-        if ( tized.size() == 4 )
+        StringTokenizer(path, tized, "/", "", false, true);
+
+        if (_headlessServer && tized.size() == 1 && tized[0] == "stats")
+        {
+            Config conf = _stats.getConfig();
+            CacheStats cs = _headlessServer->getCacheStats();
+            conf.set("cache_entries", cs._entries);
+            conf.set("cache_hit_ratio", cs._hitRatio);
+            response.setContentType("application/json");
+            response.send() << conf.toJSON(true);
+            return;
+        }
+
+        // {z}/{x}/{y}.{ext}, or terrain/{z}/{x}/{y}.png in headless mode
+        bool terrain = _headlessServer && tized.size() == 4 && tized[0] == "terrain";
+        if ( tized.size() == 3 || terrain )
         {
-            int z = as<int>(tized[1], 0);
-            int x = as<int>(tized[2], 0);
-            unsigned int y = as<int>(osgDB::getNameLessExtension(tized[3]),0);
-            std::string ext = osgDB::getFileExtension(tized[3]);
+            unsigned offset = terrain ? 1 : 0;
+            int z = as<int>(tized[offset], 0);
+            int x = as<int>(tized[offset+1], 0);
+            unsigned int y = as<int>(osgDB::getNameLessExtension(tized[offset+2]),0);
+            std::string ext = osgDB::getLowerCaseFileExtension(tized[offset+2]);
 
             OE_DEBUG << "z=" << z << std::endl;
             OE_DEBUG << "x=" << x << std::endl;
             OE_DEBUG << "y=" << y << std::endl;              
             OE_DEBUG << "ext=" << ext << std::endl;
 
-            response.setChunkedTransferEncoding(true);
+            std::string mime = "image/png";
+            if (ext == "jpeg" || ext == "jpg")
+            {
+                mime = "image/jpeg";
+            }
 
-            osg::ref_ptr< osg::Image > image = _server->getTile(z, x, y);
-            
-            if (image)
+            if (_headlessServer)
             {
-                osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
-                if (rw)
+                std::string data;
+                bool cacheHit = false;
+                bool found =
+                    (!terrain || ext == "png") &&
+                    _headlessServer->getTile(terrain, z, x, y, ext, data, cacheHit);
+
+                double seconds = OE_GET_TIMER(request);
+                _stats.record(seconds, found, cacheHit);
+                OE_INFO << LC << path << (found ? "" : " not found") << (cacheHit ? " (cached)" : "")
+                    << " in " << std::setprecision(3) << 1000.0*seconds << "ms" << std::endl;
+
+                if (found)
                 {
-                    std::string mime = "image/png";
-                    if (ext == "jpeg" || ext == "jpg")
-                    {
-                        mime = "image/jpeg";
-                    }                    
                     response.setContentType(mime);
-                    std::ostream& ostr = response.send();                 
-                    rw->writeImage(*image.get(), ostr);                    
-                }             
+                    response.setContentLength(data.size());
+                    response.set("X-Tile-Time-Ms", Stringify() << 1000.0*seconds);
+                    response.send().write(data.c_str(), data.size());
+                    return;
+                }
+            }
 
+            else
+            {
+                response.setChunkedTransferEncoding(true);
+
+                osg::ref_ptr< osg::Image > image = _server->getTile(z, x, y);
+            
+                if (image)
+                {
+                    osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
+                    if (rw)
+                    {
+                        response.setContentType(mime);
+                        std::ostream& ostr = response.send();                 
+                        rw->writeImage(*image.get(), ostr);                    
+                        return;
+                    }             
+                }
             }
         }
  
-        response.setStatus(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);                
+        response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+        response.send();
     }
-
-private:
-    std::string _format;
 };
 
 class TileRequestHandlerFactory : public HTTPRequestHandlerFactory
@@ -527,33 +817,16 @@ class TileRequestHandlerFactory : public HTTPRequestHandlerFactory
     HTTPRequestHandler* createRequestHandler(
         const HTTPServerRequest& request)
     {        
-        StringTokenizer tok("/");
-        StringVector tized;
-        tok.tokenize(request.getURI(), tized);            
-        if ( tized.size() == 4 )
-        {
-            int z = as<int>(tized[1], 0);
-            int x = as<int>(tized[2], 0);
-            unsigned int y = as<int>(osgDB::getNameLessExtension(tized[3]),0);
-            std::string ext = osgDB::getFileExtension(tized[3]);
-
-            OE_DEBUG << "z=" << z << std::endl;
-            OE_DEBUG << "x=" << x << std::endl;
-            OE_DEBUG << "y=" << y << std::endl;              
-            OE_DEBUG << "ext=" << ext << std::endl;
-
-            return new TileRequestHandler();
-        }
-
-        return 0;
+        return new TileRequestHandler();
     }
 };
 
 class TileHTTPServer: public Poco::Util::ServerApplication
 {
 public:
-    TileHTTPServer(int port):
-      _port(port)
+    TileHTTPServer(int port, int numThreads):
+      _port(port),
+      _numThreads(numThreads)
     {
     }
 
@@ -576,7 +849,10 @@ protected:
     int main(const std::vector<std::string>& args)
     {
         ServerSocket svs(_port);
-        HTTPServer srv(new TileRequestHandlerFactory(), svs, new HTTPServerParams);
+        HTTPServerParams* params = new HTTPServerParams;
+        params->setMaxThreads(_numThreads);
+        ThreadPool pool(1, _numThreads);
+        HTTPServer srv(new TileRequestHandlerFactory(), pool, svs, params);
         srv.start();
         waitForTerminationRequest();
         srv.stop();
@@ -585,6 +861,7 @@ protected:
 
 private:
     int _port;
+    int _numThreads;
 };
 
 
@@ -602,6 +879,16 @@ main(int argc, char** argv)
     arguments.read("--port", port);
     OE_NOTICE << "Listening on port " << port << std::endl;
 
+    int numThreads = OpenThreads::GetNumberOfProcessors();
+    arguments.read("--threads", numThreads);
+    numThreads = osg::maximum(numThreads, 1);
+
+    bool headless = arguments.read("--headless");
+    unsigned tileSize = 256u, cacheSize = 4096u;
+    arguments.read("--tile-size", tileSize);
+    arguments.read("--cache-size", cacheSize);
+    bool tms = !arguments.read("--xyz");
+
     // thread-safe initialization of the OSG wrapper manager. Calling this here
     // prevents the "unsupported wrapper" messages from OSG
     osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper("osg::Image");
@@ -615,9 +902,21 @@ main(int argc, char** argv)
     {
         OE_NOTICE << "Found map node" << std::endl;
     }
+    else
+    {
+        return usage(argv[0]);
+    }
 
-    _server = new TileImageServer( mapNode.get() );
+    if (headless)
+    {
+        OE_NOTICE << "Serving headless tiles with " << numThreads << " threads" << std::endl;
+        _headlessServer = new HeadlessTileServer( mapNode->getMap(), tileSize, cacheSize, tms );
+    }
+    else
+    {
+        _server = new TileImageServer( mapNode.get() );
+    }
 
-    TileHTTPServer app(port);
+    TileHTTPServer app(port, numThreads);
     return app.run(argc, argv);
 }
@@ -19,11 +19,18 @@
 #include <osgEarth/Async>
 #include <osgEarth/Registry>
 #include <osgEarth/Utils>
+#include <osgEarth/NodeUtils>
+#include <osgEarth/StringUtils>
 
 #include <osg/CullStack>
+#include <osg/Geometry>
+#include <osg/Texture>
 #include <osgDB/ReaderWriter>
 #include <osgDB/FileNameUtils>
 #include <osgDB/Registry>
+#include <algorithm>
+#include <set>
+#include <cstdlib>
 
 using namespace osgEarth;
 
@@ -44,49 +51,313 @@ _node(node), _requestId(0u)
 
 //........................................................................
 
-namespace osgEarth
+OpenThreads::Atomic AsyncNode::_idgen;
+
+AsyncNode::AsyncNode()
 {
-    // internal class
-    class AsyncNode : public osg::Referenced
+    _needy = true;
+    _lastFrameWeMet = 0u;
+    _lastTimeWeMet = 0.0;
+    _id = ++_idgen;
+    char buf[64];
+    sprintf(buf, "%u." ASYNC_PSEUDOLOADER_EXT, _id);
+    _pseudoloaderFilename = buf;
+}
+
+//........................................................................
+
+namespace
+{
+    // Estimates the memory used by the geometry and images in a subgraph.
+    // Data shared by several drawables or textures counts once.
+    struct ComputeSizeVisitor : public osg::NodeVisitor
     {
-    public:
-        AsyncNode()
+        size_t _bytes;
+        std::set<const osg::Referenced*> _seen;
+
+        ComputeSizeVisitor() : osg::NodeVisitor(), _bytes(0)
         {
-            _needy = true;
-            _id = ++_idgen;
-            char buf[64];
-            sprintf(buf, "%u." ASYNC_PSEUDOLOADER_EXT, _id);
-            _pseudoloaderFilename = buf;
+            setTraversalMode(TRAVERSE_ALL_CHILDREN);
+            setNodeMaskOverride(~0);
+        }
+
+        void apply(osg::Node& node)
+        {
+            apply(node.getStateSet());
+            traverse(node);
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            apply(drawable.getStateSet());
+
+            osg::Geometry* geom = drawable.asGeometry();
+            if (geom)
+            {
+                osg::Geometry::ArrayList arrays;
+                geom->getArrayList(arrays);
+                for (osg::Geometry::ArrayList::const_iterator i = arrays.begin(); i != arrays.end(); ++i)
+                    add(i->get());
+
+                osg::Geometry::DrawElementsList elements;
+                geom->getDrawElementsList(elements);
+                for (osg::Geometry::DrawElementsList::const_iterator i = elements.begin(); i != elements.end(); ++i)
+                    add(*i);
+            }
         }
 
-        bool _needy;
-        unsigned _id;
-        osg::ref_ptr<osg::Node> _node;
-        osg::ref_ptr<AsyncFunction> _callback;
-        std::string _pseudoloaderFilename;
-        double _lastTimeWeMet;
-        float _minValue;
-        float _maxValue;
-        osg::BoundingSphere _bound;
-        osg::ref_ptr<osg::Referenced> _internalHandle;
-        osg::ref_ptr<osgDB::Options> _options;
-
-        void accept(osg::NodeVisitor& nv) { if (_node) _node->accept(nv); }
-
-        //! Use the node's bound if we have it, or a preset
-        //! bound if we don't.
-        const osg::BoundingSphere& getBound() const
+        void apply(osg::StateSet* ss)
         {
-            if (_node.valid())
-                return _node->getBound();
-            else
-                return _bound;
+            if (!ss) return;
+
+            osg::StateSet::TextureAttributeList& a = ss->getTextureAttributeList();
+            for (osg::StateSet::TextureAttributeList::iterator i = a.begin(); i != a.end(); ++i)
+            {
+                for (osg::StateSet::AttributeList::iterator j = i->begin(); j != i->end(); ++j)
+                {
+                    osg::Texture* tex = dynamic_cast<osg::Texture*>(j->second.first.get());
+                    if (tex)
+                    {
+                        for (unsigned k = 0; k < tex->getNumImages(); ++k)
+                            add(tex->getImage(k));
+                    }
+                }
+            }
         }
 
-        static OpenThreads::Atomic _idgen;
+        void add(const osg::BufferData* data)
+        {
+            if (data && _seen.insert(data).second)
+                _bytes += data->getTotalDataSize();
+        }
     };
 
-    OpenThreads::Atomic AsyncNode::_idgen;
+    // Scan for expired content at most this often (seconds)
+    const double SCAN_INTERVAL = 1.0;
+
+    // Never destroyed, since AsyncLOD nodes may outlive static destruction.
+    AsyncResidencyManager* s_residencyManager = 0L;
+}
+
+AsyncResidencyManager&
+AsyncResidencyManager::instance()
+{
+    if (!s_residencyManager)
+        s_residencyManager = new AsyncResidencyManager();
+    return *s_residencyManager;
+}
+
+// create the instance at startup so that instance() is safe to call from any thread.
+namespace { struct InitResidencyManager { InitResidencyManager() { AsyncResidencyManager::instance(); } } s_initResidencyManager; }
+
+AsyncResidencyManager::AsyncResidencyManager() :
+_totalBytes(0),
+_maxBytes(0),
+_expirationFrames(60u),
+_expirationTime(10.0),
+_lastFrame(~0u),
+_lastScanTime(0.0)
+{
+    const char* maxMB = ::getenv("OSGEARTH_ASYNC_MAX_MB");
+    if (maxMB)
+    {
+        _maxBytes = (size_t)(as<double>(maxMB, 0.0) * 1048576.0);
+    }
+}
+
+void
+AsyncResidencyManager::setMaxBytes(size_t value)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _maxBytes = value;
+}
+
+size_t
+AsyncResidencyManager::getMaxBytes() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _maxBytes;
+}
+
+void
+AsyncResidencyManager::setExpirationFrames(unsigned value)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _expirationFrames = value;
+}
+
+unsigned
+AsyncResidencyManager::getExpirationFrames() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _expirationFrames;
+}
+
+void
+AsyncResidencyManager::setExpirationTime(double seconds)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _expirationTime = seconds;
+}
+
+double
+AsyncResidencyManager::getExpirationTime() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _expirationTime;
+}
+
+size_t
+AsyncResidencyManager::getTotalBytes() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _totalBytes;
+}
+
+unsigned
+AsyncResidencyManager::getNumResident() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _resident.size();
+}
+
+void
+AsyncResidencyManager::add(AsyncNode* node, size_t bytes)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    size_t& entry = _resident[node];
+    _totalBytes = _totalBytes - entry + bytes;
+    entry = bytes;
+}
+
+void
+AsyncResidencyManager::remove(AsyncNode* node)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    Resident::iterator i = _resident.find(node);
+    if (i != _resident.end())
+    {
+        _totalBytes -= i->second;
+        _resident.erase(i);
+    }
+}
+
+namespace
+{
+    struct Candidate
+    {
+        AsyncNode* _node;
+        unsigned   _lastFrame;
+        double     _lastTime;
+        size_t     _bytes;
+
+        // least recently seen first; of those, the largest first
+        bool operator < (const Candidate& rhs) const
+        {
+            if (_lastFrame != rhs._lastFrame) return _lastFrame < rhs._lastFrame;
+            if (_lastTime != rhs._lastTime) return _lastTime < rhs._lastTime;
+            return _bytes > rhs._bytes;
+        }
+    };
+}
+
+void
+AsyncResidencyManager::update(const osg::FrameStamp* stamp)
+{
+    if (!stamp)
+        return;
+
+    // unloaded content; released after unlocking the mutex since destroying
+    // it may remove nested AsyncLODs from this manager.
+    std::vector< osg::ref_ptr<osg::Node> > unloaded;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        // once per frame, no matter how many AsyncLODs call in:
+        unsigned frame = stamp->getFrameNumber();
+        if (frame == _lastFrame)
+            return;
+        _lastFrame = frame;
+
+        double now = stamp->getReferenceTime();
+        bool overBudget = _maxBytes > 0 && _totalBytes > _maxBytes;
+        bool scan = _expirationTime > 0.0 && now - _lastScanTime >= SCAN_INTERVAL;
+
+        if (!overBudget && !scan)
+            return;
+
+        if (scan)
+            _lastScanTime = now;
+
+        std::vector<Candidate> candidates;
+        std::vector<AsyncNode*> expired;
+
+        for (Resident::const_iterator i = _resident.begin(); i != _resident.end(); ++i)
+        {
+            Candidate c;
+            c._node = i->first;
+            c._lastFrame = c._node->_lastFrameWeMet;
+            c._lastTime = c._node->_lastTimeWeMet;
+            c._bytes = i->second;
+
+            // never unload anything that was visible in the last frame
+            if (c._lastFrame + 1u >= frame)
+                continue;
+
+            if (scan &&
+                c._lastTime < now &&
+                now - c._lastTime >= _expirationTime &&
+                frame - c._lastFrame >= _expirationFrames)
+            {
+                expired.push_back(c._node);
+            }
+            else if (overBudget)
+            {
+                candidates.push_back(c);
+            }
+        }
+
+        for (std::vector<AsyncNode*>::const_iterator i = expired.begin(); i != expired.end(); ++i)
+        {
+            unload(*i, unloaded);
+        }
+
+        if (_maxBytes > 0 && _totalBytes > _maxBytes && !candidates.empty())
+        {
+            std::sort(candidates.begin(), candidates.end());
+
+            for (std::vector<Candidate>::const_iterator i = candidates.begin();
+                i != candidates.end() && _totalBytes > _maxBytes;
+                ++i)
+            {
+                unload(i->_node, unloaded);
+            }
+        }
+
+        if (!unloaded.empty())
+        {
+            OE_DEBUG << LC << "Unloaded " << unloaded.size() << " nodes; "
+                << _resident.size() << " nodes (" << (_totalBytes / 1048576) << " MB) remain" << std::endl;
+        }
+    }
+}
+
+// internal - assumes the mutex is locked
+void
+AsyncResidencyManager::unload(AsyncNode* node, std::vector< osg::ref_ptr<osg::Node> >& unloaded)
+{
+    Resident::iterator i = _resident.find(node);
+    if (i == _resident.end())
+        return;
+
+    _totalBytes -= i->second;
+    _resident.erase(i);
+
+    // hand the node back to the pager as a potential child:
+    unloaded.push_back(node->_node.get());
+    node->_node = 0L;
+    node->_internalHandle = 0L;
+    node->_needy = true;
 }
 
 //........................................................................
@@ -96,6 +367,17 @@ AsyncLOD::AsyncLOD()
     _policy = POLICY_ACCUMULATE;
     _mode = MODE_GEOMETRIC_ERROR;
     _nodePath.push_back(this);
+
+    // the update traversal gives the residency manager a chance to run
+    ADJUST_UPDATE_TRAV_COUNT(this, +1);
+}
+
+AsyncLOD::~AsyncLOD()
+{
+    for (std::vector< osg::ref_ptr<AsyncNode> >::iterator i = _children.begin(); i != _children.end(); ++i)
+    {
+        AsyncResidencyManager::instance().remove(i->get());
+    }
 }
 
 void
@@ -137,31 +419,37 @@ AsyncLOD::setRadius(double radius)
 void
 AsyncLOD::addChild(AsyncFunction* callback, float minValue, float maxValue)
 {
-    _children.push_back(AsyncNode());
-    AsyncNode& child = _children.back();
-    child._callback = callback;
-    child._minValue = minValue;
-    child._maxValue = maxValue;
-    child._lastTimeWeMet = DBL_MAX;
-    child._options = Registry::instance()->cloneOrCreateOptions(_readOptions.get());
-    OptionsData<AsyncFunction>::set(child._options.get(), TAG_ASYNC_CALLBACK, callback);
-    _lookup[child._id] = &child;
+    AsyncNode* child = new AsyncNode();
+    child->_callback = callback;
+    child->_minValue = minValue;
+    child->_maxValue = maxValue;
+    child->_lastTimeWeMet = DBL_MAX;
+    child->_options = Registry::instance()->cloneOrCreateOptions(_readOptions.get());
+    OptionsData<AsyncFunction>::set(child->_options.get(), TAG_ASYNC_CALLBACK, callback);
+    _children.push_back(child);
+    _mutex.lock();
+    _lookup[child->_id] = child;
+    _mutex.unlock();
 }
 
 void
 AsyncLOD::addChild(osg::Node* node, float minValue, float maxValue)
 {
-    _children.push_back(AsyncNode());
-    AsyncNode& child = _children.back();
-    child._node = node;
-    child._minValue = minValue;
-    child._maxValue = maxValue;
-    child._lastTimeWeMet = DBL_MAX;
+    AsyncNode* child = new AsyncNode();
+    child->_node = node;
+    child->_minValue = minValue;
+    child->_maxValue = maxValue;
+    child->_lastTimeWeMet = DBL_MAX;
+    _children.push_back(child);
 }
 
 void
 AsyncLOD::clear()
 {
+    for (std::vector< osg::ref_ptr<AsyncNode> >::iterator i = _children.begin(); i != _children.end(); ++i)
+    {
+        AsyncResidencyManager::instance().remove(i->get());
+    }
     _children.clear();
     _mutex.lock();
     _lookup.clear();
@@ -188,6 +476,11 @@ AsyncLOD::addChild(osg::Node* node)
             if (ar->_node.valid())
             {
                 async->_node = ar->_node.get();
+
+                // account for it so it can be unloaded again later:
+                ComputeSizeVisitor size;
+                async->_node->accept(size);
+                AsyncResidencyManager::instance().add(async, size._bytes);
             }
 
             // node is no longer needy. Yay!
@@ -213,11 +506,11 @@ AsyncLOD::computeBound() const
     else
     {
         osg::BoundingSphere bs;
-        for (std::vector<AsyncNode>::const_iterator i = _children.begin();
+        for (std::vector< osg::ref_ptr<AsyncNode> >::const_iterator i = _children.begin();
             i != _children.end();
             ++i)
         {
-            bs.expandBy(i->getBound());
+            bs.expandBy((*i)->getBound());
         }
         return bs;
     }
@@ -234,15 +527,16 @@ AsyncLOD::traverse(osg::NodeVisitor& nv)
         AsyncNode* lastNeedyChild = 0L;
 
         // visit each child:
-        for (std::vector<AsyncNode>::iterator i = _children.begin(); i != _children.end(); ++i)
+        for (std::vector< osg::ref_ptr<AsyncNode> >::iterator i = _children.begin(); i != _children.end(); ++i)
         {
-            AsyncNode& child = *i;
+            AsyncNode& child = *i->get();
 
             // is the child visible?
             if (isVisible(child, nv))
             {
                 // if so, update its timestamp
                 child._lastTimeWeMet = nv.getFrameStamp()->getReferenceTime();
+                child._lastFrameWeMet = nv.getFrameStamp()->getFrameNumber();
 
                 // if this child has a live node, traverse it if we're in 
                 // accumulate mode (which means everything loaded so far is visible)
@@ -290,14 +584,24 @@ AsyncLOD::traverse(osg::NodeVisitor& nv)
         }
     }
 
-    // Update, ComputeBound, CompileGLObjects, etc.
-    else if (nv.getTraversalMode() == nv.TRAVERSE_ALL_CHILDREN)
+    else
     {
-        for (std::vector<AsyncNode>::iterator i = _children.begin(); i != _children.end(); ++i)
+        // Unload content that is no longer needed. The update traversal
+        // is a safe time to do that since no cull traversal is running.
+        if (nv.getVisitorType() == nv.UPDATE_VISITOR)
+        {
+            AsyncResidencyManager::instance().update(nv.getFrameStamp());
+        }
+
+        // Update, ComputeBound, CompileGLObjects, etc.
+        if (nv.getTraversalMode() == nv.TRAVERSE_ALL_CHILDREN)
         {
-            if (i->_node.valid())
+            for (std::vector< osg::ref_ptr<AsyncNode> >::iterator i = _children.begin(); i != _children.end(); ++i)
             {
-                i->_node->accept(nv);
+                if ((*i)->_node.valid())
+                {
+                    (*i)->_node->accept(nv);
+                }
             }
         }
     }
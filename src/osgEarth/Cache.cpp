@@ -18,6 +18,7 @@
  */
 #include <osgEarth/Cache>
 #include <osgEarth/Registry>
+#include <osgEarth/WriteBehindCacheBin>
 #include "sha1.hpp"
 
 #include <osgDB/ReadFile>
@@ -137,6 +138,15 @@ Cache::removeBin( CacheBin* bin )
     _bins.remove( bin );
 }
 
+CacheBin*
+Cache::prepareBin( CacheBin* bin ) const
+{
+    if ( bin && _options.writeBehind() == true )
+        return new WriteBehindCacheBin( bin, _options.writeQueueSize().get() );
+    else
+        return bin;
+}
+
 namespace
 {
     int hash8(const std::string& str)
@@ -247,6 +247,18 @@ namespace
 }
 
 
+unsigned
+CacheBin::writeBatch(const RecordList& records)
+{
+    unsigned count = 0u;
+    for (RecordList::const_iterator i = records.begin(); i != records.end(); ++i)
+    {
+        if (write(i->key, i->object.get(), i->metadata, i->options.get()))
+            ++count;
+    }
+    return count;
+}
+
 bool
 CacheBin::writeNode(const std::string&    key,
                     osg::Node*            node,
@@ -21,6 +21,7 @@
 #include <osgEarth/Progress>
 #include <osgEarth/Metrics>
 #include <osgEarth/URI>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -468,6 +469,27 @@ ElevationLayer::createHeightField(const TileKey& key)
 GeoHeightField
 ElevationLayer::createHeightField(const TileKey&    key,
                                   ProgressCallback* progress )
+{
+    // If another thread is already creating this tile, wait for its result
+    // instead of creating it again.
+    SingleFlight<std::string, GeoHeightField>::Scope flight(
+        _heightFieldFlights,
+        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
+        progress );
+
+    if ( !flight.isLeader() )
+    {
+        return flight.get();
+    }
+
+    GeoHeightField result = createHeightFieldInKeyProfile( key, flight.getProgress() );
+    flight.resolve( result );
+    return result;
+}
+
+GeoHeightField
+ElevationLayer::createHeightFieldInKeyProfile(const TileKey&    key,
+                                              ProgressCallback* progress )
 {
     METRIC_SCOPED_EX("ElevationLayer::createHeightField", 2,
                      "key", key.str().c_str(),
@@ -718,8 +740,233 @@ namespace
     //typedef std::pair<RefElevationLayer, TileKey> LayerAndKey;
     typedef std::vector<LayerData>              LayerDataVector;
 
-    //! Gets the normal vector for elevation data at column s, row t.
-    osg::Vec3 getNormal(const GeoExtent& extent, const osg::HeightField* hf, int s, int t)
+    //! Samples one layer's heightfield along the rows of an output tile.
+    //!
+    //! When the source heightfield is in the same SRS as the tile, the mapping
+    //! from output samples to source pixels is affine and separable, so the pixel
+    //! coordinates, extent tests and interpolation neighbors are computed once per
+    //! column and once per row, and a row is interpolated with a straight loop over
+    //! those tables. Results match GeoHeightField::getElevation. Any other source
+    //! falls back on GeoHeightField::getElevation for each sample.
+    class RowSampler
+    {
+    public:
+        RowSampler() : _heights(0L), _cols(0), _affine(false) { }
+
+        void init(const GeoHeightField&   source,
+                  const SpatialReference* srs,
+                  ElevationInterpolation  interp,
+                  double xmin, double ymin, double dx, double dy,
+                  unsigned numColumns, unsigned numRows)
+        {
+            _source = source;
+            _srs    = srs;
+            _interp = interp;
+            _xmin   = xmin;
+            _ymin   = ymin;
+            _dx     = dx;
+            _dy     = dy;
+
+            const GeoExtent& ex = source.getExtent();
+            const osg::HeightField* hf = source.getHeightField();
+
+            _affine =
+                ex.getSRS()->isEquivalentTo(srs) &&
+                !ex.crossesAntimeridian() &&
+                hf->getNumColumns() > 1 &&
+                hf->getNumRows() > 1;
+
+            if (!_affine)
+                return;
+
+            _heights = (const float*)hf->getFloatArray()->getDataPointer();
+            _cols    = hf->getNumColumns();
+
+            double xInterval = ex.width()  / (double)(hf->getNumColumns()-1);
+            double yInterval = ex.height() / (double)(hf->getNumRows()-1);
+
+            // GeoExtent::contains tests x and y independently, so test each
+            // column against the middle row and each row against the middle column.
+            double xMid = ex.xMin() + 0.5*ex.width();
+            double yMid = ex.yMin() + 0.5*ex.height();
+
+            setup(ex, xmin, dx, numColumns, ex.xMin(), xInterval, hf->getNumColumns(), yMid, true, _colIn, _px, _col0, _col1, _fx);
+            setup(ex, ymin, dy, numRows,    ex.yMin(), yInterval, hf->getNumRows(),    xMid, false, _rowIn, _py, _row0, _row1, _fy);
+        }
+
+        //! Samples row "r" at each column "c" where mask[c] is set, storing the
+        //! result in out[c]. Samples outside the source extent are NO_DATA_VALUE.
+        void sampleRow(unsigned r, const char* mask, float* out, unsigned numColumns) const
+        {
+            if (!_affine)
+            {
+                double y = _ymin + (_dy * (double)r);
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    if (mask[c] && !_source.getElevation(_srs, _xmin + (_dx * (double)c), y, _interp, _srs, out[c]))
+                        out[c] = NO_DATA_VALUE;
+                }
+                return;
+            }
+
+            if (!_rowIn[r])
+            {
+                for (unsigned c = 0; c < numColumns; ++c)
+                    if (mask[c]) out[c] = NO_DATA_VALUE;
+                return;
+            }
+
+            if (_interp != INTERP_BILINEAR)
+            {
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    if (mask[c])
+                        out[c] = _colIn[c] ? HeightFieldUtils::getHeightAtPixel(_source.getHeightField(), _px[c], _py[r], _interp) : NO_DATA_VALUE;
+                }
+                return;
+            }
+
+            const float* lower = _heights + _row0[r]*_cols;
+            const float* upper = _heights + _row1[r]*_cols;
+            const double fy = _fy[r];
+
+            for (unsigned c = 0; c < numColumns; ++c)
+            {
+                if (!mask[c])
+                    continue;
+
+                if (!_colIn[c])
+                {
+                    out[c] = NO_DATA_VALUE;
+                    continue;
+                }
+
+                float llHeight = lower[_col0[c]];
+                float lrHeight = lower[_col1[c]];
+                float ulHeight = upper[_col0[c]];
+                float urHeight = upper[_col1[c]];
+
+                if (llHeight == NO_DATA_VALUE || lrHeight == NO_DATA_VALUE ||
+                    ulHeight == NO_DATA_VALUE || urHeight == NO_DATA_VALUE)
+                {
+                    //Make sure not to use NoData in the interpolation
+                    if (!HeightFieldUtils::validateSamples(urHeight, llHeight, ulHeight, lrHeight))
+                    {
+                        out[c] = NO_DATA_VALUE;
+                        continue;
+                    }
+                }
+
+                const double fx = _fx[c];
+                double r1 = (1.0-fx) * (double)llHeight + fx * (double)lrHeight;
+                double r2 = (1.0-fx) * (double)ulHeight + fx * (double)urHeight;
+                out[c] = (float)((1.0-fy) * r1 + fy * r2);
+            }
+        }
+
+    private:
+        // builds the per-column (or per-row) tables for one axis.
+        static void setup(const GeoExtent& ex, double origin, double interval, unsigned count,
+                          double srcOrigin, double srcInterval, unsigned srcCount, double other, bool isX,
+                          std::vector<char>& in, std::vector<double>& p,
+                          std::vector<int>& i0, std::vector<int>& i1, std::vector<double>& f)
+        {
+            in.resize(count);
+            p.resize(count);
+            i0.resize(count);
+            i1.resize(count);
+            f.resize(count);
+
+            double maxPixel = (double)(srcCount-1);
+
+            for (unsigned i = 0; i < count; ++i)
+            {
+                double v = origin + (interval * (double)i);
+                in[i] = isX ? ex.contains(v, other) : ex.contains(other, v);
+                p[i]  = osg::clampBetween((v - srcOrigin) / srcInterval, 0.0, maxPixel);
+                i0[i] = (int)p[i];
+                i1[i] = p[i] > (double)i0[i] ? i0[i]+1 : i0[i];
+                f[i]  = p[i] - (double)i0[i];
+            }
+        }
+
+        GeoHeightField          _source;
+        const SpatialReference* _srs;
+        ElevationInterpolation  _interp;
+        double                  _xmin, _ymin, _dx, _dy;
+
+        const float*            _heights;
+        int                     _cols;
+        bool                    _affine;
+
+        std::vector<char>       _colIn, _rowIn;   // sample lies within the source extent
+        std::vector<double>     _px, _py;         // clamped source pixel coordinate
+        std::vector<int>        _col0, _row0;     // lower interpolation neighbor
+        std::vector<int>        _col1, _row1;     // upper interpolation neighbor
+        std::vector<double>     _fx, _fy;         // fractional offset from the lower neighbor
+    };
+
+    //! Recycles the buffers that hold the unnormalized normals of a tile
+    //! (about 800K for a 257x257 tile) so the loader threads don't allocate
+    //! and free one for every tile.
+    class NormalBufferPool
+    {
+    public:
+        typedef std::vector<osg::Vec3> Buffer;
+
+        ~NormalBufferPool()
+        {
+            for (unsigned i = 0; i < _free.size(); ++i)
+                delete _free[i];
+        }
+
+        Buffer* take(unsigned size)
+        {
+            Buffer* buffer = 0L;
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                if (!_free.empty())
+                {
+                    buffer = _free.back();
+                    _free.pop_back();
+                }
+            }
+            if (!buffer)
+                buffer = new Buffer();
+            buffer->resize(size);
+            return buffer;
+        }
+
+        void give(Buffer* buffer)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (_free.size() < 16u)
+                _free.push_back(buffer);
+            else
+                delete buffer;
+        }
+
+    private:
+        Threading::Mutex     _mutex;
+        std::vector<Buffer*> _free;
+    };
+
+    NormalBufferPool s_normalBufferPool;
+
+    //! Borrows a buffer from the pool for the life of the object.
+    struct PooledNormalBuffer
+    {
+        PooledNormalBuffer() : _buffer(0L) { }
+        ~PooledNormalBuffer() { if (_buffer) s_normalBufferPool.give(_buffer); }
+        NormalBufferPool::Buffer* _buffer;
+    };
+
+    //! Computes the normal vectors for row "t" of heightfield "hf" from the
+    //! neighboring samples. Stores the unnormalized vectors in "normals" and
+    //! writes the samples that came from full-resolution data to the normal map.
+    //! Returns true if any sample in the row came from a lower LOD; see
+    //! interpolateFallbackNormals.
+    bool createNormalRow(const GeoExtent& extent, const osg::HeightField* hf, int t, const osg::ShortArray* deltaLOD, std::vector<osg::Vec3>& normals, NormalMap* normalMap)
     {
         int w = hf->getNumColumns();
         int h = hf->getNumRows();
@@ -728,8 +975,6 @@ namespace
             extent.width() / (double)(w-1),
             extent.height() / (double)(h-1));
 
-        float e = hf->getHeight(s, t);
-
         double dx = res.x(), dy = res.y();
 
         if (extent.getSRS()->isGeographic())
@@ -740,20 +985,45 @@ namespace
             double lat = extent.yMin() + res.y()*(double)t;
             dx = dx * mPerDegAtEquator * cos(osg::DegreesToRadians(lat));
         }
-        
-        osg::Vec3d west(0, 0, e), east(0, 0, e), south(0, 0, e), north(0, 0, e);
 
-        if (s > 0)     west.set (-dx, 0, hf->getHeight(s-1, t));
-        if (s < w - 1) east.set ( dx, 0, hf->getHeight(s+1, t));
-        if (t > 0)     south.set(0, -dy, hf->getHeight(s, t-1));
-        if (t < h - 1) north.set(0,  dy, hf->getHeight(s, t+1));
+        const float* heights = (const float*)hf->getFloatArray()->getDataPointer();
+        const float* row   = heights + t*w;
+        const float* south = t > 0   ? row - w : 0L;
+        const float* north = t < h-1 ? row + w : 0L;
 
-        osg::Vec3d normal = (east - west) ^ (north - south);
-        return normal;
+        for (int s = 0; s < w; ++s)
+        {
+            float e = row[s];
+
+            osg::Vec3d W(0, 0, e), E(0, 0, e), S(0, 0, e), N(0, 0, e);
+
+            if (s > 0)     W.set(-dx, 0, row[s-1]);
+            if (s < w - 1) E.set( dx, 0, row[s+1]);
+            if (south)     S.set(0, -dy, south[s]);
+            if (north)     N.set(0,  dy, north[s]);
+
+            normals[t*w + s] = (E - W) ^ (N - S);
+        }
+
+        bool hasFallback = false;
+        for (int s = 0; s < w; ++s)
+        {
+            if ((*deltaLOD)[t*w + s] == 0)
+            {
+                osg::Vec3 normal = normals[t*w + s];
+                normal.normalize();
+                normalMap->set(s, t, normal, 0.0f);
+            }
+            else
+            {
+                hasFallback = true;
+            }
+        }
+        return hasFallback;
     }
 
-    //! Creates a normal map for heightfield "hf" and stores it in the
-    //! pre-allocated NormalMap.
+    //! Fills in the normal map for the heightfield samples whose elevation came
+    //! from a lower LOD, given the unnormalized normals for every sample.
     //!
     //! "deltaLOD" holds the difference in LODs between the heightfield itself and the LOD
     //! from which the elevation value came. This will be positive when we had to "fall back" on 
@@ -766,65 +1036,54 @@ namespace
     //! would be to sample the elevation data using a spline function instead of bilinear
     //! interpolation -- but we would need to do that to a separate heightfield (especially for
     //! normals) in order to maintain terrain correlation. Maybe someday.
-    void createNormalMap(const GeoExtent& extent, const osg::HeightField* hf, const osg::ShortArray* deltaLOD, NormalMap* normalMap)
+    void interpolateFallbackNormals(int w, int h, const osg::ShortArray* deltaLOD, const std::vector<osg::Vec3>& normals, NormalMap* normalMap)
     {
-        int w = hf->getNumColumns();
-        int h = hf->getNumRows();
-
-        for (int t = 0; t < (int)hf->getNumRows(); ++t)
+        for (int t = 0; t < h; ++t)
         {
-            for (int s = 0; s<(int)hf->getNumColumns(); ++s)
+            for (int s = 0; s < w; ++s)
             {
-                int step = 1 << (*deltaLOD)[t*h + s];
+                int step = 1 << (*deltaLOD)[t*w + s];
+                if (step == 1)
+                    continue;
 
                 osg::Vec3 normal;
 
                 // four corners:
-                int s0=s, s1=s, t0=t, t1=t;
+                int s0 = osg::maximum(s - (s % step), 0);
+                int s1 = (s%step == 0)? s0 : osg::minimum(s0+step, w-1);
+                int t0 = osg::maximum(t - (t % step), 0);
+                int t1 = (t%step == 0)? t0 : osg::minimum(t0+step, h-1);
 
-                if (step == 1)
+                if (s0 == s1 && t0 == t1)
                 {
-                    // Same LOD, simple query
-                    normal = getNormal(extent, hf, s, t);
+                    // on-pixel, simple query
+                    normal = normals[t0*w + s0];
+                }
+                else if (s0 == s1)
+                {
+                    // same column; linear interpolate along row
+                    const osg::Vec3& S = normals[t0*w + s0];
+                    const osg::Vec3& N = normals[t1*w + s0];
+                    normal = S*(double)(t1 - t) + N*(double)(t - t0);
+                }
+                else if (t0 == t1)
+                {
+                    // same row; linear interpolate along column
+                    const osg::Vec3& W = normals[t0*w + s0];
+                    const osg::Vec3& E = normals[t0*w + s1];
+                    normal = W*(double)(s1 - s) + E*(double)(s - s0);
                 }
                 else
                 {
-                    int s0 = osg::maximum(s - (s % step), 0);
-                    int s1 = (s%step == 0)? s0 : osg::minimum(s0+step, w-1);
-                    int t0 = osg::maximum(t - (t % step), 0);
-                    int t1 = (t%step == 0)? t0 : osg::minimum(t0+step, h-1);
-                    
-                    if (s0 == s1 && t0 == t1)
-                    {
-                        // on-pixel, simple query
-                        normal = getNormal(extent, hf, s0, t0);
-                    }
-                    else if (s0 == s1)
-                    {
-                        // same column; linear interpolate along row
-                        osg::Vec3 S = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 N = getNormal(extent, hf, s0, t1);
-                        normal = S*(double)(t1 - t) + N*(double)(t - t0);
-                    }
-                    else if (t0 == t1)
-                    {
-                        // same row; linear interpolate along column
-                        osg::Vec3 W = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 E = getNormal(extent, hf, s1, t0);
-                        normal = W*(double)(s1 - s) + E*(double)(s - s0);
-                    }
-                    else
-                    {
-                        // bilinear interpolate
-                        osg::Vec3 SW = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 SE = getNormal(extent, hf, s1, t0);
-                        osg::Vec3 NW = getNormal(extent, hf, s0, t1);
-                        osg::Vec3 NE = getNormal(extent, hf, s1, t1);
-
-                        osg::Vec3 S = SW*(double)(s1 - s) + SE*(double)(s - s0);
-                        osg::Vec3 N = NW*(double)(s1 - s) + NE*(double)(s - s0);
-                        normal = S*(double)(t1 - t) + N*(double)(t - t0);
-                    }
+                    // bilinear interpolate
+                    const osg::Vec3& SW = normals[t0*w + s0];
+                    const osg::Vec3& SE = normals[t0*w + s1];
+                    const osg::Vec3& NW = normals[t1*w + s0];
+                    const osg::Vec3& NE = normals[t1*w + s1];
+
+                    osg::Vec3 S = SW*(double)(s1 - s) + SE*(double)(s - s0);
+                    osg::Vec3 N = NW*(double)(s1 - s) + NE*(double)(s - s0);
+                    normal = S*(double)(t1 - t) + N*(double)(t - t0);
                 }
 
                 normal.normalize();
@@ -962,11 +1221,16 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
     double   dy         = key.getExtent().height() / (double)(numRows-1);
    
     // We will load the actual heightfields on demand. We might not need them all.
-    GeoHeightFieldVector heightFields(contenders.size());
-    GeoHeightFieldVector offsetFields(offsets.size());
-    std::vector<bool>    heightFallback(contenders.size(), false);
-    std::vector<bool>    heightFailed(contenders.size(), false);
-    std::vector<bool>    offsetFailed(offsets.size(), false);
+    GeoHeightFieldVector     heightFields(contenders.size());
+    GeoHeightFieldVector     offsetFields(offsets.size());
+    std::vector<RowSampler>  heightSamplers(contenders.size());
+    std::vector<RowSampler>  offsetSamplers(offsets.size());
+    std::vector<short>       heightDeltaLOD(contenders.size(), 0);
+    std::vector<bool>        heightFallback(contenders.size(), false);
+    std::vector<bool>        heightFailed(contenders.size(), false);
+    std::vector<bool>        offsetFailed(offsets.size(), false);
+    std::vector<unsigned>    heightLastRow(contenders.size(), 0u);
+    std::vector<unsigned>    offsetLastRow(offsets.size(), 0u);
 
     // The maximum number of heightfields to keep in this local cache
     const unsigned maxHeightFields = 50;
@@ -980,10 +1244,6 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
 
     // query resolution interval (x, y) of each sample.
     osg::ref_ptr<osg::ShortArray> deltaLOD = new osg::ShortArray(total);
-    
-    int nodataCount = 0;
-
-    TileKey scratchKey; // Storage if a new key needs to be constructed
 
     bool requiresResample = true;
 
@@ -1008,190 +1268,234 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
                 deltaLOD->resize(hf->getFloatArray()->size(), 0);
                 realData = true;
             }
+            else
+            {
+                // keep it for the resampling loop so we don't load it twice.
+                heightFields[0] = layerHF;
+                numHeightFieldsInCache++;
+                heightDeltaLOD[0] = key.getLOD() - contenderKey.getLOD();
+                heightSamplers[0].init(layerHF, keySRS, interpolation, xmin, ymin, dx, dy, numColumns, numRows);
+            }
         }
     }
 
-    // If we need to mosaic multiple layers or resample it to a new output tilesize go through a resampling loop.
-    if (requiresResample)
-    {
-        for (unsigned c = 0; c < numColumns; ++c)
-        {
-            double x = xmin + (dx * (double)c);
+    float* heights = (float*)hf->getFloatArray()->getDataPointer();
 
-            // periodically check for cancelation
-            if (progress && progress->isCanceled())
-            {
-                return false;
-            }
+    // Per-row scratch space: the index of the layer that resolved each sample
+    // (or -1), the samples to query from the current layer, and the results.
+    std::vector<int>   resolved(numColumns);
+    std::vector<char>  mask(numColumns);
+    std::vector<float> samples(numColumns);
 
-            for (unsigned r = 0; r < numRows; ++r)
-            {
-                double y = ymin + (dy * (double)r);
+    // Unnormalized normal of each sample, kept so that the samples that came
+    // from a lower LOD can interpolate between them afterwards.
+    PooledNormalBuffer normals;
+    bool hasFallbackNormals = false;
+    if (normalMap)
+    {
+        normals._buffer = s_normalBufferPool.take(total);
+    }
 
-                // Collect elevations from each layer as necessary.
-                int resolvedIndex = -1;
+    // Composite the tile one row at a time. Each layer samples the entire row in
+    // one go, but only where the layers before it left a hole. The normals for
+    // a row are generated as soon as the rows on either side of it are final.
+    for (unsigned r = 0; r < numRows; ++r)
+    {
+        // periodically check for cancelation
+        if (progress && progress->isCanceled())
+        {
+            return false;
+        }
 
-                osg::Vec3 normal_sum(0, 0, 0);
+        if (requiresResample)
+        {
+            float* row         = heights + r*numColumns;
+            short* rowDeltaLOD = &(*deltaLOD)[r*numColumns];
 
-                for (int i = 0; i < contenders.size() && resolvedIndex < 0; ++i)
-                {
-                    ElevationLayer* layer = contenders[i].layer.get();
-                    TileKey& contenderKey = contenders[i].key;
-                    int index = contenders[i].index;
+            std::fill(resolved.begin(), resolved.end(), -1);
+            unsigned numUnresolved = numColumns;
 
-                    if (heightFailed[i])
-                        continue;
+            // Collect elevations from each layer as necessary.
+            for (unsigned i = 0; i < contenders.size() && numUnresolved > 0; ++i)
+            {
+                ElevationLayer* layer = contenders[i].layer.get();
 
-                    TileKey* actualKey = &contenderKey;
+                if (heightFailed[i])
+                    continue;
 
-                    GeoHeightField& layerHF = heightFields[i];
+                GeoHeightField& layerHF = heightFields[i];
 
-                    if (!layerHF.valid())
+                if (!layerHF.valid())
+                {
+                    // We haven't loaded the heightfield yet, so try to create it.
+                    // We also fallback on parent layers to make sure that we have data at the location even if it's fallback.
+                    TileKey actualKey = contenders[i].key;
+                    while (!layerHF.valid() && actualKey.valid() && layer->isKeyInLegalRange(actualKey))
                     {
-                        // We couldn't get the heightfield from the cache, so try to create it.
-                        // We also fallback on parent layers to make sure that we have data at the location even if it's fallback.
-                        while (!layerHF.valid() && actualKey->valid() && layer->isKeyInLegalRange(*actualKey))
+                        layerHF = layer->createHeightField(actualKey, progress);
+                        if (!layerHF.valid())
                         {
-                            layerHF = layer->createHeightField(*actualKey, progress);
-                            if (!layerHF.valid())
-                            {
-                                if (actualKey != &scratchKey)
-                                {
-                                    scratchKey = *actualKey;
-                                    actualKey = &scratchKey;
-                                }
-                                *actualKey = actualKey->createParentKey();
-                            }
+                            actualKey = actualKey.createParentKey();
                         }
+                    }
 
-                        // Mark this layer as fallback if necessary.
-                        if (layerHF.valid())
-                        {
-                            heightFallback[i] = (*actualKey != contenderKey); // actualKey != contenders[i].second;
-                            numHeightFieldsInCache++;
-                        }
-                        else
-                        {
-                            heightFailed[i] = true;
+                    // Mark this layer as fallback if necessary.
+                    if (layerHF.valid())
+                    {
+                        heightFallback[i] = (actualKey != contenders[i].key);
+                        heightDeltaLOD[i] = key.getLOD() - actualKey.getLOD();
+                        numHeightFieldsInCache++;
+                        heightSamplers[i].init(layerHF, keySRS, interpolation, xmin, ymin, dx, dy, numColumns, numRows);
+                    }
+                    else
+                    {
+                        heightFailed[i] = true;
 #ifdef ANALYZE
-                            layerAnalysis[layer].failed = true;
-                            layerAnalysis[layer].actualKeyValid = actualKey->valid();
-                            if (progress) layerAnalysis[layer].message = progress->message();
+                        layerAnalysis[layer].failed = true;
+                        layerAnalysis[layer].actualKeyValid = actualKey.valid();
+                        if (progress) layerAnalysis[layer].message = progress->message();
 #endif
-                            continue;
-                        }
+                        continue;
                     }
+                }
 
-                    if (layerHF.valid())
-                    {
-                        bool isFallback = heightFallback[i];
 #ifdef ANALYZE
-                        layerAnalysis[layer].fallback = isFallback;
+                layerAnalysis[layer].fallback = heightFallback[i];
 #endif
 
-                        // We only have real data if this is not a fallback heightfield.
-                        if (!isFallback)
-                        {
-                            realData = true;
-                        }
+                // We only have real data if this is not a fallback heightfield.
+                if (!heightFallback[i])
+                {
+                    realData = true;
+                }
 
-                        float elevation;
-                        if (layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation))
-                        {
-                            if (elevation != NO_DATA_VALUE)
-                            {
-                                // remember the index so we can only apply offset layers that
-                                // sit on TOP of this layer.
-                                resolvedIndex = index;
+                heightLastRow[i] = r;
 
-                                hf->setHeight(c, r, elevation);
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    mask[c] = resolved[c] < 0;
+                }
 
+                heightSamplers[i].sampleRow(r, &mask[0], &samples[0], numColumns);
+
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    if (mask[c] && samples[c] != NO_DATA_VALUE)
+                    {
+                        // remember the index so we can only apply offset layers that
+                        // sit on TOP of this layer.
+                        resolved[c] = contenders[i].index;
+                        row[c] = samples[c];
+                        rowDeltaLOD[c] = heightDeltaLOD[i];
+                        --numUnresolved;
 #ifdef ANALYZE
-                                layerAnalysis[layer].samples++;
+                        layerAnalysis[layer].samples++;
 #endif
-
-                                if (deltaLOD)
-                                {
-                                    (*deltaLOD)[r*numColumns + c] = key.getLOD() - actualKey->getLOD();
-                                }
-                            }
-                            else
-                            {
-                                ++nodataCount;
-                            }
-                        }
                     }
+                }
+            }
 
+            for (int i = offsets.size() - 1; i >= 0; --i)
+            {
+                if (offsetFailed[i] == true)
+                    continue;
 
-                    // Clear the heightfield cache if we have too many heightfields in the cache.
-                    if (numHeightFieldsInCache >= maxHeightFields)
-                    {
-                        //OE_NOTICE << "Clearing cache" << std::endl;
-                        for (unsigned int k = 0; k < heightFields.size(); k++)
-                        {
-                            heightFields[k] = GeoHeightField::INVALID;
-                            heightFallback[k] = false;
-                        }
-                        numHeightFieldsInCache = 0;
-                    }
+                // Only apply an offset layer if it sits on top of the resolved layer
+                // (or if there was no resolved layer).
+                bool apply = false;
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    mask[c] = resolved[c] < 0 || offsets[i].index >= resolved[c];
+                    apply = apply || mask[c];
                 }
 
-                for (int i = offsets.size() - 1; i >= 0; --i)
-                {
-                    // Only apply an offset layer if it sits on top of the resolved layer
-                    // (or if there was no resolved layer).
-                    if (resolvedIndex >= 0 && offsets[i].index < resolvedIndex)
-                        continue;
+                if (!apply)
+                    continue;
 
-                    TileKey &contenderKey = offsets[i].key;
+                TileKey &contenderKey = offsets[i].key;
 
-                    if (offsetFailed[i] == true)
-                        continue;
+                GeoHeightField& layerHF = offsetFields[i];
+                if (!layerHF.valid())
+                {
+                    ElevationLayer* offset = offsets[i].layer.get();
 
-                    GeoHeightField& layerHF = offsetFields[i];
+                    layerHF = offset->createHeightField(contenderKey, progress);
                     if (!layerHF.valid())
                     {
-                        ElevationLayer* offset = offsets[i].layer.get();
-
-                        layerHF = offset->createHeightField(contenderKey, progress);
-                        if (!layerHF.valid())
-                        {
-                            offsetFailed[i] = true;
-                            continue;
-                        }
+                        offsetFailed[i] = true;
+                        continue;
                     }
 
-                    // If we actually got a layer then we have real data
-                    realData = true;
+                    offsetSamplers[i].init(layerHF, keySRS, interpolation, xmin, ymin, dx, dy, numColumns, numRows);
+                    numHeightFieldsInCache++;
+                }
+
+                offsetLastRow[i] = r;
 
-                    float elevation = 0.0f;
-                    if (layerHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation) &&
-                        elevation != NO_DATA_VALUE)
+                // If we actually got a layer then we have real data
+                realData = true;
+
+                offsetSamplers[i].sampleRow(r, &mask[0], &samples[0], numColumns);
+
+                short offsetDeltaLOD = key.getLOD() - contenderKey.getLOD();
+
+                for (unsigned c = 0; c < numColumns; ++c)
+                {
+                    if (mask[c] && samples[c] != NO_DATA_VALUE)
                     {
-                        hf->getHeight(c, r) += elevation;
+                        row[c] += samples[c];
 
                         // Update the resolution tracker to account for the offset. Sadly this
                         // will wipe out the resolution of the actual data, and might result in 
-                        // normal faceting. See the comments on "createNormalMap" for more info
-                        if (deltaLOD)
-                        {
-                            (*deltaLOD)[r*numColumns + c] = key.getLOD() - contenderKey.getLOD();
-                        }
+                        // normal faceting. See the comments on "interpolateFallbackNormals" for more info
+                        rowDeltaLOD[c] = offsetDeltaLOD;
+                    }
+                }
+            }
+
+            // Clear the heightfield cache if we have too many heightfields in the cache.
+            // Every layer this row needed stays, since the next row likely needs it too.
+            if (numHeightFieldsInCache > maxHeightFields)
+            {
+                for (unsigned k = 0; k < heightFields.size(); ++k)
+                {
+                    if (heightFields[k].valid() && heightLastRow[k] != r)
+                    {
+                        heightFields[k] = GeoHeightField::INVALID;
+                        heightSamplers[k] = RowSampler();
+                        heightFallback[k] = false;
+                        numHeightFieldsInCache--;
+                    }
+                }
+                for (unsigned k = 0; k < offsetFields.size(); ++k)
+                {
+                    if (offsetFields[k].valid() && offsetLastRow[k] != r)
+                    {
+                        offsetFields[k] = GeoHeightField::INVALID;
+                        offsetSamplers[k] = RowSampler();
+                        numHeightFieldsInCache--;
                     }
                 }
             }
         }
+
+        // this row is final, so the normals of the row below it are too.
+        if (normalMap && r > 0)
+        {
+            if (createNormalRow(key.getExtent(), hf, r-1, deltaLOD.get(), *normals._buffer, normalMap))
+                hasFallbackNormals = true;
+        }
     }
 
     if (normalMap)
     {
-        // periodically check for cancelation
-        if (progress && progress->isCanceled())
+        if (createNormalRow(key.getExtent(), hf, numRows-1, deltaLOD.get(), *normals._buffer, normalMap))
+            hasFallbackNormals = true;
+
+        if (hasFallbackNormals)
         {
-            return false;
+            interpolateFallbackNormals(numColumns, numRows, deltaLOD.get(), *normals._buffer, normalMap);
         }
-
-        createNormalMap(key.getExtent(), hf, deltaLOD.get(), normalMap);
     }
 
 #ifdef ANALYZE
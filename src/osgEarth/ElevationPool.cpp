@@ -19,6 +19,8 @@
 #include <osgEarth/ElevationPool>
 #include <osgEarth/Map>
 #include <osgEarth/Metrics>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/Registry>
 
 using namespace osgEarth;
 
@@ -28,23 +30,11 @@ using namespace osgEarth;
 
 
 ElevationPool::ElevationPool() :
-_entries(0u),
-_maxEntries( 128u ),
+_maxBytes( 128u * 257u * 257u * sizeof(float) ),
 _tileSize( 257u )
 {
-    //nop
-    //_opQueue = Registry::instance()->getAsyncOperationQueue();
-    if (!_opQueue.valid())
-    {
-        _opQueue = new osg::OperationQueue();
-        for (unsigned i=0; i<2; ++i)
-        {
-            osg::OperationThread* thread = new osg::OperationThread();
-            thread->setOperationQueue(_opQueue.get());
-            thread->start();
-            _opThreads.push_back(thread);
-        }
-    }
+    _scheduler = Registry::instance()->getJobScheduler();
+    _jobs = new JobGroup();
 }
 
 ElevationPool::~ElevationPool()
@@ -55,7 +45,7 @@ ElevationPool::~ElevationPool()
 void
 ElevationPool::setMap(const Map* map)
 {
-    Threading::ScopedMutexLock lock(_tilesMutex);
+    Threading::ScopedMutexLock lock(_mutex);
     _map = map;
     clearImpl();
 }
@@ -63,23 +53,65 @@ ElevationPool::setMap(const Map* map)
 void
 ElevationPool::clear()
 {
-    Threading::ScopedMutexLock lock(_tilesMutex);
+    Threading::ScopedMutexLock lock(_mutex);
     clearImpl();
 }
 
+void
+ElevationPool::setMaxEntries(unsigned maxEntries)
+{
+    _maxBytes = maxEntries * (sizeof(Tile) + _tileSize * _tileSize * sizeof(float));
+}
+
+unsigned
+ElevationPool::getMaxEntries() const
+{
+    return _maxBytes / (sizeof(Tile) + _tileSize * _tileSize * sizeof(float));
+}
+
+ElevationPool::Stats
+ElevationPool::getStats() const
+{
+    Stats stats;
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
+    {
+        const Shard& shard = _shards[i];
+        Threading::ScopedMutexLock lock(shard._mutex);
+        stats._hits += shard._hits;
+        stats._misses += shard._misses;
+        stats._waits += shard._waits;
+        stats._waitTime += shard._waitTime;
+        stats._entries += shard._tiles.size();
+        stats._bytes += shard._bytes;
+    }
+    return stats;
+}
+
+void
+ElevationPool::resetStats()
+{
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
+    {
+        Shard& shard = _shards[i];
+        Threading::ScopedMutexLock lock(shard._mutex);
+        shard._hits = 0u;
+        shard._misses = 0u;
+        shard._waits = 0u;
+        shard._waitTime = 0.0;
+    }
+}
+
 void
 ElevationPool::stopThreading()
 {
-    _opQueue->releaseAllOperations();
-    
-    for (unsigned i = 0; i<_opThreads.size(); ++i)
-    _opThreads[i]->setDone(true);
+    // queued queries are dropped; their futures will report abandonment.
+    _jobs->cancel();
 }
 
 void
 ElevationPool::setElevationLayers(const ElevationLayerVector& layers)
 {
-    Threading::ScopedMutexLock lock(_tilesMutex);
+    Threading::ScopedMutexLock lock(_mutex);
     _layers = layers;
     clearImpl();
 }
@@ -87,7 +119,7 @@ ElevationPool::setElevationLayers(const ElevationLayerVector& layers)
 void
 ElevationPool::setTileSize(unsigned value)
 {
-    Threading::ScopedMutexLock lock(_tilesMutex);
+    Threading::ScopedMutexLock lock(_mutex);
     _tileSize = value;
     clearImpl();
 }
@@ -97,7 +129,7 @@ ElevationPool::getElevation(const GeoPoint& point, unsigned lod)
 {
     GetElevationOp* op = new GetElevationOp(this, point, lod);
     Future<ElevationSample> result = op->_promise.getFuture();
-    _opQueue->add(op);
+    _scheduler->add(op, _jobs.get());
     return result;
 }
 
@@ -108,10 +140,10 @@ _pool(pool), _point(point), _lod(lod)
 }
 
 void
-ElevationPool::GetElevationOp::operator()(osg::Object*)
+ElevationPool::GetElevationOp::operator()(ProgressCallback* progress)
 {
     osg::ref_ptr<ElevationPool> pool;
-    if (!_promise.isAbandoned() && _pool.lock(pool))
+    if (!_promise.isAbandoned() && !progress->isCanceled() && _pool.lock(pool))
     {
         osg::ref_ptr<ElevationEnvelope> env = pool->createEnvelope(_point.getSRS(), _lod);
         std::pair<float, float> r = env->getElevationAndResolution(_point.x(), _point.y());
@@ -160,155 +192,143 @@ ElevationPool::fetchTileFromMap(const TileKey& key, const ElevationLayerVector&
 }
 
 void
-ElevationPool::popMRU()
+ElevationPool::evict(Shard& shard)
 {
-    // first rememeber the key of the item we're about the pop:
-    TileKey key = _mru.back()->_key;
+    // assumes the shard lock is taken.
+    unsigned budget = _maxBytes / NUM_SHARDS;
+
+    // walk from the LRU end toward the MRU end, removing one tile at a time
+    // until we are within budget. Tiles still being fetched are skipped.
+    LRU::iterator i = shard._lru.end();
+    while (shard._bytes > budget && i != shard._lru.begin())
+    {
+        --i;
+        Tile* tile = *i;
+        if (tile->_status == STATUS_IN_PROGRESS)
+            continue;
 
-    // establish a temporary observer on the item:
-    osg::observer_ptr<Tile> temp = _mru.back().get();
+        shard._bytes -= tile->_bytes;
+        TileKey key = tile->_key;
+        i = shard._lru.erase(i);
 
-    // pop the Tile from the MRU:
-    _mru.pop_back();
+        // releases the cache's reference; envelopes may still hold the tile.
+        shard._tiles.erase(key);
+    }
+}
 
-    // if our observer went to NULL, we know there are no more pointers
-    // to that Tile in the MRU, and we can remove it from the main list:
-    if (!temp.valid())
+void
+ElevationPool::clearImpl()
+{
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
     {
-        _tiles.erase(key);
+        Shard& shard = _shards[i];
+        Threading::ScopedMutexLock lock(shard._mutex);
+        shard._tiles.clear();
+        shard._lru.clear();
+        shard._bytes = 0u;
     }
 }
 
 bool
-ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, osg::ref_ptr<Tile>& out)
+ElevationPool::getTile(const TileKey& key, const ElevationLayerVector& layers, osg::ref_ptr<ElevationPool::Tile>& output)
 {
-    // first see whether the tile is available
-    _tilesMutex.lock();
+    const unsigned timeout_ms = 30000u;
 
-    // locate the tile in the local tile cache:
-    osg::observer_ptr<Tile>& tile_obs = _tiles[key];
+    Shard& shard = getShard(key);
 
     osg::ref_ptr<Tile> tile;
+    bool fetch = false;
 
-    // Get a safe pointer to it. If this is NULL, we need to create and
-    // fetch a new tile from the Map.
-    if (!tile_obs.lock(tile))
+    // locate the tile in the cache, or create and claim a new one:
     {
-        // a new tile; status -> EMPTY
-        tile = new Tile();
-        tile->_key = key;
+        Threading::ScopedMutexLock lock(shard._mutex);
 
-        // update the LRU:
-        _mru.push_front(tile.get());
+        Shard::Tiles::iterator i = shard._tiles.find(key);
+        if (i != shard._tiles.end())
+        {
+            tile = i->second.get();
 
-        // prune the MRU if necessary:
-        if (++_entries > _maxEntries )
+            // mark as most recently used:
+            shard._lru.splice(shard._lru.begin(), shard._lru, tile->_lru);
+            ++shard._hits;
+        }
+        else
         {
-            popMRU();
-            --_entries;
+            tile = new Tile();
+            tile->_key = key;
+            tile->_bytes = sizeof(Tile);
+            tile->_status.exchange(STATUS_IN_PROGRESS);
+
+            shard._lru.push_front(tile.get());
+            tile->_lru = shard._lru.begin();
+            shard._tiles[key] = tile.get();
+            shard._bytes += tile->_bytes;
+            ++shard._misses;
+
+            evict(shard);
+            fetch = true;
         }
-
-        // add to the main cache (after putting it on the LRU).
-        tile_obs = tile;
     }
-       
-    // This means the tile object exists but has yet to be populated:
-    if ( tile->_status == STATUS_EMPTY )
+
+    if (fetch)
     {
         OE_TEST << "  getTile(" << key.str() << ") -> fetch from map\n";
-        tile->_status.exchange(STATUS_IN_PROGRESS);
-        _tilesMutex.unlock();
 
         bool ok = fetchTileFromMap(key, layers, tile.get());
-        tile->_status.exchange( ok ? STATUS_AVAILABLE : STATUS_FAIL );
-        
-        out = ok ? tile.get() : 0L;
-        return ok;
-    }
-
-    // This means the tile object is populated and available for use:
-    else if ( tile->_status == STATUS_AVAILABLE )
-    {
-        OE_TEST << "  getTile(" << key.str() << ") -> available\n";
-        out = tile.get();
+        {
+            Threading::ScopedMutexLock lock(shard._mutex);
 
-        // Mark this tile as recently used:
-        _mru.push_front(tile.get());
+            tile->_status.exchange(ok ? STATUS_AVAILABLE : STATUS_FAIL);
 
-        // prune the MRU if necessary
-        if (++_entries > _maxEntries)
-        {
-            popMRU();
-            --_entries;
+            // charge the heightfield to the shard, unless the pool was
+            // cleared (and the tile discarded) while we were fetching.
+            Shard::Tiles::iterator i = shard._tiles.find(key);
+            if (i != shard._tiles.end() && i->second.get() == tile.get())
+            {
+                if (ok && tile->_hf.getHeightField())
+                {
+                    unsigned hfBytes = tile->_hf.getHeightField()->getFloatArray()->size() * sizeof(float);
+                    tile->_bytes += hfBytes;
+                    shard._bytes += hfBytes;
+                }
+                evict(shard);
+            }
         }
 
-        _tilesMutex.unlock();
-        return true;
+        // wake up any threads waiting on this tile:
+        tile->_ready.set();
     }
 
-    // This means the attempt to populate the tile with data failed.
-    else if ( tile->_status == STATUS_FAIL )
-    {
-        OE_TEST << "  getTile(" << key.str() << ") -> fail\n";
-        _tilesMutex.unlock();
-        out = 0L;
-        return false;
-    }
-
-    // This means tile data fetch is still in progress (in another thread)
-    // and the caller should check back later.
-    else //if ( tile->_status == STATUS_IN_PROGRESS )
+    else if (tile->_status == STATUS_IN_PROGRESS)
     {
+        // another thread is fetching the tile from the map; wait for it.
         OE_DEBUG << "  getTile(" << key.str() << ") -> in progress...waiting\n";
-        _tilesMutex.unlock();
-        out = 0L;
-        return true;            // out:NULL => check back later please.
-    }
-}
-
-void
-ElevationPool::clearImpl()
-{
-    // assumes the tiles lock is taken.
-    _tiles.clear();
-    _mru.clear();
-    _entries = 0u;
-}
 
-bool
-ElevationPool::getTile(const TileKey& key, const ElevationLayerVector& layers, osg::ref_ptr<ElevationPool::Tile>& output)
-{   
-    OE_START_TIMER(get);
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        if (!tile->_ready.wait(timeout_ms))
+        {
+            OE_TEST << LC << "Timeout fetching tile " << key.str() << std::endl;
+        }
+        double waited = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
 
-    const double timeout = 30.0;
-    osg::ref_ptr<Tile> tile;
-    while( tryTile(key, layers, tile) && !tile.valid() && OE_GET_TIMER(get) < timeout)
-    {
-        // condition: another thread is working on fetching the tile from the map,
-        // so wait and try again later. Do this until we succeed or time out.
-        OpenThreads::Thread::YieldCurrentThread();
+        Threading::ScopedMutexLock lock(shard._mutex);
+        ++shard._waits;
+        shard._waitTime += waited;
     }
 
-    if ( !tile.valid() && OE_GET_TIMER(get) >= timeout )
+    if (tile->_status != STATUS_AVAILABLE)
     {
-        // this means we timed out trying to fetch the map tile.
-        OE_TEST << LC << "Timeout fetching tile " << key.str() << std::endl;
+        return false;
     }
 
-    if ( tile.valid() )
+    if (!tile->_hf.valid())
     {
-        if ( tile->_hf.valid() )
-        {
-            // got a valid tile, so push it to the query set.
-            output = tile.get();
-        }
-        else
-        {
-            OE_WARN << LC << "Got a tile with an invalid HF (" << key.str() << ")\n";
-        }
+        OE_WARN << LC << "Got a tile with an invalid HF (" << key.str() << ")\n";
+        return false;
     }
 
-    return tile.valid();
+    output = tile.get();
+    return true;
 }
 
 ElevationEnvelope*
@@ -433,26 +453,201 @@ ElevationEnvelope::getElevationAndResolution(double x, double y)
     return std::make_pair(elevation, resolution);
 }
 
+void
+ElevationEnvelope::sampleTile(const ElevationPool::Tile* tile,
+                              const std::vector<osg::Vec3d>& points,
+                              const std::vector<unsigned>& indices,
+                              std::vector<float>& output)
+{
+    if (indices.empty())
+        return;
+
+    const osg::HeightField* hf = tile->_hf.getHeightField();
+    const GeoExtent& ex = tile->_hf.getExtent();
+
+    // pack the coordinates so the interpolation kernel runs over contiguous memory
+    unsigned count = indices.size();
+    _xs.resize(count);
+    _ys.resize(count);
+    _zs.resize(count);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        const osg::Vec3d& p = points[indices[i]];
+        _xs[i] = p.x();
+        _ys[i] = p.y();
+    }
+
+    HeightFieldUtils::getHeightsAtLocations(
+        hf,
+        &_xs[0], &_ys[0], count,
+        ex.xMin(), ex.yMin(),
+        ex.width() / (double)(hf->getNumColumns()-1),
+        ex.height() / (double)(hf->getNumRows()-1),
+        &_zs[0]);
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        output[indices[i]] = _zs[i];
+    }
+}
+
+void
+ElevationEnvelope::binPoints(const ElevationPool::Tile* tile,
+                             const std::vector<osg::Vec3d>& points,
+                             const std::vector<unsigned>& pending,
+                             std::vector<unsigned>& bin,
+                             std::vector<unsigned>& remaining,
+                             std::vector<char>& covered)
+{
+    // Same test as sample(): a tile whose bounds contain the point stops the
+    // search for a tile to fetch, but only samples it if its heightfield does
+    // too; otherwise the point falls back on the next (lower resolution) tile.
+    const GeoExtent& ex = tile->_hf.getExtent();
+
+    bin.clear();
+    remaining.clear();
+    for (std::vector<unsigned>::const_iterator i = pending.begin(); i != pending.end(); ++i)
+    {
+        const osg::Vec3d& p = points[*i];
+        if (tile->_bounds.contains(p.x(), p.y()))
+        {
+            covered[*i] = 1;
+            if (ex.contains(p.x(), p.y()))
+            {
+                bin.push_back(*i);
+                continue;
+            }
+        }
+        remaining.push_back(*i);
+    }
+}
+
 unsigned
-ElevationEnvelope::getElevations(const std::vector<osg::Vec3d>& input,
-                                 std::vector<float>& output)
+ElevationEnvelope::sampleBatch(const std::vector<osg::Vec3d>& input,
+                               std::vector<float>& output)
 {
-    METRIC_SCOPED_EX("ElevationEnvelope::getElevations", 1, "num", toString(input.size()).c_str());
+    output.assign(input.size(), NO_DATA_VALUE);
 
-    unsigned count = 0u;
+    if (input.empty() || !_mapProfile.valid())
+        return 0u;
+
+    // transform all the points into the map SRS in one pass:
+    std::vector<osg::Vec3d> points(input);
+    if (!_inputSRS.valid() || !_inputSRS->transform(points, _mapProfile->getSRS()))
+    {
+        // at least one point failed to transform; fall back on individual sampling.
+        unsigned count = 0u;
+        for (unsigned i = 0; i < input.size(); ++i)
+        {
+            float resolution;
+            if (sample(input[i].x(), input[i].y(), output[i], resolution))
+                ++count;
+        }
+        return count;
+    }
+
+    // Each point takes its elevation from the highest-resolution tile that
+    // contains it, so visit the tiles in the query set from high to low
+    // resolution and bin the points that are still unassigned.
+    std::vector<unsigned> pending(points.size());
+    for (unsigned i = 0; i < pending.size(); ++i)
+        pending[i] = i;
 
-    output.reserve(input.size());
-    output.clear();
+    std::vector<unsigned> bin, remaining;
+    std::vector<char> covered(points.size(), 0);
 
-    // for each input point:
-    for (std::vector<osg::Vec3d>::const_iterator v = input.begin(); v != input.end(); ++v)
+    for (ElevationPool::QuerySet::const_iterator tile_ref = _tiles.begin();
+        tile_ref != _tiles.end() && !pending.empty();
+        ++tile_ref)
     {
-        float elevation, resolution;
-        sample(v->x(), v->y(), elevation, resolution);
-        output.push_back(elevation);
-        if (elevation != NO_DATA_VALUE)
+        const ElevationPool::Tile* tile = tile_ref->get();
+        binPoints(tile, points, pending, bin, remaining, covered);
+        sampleTile(tile, points, bin, output);
+        pending.swap(remaining);
+    }
+
+    // Points inside a tile's bounds but no heightfield stay NO_DATA_VALUE,
+    // as in sample(). The others need new tiles.
+    remaining.clear();
+    for (std::vector<unsigned>::const_iterator i = pending.begin(); i != pending.end(); ++i)
+    {
+        if (!covered[*i])
+            remaining.push_back(*i);
+    }
+    pending.swap(remaining);
+
+    // Group the points that need new tiles by the key of the tile that
+    // should contain them so each tile is fetched once.
+    if (!pending.empty())
+    {
+        osg::ref_ptr<ElevationPool> pool;
+        if (_pool.lock(pool))
+        {
+            typedef std::map<TileKey, std::vector<unsigned> > KeyBins;
+            KeyBins keyBins;
+            for (std::vector<unsigned>::const_iterator i = pending.begin(); i != pending.end(); ++i)
+            {
+                const osg::Vec3d& p = points[*i];
+                keyBins[_mapProfile->createTileKey(p.x(), p.y(), _lod)].push_back(*i);
+            }
+
+            std::vector< osg::ref_ptr<ElevationPool::Tile> > newTiles;
+
+            for (KeyBins::iterator k = keyBins.begin(); k != keyBins.end(); ++k)
+            {
+                std::vector<unsigned>& keyPending = k->second;
+
+                // a tile fetched for an earlier bin may already cover these
+                // points (e.g. when the pool fell back on an ancestor tile):
+                for (unsigned t = 0; t < newTiles.size() && !keyPending.empty(); ++t)
+                {
+                    binPoints(newTiles[t].get(), points, keyPending, bin, remaining, covered);
+                    sampleTile(newTiles[t].get(), points, bin, output);
+                    keyPending.swap(remaining);
+                }
+
+                remaining.clear();
+                for (std::vector<unsigned>::const_iterator i = keyPending.begin(); i != keyPending.end(); ++i)
+                {
+                    if (!covered[*i])
+                        remaining.push_back(*i);
+                }
+                keyPending.swap(remaining);
+
+                if (keyPending.empty())
+                    continue;
+
+                osg::ref_ptr<ElevationPool::Tile> tile;
+                if (pool->getTile(k->first, _layers, tile))
+                {
+                    // Got the new tile; put it in the query set:
+                    _tiles.insert(tile.get());
+                    newTiles.push_back(tile.get());
+
+                    // like sample(), only points inside the heightfield get a value.
+                    binPoints(tile.get(), points, keyPending, bin, remaining, covered);
+                    sampleTile(tile.get(), points, bin, output);
+                }
+            }
+        }
+    }
+
+    unsigned count = 0u;
+    for (std::vector<float>::const_iterator i = output.begin(); i != output.end(); ++i)
+    {
+        if (*i != NO_DATA_VALUE)
             ++count;
     }
+    return count;
+}
+
+unsigned
+ElevationEnvelope::getElevations(const std::vector<osg::Vec3d>& input,
+                                 std::vector<float>& output)
+{
+    METRIC_SCOPED_EX("ElevationEnvelope::getElevations", 1, "num", toString(input.size()).c_str());
+
+    unsigned count = sampleBatch(input, output);
 
     if (count < input.size())
     {
@@ -477,15 +672,17 @@ ElevationEnvelope::getElevationExtrema(const std::vector<osg::Vec3d>& input,
 
     min = FLT_MAX, max = -FLT_MAX;
 
+    std::vector<float> elevations;
+    sampleBatch(input, elevations);
+
     osg::Vec3d centroid;
 
-    for (std::vector<osg::Vec3d>::const_iterator v = input.begin(); v != input.end(); ++v)
+    for (unsigned i = 0; i < input.size(); ++i)
     {
-        centroid += *v;
+        centroid += input[i];
 
-        float elevation, resolution;
-        
-        if (sample(v->x(), v->y(), elevation, resolution))
+        float elevation = elevations[i];
+        if (elevation != NO_DATA_VALUE)
         {
             if (elevation < min) min = elevation;
             if (elevation > max) max = elevation;
@@ -22,7 +22,10 @@
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/Terrain>
-
+#include <osgEarth/ImageUtils>
+#include <osgEarth/JobScheduler>
+#include <cfloat>
+#include <cstring>
 
 #include <gdal_priv.h>
 #include <gdalwarper.h>
@@ -2183,6 +2186,381 @@ namespace
 
         return result;
     }
+
+    /**
+     * Native reprojection engine.
+     *
+     * Instead of transforming every destination pixel (manualReproject) or
+     * handing the image to the GDAL warper (which copies it twice and holds
+     * the global GDAL lock), this transforms a sparse grid of control points,
+     * interpolates the source location of each pixel between them, and
+     * resamples the source image in place in row bands that run in parallel
+     * on the Registry's JobScheduler.
+     *
+     * The grid starts coarse and is refined until interpolation stays within
+     * 1/8 of a source pixel of the exact transform. Pixels in cells whose
+     * control points failed to transform (e.g. near the poles when going
+     * from geographic to mercator) are transformed individually.
+     *
+     * Source pixel mapping matches manualReproject.
+     */
+    class NativeReprojector
+    {
+    public:
+        NativeReprojector(
+            const osg::Image* image,
+            const GeoExtent&  src_extent,
+            const GeoExtent&  dest_extent,
+            bool              interpolate,
+            unsigned          width,
+            unsigned          height) :
+            _image      ( image ),
+            _src        ( src_extent ),
+            _dest       ( dest_extent ),
+            _interpolate( interpolate ),
+            _width      ( width ),
+            _height     ( height ),
+            _reader     ( image ),
+            _bytesPerPixel( 0u )
+        {
+            if (_width == 0 || _height == 0)
+            {
+                //If no width and height are specified, just use the minimum dimension for the image
+                _width  = osg::minimum(image->s(), image->t());
+                _height = osg::minimum(image->s(), image->t());
+            }
+
+            _dx = _dest.width() / (double)_width;
+            _dy = _dest.height() / (double)_height;
+            _xfac = (image->s() - 1) / _src.width();
+            _yfac = (image->t() - 1) / _src.height();
+            _maxCol = (double)(image->s() - 1);
+            _maxRow = (double)(image->t() - 1);
+
+            // 8-bit images are resampled directly, one channel at a time:
+            if (image->getDataType() == GL_UNSIGNED_BYTE && !image->isCompressed())
+            {
+                _bytesPerPixel = osg::Image::computePixelSizeInBits(image->getPixelFormat(), image->getDataType()) / 8;
+            }
+        }
+
+        //! Whether the engine can handle an image.
+        static bool supports(const osg::Image* image)
+        {
+            return
+                image &&
+                image->r() == 1 &&
+                !image->isCompressed() &&
+                ImageUtils::PixelReader::supports(image) &&
+                ImageUtils::PixelWriter::supports(image);
+        }
+
+        osg::Image* run()
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            _result = new osg::Image();
+            _result->allocateImage(_width, _height, 1, _image->getPixelFormat(), _image->getDataType());
+            _result->setInternalTextureFormat(_image->getInternalTextureFormat());
+            ImageUtils::markAsUnNormalized(_result.get(), ImageUtils::isUnNormalized(_image));
+
+            //Initialize the image to be completely transparent/black
+            memset(_result->data(), 0, _result->getImageSizeInBytes());
+
+            // refine the control grid until it's accurate enough:
+            for (unsigned step = 16u; ; step /= 2u)
+            {
+                buildGrid(step);
+                if (step == 1u || getGridError() <= 0.125)
+                    break;
+            }
+
+            // resample in bands of rows on the shared scheduler, so that many
+            // tiles reprojecting at once share a bounded set of threads. A
+            // scheduler thread that blocked on its own bands could starve the
+            // pool, so on one the image is resampled serially.
+            JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+
+            unsigned numBands =
+                !scheduler || scheduler->isWorkerThread() || _width*_height < 128u*128u ? 1u :
+                osg::minimum(osg::minimum(scheduler->getNumThreads() + 1u, 4u), _height / 32u);
+
+            if (numBands < 2u)
+            {
+                resampleRows(0u, _height);
+            }
+            else
+            {
+                osg::ref_ptr<JobGroup> bands = new JobGroup();
+                unsigned rowsPerBand = (_height + numBands - 1u) / numBands;
+                for (unsigned first = rowsPerBand; first < _height; first += rowsPerBand)
+                {
+                    scheduler->add(new RowBand(this, first, osg::minimum(first + rowsPerBand, _height)), bands.get());
+                }
+
+                // this thread takes the first band.
+                resampleRows(0u, rowsPerBand);
+
+                bands->wait();
+            }
+
+            OE_DEBUG << LC << "Reprojected " << _width << "x" << _height << " image (grid step " << _step << ") in "
+                << osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) << " ms" << std::endl;
+
+            return _result.release();
+        }
+
+        //! Resamples destination rows [first, last).
+        void resampleRows(unsigned first, unsigned last)
+        {
+            ImageUtils::PixelWriter writer(_result.get());
+
+            for (unsigned r = first; r < last; ++r)
+            {
+                const unsigned j = _rowCell[r];
+                const double   v = _rowWeight[r];
+
+                for (unsigned c = 0; c < _width; ++c)
+                {
+                    const unsigned i = _colCell[c];
+                    const double   u = _colWeight[c];
+
+                    const unsigned ll = j*_gridCols + i;
+                    const unsigned ul = ll + _gridCols;
+
+                    double px, py;
+
+                    if (_gridValid[ll] && _gridValid[ll+1] && _gridValid[ul] && _gridValid[ul+1])
+                    {
+                        double w00 = (1.0-u)*(1.0-v), w10 = u*(1.0-v), w01 = (1.0-u)*v, w11 = u*v;
+                        px = w00*_gridX[ll] + w10*_gridX[ll+1] + w01*_gridX[ul] + w11*_gridX[ul+1];
+                        py = w00*_gridY[ll] + w10*_gridY[ll+1] + w01*_gridY[ul] + w11*_gridY[ul+1];
+                    }
+                    else if (!exactLocation((double)c, (double)r, px, py))
+                    {
+                        continue;
+                    }
+
+                    //If the sample point is outside of the bound of the source image, leave the pixel empty.
+                    if (px < 0.0 || px > _maxCol || py < 0.0 || py > _maxRow)
+                        continue;
+
+                    if (_bytesPerPixel > 0u)
+                        sampleBytes(px, py, _result->data(c, r));
+                    else
+                        writer(sampleColor(px, py), c, r);
+                }
+            }
+        }
+
+    private:
+
+        struct RowBand : public TaskRequest
+        {
+            RowBand(NativeReprojector* engine, unsigned first, unsigned last) :
+                _engine(engine), _first(first), _last(last) { }
+
+            void operator()(ProgressCallback* progress) { _engine->resampleRows(_first, _last); }
+
+            NativeReprojector* _engine;
+            unsigned _first, _last;
+        };
+
+        // Transforms destination pixel-center locations into source pixel locations.
+        // Falls back to one-at-a-time transforms when the batch fails, so that a
+        // single bad point (e.g. a pole) doesn't invalidate the rest.
+        void transformPoints(std::vector<osg::Vec3d>& points, std::vector<bool>& valid) const
+        {
+            valid.assign(points.size(), false);
+
+            std::vector<osg::Vec3d> batch(points);
+            if (_dest.getSRS()->transform(batch, _src.getSRS()))
+            {
+                points.swap(batch);
+                for (unsigned k = 0; k < points.size(); ++k)
+                    valid[k] = true;
+            }
+            else
+            {
+                for (unsigned k = 0; k < points.size(); ++k)
+                {
+                    osg::Vec3d out;
+                    if (_dest.getSRS()->transform(points[k], _src.getSRS(), out))
+                    {
+                        points[k] = out;
+                        valid[k] = true;
+                    }
+                }
+            }
+
+            for (unsigned k = 0; k < points.size(); ++k)
+            {
+                if (valid[k] && (osg::isNaN(points[k].x()) || osg::isNaN(points[k].y())))
+                    valid[k] = false;
+
+                points[k].x() = (points[k].x() - _src.xMin()) * _xfac;
+                points[k].y() = (points[k].y() - _src.yMin()) * _yfac;
+            }
+        }
+
+        osg::Vec3d destPoint(double c, double r) const
+        {
+            return osg::Vec3d(_dest.xMin() + (c + 0.5)*_dx, _dest.yMin() + (r + 0.5)*_dy, 0.0);
+        }
+
+        bool exactLocation(double c, double r, double& px, double& py) const
+        {
+            osg::Vec3d out;
+            if (!_dest.getSRS()->transform(destPoint(c, r), _src.getSRS(), out))
+                return false;
+            px = (out.x() - _src.xMin()) * _xfac;
+            py = (out.y() - _src.yMin()) * _yfac;
+            return true;
+        }
+
+        // Places control points every "step" destination pixels (plus the last
+        // row/column) and records, for each pixel, its grid cell and weight.
+        static void layoutAxis(unsigned size, unsigned step, std::vector<unsigned>& pos, std::vector<unsigned>& cell, std::vector<double>& weight)
+        {
+            pos.clear();
+            for (unsigned p = 0; p < size; p += step)
+                pos.push_back(p);
+            if (pos.back() != size-1)
+                pos.push_back(size-1);
+            if (pos.size() == 1)
+                pos.push_back(size-1); // single-pixel axis; degenerate cell
+
+            cell.resize(size);
+            weight.resize(size);
+            unsigned k = 0;
+            for (unsigned p = 0; p < size; ++p)
+            {
+                while (k+2 < pos.size() && p >= pos[k+1])
+                    ++k;
+                cell[p] = k;
+                unsigned span = pos[k+1] - pos[k];
+                weight[p] = span > 0 ? (double)(p - pos[k]) / (double)span : 0.0;
+            }
+        }
+
+        void buildGrid(unsigned step)
+        {
+            _step = step;
+            layoutAxis(_width,  step, _colPos, _colCell, _colWeight);
+            layoutAxis(_height, step, _rowPos, _rowCell, _rowWeight);
+            _gridCols = _colPos.size();
+
+            std::vector<osg::Vec3d> points;
+            points.reserve(_colPos.size() * _rowPos.size());
+            for (unsigned j = 0; j < _rowPos.size(); ++j)
+                for (unsigned i = 0; i < _colPos.size(); ++i)
+                    points.push_back(destPoint(_colPos[i], _rowPos[j]));
+
+            transformPoints(points, _gridValid);
+
+            _gridX.resize(points.size());
+            _gridY.resize(points.size());
+            for (unsigned k = 0; k < points.size(); ++k)
+            {
+                _gridX[k] = points[k].x();
+                _gridY[k] = points[k].y();
+            }
+        }
+
+        // Worst interpolation error, in source pixels, at the cell centers.
+        double getGridError() const
+        {
+            std::vector<osg::Vec3d> centers;
+            std::vector<unsigned> cells;
+            for (unsigned j = 0; j+1 < _rowPos.size(); ++j)
+            {
+                for (unsigned i = 0; i+1 < _colPos.size(); ++i)
+                {
+                    unsigned ll = j*_gridCols + i, ul = ll + _gridCols;
+                    if (_gridValid[ll] && _gridValid[ll+1] && _gridValid[ul] && _gridValid[ul+1])
+                    {
+                        centers.push_back(destPoint(
+                            0.5*(_colPos[i] + _colPos[i+1]),
+                            0.5*(_rowPos[j] + _rowPos[j+1])));
+                        cells.push_back(ll);
+                    }
+                }
+            }
+
+            std::vector<bool> valid;
+            transformPoints(centers, valid);
+
+            double maxError = 0.0;
+            for (unsigned k = 0; k < centers.size(); ++k)
+            {
+                unsigned ll = cells[k], ul = ll + _gridCols;
+                if (!valid[k])
+                    return DBL_MAX;
+                double x = 0.25*(_gridX[ll] + _gridX[ll+1] + _gridX[ul] + _gridX[ul+1]);
+                double y = 0.25*(_gridY[ll] + _gridY[ll+1] + _gridY[ul] + _gridY[ul+1]);
+                maxError = osg::maximum(maxError, osg::maximum(fabs(x - centers[k].x()), fabs(y - centers[k].y())));
+            }
+            return maxError;
+        }
+
+        void sampleBytes(double px, double py, unsigned char* out) const
+        {
+            if (!_interpolate)
+            {
+                memcpy(out, _image->data((int)(px + 0.5), (int)(py + 0.5)), _bytesPerPixel);
+                return;
+            }
+
+            int x0 = (int)px, y0 = (int)py;
+            int x1 = osg::minimum(x0 + 1, _image->s() - 1);
+            int y1 = osg::minimum(y0 + 1, _image->t() - 1);
+            float fx = (float)(px - x0), fy = (float)(py - y0);
+
+            const unsigned char* p00 = _image->data(x0, y0);
+            const unsigned char* p10 = _image->data(x1, y0);
+            const unsigned char* p01 = _image->data(x0, y1);
+            const unsigned char* p11 = _image->data(x1, y1);
+
+            for (unsigned k = 0; k < _bytesPerPixel; ++k)
+            {
+                float bottom = (float)p00[k] + ((float)p10[k] - (float)p00[k]) * fx;
+                float top    = (float)p01[k] + ((float)p11[k] - (float)p01[k]) * fx;
+                out[k] = (unsigned char)(bottom + (top - bottom) * fy + 0.5f);
+            }
+        }
+
+        osg::Vec4 sampleColor(double px, double py) const
+        {
+            if (!_interpolate)
+            {
+                return _reader((int)(px + 0.5), (int)(py + 0.5));
+            }
+
+            int x0 = (int)px, y0 = (int)py;
+            int x1 = osg::minimum(x0 + 1, _image->s() - 1);
+            int y1 = osg::minimum(y0 + 1, _image->t() - 1);
+            float fx = (float)(px - x0), fy = (float)(py - y0);
+
+            osg::Vec4 bottom = _reader(x0, y0) * (1.0f - fx) + _reader(x1, y0) * fx;
+            osg::Vec4 top    = _reader(x0, y1) * (1.0f - fx) + _reader(x1, y1) * fx;
+            return bottom * (1.0f - fy) + top * fy;
+        }
+
+        const osg::Image*         _image;
+        GeoExtent                 _src, _dest;
+        bool                      _interpolate;
+        unsigned                  _width, _height;
+        ImageUtils::PixelReader   _reader;
+        unsigned                  _bytesPerPixel;
+        double                    _dx, _dy, _xfac, _yfac, _maxCol, _maxRow;
+        osg::ref_ptr<osg::Image>  _result;
+
+        unsigned                  _step, _gridCols;
+        std::vector<unsigned>     _colPos, _rowPos, _colCell, _rowCell;
+        std::vector<double>       _colWeight, _rowWeight;
+        std::vector<double>       _gridX, _gridY;
+        std::vector<bool>         _gridValid;
+    };
 }
 
 GeoImage
@@ -2201,8 +2579,18 @@ GeoImage::reproject(const SpatialReference* to_srs, const GeoExtent* to_extent,
     osg::Image* resultImage = 0L;
 
     bool isNormalized = ImageUtils::isNormalized(getImage());
-    
-    if ( getSRS()->isUserDefined()      || 
+
+    // geographic <-> spherical mercator is the common case; resample it natively.
+    bool isGeoMercator =
+        (getSRS()->isGeographic() && to_srs->isSphericalMercator()) ||
+        (getSRS()->isSphericalMercator() && to_srs->isGeographic());
+
+    if ( isGeoMercator && NativeReprojector::supports(getImage()) )
+    {
+        NativeReprojector engine(getImage(), getExtent(), destExtent, useBilinearInterpolation && isNormalized, width, height);
+        resultImage = engine.run();
+    }
+    else if ( getSRS()->isUserDefined()      || 
         to_srs->isUserDefined()         ||
         getSRS()->isSphericalMercator() ||
         to_srs->isSphericalMercator()   ||
@@ -2277,9 +2665,7 @@ GeoImage::takeImage()
 #define DEFAULT_CURVATURE 0.0f
 
 NormalMap::NormalMap(unsigned s, unsigned t) :
-osg::Image(),
-_write(0L),
-_read(0L)
+osg::Image()
 {
     const osg::Vec3 defaultNormal(DEFAULT_NORMAL);
     const float defaultCurvature(DEFAULT_CURVATURE);
@@ -2288,51 +2674,62 @@ _read(0L)
     {
         allocateImage(s, t, 1, GL_RGBA, GL_UNSIGNED_BYTE, 1);
 
-        _write = new ImageUtils::PixelWriter(this);
-        _read = new ImageUtils::PixelReader(this);
+        // encode the default once and replicate it.
+        set(0, 0, defaultNormal, defaultCurvature);
 
-        for (unsigned y=0; y<t; ++y)
-            for (unsigned x=0; x<s; ++x)
-                set(x, y, defaultNormal, defaultCurvature);
+        const unsigned char* first = data();
+        unsigned char* ptr = data() + 4;
+        unsigned char* end = data() + 4*s*t;
+        for (; ptr != end; ptr += 4)
+            memcpy(ptr, first, 4);
     }
 }
 
 NormalMap::~NormalMap()
 {
-    if (_read) delete _read;
-    if (_write) delete _write;
+    //nop
+}
+
+namespace
+{
+    // maps [-1..1] to [0..255]; out-of-range input (e.g. a large curvature)
+    // saturates instead of wrapping around in the cast.
+    inline unsigned char encodeUnit(float value)
+    {
+        return (unsigned char)osg::clampBetween(0.5f*(value+1.0f) * 255.0f, 0.0f, 255.0f);
+    }
 }
 
+// NormalMap is always RGBA8 so we access the bytes directly
+// instead of going through PixelReader/PixelWriter.
 void
 NormalMap::set(unsigned s, unsigned t, const osg::Vec3& normal, float curvature)
 {
-    if (!_write) return;
-
-    osg::Vec4f encoding(
-        0.5f*(normal.x()+1.0f),
-        0.5f*(normal.y()+1.0f),
-        0.5f*(normal.z()+1.0f),
-        0.5f*(curvature+1.0f));
+    if (!data()) return;
 
-    (*_write)(encoding, s, t);
+    unsigned char* ptr = data() + 4*(t*_s + s);
+    ptr[0] = encodeUnit(normal.x());
+    ptr[1] = encodeUnit(normal.y());
+    ptr[2] = encodeUnit(normal.z());
+    ptr[3] = encodeUnit(curvature);
 }
 
 osg::Vec3
 NormalMap::getNormal(unsigned s, unsigned t) const
 {
-    if (!_read) return osg::Vec3(0,0,1);
+    if (!data()) return osg::Vec3(0,0,1);
 
-    osg::Vec4 encoding = (*_read)(s, t);
+    const unsigned char* ptr = data() + 4*(t*_s + s);
     return osg::Vec3(
-        encoding.x()*2.0 - 1.0,
-        encoding.y()*2.0 - 1.0,
-        encoding.z()*2.0 - 1.0);
+        ((float)ptr[0]/255.0f)*2.0 - 1.0,
+        ((float)ptr[1]/255.0f)*2.0 - 1.0,
+        ((float)ptr[2]/255.0f)*2.0 - 1.0);
 }
 
 osg::Vec3
 NormalMap::getNormalByUV(double u, double v) const
 {
-    if (!_read) return osg::Vec3(0,0,1);
+    if (!data()) return osg::Vec3(0,0,1);
 
     double c = u * (double)(s()-1);
     double r = v * (double)(t()-1);
@@ -2387,8 +2784,8 @@ NormalMap::getNormalByUV(double u, double v) const
 float
 NormalMap::getCurvature(unsigned s, unsigned t) const
 {
-    if (!_read) return 0.0f;
-    return (*_read)(s, t).a() * 2.0f - 1.0f;
+    if (!data()) return 0.0f;
+    return ((float)data()[4*(t*_s + s) + 3]/255.0f) * 2.0f - 1.0f;
 }
 
 /***************************************************************************/
@@ -113,12 +113,16 @@ namespace osgEarth
 
         void writeHeader(const char* ptr, size_t realsize)
         {
-            std::string header(ptr);
-            StringTokenizer tok(":");
-            StringVector tized;
-            tok.tokenize(header, tized);
-            if ( tized.size() >= 2 )
-                _headers[tized[0]] = tized[1];
+            // split at the first colon only, since values like dates contain
+            // colons too, and keep quotes, which are part of an ETag.
+            std::string header(ptr, realsize);
+            std::string::size_type colon = header.find(':');
+            if ( colon != std::string::npos )
+            {
+                std::string name = trim(header.substr(0, colon));
+                if ( !name.empty() )
+                    _headers[name] = trim(header.substr(colon+1));
+            }
         }
 
         std::ostream* _stream;
@@ -239,6 +243,30 @@ void HTTPRequest::setLastModified( const DateTime &lastModified)
     addHeader("If-Modified-Since", lastModified.asRFC1123());
 }
 
+bool
+HTTPRequest::setValidators( const Config& cachedHeaders )
+{
+    bool set = false;
+    for(ConfigSet::const_iterator i = cachedHeaders.children().begin(); i != cachedHeaders.children().end(); ++i)
+    {
+        // header names are case-insensitive (and lower case in HTTP/2).
+        if ( i->value().empty() )
+            continue;
+
+        if ( ciEquals(i->key(), "ETag") )
+        {
+            addHeader("If-None-Match", i->value());
+            set = true;
+        }
+        else if ( ciEquals(i->key(), "Last-Modified") )
+        {
+            addHeader("If-Modified-Since", i->value());
+            set = true;
+        }
+    }
+    return set;
+}
+
 
 std::string
 HTTPRequest::getURL() const
@@ -388,6 +416,11 @@ namespace
     static osg::ref_ptr< URLRewriter > s_rewriter;
 
     static osg::ref_ptr< CurlConfigHandler > s_curlConfigHandler;
+
+    // shared engine for asynchronous requests, created on first use
+    static osg::ref_ptr<osg::Referenced> s_asyncEngine;
+    static Threading::Mutex              s_asyncEngineMutex;
+    static unsigned                      s_maxAsyncConnectionsPerHost = 8u;
 }
 
 HTTPClient&
@@ -421,14 +454,6 @@ HTTPClient::initializeImpl()
     _previousHttpAuthentication = 0;
     _curl_handle = curl_easy_init();
 
-    //Get the user agent
-    std::string userAgent = s_userAgent;
-    const char* userAgentEnv = getenv("OSGEARTH_USERAGENT");
-    if (userAgentEnv)
-    {
-        userAgent = std::string(userAgentEnv);
-    }
-
     //Check for a response-code simulation (for testing)
     const char* simCode = getenv("OSGEARTH_SIMULATE_HTTP_RESPONSE_CODE");
     if ( simCode )
@@ -452,24 +477,40 @@ HTTPClient::initializeImpl()
         OE_WARN << LC << "HTTP debugging enabled" << std::endl;
     }
 
+    configureHandle( _curl_handle );
+
+    _initialized = true;
+}
+
+void
+HTTPClient::configureHandle(void* handle)
+{
+    //Get the user agent
+    std::string userAgent = s_userAgent;
+    const char* userAgentEnv = getenv("OSGEARTH_USERAGENT");
+    if (userAgentEnv)
+    {
+        userAgent = std::string(userAgentEnv);
+    }
+
     OE_DEBUG << LC << "HTTPClient setting userAgent=" << userAgent << std::endl;
 
-    curl_easy_setopt( _curl_handle, CURLOPT_USERAGENT, userAgent.c_str() );
-    curl_easy_setopt( _curl_handle, CURLOPT_WRITEFUNCTION, osgEarth::StreamObjectReadCallback );
-    curl_easy_setopt( _curl_handle, CURLOPT_HEADERFUNCTION, osgEarth::StreamObjectHeaderCallback );
-    curl_easy_setopt( _curl_handle, CURLOPT_FOLLOWLOCATION, (void*)1 );
-    curl_easy_setopt( _curl_handle, CURLOPT_MAXREDIRS, (void*)5 );
-    curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSFUNCTION, &CurlProgressCallback);
-    curl_easy_setopt( _curl_handle, CURLOPT_NOPROGRESS, (void*)0 ); //0=enable.
-    curl_easy_setopt( _curl_handle, CURLOPT_FILETIME, true );
+    curl_easy_setopt( handle, CURLOPT_USERAGENT, userAgent.c_str() );
+    curl_easy_setopt( handle, CURLOPT_WRITEFUNCTION, osgEarth::StreamObjectReadCallback );
+    curl_easy_setopt( handle, CURLOPT_HEADERFUNCTION, osgEarth::StreamObjectHeaderCallback );
+    curl_easy_setopt( handle, CURLOPT_FOLLOWLOCATION, (void*)1 );
+    curl_easy_setopt( handle, CURLOPT_MAXREDIRS, (void*)5 );
+    curl_easy_setopt( handle, CURLOPT_PROGRESSFUNCTION, &CurlProgressCallback);
+    curl_easy_setopt( handle, CURLOPT_NOPROGRESS, (void*)0 ); //0=enable.
+    curl_easy_setopt( handle, CURLOPT_FILETIME, true );
 
     // Enable automatic CURL decompression of known types. An empty string will automatically add all supported encoding types that are built into curl.
     // Note that you must have curl built against zlib to support gzip or deflate encoding.
-    curl_easy_setopt( _curl_handle, CURLOPT_ENCODING, "");
+    curl_easy_setopt( handle, CURLOPT_ENCODING, "");
 
     osg::ref_ptr< CurlConfigHandler > curlConfigHandler = getCurlConfigHandler();
     if (curlConfigHandler.valid()) {
-        curlConfigHandler->onInitialize(_curl_handle);
+        curlConfigHandler->onInitialize(handle);
     }
 
     long timeout = s_timeout;
@@ -479,7 +520,7 @@ HTTPClient::initializeImpl()
         timeout = osgEarth::as<long>(std::string(timeoutEnv), 0);
     }
     OE_DEBUG << LC << "Setting timeout to " << timeout << std::endl;
-    curl_easy_setopt( _curl_handle, CURLOPT_TIMEOUT, timeout );
+    curl_easy_setopt( handle, CURLOPT_TIMEOUT, timeout );
     long connectTimeout = s_connectTimeout;
     const char* connectTimeoutEnv = getenv("OSGEARTH_HTTP_CONNECTTIMEOUT");
     if (connectTimeoutEnv)
@@ -487,9 +528,7 @@ HTTPClient::initializeImpl()
         connectTimeout = osgEarth::as<long>(std::string(connectTimeoutEnv), 0);
     }
     OE_DEBUG << LC << "Setting connect timeout to " << connectTimeout << std::endl;
-    curl_easy_setopt( _curl_handle, CURLOPT_CONNECTTIMEOUT, connectTimeout );
-
-    _initialized = true;
+    curl_easy_setopt( handle, CURLOPT_CONNECTTIMEOUT, connectTimeout );
 }
 
 HTTPClient::~HTTPClient()
@@ -539,6 +578,16 @@ void HTTPClient::setConnectTimeout( long timeout )
 {
     s_connectTimeout = timeout;
 }
+
+unsigned HTTPClient::getMaxAsyncConnectionsPerHost()
+{
+    return s_maxAsyncConnectionsPerHost;
+}
+
+void HTTPClient::setMaxAsyncConnectionsPerHost( unsigned value )
+{
+    s_maxAsyncConnectionsPerHost = value;
+}
 URLRewriter* HTTPClient::getURLRewriter()
 {
     return s_rewriter.get();
@@ -566,7 +615,7 @@ HTTPClient::globalInit()
 }
 
 void
-HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port) const
+HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port)
 {
     // try to set proxy host/port by reading the CURL proxy options
     if ( options )
@@ -588,10 +637,70 @@ HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host,
     }
 }
 
+void
+HTTPClient::getProxy(const osgDB::Options* options, std::string& proxy_addr, std::string& proxy_auth)
+{
+    std::string proxy_host;
+    std::string proxy_port = "8080";
+
+    //Try to get the proxy settings from the global settings
+    if (s_proxySettings.isSet())
+    {
+        proxy_host = s_proxySettings.get().hostName();
+        std::stringstream buf;
+        buf << s_proxySettings.get().port();
+        proxy_port = buf.str();
+
+        std::string proxy_username = s_proxySettings.get().userName();
+        std::string proxy_password = s_proxySettings.get().password();
+        if (!proxy_username.empty() && !proxy_password.empty())
+        {
+            proxy_auth = proxy_username + std::string(":") + proxy_password;
+        }
+    }
+
+    //Try to get the proxy settings from the local options that are passed in.
+    readOptions( options, proxy_host, proxy_port );
+
+    optional< ProxySettings > proxySettings;
+    ProxySettings::fromOptions( options, proxySettings );
+    if (proxySettings.isSet())
+    {
+        proxy_host = proxySettings.get().hostName();
+        proxy_port = toString<int>(proxySettings.get().port());
+        OE_DEBUG << LC << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
+    }
+
+    //Try to get the proxy settings from the environment variable
+    const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
+    if (proxyEnvAddress) //Env Proxy Settings
+    {
+        proxy_host = std::string(proxyEnvAddress);
+
+        const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
+        if (proxyEnvPort)
+        {
+            proxy_port = std::string( proxyEnvPort );
+        }
+    }
+
+    const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");
+    if (proxyEnvAuth)
+    {
+        proxy_auth = std::string(proxyEnvAuth);
+    }
+
+    proxy_addr.clear();
+    if ( !proxy_host.empty() )
+    {
+        proxy_addr = proxy_host + ":" + proxy_port;
+    }
+}
+
 bool
 HTTPClient::decodeMultipartStream(const std::string&   boundary,
                                   HTTPResponse::Part*  input,
-                                  HTTPResponse::Parts& output) const
+                                  HTTPResponse::Parts& output)
 {
     std::string bstr = std::string("--") + boundary;
     std::string line;
@@ -977,6 +1086,17 @@ HTTPClient::doGet(const HTTPRequest&    request,
     return response;
 }
 
+HTTPClient::ResponseFuture
+HTTPClient::getAsync(const HTTPRequest&    request,
+                     const osgDB::Options* options,
+                     ProgressCallback*     progress)
+{
+    // no asynchronous engine for WinInet; run the request right away.
+    Threading::Promise<AsyncResponse> promise;
+    promise.resolve( new AsyncResponse(getClient().doGet(request, options, progress)) );
+    return promise.getFuture();
+}
+
 #else // OSGEARTH_USE_WININET_FOR_HTTP
 
 HTTPResponse
@@ -997,71 +1117,14 @@ HTTPClient::doGet(const HTTPRequest&    request,
             options->getAuthenticationMap() :
             osgDB::Registry::instance()->getAuthenticationMap();
 
-    std::string proxy_host;
-    std::string proxy_port = "8080";
-
-    std::string proxy_auth;
-
     //TODO: don't do all this proxy setup on every GET. Just do it once per client, or only when
     // the proxy information changes.
-
-    //Try to get the proxy settings from the global settings
-    if (s_proxySettings.isSet())
-    {
-        proxy_host = s_proxySettings.get().hostName();
-        std::stringstream buf;
-        buf << s_proxySettings.get().port();
-        proxy_port = buf.str();
-
-        std::string proxy_username = s_proxySettings.get().userName();
-        std::string proxy_password = s_proxySettings.get().password();
-        if (!proxy_username.empty() && !proxy_password.empty())
-        {
-            proxy_auth = proxy_username + std::string(":") + proxy_password;
-        }
-    }
-
-    //Try to get the proxy settings from the local options that are passed in.
-    readOptions( options, proxy_host, proxy_port );
-
-    optional< ProxySettings > proxySettings;
-    ProxySettings::fromOptions( options, proxySettings );
-    if (proxySettings.isSet())
-    {
-        proxy_host = proxySettings.get().hostName();
-        proxy_port = toString<int>(proxySettings.get().port());
-        OE_DEBUG << LC << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
-    }
-
-    //Try to get the proxy settings from the environment variable
-    const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
-    if (proxyEnvAddress) //Env Proxy Settings
-    {
-        proxy_host = std::string(proxyEnvAddress);
-
-        const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
-        if (proxyEnvPort)
-        {
-            proxy_port = std::string( proxyEnvPort );
-        }
-    }
-
-    const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");
-    if (proxyEnvAuth)
-    {
-        proxy_auth = std::string(proxyEnvAuth);
-    }
+    std::string proxy_addr, proxy_auth;
+    getProxy( options, proxy_addr, proxy_auth );
 
     // Set up proxy server:
-    std::string proxy_addr;
-    if ( !proxy_host.empty() )
+    if ( !proxy_addr.empty() )
     {
-        std::stringstream buf;
-        buf << proxy_host << ":" << proxy_port;
-        std::string bufStr;
-        bufStr = buf.str();
-        proxy_addr = bufStr;
-
         if ( s_HTTP_DEBUG )
         {
             OE_NOTICE << LC << "Using proxy: " << proxy_addr << std::endl;
@@ -1217,66 +1280,13 @@ HTTPClient::doGet(const HTTPRequest&    request,
         res = response_code == 408 ? CURLE_OPERATION_TIMEDOUT : CURLE_COULDNT_CONNECT;
     }
 
-    HTTPResponse response( response_code );
+    HTTPResponse response = makeResponse( _curl_handle, res, response_code, part.get(), sp._headers, OE_STOP_TIMER(get_duration) );
 
-    // read the response content type:
-    char* content_type_cp;
-
-    curl_easy_getinfo( _curl_handle, CURLINFO_CONTENT_TYPE, &content_type_cp );
-
-    if ( content_type_cp != NULL )
-    {
-        response._mimeType = content_type_cp;
-    }
-
-    // read the file time:
-    response._lastModified = getCurlFileTime( _curl_handle );
-
-    if (res == CURLE_OK)
+    if ( res == CURLE_GOT_NOTHING )
     {
-        // check for multipart content
-        if (response._mimeType.length() > 9 &&
-            ::strstr( response._mimeType.c_str(), "multipart" ) == response._mimeType.c_str() )
-        {
-            OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
-
-            //TODO: parse out the "wcs" -- this is WCS-specific
-            if ( !decodeMultipartStream( "wcs", part.get(), response._parts ) )
-            {
-                // error decoding an invalid multipart stream.
-                // should we do anything, or just leave the response empty?
-            }
-        }
-        else
-        {
-            for (Headers::iterator itr = sp._headers.begin(); itr != sp._headers.end(); ++itr)
-            {
-                part->_headers[itr->first] = itr->second;
-            }
-
-            // Write the headers to the metadata
-            response._parts.push_back( part.get() );
-        }
-    }
-
-    else if (res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT)
-    {
-        //If we were aborted by a callback, then it was cancelled by a user
-        response._cancelled = true;
+        OE_DEBUG << LC << "CURLE_GOT_NOTHING for " << url << std::endl;
     }
 
-    else
-    {
-        response._message = curl_easy_strerror(res);
-
-        if (res == CURLE_GOT_NOTHING)
-        {
-            OE_DEBUG << LC << "CURLE_GOT_NOTHING for " << url << std::endl;
-        }
-    }
-
-    response._duration_s = OE_STOP_TIMER(get_duration);
-
     if ( progress )
     {
         progress->stats()["http_get_time"] += OE_STOP_TIMER(http_get);
@@ -1355,8 +1365,387 @@ HTTPClient::doGet(const HTTPRequest&    request,
     return response;
 }
 
+HTTPResponse
+HTTPClient::makeResponse(void*               handle,
+                         int                 result,
+                         long                response_code,
+                         HTTPResponse::Part* part,
+                         const Headers&      headers,
+                         double              duration_s)
+{
+    CURLcode res = (CURLcode)result;
+    HTTPResponse response( response_code );
+
+    // read the response content type:
+    char* content_type_cp = 0L;
+
+    curl_easy_getinfo( handle, CURLINFO_CONTENT_TYPE, &content_type_cp );
+
+    if ( content_type_cp != NULL )
+    {
+        response._mimeType = content_type_cp;
+    }
+
+    // read the file time:
+    response._lastModified = getCurlFileTime( handle );
+
+    if (res == CURLE_OK)
+    {
+        // check for multipart content
+        if (response._mimeType.length() > 9 &&
+            ::strstr( response._mimeType.c_str(), "multipart" ) == response._mimeType.c_str() )
+        {
+            OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
+
+            //TODO: parse out the "wcs" -- this is WCS-specific
+            if ( !decodeMultipartStream( "wcs", part, response._parts ) )
+            {
+                // error decoding an invalid multipart stream.
+                // should we do anything, or just leave the response empty?
+            }
+        }
+        else
+        {
+            for (Headers::const_iterator itr = headers.begin(); itr != headers.end(); ++itr)
+            {
+                part->_headers[itr->first] = itr->second;
+            }
+
+            // Write the headers to the metadata
+            response._parts.push_back( part );
+        }
+    }
+
+    else if (res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT)
+    {
+        //If we were aborted by a callback, then it was cancelled by a user
+        response._cancelled = true;
+    }
+
+    else
+    {
+        response._message = curl_easy_strerror(res);
+    }
+
+    response._duration_s = duration_s;
+
+    return response;
+}
+
+//........................................................................
+
+/**
+ * Runs asynchronous requests on one curl_multi handle. The multi handle
+ * keeps a connection cache that every transfer shares, and multiplexes
+ * transfers over HTTP/2 connections when the server supports it.
+ */
+class HTTPClient::AsyncEngine : public osg::Referenced, public OpenThreads::Thread
+{
+public:
+    struct Transfer : public osg::Referenced
+    {
+        Transfer() : _handle(0L), _headers(0L), _part(new HTTPResponse::Part()), _sp(&_part->_stream),
+            _start(osg::Timer::instance()->tick()) { }
+
+        ~Transfer()
+        {
+            if ( _headers ) curl_slist_free_all( _headers );
+            if ( _handle ) curl_easy_cleanup( _handle );
+        }
+
+        CURL*                             _handle;
+        curl_slist*                       _headers;
+        osg::ref_ptr<HTTPResponse::Part>  _part;
+        StreamObject                      _sp;
+        std::string                       _url;
+        osg::ref_ptr<ProgressCallback>    _progress;
+        Threading::Promise<AsyncResponse> _promise;
+        osg::Timer_t                      _start;
+    };
+
+    AsyncEngine() : _done(false)
+    {
+        _multi = curl_multi_init();
+
+#if LIBCURL_VERSION_NUM >= 0x071e00
+        curl_multi_setopt( _multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)s_maxAsyncConnectionsPerHost );
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+        curl_multi_setopt( _multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX );
+#endif
+        start();
+    }
+
+    //! Progress hook for a transfer; called on the engine thread.
+    static int progressCallback(void* clientp, double dltotal, double dlnow, double ultotal, double ulnow)
+    {
+        Transfer* t = (Transfer*)clientp;
+
+        // nobody is waiting for the result anymore.
+        if ( t->_promise.isAbandoned() )
+            return 1;
+
+        if ( t->_progress.valid() )
+            return t->_progress->isCanceled() || t->_progress->reportProgress(dlnow, dltotal);
+
+        return 0;
+    }
+
+    //! Queues a transfer; the engine thread picks it up.
+    void add(Transfer* transfer)
+    {
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            _incoming.push_back( transfer );
+        }
+        wake();
+    }
+
+    void run()
+    {
+        while( !_done )
+        {
+            // pick up new transfers
+            std::vector< osg::ref_ptr<Transfer> > incoming;
+            {
+                Threading::ScopedMutexLock lock( _mutex );
+                incoming.swap( _incoming );
+            }
+            for(unsigned i = 0; i < incoming.size(); ++i)
+            {
+                Transfer* t = incoming[i].get();
+                t->_start = osg::Timer::instance()->tick();
+                curl_multi_add_handle( _multi, t->_handle );
+                _active[t->_handle] = t;
+            }
+
+            int running = 0;
+            curl_multi_perform( _multi, &running );
+
+            // hand off the finished transfers
+            CURLMsg* msg;
+            int left;
+            while( (msg = curl_multi_info_read(_multi, &left)) != 0L )
+            {
+                if ( msg->msg == CURLMSG_DONE )
+                {
+                    CURL*    handle = msg->easy_handle;
+                    CURLcode result = msg->data.result;
+                    curl_multi_remove_handle( _multi, handle );
+
+                    Active::iterator i = _active.find( handle );
+                    if ( i != _active.end() )
+                    {
+                        finish( i->second.get(), result );
+                        _active.erase( i );
+                    }
+                }
+            }
+
+            // sleep until there's socket activity or a new transfer.
+            if ( _active.empty() )
+            {
+                _idle.wait( 1000u );
+                _idle.reset();
+            }
+            else
+            {
+#if LIBCURL_VERSION_NUM >= 0x074400
+                curl_multi_poll( _multi, 0L, 0, 1000, 0L );
+#else
+                curl_multi_wait( _multi, 0L, 0, 10, 0L );
+#endif
+            }
+        }
+
+        // shutting down; drop whatever is left.
+        for(Active::iterator i = _active.begin(); i != _active.end(); ++i)
+        {
+            curl_multi_remove_handle( _multi, i->first );
+            finish( i->second.get(), CURLE_ABORTED_BY_CALLBACK );
+        }
+        _active.clear();
+
+        Threading::ScopedMutexLock lock( _mutex );
+        for(unsigned i = 0; i < _incoming.size(); ++i)
+            finish( _incoming[i].get(), CURLE_ABORTED_BY_CALLBACK );
+        _incoming.clear();
+    }
+
+protected:
+    virtual ~AsyncEngine()
+    {
+        _done = true;
+        wake();
+        join();
+        curl_multi_cleanup( _multi );
+    }
+
+    void wake()
+    {
+        _idle.set();
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_wakeup( _multi );
+#endif
+    }
+
+    void finish(Transfer* t, CURLcode result)
+    {
+        long response_code = 0L;
+        curl_easy_getinfo( t->_handle, CURLINFO_RESPONSE_CODE, &response_code );
+
+        double duration_s = osg::Timer::instance()->delta_s( t->_start, osg::Timer::instance()->tick() );
+        HTTPResponse response = makeResponse( t->_handle, result, response_code, t->_part.get(), t->_sp._headers, duration_s );
+
+        if ( t->_progress.valid() )
+        {
+            t->_progress->stats()["http_get_time"] += duration_s;
+            t->_progress->stats()["http_get_count"] += 1;
+            if ( response.isCancelled() )
+                t->_progress->stats()["http_cancel_count"] += 1;
+        }
+
+        if ( s_HTTP_DEBUG )
+        {
+            OE_NOTICE << LC
+                << "GET(" << response_code << ", async) " << response.getMimeType() << ": \""
+                << t->_url << "\" t=" << std::setprecision(4) << duration_s << "s" << std::endl;
+        }
+
+        t->_promise.resolve( new AsyncResponse(response) );
+    }
+
+    typedef std::map< CURL*, osg::ref_ptr<Transfer> > Active;
+
+    CURLM*                                 _multi;
+    Active                                 _active;
+    Threading::Mutex                       _mutex;
+    std::vector< osg::ref_ptr<Transfer> >  _incoming;
+    Threading::Event                       _idle;
+    volatile bool                          _done;
+};
+
+HTTPClient::ResponseFuture
+HTTPClient::getAsync(const HTTPRequest&    request,
+                     const osgDB::Options* options,
+                     ProgressCallback*     progress)
+{
+    // a simulated response code is only honored by the blocking client.
+    HTTPClient& client = getClient();
+    client.initialize();
+    if ( client._simResponseCode >= 0 )
+    {
+        Threading::Promise<AsyncResponse> promise;
+        promise.resolve( new AsyncResponse(client.doGet(request, options, progress)) );
+        return promise.getFuture();
+    }
+
+    osg::ref_ptr<AsyncEngine::Transfer> t = new AsyncEngine::Transfer();
+    t->_progress = progress;
+    t->_url = request.getURL();
+
+    // Rewrite the url if the url rewriter is available
+    osg::ref_ptr< URLRewriter > rewriter = getURLRewriter();
+    if ( rewriter.valid() )
+    {
+        t->_url = rewriter->rewrite( t->_url );
+    }
+
+    CURL* handle = curl_easy_init();
+    t->_handle = handle;
+    configureHandle( handle );
+
+    curl_easy_setopt( handle, CURLOPT_URL, t->_url.c_str() );
+    curl_easy_setopt( handle, CURLOPT_WRITEDATA, (void*)&t->_sp );
+    curl_easy_setopt( handle, CURLOPT_HEADERDATA, (void*)&t->_sp );
+    curl_easy_setopt( handle, CURLOPT_PROGRESSFUNCTION, &AsyncEngine::progressCallback );
+    curl_easy_setopt( handle, CURLOPT_PROGRESSDATA, (void*)t.get() );
+    curl_easy_setopt( handle, CURLOPT_SSL_VERIFYPEER, (void*)0 );
+
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    // ask for HTTP/2 over TLS, and wait for a connection to multiplex on
+    // rather than opening a new one.
+    curl_easy_setopt( handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS );
+    curl_easy_setopt( handle, CURLOPT_PIPEWAIT, 1L );
+#endif
+
+    std::string proxy_addr, proxy_auth;
+    getProxy( options, proxy_addr, proxy_auth );
+    if ( !proxy_addr.empty() )
+    {
+        curl_easy_setopt( handle, CURLOPT_PROXY, proxy_addr.c_str() );
+        if ( !proxy_auth.empty() )
+            curl_easy_setopt( handle, CURLOPT_PROXYUSERPWD, proxy_auth.c_str() );
+    }
+
+    const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ?
+            options->getAuthenticationMap() :
+            osgDB::Registry::instance()->getAuthenticationMap();
+
+    const osgDB::AuthenticationDetails* details = authenticationMap ?
+        authenticationMap->getAuthenticationDetails( t->_url ) :
+        0;
+
+    if ( details )
+    {
+        std::string password = details->username + ":" + details->password;
+        curl_easy_setopt( handle, CURLOPT_USERPWD, password.c_str() );
+#if LIBCURL_VERSION_NUM >= 0x070a07
+        curl_easy_setopt( handle, CURLOPT_HTTPAUTH, details->httpAuthentication );
+#endif
+    }
+
+    for (HTTPRequest::Parameters::const_iterator itr = request.getHeaders().begin(); itr != request.getHeaders().end(); ++itr)
+    {
+        std::string header = itr->first + ": " + itr->second;
+        t->_headers = curl_slist_append( t->_headers, header.c_str() );
+    }
+
+    // Disable the default Pragma: no-cache that curl adds by default.
+    t->_headers = curl_slist_append( t->_headers, "Pragma: " );
+    curl_easy_setopt( handle, CURLOPT_HTTPHEADER, t->_headers );
+
+    osg::ref_ptr< CurlConfigHandler > curlConfigHandler = getCurlConfigHandler();
+    if ( curlConfigHandler.valid() )
+    {
+        curlConfigHandler->onGet( handle );
+    }
+
+    ResponseFuture future = t->_promise.getFuture();
+
+    AsyncEngine* engine;
+    {
+        Threading::ScopedMutexLock lock( s_asyncEngineMutex );
+        if ( !s_asyncEngine.valid() )
+            s_asyncEngine = new AsyncEngine();
+        engine = static_cast<AsyncEngine*>( s_asyncEngine.get() );
+    }
+    engine->add( t.get() );
+
+    return future;
+}
+
 #endif // USE_WININET
 
+HTTPResponse
+HTTPClient::getShared(const HTTPRequest&    request,
+                      const osgDB::Options* options,
+                      ProgressCallback*     progress)
+{
+    ResponseFuture future = getAsync( request, options, progress );
+    AsyncResponse* result = future.get();
+    if ( result )
+    {
+        return result->response;
+    }
+
+    // the engine dropped the request (e.g. at shutdown); report it as
+    // canceled so the caller can try again.
+    HTTPResponse response( 0L );
+    response._cancelled = true;
+    return response;
+}
+
 bool
 HTTPClient::doDownload(const std::string& url, const std::string& filename)
 {
@@ -1444,7 +1833,7 @@ HTTPClient::doReadImage(const HTTPRequest&    request,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet(request, options, callback);
+    HTTPResponse response = getShared(request, options, callback);
 
     if (response.isOK())
     {
@@ -1535,7 +1924,7 @@ HTTPClient::doReadNode(const HTTPRequest&    request,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet(request, options, callback);
+    HTTPResponse response = getShared(request, options, callback);
 
     if (response.isOK())
     {
@@ -1619,7 +2008,7 @@ HTTPClient::doReadObject(const HTTPRequest&    request,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet(request, options, callback);
+    HTTPResponse response = getShared(request, options, callback);
 
     if (response.isOK())
     {
@@ -1703,7 +2092,7 @@ HTTPClient::doReadString(const HTTPRequest&    request,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet( request, options, callback );
+    HTTPResponse response = getShared(request, options, callback);
     if ( response.isOK() && response.getNumParts() > 0 )
     {
         result = ReadResult( new StringObject(response.getPartAsString(0)) );
@@ -277,6 +277,59 @@ HeightFieldUtils::getHeightAtLocation(const osg::HeightField* hf, double x, doub
     return getHeightAtPixel(hf, px, py, interpolation);
 }
 
+void
+HeightFieldUtils::getHeightsAtLocations(const osg::HeightField* hf,
+                                        const double* xs, const double* ys,
+                                        unsigned count,
+                                        double llx, double lly,
+                                        double dx, double dy,
+                                        float* out)
+{
+    const int cols = (int)hf->getNumColumns();
+    const int rows = (int)hf->getNumRows();
+    const double maxCol = (double)(cols-1);
+    const double maxRow = (double)(rows-1);
+    const double invdx = 1.0/dx;
+    const double invdy = 1.0/dy;
+    const float* heights = (const float*)hf->getFloatArray()->getDataPointer();
+
+    // Same results as getHeightAtPixel(INTERP_BILINEAR), but written as a
+    // straight loop over packed coordinates with direct access to the
+    // height array so the compiler can keep everything in registers.
+    for (unsigned i = 0; i < count; ++i)
+    {
+        double c = osg::clampBetween((xs[i] - llx) * invdx, 0.0, maxCol);
+        double r = osg::clampBetween((ys[i] - lly) * invdy, 0.0, maxRow);
+
+        int colMin = (int)c;
+        int rowMin = (int)r;
+        int colMax = c > (double)colMin ? colMin + 1 : colMin;
+        int rowMax = r > (double)rowMin ? rowMin + 1 : rowMin;
+
+        float llHeight = heights[rowMin*cols + colMin];
+        float lrHeight = heights[rowMin*cols + colMax];
+        float ulHeight = heights[rowMax*cols + colMin];
+        float urHeight = heights[rowMax*cols + colMax];
+
+        if (llHeight == NO_DATA_VALUE || lrHeight == NO_DATA_VALUE ||
+            ulHeight == NO_DATA_VALUE || urHeight == NO_DATA_VALUE)
+        {
+            //Make sure not to use NoData in the interpolation
+            if (!validateSamples(urHeight, llHeight, ulHeight, lrHeight))
+            {
+                out[i] = NO_DATA_VALUE;
+                continue;
+            }
+        }
+
+        double fc = c - (double)colMin;
+        double fr = r - (double)rowMin;
+        double r1 = (1.0-fc) * (double)llHeight + fc * (double)lrHeight;
+        double r2 = (1.0-fc) * (double)ulHeight + fc * (double)urHeight;
+        out[i] = (float)((1.0-fr) * r1 + fr * r2);
+    }
+}
+
 osg::Vec3
 HeightFieldUtils::getNormalAtLocation(const HeightFieldNeighborhood& hood, double x, double y, double llx, double lly, double dx, double dy, ElevationInterpolation interp)
 {
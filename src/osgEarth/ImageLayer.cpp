@@ -481,7 +481,29 @@ ImageLayer::createImage(const TileKey&    key,
         return GeoImage::INVALID;
     }
 
-    return createImageInKeyProfile( key, progress );
+    // If another thread is already creating this tile, wait for its result
+    // instead of creating it again.
+    SingleFlight<std::string, GeoImage>::Scope flight(
+        _imageFlights,
+        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
+        progress );
+
+    // Callers may modify the image, so each one that shares a flight gets
+    // its own copy and the shared image stays untouched.
+    if ( !flight.isLeader() )
+    {
+        const GeoImage& shared = flight.get();
+        return shared.valid() ?
+            GeoImage(new osg::Image(*shared.getImage(), osg::CopyOp::DEEP_COPY_ALL), shared.getExtent()) :
+            shared;
+    }
+
+    GeoImage result = createImageInKeyProfile( key, flight.getProgress() );
+    if ( flight.resolve(result) && result.valid() )
+    {
+        result = GeoImage(new osg::Image(*result.getImage(), osg::CopyOp::DEEP_COPY_ALL), result.getExtent());
+    }
+    return result;
 }
 
 GeoImage
@@ -958,9 +980,10 @@ ImageLayer::assembleImage(const TileKey& key, ProgressCallback* progress)
         // same (even though extents are different), then this operation is technically not a
         // reprojection but merely a resampling.
 
+        GeoExtent keyExtent = key.getExtent();
         result = mosaicedImage.reproject( 
             key.getProfile()->getSRS(),
-            &key.getExtent(), 
+            &keyExtent, 
             getTileSize(), getTileSize(),
             options().driver()->bilinearReprojection().get());
     }
@@ -1415,6 +1415,156 @@ ImageUtils::convertToPremultipliedAlpha(osg::Image* image)
 }
 
 
+namespace
+{
+    // Encodes a 4x4 block of one channel as BC4 (the building block of RGTC2).
+    // "plane" is a w x h single-channel image; pixels past its edge replicate
+    // the edge.
+    void encodeBC4Block(const unsigned char* plane, int w, int h, int bx, int by, unsigned char* out)
+    {
+        unsigned char values[16];
+        unsigned char lo = 255, hi = 0;
+        for (int y = 0; y < 4; ++y)
+        {
+            const unsigned char* row = plane + osg::minimum(by + y, h - 1) * w;
+            for (int x = 0; x < 4; ++x)
+            {
+                unsigned char v = row[osg::minimum(bx + x, w - 1)];
+                values[y*4 + x] = v;
+                lo = osg::minimum(lo, v);
+                hi = osg::maximum(hi, v);
+            }
+        }
+
+        // Endpoints in descending order select the 8-value palette:
+        // index 0 = hi, 1 = lo, and 2..7 step from hi down to lo.
+        out[0] = hi;
+        out[1] = lo;
+
+        unsigned long long bits = 0;
+        if (hi > lo)
+        {
+            const int range = hi - lo;
+            for (int i = 0; i < 16; ++i)
+            {
+                // position along [lo..hi] in sevenths, rounded:
+                int p = ((values[i] - lo) * 14 + range) / (2 * range);
+                int index = p == 7 ? 0 : p == 0 ? 1 : 8 - p;
+                bits |= (unsigned long long)index << (3 * i);
+            }
+        }
+
+        for (int i = 0; i < 6; ++i)
+            out[2 + i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    // Halves a single-channel image with a box filter.
+    void downsamplePlane(const unsigned char* src, int w, int h, unsigned char* dst, int dw, int dh)
+    {
+        for (int y = 0; y < dh; ++y)
+        {
+            const unsigned char* r0 = src + osg::minimum(2*y,   h-1) * w;
+            const unsigned char* r1 = src + osg::minimum(2*y+1, h-1) * w;
+            for (int x = 0; x < dw; ++x)
+            {
+                int x0 = osg::minimum(2*x,   w-1);
+                int x1 = osg::minimum(2*x+1, w-1);
+                dst[y*dw + x] = (unsigned char)((r0[x0] + r0[x1] + r1[x0] + r1[x1] + 2) / 4);
+            }
+        }
+    }
+}
+
+osg::Image*
+ImageUtils::encodeRGTC2(const osg::Image* input)
+{
+    if (!input || input->getDataType() != GL_UNSIGNED_BYTE || input->r() != 1)
+        return 0L;
+
+    unsigned stride;
+    switch (input->getPixelFormat())
+    {
+    case GL_RGBA:            stride = 4; break;
+    case GL_RGB:             stride = 3; break;
+    case GL_LUMINANCE_ALPHA: stride = 2; break;
+    default: return 0L;
+    }
+
+    int w = input->s(), h = input->t();
+    if (w < 1 || h < 1)
+        return 0L;
+
+    // mipmap chain down to 1x1, 16 bytes per 4x4 block per level:
+    std::vector<unsigned> offsets;
+    unsigned totalSize = 0;
+    unsigned numLevels = 0;
+    for (int lw = w, lh = h; ; lw = osg::maximum(lw/2, 1), lh = osg::maximum(lh/2, 1))
+    {
+        if (numLevels > 0)
+            offsets.push_back(totalSize);
+        totalSize += ((lw + 3) / 4) * ((lh + 3) / 4) * 16;
+        ++numLevels;
+        if (lw == 1 && lh == 1)
+            break;
+    }
+
+    // split the two channels into planes; each level is then built from the last.
+    std::vector<unsigned char> planes[2], next[2];
+    for (unsigned c = 0; c < 2; ++c)
+        planes[c].resize(w*h);
+
+    for (int t = 0; t < h; ++t)
+    {
+        const unsigned char* ptr = input->data(0, t);
+        unsigned char* x = &planes[0][t*w];
+        unsigned char* y = &planes[1][t*w];
+        for (int s = 0; s < w; ++s, ptr += stride)
+        {
+            x[s] = ptr[0];
+            y[s] = ptr[1];
+        }
+    }
+
+    unsigned char* data = new unsigned char[totalSize];
+    unsigned char* out = data;
+
+    for (int lw = w, lh = h; ; )
+    {
+        for (int by = 0; by < lh; by += 4)
+        {
+            for (int bx = 0; bx < lw; bx += 4, out += 16)
+            {
+                encodeBC4Block(&planes[0][0], lw, lh, bx, by, out);
+                encodeBC4Block(&planes[1][0], lw, lh, bx, by, out + 8);
+            }
+        }
+
+        if (lw == 1 && lh == 1)
+            break;
+
+        int nw = osg::maximum(lw/2, 1), nh = osg::maximum(lh/2, 1);
+        for (unsigned c = 0; c < 2; ++c)
+        {
+            next[c].resize(nw*nh);
+            downsamplePlane(&planes[c][0], lw, lh, &next[c][0], nw, nh);
+            planes[c].swap(next[c]);
+        }
+        lw = nw, lh = nh;
+    }
+
+    osg::Image* output = new osg::Image();
+    output->setImage(
+        w, h, 1,
+        GL_COMPRESSED_RED_GREEN_RGTC2_EXT,
+        GL_COMPRESSED_RED_GREEN_RGTC2_EXT,
+        GL_UNSIGNED_BYTE,
+        data,
+        osg::Image::USE_NEW_DELETE);
+    output->setMipmapLevels(offsets);
+
+    return output;
+}
+
 bool
 ImageUtils::isCompressed(const osg::Image *image)
 {
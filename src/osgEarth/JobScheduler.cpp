@@ -0,0 +1,339 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Notify>
+#include <algorithm>
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+#define LC "[JobScheduler] "
+
+//------------------------------------------------------------------------
+
+JobGroup::JobGroup() :
+osg::Referenced( true ),
+_canceled( false )
+{
+    //nop
+}
+
+unsigned
+JobGroup::getNumJobs() const
+{
+    ScopedMutexLock lock(_mutex);
+    return _jobs.size();
+}
+
+void
+JobGroup::wait(unsigned maxJobs)
+{
+    ScopedMutexLock lock(_mutex);
+    while( _jobs.size() > maxJobs )
+        _finished.wait(&_mutex);
+}
+
+void
+JobGroup::cancel()
+{
+    ScopedMutexLock lock(_mutex);
+    _canceled = true;
+    for(std::set<TaskRequest*>::iterator i = _jobs.begin(); i != _jobs.end(); ++i)
+        (*i)->cancel();
+}
+
+bool
+JobGroup::added(TaskRequest* job)
+{
+    ScopedMutexLock lock(_mutex);
+    if ( _canceled )
+        return false;
+    _jobs.insert( job );
+    return true;
+}
+
+void
+JobGroup::finished(TaskRequest* job)
+{
+    ScopedMutexLock lock(_mutex);
+    _jobs.erase( job );
+    _finished.broadcast();
+}
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // orders jobs by priority for the sorted searches on a worker queue.
+    template<typename JOB>
+    struct LessPriority
+    {
+        bool operator()(const JOB& lhs, const JOB& rhs) const { return lhs._priority < rhs._priority; }
+        bool operator()(const JOB& lhs, float rhs) const      { return lhs._priority < rhs; }
+        bool operator()(float lhs, const JOB& rhs) const      { return lhs < rhs._priority; }
+    };
+}
+
+JobScheduler::Worker::Worker(JobScheduler* scheduler, unsigned index) :
+_scheduler( scheduler ),
+_index    ( index ),
+_threadId ( 0u )
+{
+    //nop
+}
+
+void
+JobScheduler::Worker::run()
+{
+    _threadId = Threading::getCurrentThreadId();
+
+    Job job;
+    while( _scheduler->next(_index, job) )
+    {
+        _scheduler->execute( job );
+        job = Job();
+    }
+}
+
+//------------------------------------------------------------------------
+
+JobScheduler::JobScheduler(const std::string& name, unsigned numThreads) :
+osg::Referenced( true ),
+_name          ( name ),
+_pending       ( 0u ),
+_nextWorker    ( 0u ),
+_done          ( false )
+{
+    numThreads = osg::maximum(numThreads, 1u);
+
+    // create all the workers before starting any, so a running worker
+    // never sees a partial list.
+    for(unsigned i=0; i<numThreads; ++i)
+        _workers.push_back( new Worker(this, i) );
+
+    for(unsigned i=0; i<numThreads; ++i)
+        _workers[i]->start();
+
+    OE_INFO << LC << "JobScheduler [" << _name << "] using " << numThreads << " threads" << std::endl;
+}
+
+JobScheduler::~JobScheduler()
+{
+    {
+        ScopedMutexLock lock(_sleepMutex);
+        _done = true;
+        _workAvailable.broadcast();
+    }
+
+    for(unsigned i=0; i<_workers.size(); ++i)
+        _workers[i]->join();
+
+    // anything still queued will never run; complete it so nobody waits on it.
+    for(unsigned i=0; i<_workers.size(); ++i)
+    {
+        JobQueue& queue = _workers[i]->_queue;
+        for(JobQueue::iterator j = queue.begin(); j != queue.end(); ++j)
+            discard( *j );
+        delete _workers[i];
+    }
+    _workers.clear();
+}
+
+int
+JobScheduler::findWorker() const
+{
+    unsigned id = Threading::getCurrentThreadId();
+    for(unsigned i=0; i<_workers.size(); ++i)
+    {
+        if ( _workers[i]->_threadId == id )
+            return (int)i;
+    }
+    return -1;
+}
+
+bool
+JobScheduler::add(TaskRequest* request, JobGroup* group)
+{
+    if ( !request )
+        return false;
+
+    request->setState( TaskRequest::STATE_PENDING );
+
+    // install a progress callback if one isn't already installed
+    if ( !request->getProgressCallback() )
+        request->setProgressCallback( new ProgressCallback() );
+
+    Job job;
+    job._request  = request;
+    job._group    = group;
+    job._priority = request->getPriority();
+
+    if ( group && !group->added(request) )
+    {
+        job._group = 0L;
+        discard( job );
+        return false;
+    }
+
+    if ( _done )
+    {
+        discard( job );
+        return false;
+    }
+
+    // work spawned by a job stays on its worker; anything else is spread out.
+    int index = findWorker();
+    if ( index < 0 )
+        index = (unsigned)(++_nextWorker) % _workers.size();
+
+    // count the job before it becomes visible so a worker that takes it
+    // right away never drives the count below zero.
+    ++_pending;
+
+    Worker* worker = _workers[index];
+    {
+        ScopedMutexLock lock(worker->_mutex);
+        JobQueue::iterator i = std::upper_bound(
+            worker->_queue.begin(), worker->_queue.end(), job._priority, LessPriority<Job>());
+        worker->_queue.insert( i, job );
+    }
+
+    {
+        ScopedMutexLock lock(_sleepMutex);
+        _workAvailable.signal();
+    }
+
+    return true;
+}
+
+bool
+JobScheduler::pop(unsigned index, Job& out)
+{
+    Worker* worker = _workers[index];
+    ScopedMutexLock lock(worker->_mutex);
+    if ( worker->_queue.empty() )
+        return false;
+
+    // newest job of the highest priority, which is most likely still warm.
+    out = worker->_queue.back();
+    worker->_queue.pop_back();
+    --_pending;
+    return true;
+}
+
+bool
+JobScheduler::steal(unsigned index, Job& out)
+{
+    // find the worker holding the highest-priority job.
+    int   victim = -1;
+    float best   = 0.0f;
+    for(unsigned i=1; i<_workers.size(); ++i)
+    {
+        Worker* worker = _workers[(index + i) % _workers.size()];
+        ScopedMutexLock lock(worker->_mutex);
+        if ( !worker->_queue.empty() && (victim < 0 || worker->_queue.back()._priority > best) )
+        {
+            victim = worker->_index;
+            best   = worker->_queue.back()._priority;
+        }
+    }
+
+    if ( victim < 0 )
+        return false;
+
+    Worker* worker = _workers[victim];
+    ScopedMutexLock lock(worker->_mutex);
+
+    // the victim may have drained its queue in the meantime.
+    if ( worker->_queue.empty() )
+        return false;
+
+    // take the oldest job of the victim's highest priority, leaving the
+    // victim the newer ones it is more likely to have data for.
+    JobQueue::iterator i = std::lower_bound(
+        worker->_queue.begin(), worker->_queue.end(), worker->_queue.back()._priority, LessPriority<Job>());
+
+    out = *i;
+    worker->_queue.erase( i );
+    --_pending;
+    return true;
+}
+
+bool
+JobScheduler::next(unsigned index, Job& out)
+{
+    while( true )
+    {
+        if ( _done )
+            return false;
+
+        if ( pop(index, out) || steal(index, out) )
+            return true;
+
+        ScopedMutexLock lock(_sleepMutex);
+
+        // _pending is bumped before a job is queued and the wakeup is sent
+        // under this lock, so we cannot sleep through a new job.
+        if ( !_done && _pending == 0u )
+            _workAvailable.wait(&_sleepMutex);
+    }
+}
+
+void
+JobScheduler::execute(Job& job)
+{
+    TaskRequest* request = job._request.get();
+
+    // discard a completed or canceled request:
+    if ( request->getState() != TaskRequest::STATE_PENDING )
+    {
+        request->cancel();
+    }
+
+    else if ( !request->wasCanceled() && !(job._group.valid() && job._group->isCanceled()) )
+    {
+        if ( request->getProgressCallback() )
+            request->getProgressCallback()->onStarted();
+
+        request->setState( TaskRequest::STATE_IN_PROGRESS );
+        request->run();
+    }
+
+    request->setState( TaskRequest::STATE_COMPLETED );
+
+    // signal the completion of a request.
+    if ( request->getProgressCallback() )
+        request->getProgressCallback()->onCompleted();
+
+    if ( job._group.valid() )
+        job._group->finished( request );
+}
+
+void
+JobScheduler::discard(Job& job)
+{
+    job._request->cancel();
+    job._request->setState( TaskRequest::STATE_COMPLETED );
+
+    if ( job._request->getProgressCallback() )
+        job._request->getProgressCallback()->onCompleted();
+
+    if ( job._group.valid() )
+        job._group->finished( job._request.get() );
+}
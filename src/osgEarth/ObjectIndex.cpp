@@ -59,8 +59,102 @@ namespace
         "} \n";
 }
 
-ObjectIndex::ObjectIndex() :
-_idGen( STARTING_OBJECT_ID )
+namespace
+{
+    // Marks a slot whose entry was removed, so probing continues past it.
+    const ObjectID TOMBSTONE = ~(ObjectID)0;
+
+    // A removed ID goes back into service only after this many other IDs
+    // were removed from the same shard, so a stale ID (say, from a pick
+    // that was in flight) is unlikely to resolve to a different object.
+    const unsigned RECYCLE_DELAY = 1024u;
+
+    const unsigned MIN_CAPACITY = 64u;
+}
+
+int
+ObjectIndex::Shard::find(ObjectID id) const
+{
+    if ( _keys.empty() )
+        return -1;
+
+    // IDs in a shard differ only above the shard bits; hash those.
+    unsigned mask = _keys.size()-1;
+    for(unsigned i = ((id >> SHARD_BITS) * 2654435761u) & mask; ; i = (i+1) & mask)
+    {
+        if ( _keys[i] == id )
+            return (int)i;
+        if ( _keys[i] == OSGEARTH_OBJECTID_EMPTY )
+            return -1;
+    }
+}
+
+void
+ObjectIndex::Shard::insert(ObjectID id, osg::Referenced* object)
+{
+    // keep at least half the slots empty so probes stay short.
+    if ( (_used+1)*2 > _keys.size() )
+    {
+        unsigned capacity = MIN_CAPACITY;
+        while( capacity < (_size+1)*4 )
+            capacity *= 2;
+        rehash( capacity );
+    }
+
+    unsigned mask = _keys.size()-1;
+    unsigned i = ((id >> SHARD_BITS) * 2654435761u) & mask;
+    while( _keys[i] != OSGEARTH_OBJECTID_EMPTY && _keys[i] != TOMBSTONE )
+        i = (i+1) & mask;
+
+    if ( _keys[i] == OSGEARTH_OBJECTID_EMPTY )
+        ++_used;
+    _keys[i] = id;
+    _values[i] = object;
+    ++_size;
+}
+
+bool
+ObjectIndex::Shard::erase(ObjectID id)
+{
+    int i = find(id);
+    if ( i < 0 )
+        return false;
+
+    _keys[i] = TOMBSTONE;
+    _values[i] = 0L;
+    --_size;
+    return true;
+}
+
+void
+ObjectIndex::Shard::rehash(unsigned capacity)
+{
+    std::vector<ObjectID> keys( capacity, OSGEARTH_OBJECTID_EMPTY );
+    std::vector< osg::observer_ptr<osg::Referenced> > values( capacity );
+    keys.swap( _keys );
+    values.swap( _values );
+    _size = 0u;
+    _used = 0u;
+
+    for(unsigned i = 0; i < keys.size(); ++i)
+    {
+        if ( keys[i] != OSGEARTH_OBJECTID_EMPTY && keys[i] != TOMBSTONE )
+        {
+            unsigned mask = capacity-1;
+            unsigned j = ((keys[i] >> SHARD_BITS) * 2654435761u) & mask;
+            while( _keys[j] != OSGEARTH_OBJECTID_EMPTY )
+                j = (j+1) & mask;
+            _keys[j] = keys[i];
+            _values[j] = values[i];
+            ++_size;
+            ++_used;
+        }
+    }
+}
+
+//........................................................................
+
+ObjectIndex::ObjectIndex()
 {
     _attribName     = "oe_index_objectid_attr";
     _attribLocation = osg::Drawable::SECONDARY_COLORS;
@@ -84,7 +178,7 @@ ObjectIndex::loadShaders(VirtualProgram* vp) const
 void
 ObjectIndex::setObjectIDAtrribLocation(int value)
 {
-    if ( _index.size() == 0 )
+    if ( size() == 0 )
     {
         _attribLocation = value;
     } 
@@ -94,52 +188,106 @@ ObjectIndex::setObjectIDAtrribLocation(int value)
     }
 }
 
+unsigned
+ObjectIndex::size() const
+{
+    unsigned total = 0u;
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedReadLock lock( _shards[s]._mutex );
+        total += _shards[s]._size;
+    }
+    return total;
+}
+
+ObjectIndex::Shard&
+ObjectIndex::nextShard()
+{
+    // spread new objects across the shards so concurrent inserts
+    // rarely contend for the same lock.
+    unsigned n = ++_nextShard;
+    return _shards[n % NUM_SHARDS];
+}
+
 ObjectID
 ObjectIndex::insert(osg::Referenced* object)
 {
-    Threading::ScopedMutexLock excl( _mutex );
-    return insertImpl( object );
+    Shard& shard = nextShard();
+    Threading::ScopedWriteLock lock( shard._mutex );
+    return insertImpl( shard, object );
 }
 
 ObjectID
-ObjectIndex::insertImpl(osg::Referenced* object)
+ObjectIndex::insertImpl(Shard& shard, osg::Referenced* object)
 {
-    // internal: assume mutex is locked
-    ObjectID id = ++_idGen;
-    _index[id] = object;
-    OE_DEBUG << LC << "Insert " << id << "; size = " << _index.size() << "\n";
+    // internal: assume the shard is write-locked
+    ObjectID id;
+    if ( shard._free.size() > RECYCLE_DELAY )
+    {
+        id = shard._free.front();
+        shard._free.pop_front();
+    }
+    else
+    {
+        // the first ordinal is 1, so new IDs never fall below STARTING_OBJECT_ID.
+        id = (shard._nextID++ << SHARD_BITS) | (ObjectID)(&shard - _shards);
+    }
+
+    shard.insert( id, object );
+    OE_DEBUG << LC << "Insert " << id << "; shard size = " << shard._size << "\n";
     return id;
 }
 
-osg::Referenced*
+osg::ref_ptr<osg::Referenced>
 ObjectIndex::getImpl(ObjectID id) const
 {
-    // assume the mutex is locked
-    IndexMap::const_iterator i = _index.find(id);
-    return i != _index.end() ? i->second.get() : 0L;
+    const Shard& shard = _shards[id % NUM_SHARDS];
+    Threading::ScopedReadLock lock( shard._mutex );
+
+    osg::ref_ptr<osg::Referenced> object;
+    int i = shard.find( id );
+    if ( i >= 0 )
+        shard._values[i].lock( object );
+    return object;
 }
 
 void
 ObjectIndex::remove(ObjectID id)
 {
-    Threading::ScopedMutexLock excl(_mutex);
-    removeImpl(id);
+    Shard& shard = _shards[id % NUM_SHARDS];
+    Threading::ScopedWriteLock lock( shard._mutex );
+    if ( shard.erase(id) )
+        shard._free.push_back( id );
+    OE_DEBUG << LC << "Remove " << id << "; shard size = " << shard._size << "\n";
 }
 
 void
-ObjectIndex::removeImpl(ObjectID id)
+ObjectIndex::remove(const std::vector<ObjectID>& ids)
 {
-    // internal - assume mutex is locked
-    _index.erase( id );
-    OE_DEBUG << "Remove " << id << "; size = " << _index.size() << "\n";
+    // group the IDs by shard so each shard is locked once.
+    std::vector<ObjectID> byShard[NUM_SHARDS];
+    for(std::vector<ObjectID>::const_iterator i = ids.begin(); i != ids.end(); ++i)
+        byShard[*i % NUM_SHARDS].push_back( *i );
 
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        if ( byShard[s].empty() )
+            continue;
+
+        Shard& shard = _shards[s];
+        Threading::ScopedWriteLock lock( shard._mutex );
+        for(std::vector<ObjectID>::const_iterator i = byShard[s].begin(); i != byShard[s].end(); ++i)
+        {
+            if ( shard.erase(*i) )
+                shard._free.push_back( *i );
+        }
+    }
 }
 
 ObjectID
 ObjectIndex::tagDrawable(osg::Drawable* drawable, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagDrawable(drawable, oid);
     return oid;
 }
@@ -190,8 +338,7 @@ namespace
 ObjectID
 ObjectIndex::tagAllDrawables(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagAllDrawables(node, oid);
     return oid;
 }
@@ -209,8 +356,7 @@ ObjectIndex::tagAllDrawables(osg::Node* node, ObjectID id) const
 ObjectID
 ObjectIndex::tagNode(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagNode(node, oid);
     return oid;
 }
@@ -272,6 +418,10 @@ ObjectIndex::updateObjectIDs(osg::Drawable* drawable,
     ObjectIDArray* oids = dynamic_cast<ObjectIDArray*>(geometry->getVertexAttribArray(_attribLocation));
     if ( !oids ) return false;
     if (oids->empty()) return false;
+
+    // index all the new objects under one lock.
+    Shard& shard = nextShard();
+    Threading::ScopedWriteLock lock( shard._mutex );
     
     for (ObjectIDArray::iterator i = oids->begin(); i != oids->end(); ++i)
     {
@@ -281,7 +431,7 @@ ObjectIndex::updateObjectIDs(osg::Drawable* drawable,
             newoid = k->second;
         }
         else {
-            newoid = insert(object);
+            newoid = insertImpl(shard, object);
             oldNewMap[*i] = newoid;
         }
         *i = newoid;
@@ -21,6 +21,7 @@
 #include <osgEarth/Cube>
 #include <osgEarth/ShaderFactory>
 #include <osgEarth/TaskService>
+#include <osgEarth/JobScheduler>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/ObjectIndex>
 
@@ -507,6 +508,26 @@ Registry::initCapabilities()
         _caps = new Capabilities();
 }
 
+JobScheduler*
+Registry::getJobScheduler()
+{
+    if ( !_jobScheduler.valid() )
+    {
+        ScopedLock<Mutex> lock( _regMutex );
+        if ( !_jobScheduler.valid() )
+        {
+            unsigned numThreads = osg::maximum(OpenThreads::GetNumberOfProcessors(), 2);
+
+            const char* value = ::getenv(OSGEARTH_ENV_NUM_JOB_THREADS);
+            if ( value && as<unsigned>(std::string(value), 0u) > 0u )
+                numThreads = as<unsigned>(std::string(value), 0u);
+
+            _jobScheduler = new JobScheduler( "osgEarth.Registry", numThreads );
+        }
+    }
+    return _jobScheduler.get();
+}
+
 ShaderFactory*
 Registry::getShaderFactory() const
 {
@@ -23,6 +23,7 @@
 #include <osgEarth/Utils>
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/Extension>
+#include <osgEarth/Metrics>
 #include <osgEarthAnnotation/BboxDrawable>
 #include <osgText/Text>
 
@@ -130,6 +131,130 @@ namespace
 
     typedef std::pair<const osg::Node*, osg::BoundingBox> RenderLeafBox;
 
+    // Uniform grid over the window that indexes the boxes accepted so far, so
+    // that a new box is only tested against the boxes near it instead of all
+    // of them. One lives in each PerCamInfo and is reused every frame.
+    struct OccupancyGrid
+    {
+        OccupancyGrid() : _cols(0), _rows(0), _query(0u) { }
+
+        // Empties the grid and sizes it to cover a window.
+        void reset(float width, float height)
+        {
+            int cols = osg::maximum((int)ceil(width / CELL_SIZE), 1);
+            int rows = osg::maximum((int)ceil(height / CELL_SIZE), 1);
+
+            if ( cols != _cols || rows != _rows )
+            {
+                _cells.clear();
+                _cells.resize( cols*rows );
+                _cols = cols;
+                _rows = rows;
+            }
+            else
+            {
+                for(unsigned i=0; i<_touched.size(); ++i)
+                    _cells[_touched[i]].clear();
+            }
+
+            _touched.clear();
+            _boxes.clear();
+            _tested.clear();
+        }
+
+        // Whether a box overlaps an accepted box with a different parent.
+        // (Boxes of the same drawable parent are allowed to overlap.)
+        bool overlaps(const osg::BoundingBox& box, const osg::Node* parent)
+        {
+            // stamp each box as it's tested, since a box spans several cells.
+            if ( ++_query == 0u )
+            {
+                std::fill( _tested.begin(), _tested.end(), 0u );
+                _query = 1u;
+            }
+
+            int c0, r0, c1, r1;
+            getCells( box, c0, r0, c1, r1 );
+
+            for(int r=r0; r<=r1; ++r)
+            {
+                for(int c=c0; c<=c1; ++c)
+                {
+                    const std::vector<unsigned>& cell = _cells[r*_cols + c];
+                    for(unsigned i=0; i<cell.size(); ++i)
+                    {
+                        unsigned b = cell[i];
+                        if ( _tested[b] == _query )
+                            continue;
+                        _tested[b] = _query;
+
+                        const RenderLeafBox& used = _boxes[b];
+
+                        // only need a 2D test since we're in clip space
+                        bool isClear =
+                            box.xMin() > used.second.xMax() ||
+                            box.xMax() < used.second.xMin() ||
+                            box.yMin() > used.second.yMax() ||
+                            box.yMax() < used.second.yMin();
+
+                        if ( !isClear && parent != used.first )
+                            return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        // Adds an accepted box.
+        void insert(const osg::Node* parent, const osg::BoundingBox& box)
+        {
+            unsigned b = _boxes.size();
+            _boxes.push_back( RenderLeafBox(parent, box) );
+            _tested.push_back( 0u );
+
+            int c0, r0, c1, r1;
+            getCells( box, c0, r0, c1, r1 );
+
+            for(int r=r0; r<=r1; ++r)
+            {
+                for(int c=c0; c<=c1; ++c)
+                {
+                    unsigned index = r*_cols + c;
+                    if ( _cells[index].empty() )
+                        _touched.push_back( index );
+                    _cells[index].push_back( b );
+                }
+            }
+        }
+
+        // Number of accepted boxes.
+        unsigned size() const { return _boxes.size(); }
+
+    private:
+        // Range of cells a box covers. Boxes that are partly or wholly off the
+        // window are clamped to the border cells, which keeps overlapping boxes
+        // in a common cell.
+        void getCells(const osg::BoundingBox& box, int& c0, int& r0, int& c1, int& r1) const
+        {
+            c0 = osg::clampBetween( (int)floor(box.xMin() / CELL_SIZE), 0, _cols-1 );
+            c1 = osg::clampBetween( (int)floor(box.xMax() / CELL_SIZE), 0, _cols-1 );
+            r0 = osg::clampBetween( (int)floor(box.yMin() / CELL_SIZE), 0, _rows-1 );
+            r1 = osg::clampBetween( (int)floor(box.yMax() / CELL_SIZE), 0, _rows-1 );
+        }
+
+        static const float CELL_SIZE;
+
+        int                                _cols, _rows;
+        std::vector< std::vector<unsigned> > _cells;    // box indices, per cell
+        std::vector<unsigned>              _touched;  // cells that are not empty
+        std::vector<RenderLeafBox>         _boxes;    // accepted boxes
+        std::vector<unsigned>              _tested;   // per box, the last query that tested it
+        unsigned                           _query;
+    };
+
+    // Size of a grid cell in pixels, about the height of a couple of labels.
+    const float OccupancyGrid::CELL_SIZE = 64.0f;
+
     // Data structure stored one-per-View.
     struct PerCamInfo
     {
@@ -141,7 +266,7 @@ namespace
         // re-usable structures (to avoid unnecessary re-allocation)
         osgUtil::RenderBin::RenderLeafList _passed;
         osgUtil::RenderBin::RenderLeafList _failed;
-        std::vector<RenderLeafBox>         _used;
+        OccupancyGrid                      _used;
 
         // time stamp of the previous pass, for calculating animation speed
         osg::Timer_t _lastTimeStamp;
@@ -258,6 +383,8 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
     {
         const ScreenSpaceLayoutOptions& options = _context->_options;
 
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
         osgUtil::RenderBin::RenderLeafList& leaves = bin->getRenderLeafList();
 
         bin->copyLeavesFromStateGraphListToRenderLeafList();
@@ -305,12 +432,14 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
         // Reset the local re-usable containers
         local._passed.clear();          // drawables that pass occlusion test
         local._failed.clear();          // drawables that fail occlusion test
-        local._used.clear();            // list of occupied bounding boxes in screen space
+
+        unsigned numLeaves = leaves.size();
 
         // compute a window matrix so we can do window-space culling. If this is an RTT camera
         // with a reference camera attachment, we actually want to declutter in the window-space
         // of the reference camera. (e.g., for picking).
         const osg::Viewport* vp = cam->getViewport();
+        osg::Vec2f layoutSize( vp->width(), vp->height() );
 
         osg::Matrix windowMatrix = vp->computeWindowMatrix();
 
@@ -331,8 +460,12 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
             refCamScale.set( vp->width() / refVP->width(), vp->height() / refVP->height(), 1.0 );
             refCamScaleMat.makeScale( refCamScale );
             refWindowMatrix = refVP->computeWindowMatrix();
+            layoutSize.set( refVP->width(), refVP->height() );
         }
 
+        // occupied bounding boxes in screen space
+        local._used.reset( layoutSize.x(), layoutSize.y() );
+
         // Track the parent nodes of drawables that are obscured (and culled). Drawables
         // with the same parent node (typically a Geode) are considered to be grouped and
         // will be culled as a group.
@@ -478,24 +611,11 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 else
                 {
                     // weed out any drawables that are obscured by closer drawables.
-                    // TODO: think about a more efficient algorithm - right now we are just using
-                    // brute force to compare all bbox's
-                    for( std::vector<RenderLeafBox>::const_iterator j = local._used.begin(); j != local._used.end(); ++j )
+                    // if there's an overlap (and the conflict isn't from the same drawable
+                    // parent, which is acceptable), then the leaf is culled.
+                    if ( local._used.overlaps(box, drawableParent) )
                     {
-                        // only need a 2D test since we're in clip space
-                        bool isClear =
-                            box.xMin() > j->second.xMax() ||
-                            box.xMax() < j->second.xMin() ||
-                            box.yMin() > j->second.yMax() ||
-                            box.yMax() < j->second.yMin();
-
-                        // if there's an overlap (and the conflict isn't from the same drawable
-                        // parent, which is acceptable), then the leaf is culled.
-                        if ( !isClear && drawableParent != j->first )
-                        {
-                            visible = false;
-                            break;
-                        }
+                        visible = false;
                     }
                 }
             }
@@ -505,7 +625,7 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 // passed the test, so add the leaf's bbox to the "used" list, and add the leaf
                 // to the final draw list.
                 if (drawableParent)
-                    local._used.push_back( std::make_pair(drawableParent, box) );
+                    local._used.insert( drawableParent, box );
 
                 local._passed.push_back( leaf );
             }
@@ -648,6 +768,16 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 info._visible = false;
             }
         }
+
+        if ( Metrics::enabled() )
+        {
+            double ms = 1000.0 * osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+            Metrics::counter(
+                cam->getName().empty() ? std::string("Declutter") : "Declutter " + cam->getName(),
+                "Declutter ms", ms,
+                "Leaves", (double)numLeaves,
+                "Occupied", (double)local._used.size());
+        }
     }
 };
 
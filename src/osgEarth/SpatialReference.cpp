@@ -21,6 +21,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Cube>
 #include <osgEarth/LocalTangentPlane>
+#include <osg/observer_ptr>
 #include <ogr_spatialref.h>
 #include <cpl_conv.h>
 
@@ -390,6 +391,41 @@ _is_geocentric ( false )
     //nop
 }
 
+struct SpatialReference::ReleaseTransformHandles : public Threading::ThreadExitCallback
+{
+    ReleaseTransformHandles(const SpatialReference* srs) : _srs(srs) { }
+
+    void onThreadExit(unsigned threadId)
+    {
+        osg::ref_ptr<const SpatialReference> srs;
+        if (_srs.lock(srs))
+            srs->releaseTransformHandles(threadId);
+    }
+
+    osg::observer_ptr<const SpatialReference> _srs;
+};
+
+void
+SpatialReference::releaseTransformHandles(unsigned threadId) const
+{
+    std::vector<void*> handles;
+    {
+        Threading::ScopedMutexLock lock(_transformHandleCacheMutex);
+        TransformHandleCache::iterator itr = _transformHandleCache.lower_bound(TransformHandleKey(threadId, std::string()));
+        while (itr != _transformHandleCache.end() && itr->first.first == threadId)
+        {
+            if (itr->second)
+                handles.push_back(itr->second);
+            _transformHandleCache.erase(itr++);
+        }
+    }
+
+    for (unsigned i = 0; i < handles.size(); ++i)
+    {
+        OCTDestroyCoordinateTransformation(handles[i]);
+    }
+}
+
 SpatialReference::~SpatialReference()
 {
     if ( _handle )
@@ -1092,25 +1128,46 @@ SpatialReference::transformXYPointArrays(double*  x,
                                          unsigned count,
                                          const SpatialReference* out_srs) const
 {  
-    // Transform the X and Y values inside an exclusive GDAL/OGR lock
-    GDAL_SCOPED_LOCK;
-
     //OE_INFO << LC << "Attempt transfrom from \n"
     //    << "    " << getHorizInitString() << "\n"
     //    << " -> " << out_srs->getHorizInitString() << std::endl;
 
     void* xform_handle = NULL;
-    TransformHandleCache::const_iterator itr = _transformHandleCache.find(out_srs->getWKT());
-    if (itr != _transformHandleCache.end())
+    TransformHandleKey key(Threading::getCurrentThreadId(), out_srs->getWKT());
+    bool found = false;
     {
-        //OE_DEBUG << LC << "using cached transform handle" << std::endl;
-        xform_handle = itr->second;
+        Threading::ScopedMutexLock lock(_transformHandleCacheMutex);
+        TransformHandleCache::const_iterator itr = _transformHandleCache.find(key);
+        if (itr != _transformHandleCache.end())
+        {
+            //OE_DEBUG << LC << "using cached transform handle" << std::endl;
+            xform_handle = itr->second;
+            found = true;
+        }
     }
-    else
+
+    if (!found)
     {
         OE_DEBUG << LC << "allocating new OCT Transform" << std::endl;
-        xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
-        const_cast<SpatialReference*>(this)->_transformHandleCache[out_srs->getWKT()] = xform_handle;
+        {
+            GDAL_SCOPED_LOCK;
+            xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
+        }
+
+        bool firstForThread;
+        {
+            Threading::ScopedMutexLock lock(_transformHandleCacheMutex);
+            TransformHandleCache::const_iterator itr = _transformHandleCache.lower_bound(TransformHandleKey(key.first, std::string()));
+            firstForThread = (itr == _transformHandleCache.end() || itr->first.first != key.first);
+            _transformHandleCache[key] = xform_handle;
+        }
+
+        // release this thread's handles when it exits, so the cache doesn't
+        // grow with every thread that ever transformed a point.
+        if (firstForThread)
+        {
+            Threading::addThreadExitCallback(new ReleaseTransformHandles(this));
+        }
     }
 
     if ( !xform_handle )
@@ -1128,6 +1185,7 @@ SpatialReference::transformXYPointArrays(double*  x,
         return false;
     }
 
+    // The handle belongs to this thread, so no global lock is necessary.
     return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
 }
 
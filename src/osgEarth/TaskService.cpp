@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/TaskService>
+#include <osgEarth/JobScheduler>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -285,15 +286,35 @@ TaskService::TaskService( const std::string& name, int numThreads, unsigned int
 osg::Referenced( true ),
 _lastRemoveFinishedThreadsStamp(0),
 _name(name),
-_numThreads( 0 )
+_numThreads( 0 ),
+_maxSize( maxSize )
 {
     _queue = new TaskRequestQueue( maxSize );
     setNumThreads( numThreads );
 }
 
+TaskService::TaskService( const std::string& name, JobScheduler* scheduler, unsigned int maxSize ):
+osg::Referenced( true ),
+_lastRemoveFinishedThreadsStamp(0),
+_name(name),
+_numThreads( scheduler ? scheduler->getNumThreads() : 0 ),
+_scheduler( scheduler ),
+_maxSize( maxSize )
+{
+    _queue = new TaskRequestQueue( maxSize );
+    _jobs = new JobGroup();
+
+    // without a scheduler, fall back on a thread of our own.
+    if ( !_scheduler.valid() )
+        setNumThreads( 1 );
+}
+
 unsigned int
 TaskService::getNumRequests() const
 {
+    if ( _scheduler.valid() )
+        return _jobs->getNumJobs();
+
     return _queue->getNumRequests();
 }
 
@@ -301,11 +322,31 @@ void
 TaskService::add( TaskRequest* request )
 {   
     //OE_INFO << LC << "TS [" << _name << "] adding request [" << request->getName() << "]" << std::endl;
-    _queue->add( request );
+    if ( _scheduler.valid() )
+    {
+        // the scheduler's threads are shared, so there's nothing to shut down.
+        if ( dynamic_cast<PoisonPill*>(request) )
+            return;
+
+        if ( _maxSize > 0 )
+            _jobs->wait( _maxSize-1 );
+
+        _scheduler->add( request, _jobs.get() );
+    }
+    else
+    {
+        _queue->add( request );
+    }
 }
 
 void TaskService::waitforThreadsToComplete()
 {        
+    if ( _scheduler.valid() )
+    {
+        _jobs->wait();
+        return;
+    }
+
     for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
     {
         (*i)->join();
@@ -314,6 +355,9 @@ void TaskService::waitforThreadsToComplete()
 
 bool TaskService::areThreadsRunning()
 {
+    if ( _scheduler.valid() )
+        return _jobs->getNumJobs() > 0;
+
     for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
     {                
         if ((*i)->isRunning())
@@ -327,6 +371,9 @@ bool TaskService::areThreadsRunning()
 
 TaskService::~TaskService()
 {
+    if ( _jobs.valid() )
+        _jobs->cancel();
+
     _queue->setDone();
 
     for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
@@ -368,6 +415,10 @@ TaskService::getNumThreads() const
 void
 TaskService::setNumThreads(int numThreads )
 {
+    // the size of a shared scheduler is not ours to change.
+    if ( _scheduler.valid() )
+        return;
+
     if ( _numThreads != numThreads )
     {
         _numThreads = osg::maximum(1, numThreads);
@@ -445,6 +496,13 @@ TaskService::removeFinishedThreads()
 void
 TaskService::cancelAll()
 {
+    if ( _scheduler.valid() )
+    {
+        _jobs->cancel();
+        OE_INFO << LC << "Cancelled all requests in TaskService [" << _name << "]" << std::endl;
+        return;
+    }
+
     if (_numThreads > 0)
     {
         _numThreads = 0;
@@ -463,6 +521,18 @@ _targetNumThreads( numThreads )
     //nop
 }
 
+TaskServiceManager::~TaskServiceManager()
+{
+    //nop
+}
+
+void
+TaskServiceManager::setJobScheduler( JobScheduler* scheduler )
+{
+    ScopedLock<Mutex> lock( _taskServiceMgrMutex );
+    _scheduler = scheduler;
+}
+
 void
 TaskServiceManager::setNumThreads( int numThreads )
 {
@@ -486,7 +556,9 @@ TaskServiceManager::add( UID uid, float weight )
     }
     else
     {
-        TaskService* newService = new TaskService( "", 1 );
+        TaskService* newService = _scheduler.valid() ?
+            new TaskService( "", _scheduler.get() ) :
+            new TaskService( "", 1 );
         _services[uid] = WeightedTaskService( newService, weight );
         reallocate( _targetNumThreads );
         return newService;
@@ -557,14 +629,19 @@ void
 TaskServiceManager::reallocate( int numThreads )
 {
     // first, total up all the weights.
+    // (services on a shared scheduler don't take part.)
     float totalWeight = 0.0f;
     for( TaskServiceMap::const_iterator i = _services.begin(); i != _services.end(); ++i )
-        totalWeight += i->second.second;
+        if ( !i->second.first->getJobScheduler() )
+            totalWeight += i->second.second;
 
     // next divide the total thread pool size by the relative weight of each service.
     _numThreads = 0;
     for( TaskServiceMap::const_iterator i = _services.begin(); i != _services.end(); ++i )
     {
+        if ( i->second.first->getJobScheduler() )
+            continue;
+
         int threads = osg::maximum( 1, (int)( (float)_targetNumThreads * (i->second.second / totalWeight) ) );
         i->second.first->setNumThreads( threads );
         _numThreads += threads;
@@ -464,15 +464,27 @@ TerrainTileModelFactory::createNormalTexture(osg::Image* image, bool compress) c
         if (image->getPixelFormat() != GL_COMPRESSED_RED_GREEN_RGTC2_EXT)
         {
             METRIC_SCOPED("normalmap compression");
-            // See if we have a CPU compressor generator:
-            osgDB::ImageProcessor* ip = osgDB::Registry::instance()->getImageProcessor();
-            if (ip)
+
+            // Encode X and Y straight from the normal map; the shader rebuilds Z.
+            // This makes a new image, so the normal map itself (which may live
+            // in the heightfield cache) stays uncompressed.
+            osg::Image* encoded = ImageUtils::encodeRGTC2(image);
+            if (encoded)
             {
-                ip->compress(*image, osg::Texture::USE_RGTC2_COMPRESSION, true, true, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::NORMAL);
+                image = encoded;
             }
             else
             {
-                OE_NOTICE << LC << "Failed to get image processor, cannot compress normal map" << std::endl;
+                // See if we have a CPU compressor generator:
+                osgDB::ImageProcessor* ip = osgDB::Registry::instance()->getImageProcessor();
+                if (ip)
+                {
+                    ip->compress(*image, osg::Texture::USE_RGTC2_COMPRESSION, true, true, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::NORMAL);
+                }
+                else
+                {
+                    OE_NOTICE << LC << "Failed to get image processor, cannot compress normal map" << std::endl;
+                }
             }
         }
     }    
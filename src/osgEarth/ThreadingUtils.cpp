@@ -18,11 +18,14 @@
  */
 #include <osgEarth/ThreadingUtils>
 
+#include <vector>
+
 #ifdef _WIN32
-    extern "C" unsigned long __stdcall GetCurrentThreadId();
+#   include <windows.h>
 #elif defined(__APPLE__) || defined(__LINUX__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__) || defined(__ANDROID__)
 #   include <unistd.h>
 #   include <sys/syscall.h>
+#   include <pthread.h>
 #else
 #   include <pthread.h>
 #endif
@@ -56,6 +59,79 @@ unsigned osgEarth::Threading::getCurrentThreadId()
 
 //...................................................................
 
+namespace
+{
+    typedef std::vector< osg::ref_ptr<ThreadExitCallback> > ThreadExitCallbacks;
+
+    // runs on the exiting thread with the callbacks it registered.
+    void runThreadExitCallbacks(void* data)
+    {
+        ThreadExitCallbacks* callbacks = static_cast<ThreadExitCallbacks*>(data);
+        if (callbacks)
+        {
+            unsigned id = getCurrentThreadId();
+            for (unsigned i = 0; i < callbacks->size(); ++i)
+                (*callbacks)[i]->onThreadExit(id);
+            delete callbacks;
+        }
+    }
+
+#ifdef _WIN32
+    // fiber-local storage, unlike TLS, calls back when a thread exits.
+    void WINAPI runThreadExitCallbacksFLS(void* data)
+    {
+        runThreadExitCallbacks(data);
+    }
+
+    DWORD s_threadExitKey = FLS_OUT_OF_INDEXES;
+    Mutex s_threadExitKeyMutex;
+#else
+    pthread_key_t  s_threadExitKey;
+    pthread_once_t s_threadExitKeyOnce = PTHREAD_ONCE_INIT;
+
+    void createThreadExitKey()
+    {
+        pthread_key_create(&s_threadExitKey, &runThreadExitCallbacks);
+    }
+#endif
+}
+
+void osgEarth::Threading::addThreadExitCallback(ThreadExitCallback* callback)
+{
+    if (!callback)
+        return;
+
+#ifdef _WIN32
+    {
+        ScopedMutexLock lock(s_threadExitKeyMutex);
+        if (s_threadExitKey == FLS_OUT_OF_INDEXES)
+            s_threadExitKey = ::FlsAlloc(&runThreadExitCallbacksFLS);
+    }
+    if (s_threadExitKey == FLS_OUT_OF_INDEXES)
+        return;
+
+    ThreadExitCallbacks* callbacks = static_cast<ThreadExitCallbacks*>(::FlsGetValue(s_threadExitKey));
+    if (!callbacks)
+    {
+        callbacks = new ThreadExitCallbacks();
+        ::FlsSetValue(s_threadExitKey, callbacks);
+    }
+#else
+    pthread_once(&s_threadExitKeyOnce, &createThreadExitKey);
+
+    ThreadExitCallbacks* callbacks = static_cast<ThreadExitCallbacks*>(pthread_getspecific(s_threadExitKey));
+    if (!callbacks)
+    {
+        callbacks = new ThreadExitCallbacks();
+        pthread_setspecific(s_threadExitKey, callbacks);
+    }
+#endif
+
+    callbacks->push_back(callback);
+}
+
+//...................................................................
+
 Event::Event() :
 _set(false)
 {
@@ -27,43 +27,108 @@ TileKey TileKey::INVALID( 0, 0, 0, 0L );
 
 //------------------------------------------------------------------------
 
-TileKey::TileKey(unsigned int lod, unsigned int tile_x, unsigned int tile_y, const Profile* profile)
+struct TileKey::Derived : public osg::Referenced
+{
+    GeoExtent   extent;
+    std::string str;
+};
+
+TileKey::TileKey(unsigned int lod, unsigned int tile_x, unsigned int tile_y, const Profile* profile) :
+_id(0),
+_profile(profile),
+_derived(0L)
 {
-    _x = tile_x;
-    _y = tile_y;
-    _lod = lod;
-    _profile = profile;
-
-    double width, height;
     if ( _profile.valid() )
     {
-        _profile->getTileDimensions(lod, width, height);
+        if (lod > MAX_LOD || tile_x >= (1u << X_BITS) || tile_y >= (1u << Y_BITS))
+        {
+            OE_WARN << "[TileKey] Key " << lod << "/" << tile_x << "/" << tile_y
+                << " is out of the representable range" << std::endl;
+            _profile = 0L;
+        }
+        else
+        {
+            _id = pack(lod, tile_x, tile_y);
+        }
+    }
+}
+
+TileKey::~TileKey()
+{
+    osg::Referenced* derived = static_cast<osg::Referenced*>(_derived.get());
+    if ( derived )
+        derived->unref();
+}
+
+TileKey&
+TileKey::operator = (const TileKey& rhs)
+{
+    if ( this != &rhs )
+    {
+        osg::Referenced* derived = rhs.getDerivedRef();
+        osg::Referenced* old;
+        do {
+            old = static_cast<osg::Referenced*>(_derived.get());
+        } while ( !_derived.assign(derived, old) );
+        if ( old )
+            old->unref();
+
+        _id = rhs._id;
+        _profile = rhs._profile;
+    }
+    return *this;
+}
+
+const TileKey::Derived*
+TileKey::getDerived() const
+{
+    osg::Referenced* derived = static_cast<osg::Referenced*>(_derived.get());
+    if ( !derived )
+    {
+        Derived* d = new Derived();
+
+        double width, height;
+        _profile->getTileDimensions(getLOD(), width, height);
 
-        double xmin = _profile->getExtent().xMin() + (width * (double)_x);
-        double ymax = _profile->getExtent().yMax() - (height * (double)_y);
+        double xmin = _profile->getExtent().xMin() + (width * (double)getTileX());
+        double ymax = _profile->getExtent().yMax() - (height * (double)getTileY());
         double xmax = xmin + width;
         double ymin = ymax - height;
 
-        _extent = GeoExtent( _profile->getSRS(), xmin, ymin, xmax, ymax );
+        d->extent = GeoExtent( _profile->getSRS(), xmin, ymin, xmax, ymax );
+        d->str = Stringify() << getLOD() << "/" << getTileX() << "/" << getTileY();
+        d->ref();
 
-        _key = Stringify() << _lod << "/" << _x << "/" << _y;
-    }
-    else
-    {
-        _extent = GeoExtent::INVALID;
-        _key = "invalid";
+        // another thread may get there first; keep its copy.
+        if ( _derived.assign(static_cast<osg::Referenced*>(d), 0L) )
+        {
+            derived = d;
+        }
+        else
+        {
+            d->unref();
+            derived = static_cast<osg::Referenced*>(_derived.get());
+        }
     }
+    return static_cast<const Derived*>(derived);
+}
+
+std::string
+TileKey::str() const
+{
+    if ( !valid() )
+        return "invalid";
+
+    return getDerived()->str;
 }
 
-TileKey::TileKey( const TileKey& rhs ) :
-_key( rhs._key ),
-_lod(rhs._lod),
-_x(rhs._x),
-_y(rhs._y),
-_profile( rhs._profile.get() ),
-_extent( rhs._extent )
+GeoExtent
+TileKey::getExtent() const
 {
-    //NOP
+    if ( !valid() )
+        return GeoExtent::INVALID;
+
+    return getDerived()->extent;
 }
 
 const Profile*
@@ -76,17 +141,17 @@ void
 TileKey::getTileXY(unsigned int& out_tile_x,
                    unsigned int& out_tile_y) const
 {
-    out_tile_x = _x;
-    out_tile_y = _y;
+    out_tile_x = getTileX();
+    out_tile_y = getTileY();
 }
 
 unsigned
 TileKey::getQuadrant() const
 {
-    if ( _lod == 0 )
+    if ( getLOD() == 0 )
         return 0;
-    bool xeven = (_x & 1) == 0;
-    bool yeven = (_y & 1) == 0;
+    bool xeven = (getTileX() & 1) == 0;
+    bool yeven = (getTileY() & 1) == 0;
     return 
         xeven && yeven ? 0 :
         xeven          ? 2 :
@@ -100,8 +165,8 @@ TileKey::getPixelExtents(unsigned int& xmin,
                          unsigned int& ymax,
                          const unsigned int &tile_size) const
 {
-    xmin = _x * tile_size;
-    ymin = _y * tile_size;
+    xmin = getTileX() * tile_size;
+    ymin = getTileY() * tile_size;
     xmax = xmin + tile_size;
     ymax = ymin + tile_size; 
 }
@@ -109,9 +174,9 @@ TileKey::getPixelExtents(unsigned int& xmin,
 TileKey
 TileKey::createChildKey( unsigned int quadrant ) const
 {
-    unsigned int lod = _lod + 1;
-    unsigned int x = _x * 2;
-    unsigned int y = _y * 2;
+    unsigned int lod = getLOD() + 1;
+    unsigned int x = getTileX() * 2;
+    unsigned int y = getTileY() * 2;
 
     if (quadrant == 1)
     {
@@ -133,21 +198,22 @@ TileKey::createChildKey( unsigned int quadrant ) const
 TileKey
 TileKey::createParentKey() const
 {
-    if (_lod == 0) return TileKey::INVALID;
+    if (getLOD() == 0) return TileKey::INVALID;
 
-    unsigned int lod = _lod - 1;
-    unsigned int x = _x / 2;
-    unsigned int y = _y / 2;
+    unsigned int lod = getLOD() - 1;
+    unsigned int x = getTileX() / 2;
+    unsigned int y = getTileY() / 2;
     return TileKey( lod, x, y, _profile.get());
 }
 
 TileKey
 TileKey::createAncestorKey( int ancestorLod ) const
 {
-    if ( ancestorLod > (int)_lod ) return TileKey::INVALID;
+    int lod = (int)getLOD();
+    if ( ancestorLod > lod ) return TileKey::INVALID;
 
-    unsigned int x = _x, y = _y;
-    for( int i=_lod; i > ancestorLod; i-- )
+    unsigned int x = getTileX(), y = getTileY();
+    for( int i=lod; i > ancestorLod; i-- )
     {
         x /= 2;
         y /= 2;
@@ -159,15 +225,16 @@ TileKey
 TileKey::createNeighborKey( int xoffset, int yoffset ) const
 {
     unsigned tx, ty;
-    getProfile()->getNumTiles( _lod, tx, ty );
+    unsigned lod = getLOD();
+    getProfile()->getNumTiles( lod, tx, ty );
 
-    int sx = (int)_x + xoffset;
+    int sx = (int)getTileX() + xoffset;
     unsigned x =
         sx < 0        ? (unsigned)((int)tx + sx) :
         sx >= (int)tx ? (unsigned)sx - tx :
         (unsigned)sx;
 
-    int sy = (int)_y + yoffset;
+    int sy = (int)getTileY() + yoffset;
     unsigned y =
         sy < 0        ? (unsigned)((int)ty + sy) :
         sy >= (int)ty ? (unsigned)sy - ty :
@@ -175,7 +242,7 @@ TileKey::createNeighborKey( int xoffset, int yoffset ) const
 
     //OE_NOTICE << "Returning neighbor " << x << ", " << y << " for tile " << str() << " offset=" << xoffset << ", " << yoffset << std::endl;
 
-    return TileKey( _lod, x, y, _profile.get() );
+    return TileKey( lod, x, y, _profile.get() );
 }
 
 namespace
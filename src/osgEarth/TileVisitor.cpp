@@ -240,7 +240,7 @@ TileVisitor( handler ),
 
 unsigned int MultithreadedTileVisitor::getNumThreads() const
 {
-    return _numThreads; 
+    return _scheduler.valid() ? _scheduler->getNumThreads() : _numThreads; 
 }
 
 void MultithreadedTileVisitor::setNumThreads( unsigned int numThreads)
@@ -248,11 +248,19 @@ void MultithreadedTileVisitor::setNumThreads( unsigned int numThreads)
     _numThreads = numThreads; 
 }
 
+void MultithreadedTileVisitor::setJobScheduler( JobScheduler* scheduler )
+{
+    _scheduler = scheduler;
+}
+
 void MultithreadedTileVisitor::run(const Profile* mapProfile)
 {                   
     // Start up the task service
-    OE_INFO << "Starting " << _numThreads << std::endl;
-    _taskService = new TaskService( "MTTileHandler", _numThreads, 1000 );
+    OE_INFO << "Starting " << getNumThreads() << std::endl;
+    if ( _scheduler.valid() )
+        _taskService = new TaskService( "MTTileHandler", _scheduler.get(), 1000 );
+    else
+        _taskService = new TaskService( "MTTileHandler", _numThreads, 1000 );
 
     // Produce the tiles
     TileVisitor::run( mapProfile );
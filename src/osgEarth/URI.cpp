@@ -21,6 +21,8 @@
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
 #include <osgEarth/Progress>
+#include <osgEarth/SingleFlight>
+#include <osgEarth/StringUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/Archive>
@@ -352,19 +354,30 @@ namespace
     //--------------------------------------------------------------------
     // Read functors (used by the doRead method)
 
+    // Builds the request for a remote read. If there is an (expired) cached
+    // copy, the request is conditional on it, so that the server can answer
+    // "not modified" instead of sending the same data again.
+    HTTPRequest makeRequest(const URI& uri, const ReadResult& cached)
+    {
+        HTTPRequest req(uri.full());
+        req.getHeaders() = uri.context().getHeaders();
+        if ( cached.succeeded() && !req.setValidators(cached.metadata()) && cached.lastModifiedTime() > 0 )
+        {
+            // no validators from the server; fall back on the time we cached it.
+            req.setLastModified(cached.lastModifiedTime());
+        }
+        return req;
+    }
+
     struct ReadObject
     {
+        const char* type() const { return "object"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_OBJECTS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readObject(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP( const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP( const URI& uri, const osgDB::Options* opt, ProgressCallback* p, const ReadResult& cached )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+            HTTPRequest req = makeRequest(uri, cached);
             return HTTPClient::readObject(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -374,17 +387,13 @@ namespace
 
     struct ReadNode
     {
+        const char* type() const { return "node"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_NODES) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readNode(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key ) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, const ReadResult& cached )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+            HTTPRequest req = makeRequest(uri, cached);
             return HTTPClient::readNode(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -394,6 +403,7 @@ namespace
 
     struct ReadImage
     {
+        const char* type() const { return "image"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const {
             return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_IMAGES) != 0);
         }
@@ -407,14 +417,8 @@ namespace
             if ( r.getImage() ) r.getImage()->setFileName( key );
             return r;
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified ) {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, const ReadResult& cached ) {
+            HTTPRequest req = makeRequest(uri, cached);
             ReadResult r = HTTPClient::readImage(req, opt, p);
             if ( r.getImage() ) r.getImage()->setFileName( uri.full() );
             return r;
@@ -428,6 +432,7 @@ namespace
 
     struct ReadString
     {
+        const char* type() const { return "string"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const {
             return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_STRINGS) != 0);
         }
@@ -437,14 +442,9 @@ namespace
         ReadResult fromCache( CacheBin* bin, const std::string& key) { 
             return bin->readString(key, 0L);
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, const ReadResult& cached )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+            HTTPRequest req = makeRequest(uri, cached);
             return HTTPClient::readString(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -452,6 +452,44 @@ namespace
         }
     };
 
+    //--------------------------------------------------------------------
+    // Reads of the same URI that are in flight at the same time, keyed
+    // by read type, cache key, option string, cache bin and cache policy,
+    // so that only reads that would produce the same result share it.
+
+    typedef SingleFlight<std::string, ReadResult> URIFlights;
+    URIFlights s_uriFlights;
+
+    std::string makeFlightKey(const char* type, const URI& uri, const osgDB::Options* options)
+    {
+        std::stringstream buf;
+        buf << type << ":" << uri.cacheKey() << "|" << options->getOptionString();
+
+        CacheSettings* cacheSettings = CacheSettings::get(options);
+        if (cacheSettings)
+        {
+            CacheBin* bin = cacheSettings->getCacheBin();
+            buf << "|" << (bin ? bin->getID() : std::string())
+                << "|" << cacheSettings->cachePolicy()->getConfig().toJSON(false);
+        }
+        return buf.str();
+    }
+
+    // Copy of a result with its own copy of the image, if it holds one.
+    // Images are modified in place after a read (e.g. chroma keying or a
+    // post-read callback), so callers sharing a flight must not share one.
+    ReadResult copyImage(const ReadResult& in)
+    {
+        if ( !in.getImage() )
+            return in;
+
+        ReadResult out( in.code(), new osg::Image(*in.getImage(), osg::CopyOp::DEEP_COPY_ALL), in.metadata() );
+        out.setIsFromCache( in.isFromCache() );
+        out.setLastModifiedTime( in.lastModifiedTime() );
+        out.setDuration( in.duration() );
+        return out;
+    }
+
     //--------------------------------------------------------------------
     // MASTER read template function. I templatized this so we wouldn't
     // have 4 95%-identical code paths to maintain...
@@ -498,9 +536,29 @@ namespace
                 uri = aliasMap->resolve(inputURI.full(), inputURI.context());
             }
 
+            // Join any identical read that's already in flight, so only
+            // one thread goes to the cache or the server for it.
+            URIFlights::Scope flight(
+                s_uriFlights,
+                makeFlightKey(reader.type(), uri, localOptions.get()),
+                progress );
+
+            if ( flight.isLeader() )
+            {
+                progress = flight.getProgress();
+            }
+            else if ( progress && progress->isCanceled() )
+            {
+                return 0L;
+            }
+            else
+            {
+                result = copyImage( flight.get() );
+            }
+
             // check if there's a URI cache in the options.
             URIResultCache* memCache = URIResultCache::from( localOptions.get() );
-            if ( memCache )
+            if ( memCache && flight.isLeader() )
             {
                 URIResultCache::Record rec;
                 if ( memCache->get(uri, rec) )
@@ -509,7 +567,7 @@ namespace
                 }
             }
 
-            if ( result.empty() )
+            if ( result.empty() && flight.isLeader() )
             {
                 // see if there's a read callback installed.
                 URIReadCallback* cb = Registry::instance()->getURIReadCallback();
@@ -575,8 +633,8 @@ namespace
                             Registry::instance()->cloneOrCreateOptions( localOptions.get() );
                         remoteOptions->getDatabasePathList().push_front( osgDB::getFilePath(uri.full()) );
 
-                        // Store the existing object from the cache if there is one.
-                        osg::ref_ptr< osg::Object > object = result.getObject();
+                        // Keep the expired copy from the cache if there is one.
+                        ReadResult cached = expired ? result : ReadResult();
 
                         // try to use the callback if it's set. Callback ignores the caching policy.
                         if ( cb )
@@ -595,13 +653,14 @@ namespace
                             // still no data, go to the source:
                             if ( (result.empty() || expired) && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
                             {
-                                ReadResult remoteResult = reader.fromHTTP( uri, remoteOptions.get(), progress, result.lastModifiedTime() );
-                                if (remoteResult.code() == ReadResult::RESULT_NOT_MODIFIED)
+                                ReadResult remoteResult = reader.fromHTTP( uri, remoteOptions.get(), progress, cached );
+                                if (remoteResult.code() == ReadResult::RESULT_NOT_MODIFIED && cached.succeeded())
                                 {
                                     OE_DEBUG << LC << uri.full() << " not modified, using cached result" << std::endl;
                                     // Touch the cached item to update it's last modified timestamp so it doesn't expire again immediately.
                                     if (bin)
                                         bin->touch( uri.cacheKey() );
+                                    result = cached;
                                 }
                                 else
                                 {
@@ -650,6 +709,13 @@ namespace
                 }
             }
 
+            // share the result with anyone waiting on it. If anyone was,
+            // keep a copy of an image so the shared one stays untouched.
+            if ( flight.resolve(result) )
+            {
+                result = copyImage( result );
+            }
+
             OE_TEST << LC
                 << uri.base() << ": "
                 << (result.succeeded() ? "OK" : "FAILED")
@@ -0,0 +1,344 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/WriteBehindCacheBin>
+#include <osgEarth/DateTime>
+#include <osgEarth/StringUtils>
+#include <osg/Node>
+#include <algorithm>
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+
+#define LC "[WriteBehindCacheBin] "
+
+WriteBehindCacheBin::WriteBehindCacheBin(CacheBin* bin, unsigned maxQueueSize, unsigned maxBatchSize) :
+CacheBin     ( bin ? bin->getID() : std::string() ),
+_bin         ( bin ),
+_maxQueueSize( osg::maximum(maxQueueSize, 1u) ),
+_maxBatchSize( osg::maximum(maxBatchSize, 1u) ),
+_done        ( false ),
+_thread      ( 0L )
+{
+    if ( bin )
+        setHashKeys( bin->getHashKeys() );
+}
+
+WriteBehindCacheBin::~WriteBehindCacheBin()
+{
+    // the writer drains the queue before it exits.
+    {
+        ScopedMutexLock lock(_mutex);
+        _done = true;
+        _workAvailable.broadcast();
+        _spaceAvailable.broadcast();
+    }
+
+    if ( _thread )
+    {
+        _thread->join();
+        delete _thread;
+        _thread = 0L;
+    }
+}
+
+void
+WriteBehindCacheBin::drain()
+{
+    ScopedMutexLock lock(_mutex);
+
+    while( true )
+    {
+        while( _order.empty() && !_done )
+            _workAvailable.wait(&_mutex);
+
+        if ( _order.empty() )
+            break;
+
+        RecordList batch;
+        while( !_order.empty() && batch.size() < _maxBatchSize )
+        {
+            RecordMap::iterator i = _queued.find( _order.front() );
+            _order.pop_front();
+            if ( i != _queued.end() )
+            {
+                batch.push_back( i->second );
+                _inFlight[i->first] = i->second;
+                _queued.erase( i );
+            }
+        }
+        _spaceAvailable.broadcast();
+
+        _mutex.unlock();
+        unsigned written = _bin->writeBatch( batch );
+        _mutex.lock();
+
+        if ( written < batch.size() )
+        {
+            OE_WARN << LC << "Bin " << getID() << ": " << (batch.size()-written) << " of "
+                << batch.size() << " queued writes failed" << std::endl;
+        }
+
+        for(RecordList::const_iterator r = batch.begin(); r != batch.end(); ++r)
+            _inFlight.erase( r->key );
+
+        _batchDone.broadcast();
+    }
+}
+
+const CacheBin::Record*
+WriteBehindCacheBin::find(const std::string& key) const
+{
+    RecordMap::const_iterator i = _queued.find(key);
+    if ( i != _queued.end() )
+        return &i->second;
+
+    i = _inFlight.find(key);
+    if ( i != _inFlight.end() )
+        return &i->second;
+
+    return 0L;
+}
+
+void
+WriteBehindCacheBin::cancel(const std::string& key)
+{
+    if ( _queued.erase(key) > 0 )
+    {
+        std::deque<std::string>::iterator i = std::find(_order.begin(), _order.end(), key);
+        if ( i != _order.end() )
+            _order.erase( i );
+        _spaceAvailable.broadcast();
+    }
+
+    while( _inFlight.find(key) != _inFlight.end() )
+        _batchDone.wait(&_mutex);
+}
+
+void
+WriteBehindCacheBin::flush()
+{
+    ScopedMutexLock lock(_mutex);
+    while( !_order.empty() || !_inFlight.empty() )
+        _batchDone.wait(&_mutex);
+}
+
+unsigned
+WriteBehindCacheBin::getQueueSize() const
+{
+    ScopedMutexLock lock(_mutex);
+    return _order.size();
+}
+
+bool
+WriteBehindCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* dbo)
+{
+    if ( !_bin.valid() || !object )
+        return false;
+
+    // scene graphs keep changing after they're written, so don't queue them.
+    if ( dynamic_cast<const osg::Node*>(object) )
+    {
+        {
+            ScopedMutexLock lock(_mutex);
+            cancel( key );
+        }
+        return _bin->write( key, object, meta, dbo );
+    }
+
+    Record record;
+    record.key      = key;
+    record.object   = object;
+    record.metadata = meta;
+    record.options  = dbo;
+
+    ScopedMutexLock lock(_mutex);
+
+    if ( _done )
+        return false;
+
+    // coalesce with a record still waiting in the queue:
+    RecordMap::iterator i = _queued.find( key );
+    if ( i != _queued.end() )
+    {
+        i->second = record;
+        return true;
+    }
+
+    while( _order.size() >= _maxQueueSize && !_done )
+        _spaceAvailable.wait(&_mutex);
+
+    if ( _done )
+        return false;
+
+    if ( !_thread )
+    {
+        _thread = new WriterThread(this);
+        _thread->start();
+    }
+
+    _queued[key] = record;
+    _order.push_back( key );
+    _workAvailable.signal();
+
+    return true;
+}
+
+unsigned
+WriteBehindCacheBin::writeBatch(const RecordList& records)
+{
+    unsigned count = 0u;
+    for(RecordList::const_iterator r = records.begin(); r != records.end(); ++r)
+    {
+        if ( write(r->key, r->object.get(), r->metadata, r->options.get()) )
+            ++count;
+    }
+    return count;
+}
+
+ReadResult
+WriteBehindCacheBin::readObject(const std::string& key, const osgDB::Options* dbo)
+{
+    {
+        ScopedMutexLock lock(_mutex);
+        const Record* record = find(key);
+        if ( record )
+        {
+            ReadResult rr( const_cast<osg::Object*>(record->object.get()), record->metadata );
+            rr.setLastModifiedTime( DateTime().asTimeStamp() );
+            return rr;
+        }
+    }
+    return _bin.valid() ? _bin->readObject(key, dbo) : ReadResult(ReadResult::RESULT_NOT_FOUND);
+}
+
+ReadResult
+WriteBehindCacheBin::readImage(const std::string& key, const osgDB::Options* dbo)
+{
+    {
+        ScopedMutexLock lock(_mutex);
+        const Record* record = find(key);
+        if ( record )
+        {
+            if ( !dynamic_cast<const osg::Image*>(record->object.get()) )
+                return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+            ReadResult rr( const_cast<osg::Object*>(record->object.get()), record->metadata );
+            rr.setLastModifiedTime( DateTime().asTimeStamp() );
+            return rr;
+        }
+    }
+    return _bin.valid() ? _bin->readImage(key, dbo) : ReadResult(ReadResult::RESULT_NOT_FOUND);
+}
+
+ReadResult
+WriteBehindCacheBin::readString(const std::string& key, const osgDB::Options* dbo)
+{
+    {
+        ScopedMutexLock lock(_mutex);
+        const Record* record = find(key);
+        if ( record )
+        {
+            if ( !dynamic_cast<const StringObject*>(record->object.get()) )
+                return ReadResult();
+
+            ReadResult rr( const_cast<osg::Object*>(record->object.get()), record->metadata );
+            rr.setLastModifiedTime( DateTime().asTimeStamp() );
+            return rr;
+        }
+    }
+    return _bin.valid() ? _bin->readString(key, dbo) : ReadResult(ReadResult::RESULT_NOT_FOUND);
+}
+
+CacheBin::RecordStatus
+WriteBehindCacheBin::getRecordStatus(const std::string& key)
+{
+    {
+        ScopedMutexLock lock(_mutex);
+        if ( find(key) )
+            return STATUS_OK;
+    }
+    return _bin.valid() ? _bin->getRecordStatus(key) : STATUS_NOT_FOUND;
+}
+
+bool
+WriteBehindCacheBin::remove(const std::string& key)
+{
+    bool wasQueued = false;
+    {
+        ScopedMutexLock lock(_mutex);
+        wasQueued = _queued.find(key) != _queued.end();
+        cancel( key );
+    }
+    bool removed = _bin.valid() && _bin->remove(key);
+    return removed || wasQueued;
+}
+
+bool
+WriteBehindCacheBin::touch(const std::string& key)
+{
+    {
+        // a queued record will be stamped when it's written.
+        ScopedMutexLock lock(_mutex);
+        if ( find(key) )
+            return true;
+    }
+    return _bin.valid() && _bin->touch(key);
+}
+
+Config
+WriteBehindCacheBin::readMetadata()
+{
+    return _bin.valid() ? _bin->readMetadata() : Config();
+}
+
+bool
+WriteBehindCacheBin::writeMetadata(const Config& meta)
+{
+    return _bin.valid() && _bin->writeMetadata(meta);
+}
+
+bool
+WriteBehindCacheBin::clear()
+{
+    {
+        ScopedMutexLock lock(_mutex);
+        _queued.clear();
+        _order.clear();
+        _spaceAvailable.broadcast();
+        while( !_inFlight.empty() )
+            _batchDone.wait(&_mutex);
+    }
+    return _bin.valid() && _bin->clear();
+}
+
+bool
+WriteBehindCacheBin::compact()
+{
+    flush();
+    return _bin.valid() && _bin->compact();
+}
+
+unsigned
+WriteBehindCacheBin::getStorageSize()
+{
+    return _bin.valid() ? _bin->getStorageSize() : 0u;
+}
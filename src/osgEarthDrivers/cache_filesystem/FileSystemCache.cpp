@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "FileSystemCache"
+#include "PackedCacheBin"
 #include <osgEarth/Cache>
 #include <osgEarth/StringUtils>
 #include <osgEarth/ThreadingUtils>
@@ -71,6 +72,8 @@ namespace
         void init();
 
         std::string _rootPath;
+        bool        _packed;
+        unsigned    _maxDataFileSize;
     };
 
     /** 
@@ -177,19 +180,24 @@ namespace
         }
 
         _rootPath = URI( *fsco.rootPath(), options.referrer() ).full();
+        _packed = fsco.packed().get();
+        _maxDataFileSize = fsco.maxDataFileSize().get();
         init();
     }
 
     void
     FileSystemCache::init()
     {
-        OE_INFO << LC << "Opened a filesystem cache at \"" << _rootPath << "\"\n";
+        OE_INFO << LC << "Opened a " << (_packed ? "packed " : "") << "filesystem cache at \"" << _rootPath << "\"\n";
     }
 
     CacheBin*
     FileSystemCache::addBin( const std::string& name )
     {
-        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath ) );
+        if ( _packed )
+            return _bins.getOrCreate( name, prepareBin(new PackedCacheBin( name, _rootPath, _maxDataFileSize )) );
+        else
+            return _bins.getOrCreate( name, prepareBin(new FileSystemCacheBin( name, _rootPath )) );
     }
 
     CacheBin*
@@ -201,7 +209,10 @@ namespace
             Threading::ScopedMutexLock lock( s_defaultBinMutex );
             if ( !_defaultBin.valid() ) // double-check
             {
-                _defaultBin = new FileSystemCacheBin( "__default", _rootPath );
+                if ( _packed )
+                    _defaultBin = prepareBin(new PackedCacheBin( "__default", _rootPath, _maxDataFileSize ));
+                else
+                    _defaultBin = prepareBin(new FileSystemCacheBin( "__default", _rootPath ));
             }
         }
         return _defaultBin.get();
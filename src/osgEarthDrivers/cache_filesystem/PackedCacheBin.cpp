@@ -0,0 +1,1110 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackedCacheBin"
+#include <osgEarth/DateTime>
+#include <osgEarth/FileUtils>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/URI>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstring>
+
+#ifdef _WIN32
+#   include <windows.h>
+#   include <io.h>
+#   include <fcntl.h>
+#else
+#   include <sys/mman.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+using namespace osgEarth::Threading;
+
+#define LC "[PackedCacheBin] "
+
+#define OSG_FORMAT "osgb"
+
+namespace
+{
+    const char     INDEX_MAGIC[8]   = { 'O','E','P','A','C','K','I','X' };
+    const uint32_t INDEX_VERSION    = 1u;
+    const uint64_t INDEX_MIN_SLOTS  = 1u << 16;
+    const uint32_t RECORD_MAGIC     = 0x4F455052u; // "OEPR"
+    const uint32_t SLOT_DELETED     = 0xFFFFFFFFu;
+
+    enum RecordType
+    {
+        RECORD_RAW_IMAGE = 1, // uncompressed image, readable in place
+        RECORD_IMAGE     = 2, // osgb-serialized image
+        RECORD_NODE      = 3, // osgb-serialized node
+        RECORD_OBJECT    = 4  // osgb-serialized object
+    };
+
+    enum RawImageFlags
+    {
+        RAW_UNNORMALIZED = 1
+    };
+
+    // Index file header, followed by "capacity" slots.
+    struct IndexHeader
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t numDataFiles;
+        uint64_t capacity;
+        uint64_t count;     // occupied slots, including deleted ones
+        uint64_t reserved[4];
+    };
+
+    // Open-addressed, linearly probed hash slot. hash == 0 means empty.
+    // Deleted records keep their hash so probe chains stay intact.
+    struct IndexSlot
+    {
+        uint64_t hash;
+        uint64_t offset;
+        uint32_t file;
+        uint32_t length;
+        int64_t  timestamp;
+    };
+
+    // Each data record starts on an 8-byte boundary:
+    // header, key, metadata JSON, padding, payload, padding.
+    struct RecordHeader
+    {
+        uint32_t magic;
+        uint32_t type;
+        uint32_t keyLength;
+        uint32_t metaLength;
+        uint64_t payloadLength;
+    };
+
+    struct RawImageHeader
+    {
+        int32_t  s, t, r;
+        int32_t  internalFormat;
+        uint32_t pixelFormat;
+        uint32_t dataType;
+        uint32_t packing;
+        int32_t  rowLength;
+        uint32_t flags;
+        uint32_t numMipmaps;  // number of mipmap offsets that follow
+        uint64_t dataLength;
+    };
+
+    inline uint64_t align8(uint64_t n)
+    {
+        return (n + 7u) & ~(uint64_t)7u;
+    }
+
+    // FNV-1a; 0 is reserved for empty slots.
+    uint64_t hashKey(const std::string& key)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (std::string::const_iterator i = key.begin(); i != key.end(); ++i)
+        {
+            h ^= (unsigned char)(*i);
+            h *= 1099511628211ull;
+        }
+        return h == 0u ? 1u : h;
+    }
+
+    inline IndexHeader* header(MappedFile* index)
+    {
+        return reinterpret_cast<IndexHeader*>(index->data());
+    }
+
+    inline IndexSlot* slots(MappedFile* index)
+    {
+        return reinterpret_cast<IndexSlot*>(index->data() + sizeof(IndexHeader));
+    }
+
+    // 64-bit file positions; ftell/fseek take a long, which is 32 bits on Windows.
+    inline int64_t tell64(FILE* f)
+    {
+#ifdef _WIN32
+        return ::_ftelli64(f);
+#else
+        return (int64_t)::ftello(f);
+#endif
+    }
+
+    inline bool seek64(FILE* f, int64_t offset, int whence)
+    {
+#ifdef _WIN32
+        return ::_fseeki64(f, offset, whence) == 0;
+#else
+        return ::fseeko(f, (off_t)offset, whence) == 0;
+#endif
+    }
+
+    uint64_t getFileSize(const std::string& path)
+    {
+        uint64_t size = 0u;
+        FILE* f = ::fopen(path.c_str(), "rb");
+        if (f)
+        {
+            if (seek64(f, 0, SEEK_END))
+            {
+                int64_t end = tell64(f);
+                size = end > 0 ? (uint64_t)end : 0u;
+            }
+            ::fclose(f);
+        }
+        return size;
+    }
+
+    bool truncateFile(const std::string& path, uint64_t size)
+    {
+#ifdef _WIN32
+        int fd = ::_open(path.c_str(), _O_RDWR | _O_BINARY);
+        if (fd < 0)
+            return false;
+        bool ok = ::_chsize_s(fd, (__int64)size) == 0;
+        ::_close(fd);
+        return ok;
+#else
+        return ::truncate(path.c_str(), (off_t)size) == 0;
+#endif
+    }
+
+    // Opens a data file for appending and returns its size in "size". A
+    // file whose tail was left unaligned (by a crash or a failed write that
+    // could not be rolled back) is zero-padded, so records stay 8-byte aligned
+    // and the next record lands exactly at "size".
+    FILE* openDataFile(const std::string& path, uint64_t& size)
+    {
+        FILE* f = ::fopen(path.c_str(), "ab");
+        if (!f)
+            return 0L;
+
+        static const char zeros[8] = { 0,0,0,0,0,0,0,0 };
+        int64_t end = seek64(f, 0, SEEK_END) ? tell64(f) : -1;
+        size_t pad = end >= 0 ? (size_t)(align8((uint64_t)end) - (uint64_t)end) : 0u;
+
+        if (end < 0 ||
+            (pad > 0u && ::fwrite(zeros, 1, pad, f) != pad) ||
+            ::fflush(f) != 0)
+        {
+            ::fclose(f);
+            return 0L;
+        }
+
+        size = (uint64_t)end + pad;
+        return f;
+    }
+
+    // Writes an empty index with the given capacity.
+    bool createIndexFile(const std::string& path, uint64_t capacity, uint32_t numDataFiles)
+    {
+        FILE* f = ::fopen(path.c_str(), "wb");
+        if (!f)
+            return false;
+
+        IndexHeader h;
+        ::memset(&h, 0, sizeof(h));
+        ::memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+        h.version = INDEX_VERSION;
+        h.numDataFiles = numDataFiles;
+        h.capacity = capacity;
+
+        bool ok = ::fwrite(&h, sizeof(h), 1, f) == 1;
+
+        // extend to full size; the slots read back as zeros (empty).
+        uint64_t total = sizeof(IndexHeader) + capacity*sizeof(IndexSlot);
+        ok = ok && seek64(f, (int64_t)(total - 1u), SEEK_SET);
+        ok = ok && ::fputc(0, f) != EOF;
+        ok = (::fclose(f) == 0) && ok;
+        return ok;
+    }
+
+    // Image whose pixels live in a (copy-on-write) mapping of a data file.
+    // Holds a reference to the mapping so the memory outlives any remapping
+    // of the data file.
+    class MappedImage : public osg::Image
+    {
+    public:
+        MappedImage(MappedFile* mapping) : _mapping(mapping) { }
+    protected:
+        virtual ~MappedImage() { }
+        osg::ref_ptr<MappedFile> _mapping;
+    };
+
+    // Read-only stream over a block of memory, for the osgb reader.
+    class MemoryStreamBuf : public std::streambuf
+    {
+    public:
+        MemoryStreamBuf(const unsigned char* data, size_t length)
+        {
+            char* p = const_cast<char*>(reinterpret_cast<const char*>(data));
+            setg(p, p, p + length);
+        }
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+        {
+            char* target =
+                dir == std::ios_base::beg ? eback() + off :
+                dir == std::ios_base::cur ? gptr()  + off :
+                                            egptr() + off;
+            if (target < eback() || target > egptr())
+                return pos_type(off_type(-1));
+            setg(eback(), target, egptr());
+            return pos_type(target - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    // Whether an image can be stored raw and rebuilt exactly from the raw record.
+    // The only user value we carry is the osgEarth normalization flag.
+    bool canStoreRaw(const osg::Image* image)
+    {
+        if (!image || !image->data() || !image->isDataContiguous())
+            return false;
+
+        const osg::UserDataContainer* udc = image->getUserDataContainer();
+        if (udc)
+        {
+            if (udc->getUserData() != 0L || udc->getNumDescriptions() > 0)
+                return false;
+
+            unsigned n = udc->getNumUserObjects();
+            if (n > 1u || (n == 1u && udc->getUserObjectIndex("osgEarth.unnormalized") != 0u))
+                return false;
+        }
+        return true;
+    }
+}
+
+//........................................................................
+
+MappedFile::MappedFile(const std::string& path, size_t size, bool shared) :
+_data( 0L ),
+_size( size )
+{
+    if (size == 0u)
+        return;
+
+#ifdef _WIN32
+    HANDLE file = ::CreateFileA(
+        path.c_str(),
+        shared ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        0L, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0L);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    HANDLE mapping = ::CreateFileMappingA(
+        file, 0L,
+        shared ? PAGE_READWRITE : PAGE_WRITECOPY,
+        (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFFu),
+        0L);
+
+    if (mapping)
+    {
+        _data = (unsigned char*)::MapViewOfFile(
+            mapping,
+            shared ? FILE_MAP_WRITE : FILE_MAP_COPY,
+            0, 0, size);
+
+        // the view keeps the mapping alive.
+        ::CloseHandle(mapping);
+    }
+    ::CloseHandle(file);
+#else
+    int fd = ::open(path.c_str(), shared ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+        return;
+
+    void* p = ::mmap(0L, size, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+        _data = (unsigned char*)p;
+
+    // the mapping keeps the file alive.
+    ::close(fd);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    if (_data)
+    {
+#ifdef _WIN32
+        ::UnmapViewOfFile(_data);
+#else
+        ::munmap(_data, _size);
+#endif
+    }
+}
+
+void
+MappedFile::flush()
+{
+    if (_data)
+    {
+#ifdef _WIN32
+        ::FlushViewOfFile(_data, _size);
+#else
+        ::msync(_data, _size, MS_SYNC);
+#endif
+    }
+}
+
+//........................................................................
+
+PackedCacheBin::PackedCacheBin(const std::string& binID,
+                               const std::string& rootPath,
+                               unsigned           maxDataFileSizeMB) :
+CacheBin         ( binID ),
+_ok              ( false ),
+_numDataFiles    ( 0u ),
+_out             ( 0L ),
+_outSize         ( 0u )
+{
+    _binPath   = osgDB::concatPaths( rootPath, binID );
+    _metaPath  = osgDB::concatPaths( _binPath, "osgearth_cacheinfo.json" );
+    _indexPath = osgDB::concatPaths( _binPath, "index.pack" );
+
+    // data files are mapped whole, so stay under 2GB for 32-bit address spaces.
+    // write() enforces the limit.
+    _maxDataFileSize = (uint64_t)osg::clampBetween(maxDataFileSizeMB, 1u, 2047u) * 1048576u;
+
+    _rw = osgDB::Registry::instance()->getReaderWriterForExtension(OSG_FORMAT);
+
+    _zlibOptions = Registry::instance()->cloneOrCreateOptions();
+
+    if (::getenv(OSGEARTH_ENV_DEFAULT_COMPRESSOR) != 0L)
+    {
+        _compressorName = ::getenv(OSGEARTH_ENV_DEFAULT_COMPRESSOR);
+    }
+    else
+    {
+        _compressorName = "zlib";
+    }
+
+    if (_compressorName.length() > 0)
+    {
+        _zlibOptions->setPluginStringData("Compressor", _compressorName);
+    }
+
+    _debug = ::getenv("OSGEARTH_CACHE_DEBUG") != 0L;
+}
+
+PackedCacheBin::~PackedCacheBin()
+{
+    ScopedWriteLock lock(_mutex);
+    close();
+}
+
+std::string
+PackedCacheBin::getDataFilePath(unsigned file) const
+{
+    return osgDB::concatPaths( _binPath, Stringify() << "data_" << std::setfill('0') << std::setw(4) << file << ".pack" );
+}
+
+const osgDB::Options*
+PackedCacheBin::mergeOptions(const osgDB::Options* dbo)
+{
+    if (!dbo)
+    {
+        return _zlibOptions.get();
+    }
+    else if (!_zlibOptions.valid())
+    {
+        return dbo;
+    }
+    else
+    {
+        osgDB::Options* merged = Registry::cloneOrCreateOptions(dbo);
+        if (_compressorName.length())
+        {
+            merged->setPluginStringData("Compressor", _compressorName);
+        }
+        return merged;
+    }
+}
+
+bool
+PackedCacheBin::open(bool create)
+{
+    if (_ok)
+        return true;
+
+    if (!_rw.valid())
+        return false;
+
+    if (!osgDB::fileExists(_indexPath))
+    {
+        if (!create)
+            return false;
+
+        osgEarth::makeDirectoryForFile( _indexPath );
+        if (!createIndexFile(_indexPath, INDEX_MIN_SLOTS, 0u))
+        {
+            OE_WARN << LC << "FAILED to create cache bin index at [" << _indexPath << "]" << std::endl;
+            return false;
+        }
+    }
+
+    uint64_t size = getFileSize(_indexPath);
+    if (size < sizeof(IndexHeader))
+    {
+        OE_WARN << LC << "Cache bin index [" << _indexPath << "] is corrupt" << std::endl;
+        return false;
+    }
+
+    _index = new MappedFile(_indexPath, (size_t)size, true);
+    if (!_index->valid() ||
+        ::memcmp(header(_index.get())->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header(_index.get())->version != INDEX_VERSION ||
+        size != sizeof(IndexHeader) + header(_index.get())->capacity * sizeof(IndexSlot))
+    {
+        OE_WARN << LC << "Cache bin index [" << _indexPath << "] is corrupt or incompatible" << std::endl;
+        _index = 0L;
+        return false;
+    }
+
+    _numDataFiles = header(_index.get())->numDataFiles;
+    _ok = true;
+
+    if (_debug)
+        OE_NOTICE << LC << "Opened bin [" << getID() << "] with " << header(_index.get())->count << " records in " << _numDataFiles << " data files" << std::endl;
+
+    return true;
+}
+
+void
+PackedCacheBin::close()
+{
+    if (_out)
+    {
+        ::fclose(_out);
+        _out = 0L;
+    }
+
+    if (_index.valid())
+    {
+        _index->flush();
+        _index = 0L;
+    }
+
+    {
+        ScopedMutexLock lock(_dataMutex);
+        _dataMappings.clear();
+    }
+
+    _numDataFiles = 0u;
+    _outSize = 0u;
+    _ok = false;
+}
+
+bool
+PackedCacheBin::binValidForReading()
+{
+    {
+        ScopedReadLock lock(_mutex);
+        if (_ok)
+            return true;
+    }
+    ScopedWriteLock lock(_mutex);
+    return open(false);
+}
+
+bool
+PackedCacheBin::binValidForWriting()
+{
+    {
+        ScopedReadLock lock(_mutex);
+        if (_ok)
+            return true;
+    }
+    ScopedWriteLock lock(_mutex);
+    return open(true);
+}
+
+void*
+PackedCacheBin::findSlot(uint64_t hash) const
+{
+    // returns the slot holding "hash", or the empty slot where it belongs.
+    IndexSlot* table = slots(_index.get());
+    uint64_t mask = header(_index.get())->capacity - 1u;
+
+    for (uint64_t i = hash & mask; ; i = (i + 1u) & mask)
+    {
+        if (table[i].hash == hash || table[i].hash == 0u)
+            return &table[i];
+    }
+}
+
+bool
+PackedCacheBin::lookup(const std::string& key, Location& out) const
+{
+    if (!_ok)
+        return false;
+
+    const IndexSlot* slot = static_cast<const IndexSlot*>(findSlot(hashKey(key)));
+    if (slot->hash == 0u || slot->file == SLOT_DELETED)
+        return false;
+
+    out.file      = slot->file;
+    out.length    = slot->length;
+    out.offset    = slot->offset;
+    out.timestamp = (TimeStamp)slot->timestamp;
+    return true;
+}
+
+bool
+PackedCacheBin::insert(uint64_t hash, const Location& loc)
+{
+    // keep the load factor under 0.7 so probe chains stay short.
+    IndexHeader* h = header(_index.get());
+    if ((h->count + 1u) * 10u > h->capacity * 7u)
+    {
+        if (!growIndex())
+            return false;
+        h = header(_index.get());
+    }
+
+    IndexSlot* slot = static_cast<IndexSlot*>(findSlot(hash));
+    if (slot->hash == 0u)
+    {
+        slot->hash = hash;
+        ++h->count;
+    }
+    slot->offset    = loc.offset;
+    slot->file      = loc.file;
+    slot->length    = loc.length;
+    slot->timestamp = (int64_t)loc.timestamp;
+    return true;
+}
+
+bool
+PackedCacheBin::growIndex()
+{
+    IndexHeader* h = header(_index.get());
+    uint64_t newCapacity = h->capacity * 2u;
+
+    std::string tempPath = _indexPath + ".tmp";
+    if (!createIndexFile(tempPath, newCapacity, h->numDataFiles))
+        return false;
+
+    osg::ref_ptr<MappedFile> newIndex = new MappedFile(
+        tempPath, (size_t)(sizeof(IndexHeader) + newCapacity*sizeof(IndexSlot)), true);
+
+    if (!newIndex->valid())
+    {
+        ::remove(tempPath.c_str());
+        return false;
+    }
+
+    // rehash live records; deleted ones are dropped.
+    const IndexSlot* oldTable = slots(_index.get());
+    IndexSlot* newTable = slots(newIndex.get());
+    uint64_t mask = newCapacity - 1u;
+    uint64_t count = 0u;
+
+    for (uint64_t i = 0; i < h->capacity; ++i)
+    {
+        const IndexSlot& s = oldTable[i];
+        if (s.hash != 0u && s.file != SLOT_DELETED)
+        {
+            uint64_t j = s.hash & mask;
+            while (newTable[j].hash != 0u)
+                j = (j + 1u) & mask;
+            newTable[j] = s;
+            ++count;
+        }
+    }
+    header(newIndex.get())->count = count;
+    newIndex->flush();
+
+    newIndex = 0L;
+    _index = 0L;
+
+#ifdef _WIN32
+    ::remove(_indexPath.c_str()); // rename won't replace an existing file
+#endif
+    if (::rename(tempPath.c_str(), _indexPath.c_str()) != 0)
+    {
+        OE_WARN << LC << "FAILED to replace cache bin index [" << _indexPath << "]" << std::endl;
+        close();
+        return false;
+    }
+
+    _index = new MappedFile(_indexPath, (size_t)(sizeof(IndexHeader) + newCapacity*sizeof(IndexSlot)), true);
+    if (!_index->valid())
+    {
+        close();
+        return false;
+    }
+
+    if (_debug)
+        OE_NOTICE << LC << "Bin [" << getID() << "] index grew to " << newCapacity << " slots" << std::endl;
+
+    return true;
+}
+
+MappedFile*
+PackedCacheBin::getDataMapping(unsigned file, uint64_t minSize, osg::ref_ptr<MappedFile>& out)
+{
+    ScopedMutexLock lock(_dataMutex);
+
+    if (file >= _dataMappings.size())
+        _dataMappings.resize(file + 1u);
+
+    osg::ref_ptr<MappedFile>& mapping = _dataMappings[file];
+
+    // (re)map when the record lies past the end of the current mapping,
+    // i.e. it was appended after we mapped the file. Existing readers
+    // keep the old mapping alive through their references.
+    if (!mapping.valid() || mapping->size() < minSize)
+    {
+        std::string path = getDataFilePath(file);
+        uint64_t size = getFileSize(path);
+        if (size < minSize)
+            return 0L;
+
+        mapping = new MappedFile(path, (size_t)size, false);
+        if (!mapping->valid())
+        {
+            OE_WARN << LC << "FAILED to map data file [" << path << "]" << std::endl;
+            mapping = 0L;
+            return 0L;
+        }
+    }
+
+    out = mapping.get();
+    return out.get();
+}
+
+ReadResult
+PackedCacheBin::read(const std::string& key, bool imagesOnly, const osgDB::Options* readOptions)
+{
+    if ( !binValidForReading() )
+        return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+    Location loc;
+    {
+        ScopedReadLock lock(_mutex);
+        if (!lookup(key, loc))
+            return ReadResult(ReadResult::RESULT_NOT_FOUND);
+    }
+
+    osg::ref_ptr<MappedFile> mapping;
+    if (!getDataMapping(loc.file, loc.offset + loc.length, mapping))
+        return ReadResult();
+
+    const unsigned char* record = mapping->data() + loc.offset;
+    const RecordHeader* rh = reinterpret_cast<const RecordHeader*>(record);
+
+    // verify the record; this also catches (unlikely) hash collisions.
+    if (rh->magic != RECORD_MAGIC ||
+        rh->keyLength != key.length() ||
+        ::memcmp(record + sizeof(RecordHeader), key.data(), key.length()) != 0)
+    {
+        return ReadResult(ReadResult::RESULT_NOT_FOUND);
+    }
+
+    Config meta;
+    if (rh->metaLength > 0u)
+    {
+        meta.fromJSON(std::string(
+            reinterpret_cast<const char*>(record + sizeof(RecordHeader) + rh->keyLength),
+            rh->metaLength));
+    }
+
+    const unsigned char* payload = record + align8(sizeof(RecordHeader) + rh->keyLength + rh->metaLength);
+
+    osg::ref_ptr<osg::Object> object;
+
+    if (rh->type == RECORD_RAW_IMAGE)
+    {
+        const RawImageHeader* ih = reinterpret_cast<const RawImageHeader*>(payload);
+        const uint32_t* mipmaps = reinterpret_cast<const uint32_t*>(payload + sizeof(RawImageHeader));
+        unsigned char* pixels = const_cast<unsigned char*>(
+            payload + align8(sizeof(RawImageHeader) + ih->numMipmaps*sizeof(uint32_t)));
+
+        // zero-copy: the image points into the copy-on-write mapping.
+        osg::ref_ptr<osg::Image> image = new MappedImage(mapping.get());
+        image->setImage(
+            ih->s, ih->t, ih->r,
+            ih->internalFormat, ih->pixelFormat, ih->dataType,
+            pixels, osg::Image::NO_DELETE, ih->packing, ih->rowLength);
+
+        if (ih->numMipmaps > 0u)
+        {
+            osg::Image::MipmapDataType levels(mipmaps, mipmaps + ih->numMipmaps);
+            image->setMipmapLevels(levels);
+        }
+
+        if (ih->flags & RAW_UNNORMALIZED)
+            ImageUtils::markAsUnNormalized(image.get(), true);
+
+        object = image.get();
+    }
+    else
+    {
+        if (imagesOnly && rh->type != RECORD_IMAGE)
+            return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+        osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(readOptions);
+        MemoryStreamBuf buf(payload, (size_t)rh->payloadLength);
+        std::istream in(&buf);
+
+        osgDB::ReaderWriter::ReadResult r =
+            rh->type == RECORD_IMAGE ? _rw->readImage(in, dbo.get()) :
+            rh->type == RECORD_NODE  ? _rw->readNode(in, dbo.get()) :
+                                       _rw->readObject(in, dbo.get());
+
+        if (!r.success())
+        {
+            OE_WARN << LC << "Cache read failure for \"" << key << "\" in bin [" << getID() << "]: " << r.message() << std::endl;
+            return ReadResult(ReadResult::RESULT_READER_ERROR);
+        }
+        object = r.getObject();
+    }
+
+    if (_debug)
+        OE_NOTICE << LC << "Read \"" << key << "\" from cache bin [" << getID() << "]" << std::endl;
+
+    ReadResult rr(object.get(), meta);
+    rr.setLastModifiedTime(loc.timestamp);
+    return rr;
+}
+
+ReadResult
+PackedCacheBin::readImage(const std::string& key, const osgDB::Options* readOptions)
+{
+    return read(key, true, readOptions);
+}
+
+ReadResult
+PackedCacheBin::readObject(const std::string& key, const osgDB::Options* readOptions)
+{
+    return read(key, false, readOptions);
+}
+
+ReadResult
+PackedCacheBin::readString(const std::string& key, const osgDB::Options* readOptions)
+{
+    ReadResult r = readObject(key, readOptions);
+    if ( r.succeeded() )
+    {
+        if ( r.get<StringObject>() )
+        {
+            return r;
+        }
+        else
+        {
+            return ReadResult();
+        }
+    }
+    else
+    {
+        return r;
+    }
+}
+
+bool
+PackedCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
+{
+    if ( !binValidForWriting() || !object )
+        return false;
+
+    // serialize outside the lock.
+    const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+
+    RecordHeader rh;
+    rh.magic = RECORD_MAGIC;
+    rh.keyLength = key.length();
+
+    std::string metaJSON = meta.empty() ? std::string() : meta.toJSON(false);
+    rh.metaLength = metaJSON.length();
+
+    RawImageHeader ih;
+    osg::Image::MipmapDataType mipmaps;
+    std::string serialized;
+
+    if (image && canStoreRaw(image))
+    {
+        rh.type = RECORD_RAW_IMAGE;
+
+        ::memset(&ih, 0, sizeof(ih));
+        ih.s              = image->s();
+        ih.t              = image->t();
+        ih.r              = image->r();
+        ih.internalFormat = image->getInternalTextureFormat();
+        ih.pixelFormat    = image->getPixelFormat();
+        ih.dataType       = image->getDataType();
+        ih.packing        = image->getPacking();
+        ih.rowLength      = image->getRowLength();
+        ih.flags          = ImageUtils::isUnNormalized(image) ? RAW_UNNORMALIZED : 0u;
+        ih.dataLength     = image->getTotalSizeInBytesIncludingMipmaps();
+
+        mipmaps = image->getMipmapLevels();
+        ih.numMipmaps = mipmaps.size();
+
+        rh.payloadLength = align8(sizeof(RawImageHeader) + ih.numMipmaps*sizeof(uint32_t)) + ih.dataLength;
+    }
+    else
+    {
+        osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(writeOptions);
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult r;
+
+        if (image)
+        {
+            rh.type = RECORD_IMAGE;
+            r = _rw->writeImage(*image, buf, dbo.get());
+        }
+        else if (dynamic_cast<const osg::Node*>(object))
+        {
+            rh.type = RECORD_NODE;
+            r = _rw->writeNode(*static_cast<const osg::Node*>(object), buf, dbo.get());
+        }
+        else
+        {
+            rh.type = RECORD_OBJECT;
+            r = _rw->writeObject(*object, buf, dbo.get());
+        }
+
+        if (!r.success())
+        {
+            OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID()
+                << "; msg = \"" << r.message() << "\"" << std::endl;
+            return false;
+        }
+
+        serialized = buf.str();
+        rh.payloadLength = serialized.length();
+    }
+
+    uint64_t payloadOffset = align8(sizeof(RecordHeader) + rh.keyLength + rh.metaLength);
+    uint64_t recordLength = align8(payloadOffset + rh.payloadLength);
+    static const char zeros[8] = { 0,0,0,0,0,0,0,0 };
+
+    if (recordLength > _maxDataFileSize)
+    {
+        OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID()
+            << "; record is larger than the maximum data file size" << std::endl;
+        return false;
+    }
+
+    ScopedWriteLock lock(_mutex);
+
+    if (!_ok)
+        return false;
+
+    // start a new data file when the current one is full:
+    if (_out == 0L || (_outSize > 0u && _outSize + recordLength > _maxDataFileSize))
+    {
+        if (_out)
+        {
+            ::fclose(_out);
+            _out = 0L;
+        }
+
+        if (_numDataFiles == 0u ||
+            getFileSize(getDataFilePath(_numDataFiles-1u)) + recordLength > _maxDataFileSize)
+        {
+            ++_numDataFiles;
+            header(_index.get())->numDataFiles = _numDataFiles;
+        }
+
+        std::string path = getDataFilePath(_numDataFiles-1u);
+        _out = openDataFile(path, _outSize);
+        if (!_out)
+        {
+            OE_WARN << LC << "FAILED to open data file [" << path << "]" << std::endl;
+            return false;
+        }
+    }
+
+    Location loc;
+    loc.file      = _numDataFiles-1u;
+    loc.offset    = _outSize;
+    loc.length    = (uint32_t)recordLength;
+    loc.timestamp = DateTime().asTimeStamp();
+
+    bool ok =
+        ::fwrite(&rh, sizeof(rh), 1, _out) == 1 &&
+        ::fwrite(key.data(), 1, key.length(), _out) == key.length() &&
+        ::fwrite(metaJSON.data(), 1, metaJSON.length(), _out) == metaJSON.length() &&
+        ::fwrite(zeros, 1, (size_t)(payloadOffset - sizeof(rh) - key.length() - metaJSON.length()), _out) == (size_t)(payloadOffset - sizeof(rh) - key.length() - metaJSON.length());
+
+    if (ok && rh.type == RECORD_RAW_IMAGE)
+    {
+        size_t headerLength = (size_t)align8(sizeof(ih) + ih.numMipmaps*sizeof(uint32_t));
+        size_t mipmapLength = ih.numMipmaps*sizeof(uint32_t);
+
+        ok =
+            ::fwrite(&ih, sizeof(ih), 1, _out) == 1 &&
+            (mipmapLength == 0u || ::fwrite(&mipmaps[0], 1, mipmapLength, _out) == mipmapLength) &&
+            ::fwrite(zeros, 1, headerLength - sizeof(ih) - mipmapLength, _out) == headerLength - sizeof(ih) - mipmapLength &&
+            ::fwrite(image->data(), 1, (size_t)ih.dataLength, _out) == (size_t)ih.dataLength;
+    }
+    else if (ok)
+    {
+        ok = ::fwrite(serialized.data(), 1, serialized.length(), _out) == serialized.length();
+    }
+
+    size_t tail = (size_t)(recordLength - payloadOffset - rh.payloadLength);
+    ok = ok && ::fwrite(zeros, 1, tail, _out) == tail;
+
+    // data must reach the file before the index points at it.
+    ok = ok && ::fflush(_out) == 0;
+
+    if (!ok)
+    {
+        // Roll the file back to the last good record. If that fails, the
+        // next write reopens the file, which pads the partial record out to
+        // an aligned size; either way the append position matches the file.
+        OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID() << std::endl;
+        ::fclose(_out);
+        _out = 0L;
+        truncateFile(getDataFilePath(loc.file), loc.offset);
+        return false;
+    }
+
+    _outSize += recordLength;
+
+    if (!insert(hashKey(key), loc))
+        return false;
+
+    if (_debug)
+        OE_NOTICE << LC << "Wrote \"" << key << "\" to cache bin [" << getID() << "]" << std::endl;
+
+    return true;
+}
+
+CacheBin::RecordStatus
+PackedCacheBin::getRecordStatus(const std::string& key)
+{
+    if ( !binValidForReading() )
+        return STATUS_NOT_FOUND;
+
+    ScopedReadLock lock(_mutex);
+    Location loc;
+    return lookup(key, loc) ? STATUS_OK : STATUS_NOT_FOUND;
+}
+
+bool
+PackedCacheBin::remove(const std::string& key)
+{
+    if ( !binValidForReading() )
+        return false;
+
+    ScopedWriteLock lock(_mutex);
+    if (!_ok)
+        return false;
+
+    IndexSlot* slot = static_cast<IndexSlot*>(findSlot(hashKey(key)));
+    if (slot->hash == 0u || slot->file == SLOT_DELETED)
+        return false;
+
+    // the record's bytes stay in the data file until the bin is cleared.
+    slot->file = SLOT_DELETED;
+    return true;
+}
+
+bool
+PackedCacheBin::touch(const std::string& key)
+{
+    if ( !binValidForReading() )
+        return false;
+
+    ScopedWriteLock lock(_mutex);
+    if (!_ok)
+        return false;
+
+    IndexSlot* slot = static_cast<IndexSlot*>(findSlot(hashKey(key)));
+    if (slot->hash == 0u || slot->file == SLOT_DELETED)
+        return false;
+
+    slot->timestamp = (int64_t)DateTime().asTimeStamp();
+    return true;
+}
+
+bool
+PackedCacheBin::clear()
+{
+    if ( !binValidForReading() )
+        return false;
+
+    ScopedWriteLock lock(_mutex);
+
+    unsigned numDataFiles = _numDataFiles;
+    close();
+
+    bool ok = true;
+    for (unsigned i = 0; i < numDataFiles; ++i)
+    {
+        std::string path = getDataFilePath(i);
+        if (osgDB::fileExists(path) && ::remove(path.c_str()) != 0)
+            ok = false;
+    }
+
+    if (::remove(_indexPath.c_str()) != 0)
+        ok = false;
+
+    return ok;
+}
+
+Config
+PackedCacheBin::readMetadata()
+{
+    if ( !osgDB::fileExists(_metaPath) ) return Config();
+
+    ScopedReadLock lock(_mutex);
+
+    Config conf;
+    conf.fromJSON( URI(_metaPath).getString(_zlibOptions.get()) );
+
+    return conf;
+}
+
+bool
+PackedCacheBin::writeMetadata( const Config& conf )
+{
+    if ( !binValidForWriting() ) return false;
+
+    ScopedWriteLock lock(_mutex);
+
+    std::fstream output( _metaPath.c_str(), std::ios_base::out );
+    if ( output.is_open() )
+    {
+        output << conf.toJSON(true);
+        output.flush();
+        output.close();
+        return true;
+    }
+    return false;
+}
@@ -179,7 +179,7 @@ CacheBin*
 LevelDBCacheImpl::addBin( const std::string& name )
 {
     return _db ?
-        _bins.getOrCreate(name, new LevelDBCacheBin(name, _db, _tracker.get())) :
+        _bins.getOrCreate(name, prepareBin(new LevelDBCacheBin(name, _db, _tracker.get()))) :
         0L;
 }
 
@@ -195,7 +195,7 @@ LevelDBCacheImpl::getOrCreateDefaultBin()
         Threading::ScopedMutexLock lock( s_defaultBinMutex );
         if ( !_defaultBin.valid() ) // double-check
         {
-            _defaultBin = new LevelDBCacheBin("_default", _db, _tracker.get());
+            _defaultBin = prepareBin(new LevelDBCacheBin("_default", _db, _tracker.get()));
         }
     }
     return _defaultBin.get();
@@ -337,7 +337,83 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
 {
     if ( !binValidForWriting() || !object ) 
         return false;
-        
+
+    leveldb::WriteBatch batch;
+    std::string message;
+
+    bool objWriteOK =
+        addToBatch( key, object, meta, writeOptions, batch, message ) &&
+        _db->Write( leveldb::WriteOptions(), &batch ).ok();
+
+    if ( objWriteOK )
+    {
+        ++_tracker->writes;
+        postWrite();
+
+        if ( _debug )
+        {
+            OE_NOTICE << LC << "Bin " << getID() << ": wrote (" << key << ")\n";
+        }
+    }
+    else
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \"" 
+            << message << "\"\n";
+    }
+
+    return objWriteOK;
+}
+
+unsigned
+LevelDBCacheBin::writeBatch(const RecordList& records)
+{
+    if ( !binValidForWriting() )
+        return 0u;
+
+    // serialize everything, then commit it all in one write.
+    leveldb::WriteBatch batch;
+    unsigned count = 0u;
+
+    for(RecordList::const_iterator i = records.begin(); i != records.end(); ++i)
+    {
+        std::string message;
+        if ( i->object.valid() && addToBatch( i->key, i->object.get(), i->metadata, i->options.get(), batch, message ) )
+        {
+            ++count;
+        }
+        else
+        {
+            OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << i->key << "); msg = \"" 
+                << message << "\"\n";
+        }
+    }
+
+    if ( count == 0u )
+        return 0u;
+
+    if ( !_db->Write( leveldb::WriteOptions(), &batch ).ok() )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write a batch of " << count << " records\n";
+        return 0u;
+    }
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        ++_tracker->writes;
+        postWrite();
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote a batch of " << count << " records\n";
+    }
+
+    return count;
+}
+
+bool
+LevelDBCacheBin::addToBatch(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions, leveldb::WriteBatch& batch, std::string& message)
+{
     osgDB::ReaderWriter::WriteResult r;
     bool objWriteOK = false;
 
@@ -375,10 +451,11 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
         objWriteOK = r.success();
     }
 
+    message = r.message();
+
     if (objWriteOK)
     {
         DateTime now;
-        leveldb::WriteBatch batch;
 
         // write the data:
         data = datastream.str();
@@ -394,26 +471,6 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
         metadata.set( TIME_FIELD, now.asCompactISO8601() );
         encodeMeta( metadata, data );
         batch.Put( metaKey(key), data );
-
-        objWriteOK = _db->Write( leveldb::WriteOptions(), &batch ).ok();
-
-        if ( objWriteOK )
-        {
-            ++_tracker->writes;
-            postWrite();
-            
-            if ( _debug )
-            {
-                OE_NOTICE << LC << "Bin " << getID() << ": wrote (" << key << ")\n";
-            }
-        }
-    }
-
-        
-    if ( !objWriteOK )
-    {
-        OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \"" 
-            << r.message() << "\"\n";
     }
 
     return objWriteOK;
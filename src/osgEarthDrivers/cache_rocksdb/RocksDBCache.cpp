@@ -200,7 +200,7 @@ CacheBin*
 RocksDBCacheImpl::addBin( const std::string& name )
 {
     return _db ?
-        _bins.getOrCreate(name, new RocksDBCacheBin(name, _db, _tracker.get())) :
+        _bins.getOrCreate(name, prepareBin(new RocksDBCacheBin(name, _db, _tracker.get()))) :
         0L;
 }
 
@@ -216,7 +216,7 @@ RocksDBCacheImpl::getOrCreateDefaultBin()
         Threading::ScopedMutexLock lock( s_defaultBinMutex );
         if ( !_defaultBin.valid() ) // double-check
         {
-            _defaultBin = new RocksDBCacheBin("_default", _db, _tracker.get());
+            _defaultBin = prepareBin(new RocksDBCacheBin("_default", _db, _tracker.get()));
         }
     }
     return _defaultBin.get();
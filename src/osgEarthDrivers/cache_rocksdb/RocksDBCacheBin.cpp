@@ -331,7 +331,83 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
 {
     if ( !binValidForWriting() || !object ) 
         return false;
-        
+
+    rocksdb::WriteBatch batch;
+    std::string message;
+
+    bool objWriteOK =
+        addToBatch( key, object, meta, writeOptions, batch, message ) &&
+        _db->Write( rocksdb::WriteOptions(), &batch ).ok();
+
+    if ( objWriteOK )
+    {
+        ++_tracker->writes;
+        postWrite();
+
+        if ( _debug )
+        {
+            OE_NOTICE << LC << "Bin " << getID() << ": wrote (" << key << ")\n";
+        }
+    }
+    else
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \"" 
+            << message << "\"\n";
+    }
+
+    return objWriteOK;
+}
+
+unsigned
+RocksDBCacheBin::writeBatch(const RecordList& records)
+{
+    if ( !binValidForWriting() )
+        return 0u;
+
+    // serialize everything, then commit it all in one write.
+    rocksdb::WriteBatch batch;
+    unsigned count = 0u;
+
+    for(RecordList::const_iterator i = records.begin(); i != records.end(); ++i)
+    {
+        std::string message;
+        if ( i->object.valid() && addToBatch( i->key, i->object.get(), i->metadata, i->options.get(), batch, message ) )
+        {
+            ++count;
+        }
+        else
+        {
+            OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << i->key << "); msg = \"" 
+                << message << "\"\n";
+        }
+    }
+
+    if ( count == 0u )
+        return 0u;
+
+    if ( !_db->Write( rocksdb::WriteOptions(), &batch ).ok() )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write a batch of " << count << " records\n";
+        return 0u;
+    }
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        ++_tracker->writes;
+        postWrite();
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote a batch of " << count << " records\n";
+    }
+
+    return count;
+}
+
+bool
+RocksDBCacheBin::addToBatch(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions, rocksdb::WriteBatch& batch, std::string& message)
+{
     osgDB::ReaderWriter::WriteResult r;
     bool objWriteOK = false;
 
@@ -345,7 +421,7 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
             OE_WARN << LC << "Internal: tried to write image to " << _rw->className() << "\n";
             return false;
         }
-        r = _rw->writeImage( *static_cast<const osg::Image*>(object), datastream, writeOptions);
+        r = _rw->writeImage( *static_cast<const osg::Image*>(object), datastream, writeOptions );
         objWriteOK = r.success();
     }
     else if ( dynamic_cast<const osg::Node*>(object) )
@@ -355,7 +431,7 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
             OE_WARN << LC << "Internal: tried to write node to " << _rw->className() << "\n";
             return false;
         }
-        r = _rw->writeNode( *static_cast<const osg::Node*>(object), datastream, writeOptions);
+        r = _rw->writeNode( *static_cast<const osg::Node*>(object), datastream, writeOptions );
         objWriteOK = r.success();
     }
     else
@@ -369,10 +445,11 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
         objWriteOK = r.success();
     }
 
+    message = r.message();
+
     if (objWriteOK)
     {
         DateTime now;
-        rocksdb::WriteBatch batch;
 
         // write the data:
         data = datastream.str();
@@ -388,26 +465,6 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
         metadata.set( TIME_FIELD, now.asCompactISO8601() );
         encodeMeta( metadata, data );
         batch.Put( metaKey(key), data );
-
-        objWriteOK = _db->Write( rocksdb::WriteOptions(), &batch ).ok();
-
-        if ( objWriteOK )
-        {
-            ++_tracker->writes;
-            postWrite();
-            
-            if ( _debug )
-            {
-                OE_NOTICE << LC << "Bin " << getID() << ": wrote (" << key << ")\n";
-            }
-        }
-    }
-
-        
-    if ( !objWriteOK )
-    {
-        OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \"" 
-            << r.message() << "\"\n";
     }
 
     return objWriteOK;
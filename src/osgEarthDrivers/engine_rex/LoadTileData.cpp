@@ -124,13 +124,22 @@ namespace
     struct ModelCompilingAttribute : public osg::Texture2D
     {
         osg::observer_ptr<TerrainTileModel> _dataModel;
+        osg::observer_ptr<Loader::Request> _request;
         
         // the ICO calls apply() directly instead of compileGLObjects
         void apply(osg::State& state) const
         {
             osg::ref_ptr<TerrainTileModel> dataModel;
             if (_dataModel.lock(dataModel))
+            {
+                osg::Timer_t start = osg::Timer::instance()->tick();
                 dataModel->compileGLObjects(state);
+
+                // tell the loader what the compile cost, for its merge budget.
+                osg::ref_ptr<Loader::Request> request;
+                if (_request.lock(request))
+                    request->addCompileTime(osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick()));
+            }
         }
 
         // no need to override release or resize since this is a temporary object
@@ -164,8 +173,45 @@ LoadTileData::createStateSet() const
         out = new osg::StateSet();
         ModelCompilingAttribute* mca = new ModelCompilingAttribute();
         mca->_dataModel = _dataModel.get();
+        mca->_request = const_cast<LoadTileData*>(this);
         out->setTextureAttribute(0, mca, 1);
     }
 
     return out.release();
+}
+
+namespace
+{
+    unsigned getTextureDataSize(const osg::Texture* texture)
+    {
+        unsigned bytes = 0u;
+        if (texture)
+        {
+            for (unsigned i = 0; i < texture->getNumImages(); ++i)
+            {
+                const osg::Image* image = texture->getImage(i);
+                if (image)
+                    bytes += image->getTotalSizeInBytesIncludingMipmaps();
+            }
+        }
+        return bytes;
+    }
+}
+
+unsigned
+LoadTileData::getGLDataSize() const
+{
+    unsigned bytes = 0u;
+    if (_dataModel.valid())
+    {
+        const TerrainTileColorLayerModelVector& colorLayers = _dataModel->colorLayers();
+        for (TerrainTileColorLayerModelVector::const_iterator i = colorLayers.begin(); i != colorLayers.end(); ++i)
+        {
+            if (i->valid())
+                bytes += getTextureDataSize(i->get()->getTexture());
+        }
+        bytes += getTextureDataSize(_dataModel->getNormalTexture());
+        bytes += getTextureDataSize(_dataModel->getElevationTexture());
+    }
+    return bytes;
 }
\ No newline at end of file
@@ -29,10 +29,21 @@
 #include <osgDB/Registry>
 #include <osgDB/ReaderWriter>
 
+#include <algorithm>
 #include <string>
 
 #define REPORT_ACTIVITY true
 
+// a request that no cull traversal has asked for in this many frames is
+// for a tile that is no longer visible.
+#define MAX_UNREQUESTED_FRAMES 2u
+
+// GL upload rate assumed for merged data until the ICO has measured one.
+#define DEFAULT_COMPILE_BYTES_PER_SECOND (1024.0*1024.0*1024.0)
+
+// weight of the newest sample in the rolling merge cost averages.
+#define MERGE_COST_SMOOTHING 0.1
+
 using namespace osgEarth::Drivers::RexTerrainEngine;
 
 
@@ -44,6 +55,9 @@ Loader::Request::Request()
     _priority = 0;
     _lastFrameSubmitted = 0;
     _lastTick = 0;
+    _mergePriority = 0.0f;
+    _mergeIndex = -1;
+    _compileTime = 0.0;
 }
 
 void
@@ -131,6 +145,154 @@ SimpleLoader::clear()
 
 //...............................................
 
+namespace
+{
+    // the cull writes a request's priority under the request's own lock.
+    float getPriority(Loader::Request* req)
+    {
+        req->lock();
+        float priority = req->_priority;
+        req->unlock();
+        return priority;
+    }
+}
+
+void
+MergeQueue::push(Loader::Request* req)
+{
+    float priority = getPriority(req);
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    req->_mergePriority = priority;
+
+    if ( req->_mergeIndex >= 0 )
+    {
+        reposition( req->_mergeIndex );
+    }
+    else
+    {
+        req->_mergeIndex = _heap.size();
+        _heap.push_back( req );
+        siftUp( req->_mergeIndex );
+    }
+}
+
+void
+MergeQueue::update(Loader::Request* req)
+{
+    float priority = getPriority(req);
+
+    Threading::ScopedMutexLock lock(_mutex);
+    if ( req->_mergeIndex >= 0 && req->_mergePriority != priority )
+    {
+        req->_mergePriority = priority;
+        reposition( req->_mergeIndex );
+    }
+}
+
+bool
+MergeQueue::pop(osg::ref_ptr<Loader::Request>& out)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if ( _heap.empty() )
+        return false;
+
+    out = _heap.front();
+    removeAt( 0u );
+    return true;
+}
+
+void
+MergeQueue::remove(Loader::Request* req)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    if ( req->_mergeIndex >= 0 )
+        removeAt( req->_mergeIndex );
+}
+
+bool
+MergeQueue::empty() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _heap.empty();
+}
+
+unsigned
+MergeQueue::size() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _heap.size();
+}
+
+void
+MergeQueue::removeAt(unsigned i)
+{
+    _heap[i]->_mergeIndex = -1;
+
+    // fill the hole with the last entry and restore the heap around it.
+    unsigned last = _heap.size()-1;
+    if ( i != last )
+    {
+        _heap[i] = _heap[last];
+        _heap[i]->_mergeIndex = i;
+    }
+    _heap.pop_back();
+
+    if ( i < _heap.size() )
+        reposition( i );
+}
+
+void
+MergeQueue::reposition(unsigned i)
+{
+    if ( i > 0u && _heap[i]->_mergePriority > _heap[(i-1)/2]->_mergePriority )
+        siftUp( i );
+    else
+        siftDown( i );
+}
+
+void
+MergeQueue::siftUp(unsigned i)
+{
+    while( i > 0u )
+    {
+        unsigned parent = (i-1)/2;
+        if ( _heap[i]->_mergePriority <= _heap[parent]->_mergePriority )
+            break;
+        swap( i, parent );
+        i = parent;
+    }
+}
+
+void
+MergeQueue::siftDown(unsigned i)
+{
+    unsigned n = _heap.size();
+    while( true )
+    {
+        unsigned child = 2*i + 1;
+        if ( child >= n )
+            break;
+        if ( child+1 < n && _heap[child+1]->_mergePriority > _heap[child]->_mergePriority )
+            ++child;
+        if ( _heap[child]->_mergePriority <= _heap[i]->_mergePriority )
+            break;
+        swap( i, child );
+        i = child;
+    }
+}
+
+void
+MergeQueue::swap(unsigned a, unsigned b)
+{
+    std::swap( _heap[a], _heap[b] );
+    _heap[a]->_mergeIndex = a;
+    _heap[b]->_mergeIndex = b;
+}
+
+//...............................................
+
 #undef  LC
 #define LC "[PagerLoader.FileLocationCallback] "
 
@@ -220,6 +382,10 @@ namespace
 PagerLoader::PagerLoader(TerrainEngineNode* engine) :
 _checkpoint    ( (osg::Timer_t)0 ),
 _mergesPerFrame( 0 ),
+_mergeBudget   ( 0.0f ),
+_mergeTraversal( false ),
+_avgApplyTime  ( 0.0 ),
+_compileTimePerByte( 1.0/DEFAULT_COMPILE_BYTES_PER_SECOND ),
 _frameNumber   ( 0 ),
 _numLODs       ( 20u )
 {
@@ -248,11 +414,30 @@ void
 PagerLoader::setMergesPerFrame(int value)
 {
     _mergesPerFrame = osg::maximum(value, 0);
-    ADJUST_EVENT_TRAV_COUNT(this, +1);
+    if ( !_mergeTraversal )
+    {
+        ADJUST_EVENT_TRAV_COUNT(this, +1);
+        _mergeTraversal = true;
+    }
     OE_INFO << LC << "Merges per frame = " << _mergesPerFrame << std::endl;
     
 }
 
+void
+PagerLoader::setMergeBudget(float milliseconds)
+{
+    _mergeBudget = osg::maximum(milliseconds, 0.0f);
+    if ( !_mergeTraversal )
+    {
+        ADJUST_EVENT_TRAV_COUNT(this, +1);
+        _mergeTraversal = true;
+    }
+    if ( _mergeBudget > 0.0f )
+    {
+        OE_INFO << LC << "Merge budget = " << _mergeBudget << " ms per frame" << std::endl;
+    }
+}
+
 void
 PagerLoader::setLODPriorityScale(unsigned lod, float priorityScale)
 {
@@ -267,9 +452,35 @@ PagerLoader::setLODPriorityOffset(unsigned lod, float offset)
         _priorityOffsets[lod] = offset;
 }
 
+float
+PagerLoader::normalizePriority(const Loader::Request* request, float priority) const
+{
+    // scale and bias the priority, and then normalize it to [0..1] range.
+    unsigned lod = request->getTileKey().getLOD();
+    float p = priority * _priorityScales[lod] + _priorityOffsets[lod];            
+    return p / (float)(_numLODs+1);
+}
+
 bool
 PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv)
 {
+    // a request that's waiting to merge is still wanted; keep it alive and
+    // move it in the merge queue to reflect the current view.
+    if ( request && request->isMerging() )
+    {
+        request->lock();
+        {
+            if ( nv.getFrameStamp() )
+                request->setFrameNumber( nv.getFrameStamp()->getFrameNumber() );
+
+            request->_priority = normalizePriority( request, priority );
+        }
+        request->unlock();
+
+        _mergeQueue.update( request );
+        return false;
+    }
+
     // check that the request is not already completed but unmerged:
     if ( request && !request->isMerging() && !request->isFinished() && nv.getDatabaseRequestHandler() )
     {
@@ -283,6 +494,7 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
         }
 
         bool addToRequestSet = false;
+        float requestPriority = 0.0f;
 
         // lock the request since multiple cull traversals might hit this function.
         request->lock();
@@ -293,9 +505,8 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
             request->_lastTick = osg::Timer::instance()->tick();
 
             // update the priority, scale and bias it, and then normalize it to [0..1] range.
-            unsigned lod = request->getTileKey().getLOD();
-            float p = priority * _priorityScales[lod] + _priorityOffsets[lod];            
-            request->_priority = p / (float)(_numLODs+1);
+            request->_priority = normalizePriority( request, priority );
+            requestPriority = request->_priority;
 
             // timestamp it
             request->setFrameNumber( fn );
@@ -315,16 +526,17 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
         nv.getDatabaseRequestHandler()->requestNodeFile(
             filename,
             _myNodePath,
-            request->_priority,
+            requestPriority,
             nv.getFrameStamp(),
             request->_internalHandle,
             _dboptions.get() );
 
         // remember the request:
-        if ( true ) // addToRequestSet // Not sure whether we need to keep doing this in order keep it sorted -- check it out.
+        if ( addToRequestSet )
         {
-            Threading::ScopedMutexLock lock( _requestsMutex );
-            _requests[request->getUID()] = request;
+            RequestShard& shard = getShard( request->getUID() );
+            Threading::ScopedMutexLock lock( shard._mutex );
+            shard._requests[request->getUID()] = request;
         }
 
         return true;
@@ -342,7 +554,7 @@ PagerLoader::clear()
 void
 PagerLoader::traverse(osg::NodeVisitor& nv)
 {
-    // only called when _mergesPerFrame > 0
+    // only called when a merge count or budget is set
     if ( nv.getVisitorType() == nv.EVENT_VISITOR )
     {
         if ( nv.getFrameStamp() )
@@ -350,24 +562,17 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
             setFrameStamp(nv.getFrameStamp());
         }
 
+        unsigned fn = 0;
+        if ( nv.getFrameStamp() )
+            fn = nv.getFrameStamp()->getFrameNumber();
+
         // process pending merges.
         {
             METRIC_BEGIN("loader.merge");
-            int count;
-            for(count=0; count < _mergesPerFrame && !_mergeQueue.empty(); ++count)
-            {
-                Request* req = _mergeQueue.begin()->get();
-                if ( req && req->_lastTick >= _checkpoint )
-                {
-                    OE_START_TIMER(req_apply);
-                    req->apply( getFrameStamp() );
-                    double s = OE_STOP_TIMER(req_apply);
-
-                    req->setState(Request::FINISHED);
-                }
-
-                _mergeQueue.erase( _mergeQueue.begin() );
-            }
+            if ( _mergeBudget > 0.0f )
+                mergeByBudget( nv.getFrameStamp() );
+            else
+                mergeByCount( nv.getFrameStamp() );
             METRIC_END("loader.merge");
         }
 
@@ -375,55 +580,56 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
         {
             METRIC_SCOPED("loader.cull");
 
-            Threading::ScopedMutexLock lock( _requestsMutex );
-
-            unsigned fn = 0;
-            if ( nv.getFrameStamp() )
-                fn = nv.getFrameStamp()->getFrameNumber();
-
-            // Purge expired requests.
-            for(Requests::iterator i = _requests.begin(); i != _requests.end(); )
+            for(unsigned s = 0; s < NUM_REQUEST_SHARDS; ++s)
             {
-                Request* req = i->second.get();
-                const unsigned frameDiff = fn - req->getLastFrameSubmitted();
+                RequestShard& shard = _requestShards[s];
+                Threading::ScopedMutexLock lock( shard._mutex );
 
-                // Deal with completed requests:
-                if ( req->isFinished() )
+                // Purge expired requests.
+                for(Requests::iterator i = shard._requests.begin(); i != shard._requests.end(); )
                 {
-                    //OE_INFO << LC << req->getName() << "(" << i->second->getUID() << ") finished." << std::endl; 
-                    req->setState( Request::IDLE );
-                    if ( REPORT_ACTIVITY )
-                        Registry::instance()->endActivity( req->getName() );
-                    _requests.erase( i++ );
-                }
+                    Request* req = i->second.get();
+                    const unsigned frameDiff = fn - req->getLastFrameSubmitted();
 
-                // Discard requests that are no longer required:
-                else if ( !req->isMerging() && frameDiff > 2 )
-                {
-                    //OE_INFO << LC << req->getName() << "(" << i->second->getUID() << ") died waiting after " << frameDiff << " frames" << std::endl; 
-                    req->setState( Request::IDLE );
-                    if ( REPORT_ACTIVITY )
-                        Registry::instance()->endActivity( req->getName() );
-                    _requests.erase( i++ );
-                }
+                    // Deal with completed requests:
+                    if ( req->isFinished() )
+                    {
+                        //OE_INFO << LC << req->getName() << "(" << i->second->getUID() << ") finished." << std::endl; 
+                        req->setState( Request::IDLE );
+                        if ( REPORT_ACTIVITY )
+                            Registry::instance()->endActivity( req->getName() );
+                        shard._requests.erase( i++ );
+                    }
 
-                // Prevent a request from getting stuck in the merge queue:
-                else if ( req->isMerging() && frameDiff > 1800 )
-                {
-                    //OE_INFO << LC << req->getName() << "(" << i->second->getUID() << ") died waiting " << frameDiff << " frames to merge" << std::endl; 
-                    req->setState( Request::IDLE );
-                    if ( REPORT_ACTIVITY )
-                        Registry::instance()->endActivity( req->getName() );
-                    _requests.erase( i++ );
-                }
+                    // Discard requests that are no longer required:
+                    else if ( !req->isMerging() && frameDiff > MAX_UNREQUESTED_FRAMES )
+                    {
+                        //OE_INFO << LC << req->getName() << "(" << i->second->getUID() << ") died waiting after " << frameDiff << " frames" << std::endl; 
+                        req->setState( Request::IDLE );
+                        if ( REPORT_ACTIVITY )
+                            Registry::instance()->endActivity( req->getName() );
+                        shard._requests.erase( i++ );
+                    }
 
-                else // still valid.
-                {
-                    ++i;
+                    // Prevent a request from getting stuck in the merge queue:
+                    else if ( req->isMerging() && frameDiff > 1800 )
+                    {
+                        //OE_INFO << LC << req->getName() << "(" << i->second->getUID() << ") died waiting " << frameDiff << " frames to merge" << std::endl; 
+                        _mergeQueue.remove( req );
+                        req->setState( Request::IDLE );
+                        if ( REPORT_ACTIVITY )
+                            Registry::instance()->endActivity( req->getName() );
+                        shard._requests.erase( i++ );
+                    }
+
+                    else // still valid.
+                    {
+                        ++i;
+                    }
                 }
             }
 
-            //OE_NOTICE << LC << "PagerLoader: requests=" << _requests.size() << "; mergeQueue=" << _mergeQueue.size() << std::endl;
+            //OE_NOTICE << LC << "PagerLoader: mergeQueue=" << _mergeQueue.size() << std::endl;
         }
     }
 
@@ -431,6 +637,99 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
 }
 
 
+bool
+PagerLoader::wantsMerge(const Loader::Request* req, const osg::FrameStamp* stamp) const
+{
+    // Requests that were cleared, or whose tiles have left the view, are not
+    // worth a merge (or any of the merge budget).
+    if ( req->_lastTick < _checkpoint )
+        return false;
+
+    if ( stamp && stamp->getFrameNumber() - req->getLastFrameSubmitted() > MAX_UNREQUESTED_FRAMES )
+        return false;
+
+    return true;
+}
+
+void
+PagerLoader::mergeByCount(const osg::FrameStamp* stamp)
+{
+    int count = 0;
+    osg::ref_ptr<Request> req;
+    while( count < _mergesPerFrame && _mergeQueue.pop(req) )
+    {
+        // Going back to idle lets the purge retire an unwanted request,
+        // and lets the tile ask again if it comes back into view.
+        if ( !wantsMerge(req.get(), stamp) )
+        {
+            req->setState(Request::IDLE);
+        }
+        else
+        {
+            req->apply( getFrameStamp() );
+            req->setState(Request::FINISHED);
+            ++count;
+        }
+    }
+}
+
+void
+PagerLoader::mergeByBudget(const osg::FrameStamp* stamp)
+{
+    const double budget = 0.001 * (double)_mergeBudget;
+    double spent = 0.0;
+    unsigned count = 0u;
+
+    osg::ref_ptr<Request> req;
+    while( _mergeQueue.pop(req) )
+    {
+        if ( !wantsMerge(req.get(), stamp) )
+        {
+            req->setState(Request::IDLE);
+            continue;
+        }
+
+        // GL objects that the ICO already compiled cost nothing more at draw
+        // time; everything else gets compiled on first draw, in this frame.
+        unsigned bytes = req->getGLDataSize();
+        double precompileTime = req->getCompileTime();
+        double compileTime = precompileTime > 0.0 ? 0.0 : (double)bytes * _compileTimePerByte;
+
+        // stop when the next merge would overrun the budget, but always merge
+        // at least one request so a large one cannot stall the queue.
+        if ( count > 0u && spent + _avgApplyTime + compileTime > budget )
+        {
+            _mergeQueue.push( req.get() );
+            break;
+        }
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        req->apply( getFrameStamp() );
+        double applyTime = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+        req->setState(Request::FINISHED);
+        spent += applyTime + compileTime;
+        ++count;
+
+        // update the rolling costs.
+        _avgApplyTime += MERGE_COST_SMOOTHING * (applyTime - _avgApplyTime);
+
+        if ( precompileTime > 0.0 && bytes > 0u )
+        {
+            double timePerByte = precompileTime / (double)bytes;
+            _compileTimePerByte += MERGE_COST_SMOOTHING * (timePerByte - _compileTimePerByte);
+        }
+    }
+
+    if ( Metrics::enabled() )
+    {
+        Metrics::counter("RexMerge",
+            "Merge ms", 1000.0 * spent,
+            "Apply ms", 1000.0 * _avgApplyTime,
+            "Compile ms/MB", 1000.0 * _compileTimePerByte * 1048576.0);
+    }
+}
+
 bool
 PagerLoader::addChild(osg::Node* node)
 {
@@ -444,10 +743,10 @@ PagerLoader::addChild(osg::Node* node)
             // and running (i.e. has not been canceled along the way)
             if (req->_lastTick >= _checkpoint && req->isRunning())
             {
-                if ( _mergesPerFrame > 0 )
+                if ( usingMergeQueue() )
                 {
-                    _mergeQueue.insert( req );
                     req->setState( Request::MERGING );
+                    _mergeQueue.push( req );
                 }
                 else
                 {
@@ -478,9 +777,10 @@ PagerLoader::addChild(osg::Node* node)
 TileKey
 PagerLoader::getTileKeyForRequest(UID requestUID) const
 {
-    Threading::ScopedMutexLock lock( _requestsMutex );
-    Requests::const_iterator i = _requests.find( requestUID );
-    if ( i != _requests.end() )
+    const RequestShard& shard = getShard( requestUID );
+    Threading::ScopedMutexLock lock( shard._mutex );
+    Requests::const_iterator i = shard._requests.find( requestUID );
+    if ( i != shard._requests.end() )
     {
         return i->second->getTileKey();
     }
@@ -493,9 +793,10 @@ PagerLoader::invokeAndRelease(UID requestUID)
 {
     osg::ref_ptr<Request> request;
     {
-        Threading::ScopedMutexLock lock( _requestsMutex );
-        Requests::iterator i = _requests.find( requestUID );
-        if ( i != _requests.end() )
+        RequestShard& shard = getShard( requestUID );
+        Threading::ScopedMutexLock lock( shard._mutex );
+        Requests::iterator i = shard._requests.find( requestUID );
+        if ( i != shard._requests.end() )
         {
             request = i->second.get();
         }
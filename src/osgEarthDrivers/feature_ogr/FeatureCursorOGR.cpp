@@ -22,6 +22,7 @@
 #include <osgEarthFeatures/FilterContext>
 #include <osgEarth/Registry>
 #include <osg/Math>
+#include <osg/observer_ptr>
 #include <algorithm>
 
 #define LC "[FeatureCursorOGR] "
@@ -34,6 +35,22 @@ using namespace osgEarth::Symbology;
 
 namespace
 {
+    // Takes the global GDAL lock only when asked to.
+    struct OptionalGDALLock
+    {
+        OptionalGDALLock(bool lock) : _locked(lock) {
+            if (_locked) osgEarth::getGDALMutex().lock();
+        }
+        ~OptionalGDALLock() {
+            unlock();
+        }
+        void unlock() {
+            if (_locked) osgEarth::getGDALMutex().unlock();
+            _locked = false;
+        }
+        bool _locked;
+    };
+
     /**
      * Determine whether a point is valid or not.  Some shapefiles can have points that are ridiculously big, which are really invalid data
      * but shapefiles have no way of marking the data as invalid.  So instead we check for really large values that are indiciative of something being wrong.
@@ -70,13 +87,110 @@ namespace
 }
 
 
+OGRDataSourcePool::OGRDataSourcePool(const std::string& source) :
+_source(source)
+{
+    //nop
+}
+
+OGRDataSourcePool::~OGRDataSourcePool()
+{
+    OGR_SCOPED_LOCK;
+    for (std::vector<OGRDataSourceH>::iterator i = _idle.begin(); i != _idle.end(); ++i)
+    {
+        OGRReleaseDataSource(*i);
+    }
+    _idle.clear();
+}
+
+struct OGRDataSourcePool::ThreadExited : public Threading::ThreadExitCallback
+{
+    ThreadExited(OGRDataSourcePool* pool) : _pool(pool) { }
+
+    void onThreadExit(unsigned threadId)
+    {
+        osg::ref_ptr<OGRDataSourcePool> pool;
+        if (_pool.lock(pool))
+            pool->threadExited(threadId);
+    }
+
+    osg::observer_ptr<OGRDataSourcePool> _pool;
+};
+
+OGRDataSourceH
+OGRDataSourcePool::acquire()
+{
+    unsigned id = Threading::getCurrentThreadId();
+    bool newThread = false;
+    OGRDataSourceH handle = 0L;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        newThread = _threads.insert(id).second;
+        if (!_idle.empty())
+        {
+            handle = _idle.back();
+            _idle.pop_back();
+        }
+    }
+
+    if (newThread)
+    {
+        Threading::addThreadExitCallback(new ThreadExited(this));
+    }
+
+    if (handle)
+    {
+        return handle;
+    }
+
+    OGR_SCOPED_LOCK;
+    return OGROpen(_source.c_str(), 0, 0L);
+}
+
+void
+OGRDataSourcePool::threadExited(unsigned threadId)
+{
+    std::vector<OGRDataSourceH> excess;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _threads.erase(threadId);
+        while (_idle.size() > _threads.size())
+        {
+            excess.push_back(_idle.back());
+            _idle.pop_back();
+        }
+    }
+
+    if (!excess.empty())
+    {
+        OGR_SCOPED_LOCK;
+        for (unsigned i = 0; i < excess.size(); ++i)
+        {
+            OGRReleaseDataSource(excess[i]);
+        }
+    }
+}
+
+void
+OGRDataSourcePool::release(OGRDataSourceH handle)
+{
+    if (handle)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _idle.push_back(handle);
+    }
+}
+
+//........................................................................
+
 FeatureCursorOGR::FeatureCursorOGR(OGRDataSourceH              dsHandle,
                                    OGRLayerH                   layerHandle,
                                    const FeatureSource*        source,
                                    const FeatureProfile*       profile,
                                    const Symbology::Query&     query,
                                    const FeatureFilterChain*   filters,
-                                   ProgressCallback*           progress) :
+                                   ProgressCallback*           progress,
+                                   OGRDataSourcePool*          pool) :
 FeatureCursor     ( progress ),
 _source           ( source ),
 _dsHandle         ( dsHandle ),
@@ -88,10 +202,13 @@ _chunkSize        ( 500 ),
 _nextHandleToQueue( 0L ),
 _resultSetEndReached(false),
 _profile          ( profile ),
-_filters          ( filters )
+_filters          ( filters ),
+_pool             ( pool )
 {
     {
-        OGR_SCOPED_LOCK;
+        // When the handle comes from a pool, this cursor has exclusive use
+        // of it and needs no global lock; otherwise it may be shared.
+        OptionalGDALLock lock( !_pool.valid() );
 
         std::string expr;
         std::string from = OGR_FD_GetName( OGR_L_GetLayerDefn( _layerHandle ));        
@@ -187,7 +304,7 @@ _filters          ( filters )
 
 FeatureCursorOGR::~FeatureCursorOGR()
 {
-    OGR_SCOPED_LOCK;
+    OptionalGDALLock lock( !_pool.valid() );
 
     if ( _nextHandleToQueue )
         OGR_F_Destroy( _nextHandleToQueue );
@@ -199,7 +316,12 @@ FeatureCursorOGR::~FeatureCursorOGR()
         OGR_G_DestroyGeometry( _spatialFilter );
 
     if ( _dsHandle )
-        OGRReleaseDataSource( _dsHandle );
+    {
+        if ( _pool.valid() )
+            _pool->release( _dsHandle );
+        else
+            OGRReleaseDataSource( _dsHandle );
+    }
 }
 
 bool
@@ -233,12 +355,14 @@ FeatureCursorOGR::readChunk()
 {
     if ( !_resultSetHandle )
         return;
-    
-    OGR_SCOPED_LOCK;
 
     while( _queue.size() < _chunkSize && !_resultSetEndReached )
     {
         FeatureList filterList;
+
+        // read the raw features; the filters below run without the lock.
+        OptionalGDALLock lock( !_pool.valid() );
+
         while( filterList.size() < _chunkSize && !_resultSetEndReached )
         {
             OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
@@ -285,6 +409,8 @@ FeatureCursorOGR::readChunk()
             }
         }
 
+        lock.unlock();
+
         // preprocess the features using the filter list:
         if ( _filters.valid() && !_filters->empty() )
         {
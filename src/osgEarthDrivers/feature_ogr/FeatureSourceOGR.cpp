@@ -134,6 +134,8 @@ public:
             _source = _options.connection().value();
         }
 
+        _readPool = new OGRDataSourcePool(_source);
+
         // ..or inline geometry?
         _geometry =
             _options.geometry().valid() ? _options.geometry().get() :
@@ -212,6 +214,8 @@ public:
         {
             _source = _options.connection().value();
         }
+
+        _readPool = new OGRDataSourcePool(_source);
         
         // ..or inline geometry?
         _geometry = 
@@ -426,17 +430,13 @@ public:
             OGRDataSourceH dsHandle = 0L;
             OGRLayerH layerHandle = 0L;
 
-            // open the handles safely:
+            // Each cursor requires its own DS handle so that multi-threaded access will work.
+            // The cursor returns the handle to the pool when it is done.
+            if ( _readPool.valid() )
+                dsHandle = _readPool->acquire();
+            if ( dsHandle )
             {
-                OGR_SCOPED_LOCK;
-
-                // Each cursor requires its own DS handle so that multi-threaded access will work.
-                // The cursor impl will dispose of the new DS handle.
-                dsHandle = OGROpenShared( _source.c_str(), 0, &_ogrDriverHandle );
-                if ( dsHandle )
-                {
-                    layerHandle = openLayer(dsHandle, _options.layer().get());
-                }
+                layerHandle = openLayer(dsHandle, _options.layer().get());
             }
 
             if ( dsHandle && layerHandle )
@@ -457,16 +457,13 @@ public:
                     getFeatureProfile(),
                     newQuery,
                     getFilters(),
-                    progress);
+                    progress,
+                    _readPool.get());
             }
             else
             {
                 if ( dsHandle )
-                {
-                    OGR_SCOPED_LOCK;
-                    OGRReleaseDataSource( dsHandle );
-                }
-
+                    _readPool->release( dsHandle );
                 return 0L;
             }
         }
@@ -640,6 +637,7 @@ private:
     OGRLayerH _layerHandle;
     OGRSFDriverH _ogrDriverHandle;
     osg::ref_ptr<Symbology::Geometry> _geometry; // explicit geometry.
+    osg::ref_ptr<OGRDataSourcePool> _readPool;
     const OGRFeatureOptions _options;
     int _featureCount;
     bool _needsSync;
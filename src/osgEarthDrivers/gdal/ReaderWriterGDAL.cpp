@@ -33,6 +33,8 @@
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 #include <osgDB/ImageOptions>
+#include <osg/observer_ptr>
+#include <OpenThreads/Atomic>
 
 #include <sstream>
 #include <stdlib.h>
@@ -681,6 +683,22 @@ GeoExtent getGeoExtent(std::string& filename)
 
 
 
+namespace
+{
+    // Takes the global GDAL lock only when asked to.
+    struct OptionalGDALLock
+    {
+        OptionalGDALLock(bool lock) : _locked(lock) {
+            if (_locked) osgEarth::getGDALMutex().lock();
+        }
+        ~OptionalGDALLock() {
+            if (_locked) osgEarth::getGDALMutex().unlock();
+        }
+        bool _locked;
+    };
+}
+
+
 class GDALTileSource : public TileSource
 {
 public:
@@ -688,6 +706,11 @@ public:
       TileSource( options ),
       _srcDS(NULL),
       _warpedDS(NULL),
+      _reopenable(0u),
+      _warpRequired(false),
+      _warpPolar(false),
+      _rasterXSize(0),
+      _rasterYSize(0),
       _options(options),
       _maxDataLevel(30),
       _linearUnits(1.0)
@@ -698,6 +721,19 @@ public:
     {
         GDAL_SCOPED_LOCK;
 
+        // Close the per-thread read handles. A thread exit callback can no
+        // longer reach us through its observer, but take the handles under
+        // the lock anyway so the map is never read while it is changing.
+        ThreadDatasets threadDatasets;
+        {
+            Threading::ScopedMutexLock lock(_threadDatasetsMutex);
+            threadDatasets.swap(_threadDatasets);
+        }
+        for (ThreadDatasets::iterator i = threadDatasets.begin(); i != threadDatasets.end(); ++i)
+        {
+            closeDatasets(i->second);
+        }
+
         // Close the _warpedDS dataset if :
         // - it exists
         // - and is different from _srcDS
@@ -897,12 +933,20 @@ public:
                         return Status::Error( "Failed to build VRT from input datasets" );
                     }
                 }
+
+                // The serialized VRT lets reading threads open their own copies.
+                char** vrtXML = _srcDS->GetMetadata("xml:VRT");
+                if (vrtXML && vrtXML[0])
+                {
+                    _reopenConnection = vrtXML[0];
+                }
             }
             else
             {
                 //If we couldn't build a VRT, just try opening the file directly
                 //Open the dataset
                 _srcDS = (GDALDataset*)GDALOpen( files[0].c_str(), GA_ReadOnly );
+                _reopenConnection = files[0];
 
                 if (_srcDS)
                 {
@@ -920,6 +964,7 @@ public:
                         char *pszSubdatasetName = CPLStrdup( CSLFetchNameValue( subDatasets, buf.str().c_str() ) );
                         GDALClose( _srcDS );
                         _srcDS = (GDALDataset*)GDALOpen( pszSubdatasetName, GA_ReadOnly ) ;
+                        _reopenConnection = pszSubdatasetName;
                         CPLFree( pszSubdatasetName );
                     }
                 }
@@ -1050,27 +1095,12 @@ public:
 
         if ( requiresReprojection || (profile && !profile->getSRS()->isEquivalentTo( src_srs.get() )) )
         {
-            if ( profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar()) )
-            {
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    profile->getSRS()->getWKT().c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    NULL);
-            }
-            else
-            {
-                std::string destWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRT(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    destWKT.c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    0);
-            }
+            _warpRequired = true;
+            _warpPolar = profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar());
+            _warpSrcWKT = src_srs->getWKT();
+            _warpDstWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
+
+            _warpedDS = createWarpedDataset(_srcDS);
 
             if ( _warpedDS )
             {
@@ -1088,6 +1118,10 @@ public:
             return Status::Error( "Failed to create a warping VRT" );
         }
 
+        _rasterXSize = _warpedDS->GetRasterXSize();
+        _rasterYSize = _warpedDS->GetRasterYSize();
+        _reopenable.exchange(!useExternalDataset && !_reopenConnection.empty() ? 1u : 0u);
+
         //Get the _geotransform
         if ( getProfile() )
         {
@@ -1258,8 +1292,6 @@ public:
     */
     static GDALRasterBand* findBandByColorInterp(GDALDataset *ds, GDALColorInterp colorInterp)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetColorInterpretation() == colorInterp) return ds->GetRasterBand(i);
@@ -1269,8 +1301,6 @@ public:
 
     static GDALRasterBand* findBandByDataType(GDALDataset *ds, GDALDataType dataType)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetRasterDataType() == dataType) return ds->GetRasterBand(i);
@@ -1376,8 +1406,8 @@ public:
         double eps = 0.0001;
         if (osg::equivalent(x, 0, eps)) x = 0;
         if (osg::equivalent(y, 0, eps)) y = 0;
-        if (osg::equivalent(x, (double)_warpedDS->GetRasterXSize(), eps)) x = _warpedDS->GetRasterXSize();
-        if (osg::equivalent(y, (double)_warpedDS->GetRasterYSize(), eps)) y = _warpedDS->GetRasterYSize();
+        if (osg::equivalent(x, (double)_rasterXSize, eps)) x = _rasterXSize;
+        if (osg::equivalent(y, (double)_rasterYSize, eps)) y = _rasterYSize;
 
     }
 
@@ -1447,7 +1477,13 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        // Read through this thread's own dataset handles when possible so that
+        // tiles can be created in parallel; otherwise fall back on the shared
+        // handles under the global GDAL lock.
+        GDALDataset* warpedDS = getThreadDataset();
+        OptionalGDALLock lock(warpedDS == 0L);
+        if (!warpedDS)
+            warpedDS = _warpedDS;
 
         int tileSize = getPixelsPerTile(); //_options.tileSize().value();
 
@@ -1512,8 +1548,8 @@ public:
         int height = (int)(src_max_y - src_min_y);
 
 
-        int rasterWidth = _warpedDS->GetRasterXSize();
-        int rasterHeight = _warpedDS->GetRasterYSize();
+        int rasterWidth = warpedDS->GetRasterXSize();
+        int rasterHeight = warpedDS->GetRasterYSize();
         if (off_x + width > rasterWidth || off_y + height > rasterHeight)
         {
             OE_WARN << LC << "Read window outside of bounds of dataset.  Source Dimensions=" << rasterWidth << "x" << rasterHeight << " Read Window=" << off_x << ", " << off_y << " " << width << "x" << height << std::endl;
@@ -1547,44 +1583,44 @@ public:
 
 
 
-        GDALRasterBand* bandRed = findBandByColorInterp(_warpedDS, GCI_RedBand);
-        GDALRasterBand* bandGreen = findBandByColorInterp(_warpedDS, GCI_GreenBand);
-        GDALRasterBand* bandBlue = findBandByColorInterp(_warpedDS, GCI_BlueBand);
-        GDALRasterBand* bandAlpha = findBandByColorInterp(_warpedDS, GCI_AlphaBand);
+        GDALRasterBand* bandRed = findBandByColorInterp(warpedDS, GCI_RedBand);
+        GDALRasterBand* bandGreen = findBandByColorInterp(warpedDS, GCI_GreenBand);
+        GDALRasterBand* bandBlue = findBandByColorInterp(warpedDS, GCI_BlueBand);
+        GDALRasterBand* bandAlpha = findBandByColorInterp(warpedDS, GCI_AlphaBand);
 
-        GDALRasterBand* bandGray = findBandByColorInterp(_warpedDS, GCI_GrayIndex);
+        GDALRasterBand* bandGray = findBandByColorInterp(warpedDS, GCI_GrayIndex);
 
-        GDALRasterBand* bandPalette = findBandByColorInterp(_warpedDS, GCI_PaletteIndex);
+        GDALRasterBand* bandPalette = findBandByColorInterp(warpedDS, GCI_PaletteIndex);
 
         if (!bandRed && !bandGreen && !bandBlue && !bandAlpha && !bandGray && !bandPalette)
         {
             OE_DEBUG << LC << "Could not determine bands based on color interpretation, using band count" << std::endl;
             //We couldn't find any valid bands based on the color interp, so just make an educated guess based on the number of bands in the file
             //RGB = 3 bands
-            if (_warpedDS->GetRasterCount() == 3)
+            if (warpedDS->GetRasterCount() == 3)
             {
-                bandRed   = _warpedDS->GetRasterBand( 1 );
-                bandGreen = _warpedDS->GetRasterBand( 2 );
-                bandBlue  = _warpedDS->GetRasterBand( 3 );
+                bandRed   = warpedDS->GetRasterBand( 1 );
+                bandGreen = warpedDS->GetRasterBand( 2 );
+                bandBlue  = warpedDS->GetRasterBand( 3 );
             }
             //RGBA = 4 bands
-            else if (_warpedDS->GetRasterCount() == 4)
+            else if (warpedDS->GetRasterCount() == 4)
             {
-                bandRed   = _warpedDS->GetRasterBand( 1 );
-                bandGreen = _warpedDS->GetRasterBand( 2 );
-                bandBlue  = _warpedDS->GetRasterBand( 3 );
-                bandAlpha = _warpedDS->GetRasterBand( 4 );
+                bandRed   = warpedDS->GetRasterBand( 1 );
+                bandGreen = warpedDS->GetRasterBand( 2 );
+                bandBlue  = warpedDS->GetRasterBand( 3 );
+                bandAlpha = warpedDS->GetRasterBand( 4 );
             }
             //Gray = 1 band
-            else if (_warpedDS->GetRasterCount() == 1)
+            else if (warpedDS->GetRasterCount() == 1)
             {
-                bandGray = _warpedDS->GetRasterBand( 1 );
+                bandGray = warpedDS->GetRasterBand( 1 );
             }
             //Gray + alpha = 2 bands
-            else if (_warpedDS->GetRasterCount() == 2)
+            else if (warpedDS->GetRasterCount() == 2)
             {
-                bandGray  = _warpedDS->GetRasterBand( 1 );
-                bandAlpha = _warpedDS->GetRasterBand( 2 );
+                bandGray  = warpedDS->GetRasterBand( 1 );
+                bandAlpha = warpedDS->GetRasterBand( 2 );
             }
         }
 
@@ -1914,7 +1950,6 @@ public:
 
     bool isValidValue(float v, GDALRasterBand* band)
     {
-        GDAL_SCOPED_LOCK;
         return isValidValue_noLock( v, band );
     }
 
@@ -1938,25 +1973,25 @@ public:
             {
                 c = 0;
             }
-            else if (c > _warpedDS->GetRasterXSize()-1 && c <= _warpedDS->GetRasterXSize()-0.5)
+            else if (c > _rasterXSize-1 && c <= _rasterXSize-0.5)
             {
-                c = _warpedDS->GetRasterXSize()-1;
+                c = _rasterXSize-1;
             }
 
             if (r < 0 && r >= -0.5)
             {
                 r = 0;
             }
-            else if (r > _warpedDS->GetRasterYSize()-1 && r <= _warpedDS->GetRasterYSize()-0.5)
+            else if (r > _rasterYSize-1 && r <= _rasterYSize-0.5)
             {
-                r = _warpedDS->GetRasterYSize()-1;
+                r = _rasterYSize-1;
             }
         }
 
         float result = 0.0f;
 
         //If the location is outside of the pixel values of the dataset, just return 0
-        if (c < 0 || r < 0 || c > _warpedDS->GetRasterXSize()-1 || r > _warpedDS->GetRasterYSize()-1)
+        if (c < 0 || r < 0 || c > _rasterXSize-1 || r > _rasterYSize-1)
             return NO_DATA_VALUE;
 
         if ( _options.interpolation() == INTERP_NEAREST )
@@ -1970,9 +2005,9 @@ public:
         else
         {
             int rowMin = osg::maximum((int)floor(r), 0);
-            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_warpedDS->GetRasterYSize()-1)), 0);
+            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_rasterYSize-1)), 0);
             int colMin = osg::maximum((int)floor(c), 0);
-            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_warpedDS->GetRasterXSize()-1)), 0);
+            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_rasterXSize-1)), 0);
 
             if (rowMin > rowMax) rowMin = rowMax;
             if (colMin > colMax) colMin = colMax;
@@ -2046,7 +2081,11 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        // see createImage
+        GDALDataset* warpedDS = getThreadDataset();
+        OptionalGDALLock lock(warpedDS == 0L);
+        if (!warpedDS)
+            warpedDS = _warpedDS;
 
         int tileSize = getPixelsPerTile();
 
@@ -2061,11 +2100,11 @@ public:
             key.getExtent().getBounds(xmin, ymin, xmax, ymax);
 
             // Try to find a FLOAT band
-            GDALRasterBand* band = findBandByDataType(_warpedDS, GDT_Float32);
+            GDALRasterBand* band = findBandByDataType(warpedDS, GDT_Float32);
             if (band == NULL)
             {
                 // Just get first band
-                band = _warpedDS->GetRasterBand(1);
+                band = warpedDS->GetRasterBand(1);
             }
 
             if (_options.interpolation() == INTERP_NEAREST)
@@ -2084,9 +2123,9 @@ public:
                 int iNumRows = iRowMax - iRowMin + 1;
 
                 int iWinColMin = max(0, iColMin);
-                int iWinColMax = min(_warpedDS->GetRasterXSize()-1, iColMax);
+                int iWinColMax = min(warpedDS->GetRasterXSize()-1, iColMax);
                 int iWinRowMin = max(0, iRowMin);
-                int iWinRowMax = min(_warpedDS->GetRasterYSize()-1, iRowMax);
+                int iWinRowMax = min(warpedDS->GetRasterYSize()-1, iRowMax);
                 int iNumWinCols = iWinColMax - iWinColMin + 1;
                 int iNumWinRows = iWinRowMax - iWinRowMin + 1;
 
@@ -2140,11 +2179,152 @@ public:
         return key.getExtent().intersects( _extents );
     }
 
+    // Source and warped dataset handles used by one reading thread.
+    struct Datasets
+    {
+        Datasets() : _srcDS(0L), _warpedDS(0L) { }
+        GDALDataset* _srcDS;
+        GDALDataset* _warpedDS;
+    };
+
+    // Creates the warping VRT for a source dataset; assumes the GDAL lock is taken.
+    GDALDataset* createWarpedDataset(GDALDataset* srcDS)
+    {
+        if (_warpPolar)
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDstWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                NULL);
+        }
+        else
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRT(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDstWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                0);
+        }
+    }
+
+    // Closes a pair of per-thread handles; assumes the GDAL lock is taken.
+    void closeDatasets(Datasets& ds)
+    {
+        if (ds._warpedDS && ds._warpedDS != ds._srcDS)
+            GDALClose(ds._warpedDS);
+        if (ds._srcDS)
+            GDALClose(ds._srcDS);
+        ds._srcDS = ds._warpedDS = 0L;
+    }
+
+    // Gets the (warped) dataset owned by the calling thread, opening it on
+    // first use. GDAL datasets must not be shared between threads, but
+    // separate handles on the same source can be read concurrently.
+    // Returns NULL if the source cannot be reopened (e.g. an external dataset),
+    // in which case the caller must use the shared handles under the GDAL lock.
+    GDALDataset* getThreadDataset()
+    {
+        if ((unsigned)_reopenable == 0u)
+            return 0L;
+
+        unsigned id = Threading::getCurrentThreadId();
+        {
+            Threading::ScopedMutexLock lock(_threadDatasetsMutex);
+            ThreadDatasets::const_iterator i = _threadDatasets.find(id);
+            if (i != _threadDatasets.end())
+                return i->second._warpedDS;
+        }
+
+        Datasets ds;
+        {
+            GDAL_SCOPED_LOCK;
+
+            ds._srcDS = (GDALDataset*)GDALOpen(_reopenConnection.c_str(), GA_ReadOnly);
+            if (ds._srcDS)
+            {
+                ds._warpedDS = _warpRequired ? createWarpedDataset(ds._srcDS) : ds._srcDS;
+            }
+
+            if (!ds._warpedDS ||
+                ds._warpedDS->GetRasterXSize() != _rasterXSize ||
+                ds._warpedDS->GetRasterYSize() != _rasterYSize)
+            {
+                OE_WARN << LC << "Failed to open a read handle on " << _reopenConnection
+                    << "; falling back on serialized reads" << std::endl;
+                closeDatasets(ds);
+                _reopenable.exchange(0u);
+                return 0L;
+            }
+        }
+
+        {
+            Threading::ScopedMutexLock lock(_threadDatasetsMutex);
+            _threadDatasets[id] = ds;
+        }
+
+        // close the handles when the thread exits, so they don't pile up
+        // as pager and scheduler threads come and go.
+        Threading::addThreadExitCallback(new CloseThreadDatasets(this));
+
+        return ds._warpedDS;
+    }
+
+    // Closes the handles a thread opened; called when the thread exits.
+    void closeThreadDatasets(unsigned id)
+    {
+        Datasets ds;
+        {
+            Threading::ScopedMutexLock lock(_threadDatasetsMutex);
+            ThreadDatasets::iterator i = _threadDatasets.find(id);
+            if (i == _threadDatasets.end())
+                return;
+            ds = i->second;
+            _threadDatasets.erase(i);
+        }
+
+        GDAL_SCOPED_LOCK;
+        closeDatasets(ds);
+    }
+
+    struct CloseThreadDatasets : public Threading::ThreadExitCallback
+    {
+        CloseThreadDatasets(GDALTileSource* source) : _source(source) { }
+
+        void onThreadExit(unsigned id)
+        {
+            osg::ref_ptr<GDALTileSource> source;
+            if (_source.lock(source))
+                source->closeThreadDatasets(id);
+        }
+
+        osg::observer_ptr<GDALTileSource> _source;
+    };
+
 
 private:
 
     GDALDataset* _srcDS;
     GDALDataset* _warpedDS;
+
+    // information needed to reopen the dataset on other threads
+    std::string  _reopenConnection;
+    OpenThreads::Atomic _reopenable;  // read without a lock by every reading thread
+    bool         _warpRequired;
+    bool         _warpPolar;
+    std::string  _warpSrcWKT;
+    std::string  _warpDstWKT;
+    int          _rasterXSize;
+    int          _rasterYSize;
+
+    typedef std::map<unsigned, Datasets> ThreadDatasets;
+    ThreadDatasets   _threadDatasets;
+    Threading::Mutex _threadDatasetsMutex;
+
     double       _geotransform[6];
     double       _invtransform[6];
     double       _linearUnits;
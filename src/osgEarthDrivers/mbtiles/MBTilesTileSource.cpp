@@ -53,6 +53,55 @@ namespace
         }
         return rw;
     }
+
+    const char* SELECT_TILE_SQL = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+    const char* INSERT_TILE_SQL = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
+
+    // Prepares a statement on first use, keeping it for the next time.
+    bool prepare(sqlite3* database, const char* query, sqlite3_stmt*& statement)
+    {
+        if ( statement )
+            return true;
+
+        int rc = sqlite3_prepare_v2( database, query, -1, &statement, 0L );
+        if ( rc != SQLITE_OK )
+        {
+            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(database) << std::endl;
+            statement = 0L;
+            return false;
+        }
+        return true;
+    }
+
+    // Copies the data of a tile into "output". Returns false if there is no such tile.
+    bool readTileData(sqlite3* database, sqlite3_stmt*& select, int z, int x, int y, std::string& output)
+    {
+        if ( !prepare(database, SELECT_TILE_SQL, select) )
+            return false;
+
+        sqlite3_bind_int( select, 1, z );
+        sqlite3_bind_int( select, 2, x );
+        sqlite3_bind_int( select, 3, y );
+
+        bool found = false;
+        int rc = sqlite3_step( select );
+        if ( rc == SQLITE_ROW)
+        {
+            // the pointer returned from _blob gets freed internally by sqlite, supposedly
+            const char* data = (const char*)sqlite3_column_blob( select, 0 );
+            int dataLen = sqlite3_column_bytes( select, 0 );
+            if ( data && dataLen > 0 )
+                output.assign( data, dataLen );
+            found = true;
+        }
+        else
+        {
+            OE_DEBUG << LC << "SQL QUERY failed for " << SELECT_TILE_SQL << ": " << std::endl;
+        }
+
+        sqlite3_reset( select );
+        return found;
+    }
 }
 
 //......................................................................
@@ -61,6 +110,11 @@ MBTilesTileSource::MBTilesTileSource(const TileSourceOptions& options) :
 TileSource( options ),
 _options  ( options ),
 _database ( NULL ),
+_selectTile( NULL ),
+_insertTile( NULL ),
+_inTransaction( false ),
+_pendingWrites( 0u ),
+_transactionStart( 0 ),
 _minLevel ( 0 ),
 _maxLevel ( 20 ),
 _forceRGB ( false )
@@ -68,6 +122,59 @@ _forceRGB ( false )
     //nop
 }
 
+MBTilesTileSource::~MBTilesTileSource()
+{
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    commitPendingWrites();
+
+    sqlite3_finalize( _selectTile );
+    sqlite3_finalize( _insertTile );
+    sqlite3_close( _database );
+}
+
+MBTilesTileSource::ReadConnection::~ReadConnection()
+{
+    sqlite3_finalize( _selectTile );
+    sqlite3_close( _database );
+}
+
+MBTilesTileSource::ReadConnection&
+MBTilesTileSource::getReadConnection()
+{
+    ReadConnection& conn = _readConnections.get();
+
+    if ( !conn._database && !conn._failed )
+    {
+        int rc = sqlite3_open_v2( _fullFilename.c_str(), &conn._database, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, 0L );
+        if ( rc != SQLITE_OK )
+        {
+            OE_WARN << LC << "Database \"" << _fullFilename << "\": " << sqlite3_errmsg(conn._database) << std::endl;
+            sqlite3_close( conn._database );
+            conn._database = 0L;
+            conn._failed = true;
+        }
+    }
+
+    return conn;
+}
+
+void
+MBTilesTileSource::commitPendingWrites()
+{
+    if ( !_inTransaction )
+        return;
+
+    char* errorMsg = 0L;
+    if ( SQLITE_OK != sqlite3_exec(_database, "COMMIT", 0L, 0L, &errorMsg) )
+    {
+        OE_WARN << LC << "Failed to commit " << _pendingWrites << " tiles: " << (errorMsg ? errorMsg : "") << std::endl;
+        sqlite3_free( errorMsg );
+    }
+    _inTransaction = false;
+    _pendingWrites = 0u;
+}
+
 Status
 MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
 {
@@ -83,6 +190,8 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
             fullFilename = _options.filename()->full();
     }
 
+    _fullFilename = fullFilename;
+
     bool isNewDatabase = readWrite && !osgDB::fileExists(fullFilename);
 
     if ( isNewDatabase )
@@ -303,8 +412,6 @@ osg::Image*
 MBTilesTileSource::createImage(const TileKey&    key,
                                ProgressCallback* progress)
 {
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     int z = key.getLevelOfDetail();
     int x = key.getTileX();
     int y = key.getTileY();
@@ -325,65 +432,48 @@ MBTilesTileSource::createImage(const TileKey&    key,
     y  = numRows - y - 1;
 
     //Get the image
-    sqlite3_stmt* select = NULL;
-    std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &select, 0L );
-    if ( rc != SQLITE_OK )
+    std::string dataBuffer;
+    bool found = false;
+
+    if ( (getMode() & MODE_WRITE) == 0 )
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
-        return NULL;
+        // each thread reads through its own connection, so reads run concurrently.
+        ReadConnection& conn = getReadConnection();
+        if ( conn._database )
+            found = readTileData( conn._database, conn._selectTile, z, x, y, dataBuffer );
     }
-
-    bool valid = true;
-
-    sqlite3_bind_int( select, 1, z );
-    sqlite3_bind_int( select, 2, x );
-    sqlite3_bind_int( select, 3, y );
-
-    osg::Image* result = NULL;
-    rc = sqlite3_step( select );
-    if ( rc == SQLITE_ROW)
+    else
     {
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
-        const char* data = (const char*)sqlite3_column_blob( select, 0 );
-        int dataLen = sqlite3_column_bytes( select, 0 );
+        // a writable source reads through the writing connection, so it sees
+        // the tiles that are not committed yet.
+        Threading::ScopedMutexLock exclusiveLock(_mutex);
+        found = readTileData( _database, _selectTile, z, x, y, dataBuffer );
+    }
 
-        std::string dataBuffer( data, dataLen );
+    if ( !found )
+    {
+        return NULL;
+    }
 
-        // decompress if necessary:
-        if ( _compressor.valid() )
+    // decompress if necessary:
+    if ( _compressor.valid() )
+    {
+        std::istringstream inputStream(dataBuffer);
+        std::string value;
+        if ( !_compressor->decompress(inputStream, value) )
         {
-            std::istringstream inputStream(dataBuffer);
-            std::string value;
-            if ( !_compressor->decompress(inputStream, value) )
-            {
-                if ( _options.filename().isSet() )
-                    OE_WARN << LC << "Decompression failed: " << _options.filename()->base() << std::endl;
-                else
-                    OE_WARN << LC << "Decompression failed" << std::endl;
-                valid = false;
-            }
+            if ( _options.filename().isSet() )
+                OE_WARN << LC << "Decompression failed: " << _options.filename()->base() << std::endl;
             else
-            {
-                dataBuffer = value;
-            }
-        }
-
-        // decode the raw image data:
-        if ( valid )
-        {
-            std::istringstream inputStream(dataBuffer);
-            result = ImageUtils::readStream(inputStream, _dbOptions.get());
+                OE_WARN << LC << "Decompression failed" << std::endl;
+            return NULL;
         }
-    }
-    else
-    {
-        OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
-        valid = false;
+        dataBuffer.swap( value );
     }
 
-    sqlite3_finalize( select );
-    return result;
+    // decode the raw image data:
+    std::istringstream inputStream(dataBuffer);
+    return ImageUtils::readStream(inputStream, _dbOptions.get());
 }
 
 bool
@@ -394,8 +484,6 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     if ( (getMode() & MODE_WRITE) == 0 )
         return false;
 
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     // encode the data stream:
     std::stringstream buf;
     osgDB::ReaderWriter::WriteResult wr;
@@ -438,43 +526,65 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
     // Prep the insert statement:
-    sqlite3_stmt* insert = NULL;
-    std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &insert, 0L );
-    if ( rc != SQLITE_OK )
+    if ( !prepare(_database, INSERT_TILE_SQL, _insertTile) )
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
         return false;
     }
 
+    // Tiles are committed in batches; a commit per tile waits on the disk every time.
+    // If a transaction cannot be started the tile is committed on its own.
+    if ( !_inTransaction && SQLITE_OK == sqlite3_exec( _database, "BEGIN TRANSACTION", 0L, 0L, 0L ) )
+    {
+        _inTransaction = true;
+        _transactionStart = osg::Timer::instance()->tick();
+    }
+
     // bind parameters:
-    sqlite3_bind_int( insert, 1, z );
-    sqlite3_bind_int( insert, 2, x );
-    sqlite3_bind_int( insert, 3, y );
+    sqlite3_bind_int( _insertTile, 1, z );
+    sqlite3_bind_int( _insertTile, 2, x );
+    sqlite3_bind_int( _insertTile, 3, y );
 
     // bind the data blob:
-    sqlite3_bind_blob( insert, 4, value.c_str(), value.length(), SQLITE_STATIC );
+    sqlite3_bind_blob( _insertTile, 4, value.c_str(), value.length(), SQLITE_STATIC );
 
     // run the sql.
     bool ok = true;
+    int rc;
     int tries = 0;
     do {
-        rc = sqlite3_step(insert);
+        rc = sqlite3_step(_insertTile);
     }
     while (++tries < 100 && (rc == SQLITE_BUSY || rc == SQLITE_LOCKED));
 
     if (SQLITE_OK != rc && SQLITE_DONE != rc)
     {
 #if SQLITE_VERSION_NUMBER >= 3007015
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
+        OE_WARN << LC << "Failed query: " << INSERT_TILE_SQL << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
 #else
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
+        OE_WARN << LC << "Failed query: " << INSERT_TILE_SQL << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
 #endif
         ok = false;
     }
 
-    sqlite3_finalize( insert );
+    // release the blob before "value" goes away.
+    sqlite3_reset( _insertTile );
+    sqlite3_clear_bindings( _insertTile );
+
+    if ( ok )
+    {
+        ++_pendingWrites;
+    }
+
+    // commit a full batch, or one that has been open too long.
+    if ( _inTransaction &&
+        (_pendingWrites >= osg::maximum(_options.writeBatchSize().get(), 1u) ||
+         osg::Timer::instance()->delta_s(_transactionStart, osg::Timer::instance()->tick()) >= _options.writeBatchSeconds().get()) )
+    {
+        commitPendingWrites();
+    }
 
     return ok;
 }
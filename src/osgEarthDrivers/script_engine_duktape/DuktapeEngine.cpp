@@ -33,6 +33,7 @@
 
 using namespace osgEarth;
 using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
 using namespace osgEarth::Drivers::Duktape;
 
 //............................................................................
@@ -56,26 +57,18 @@ namespace
 
     static duk_ret_t oe_duk_save_feature(duk_context* ctx)
     {
-        // stack: [ptr]
+        // stack: [ptr, properties, geometry]
+        // The properties and geometry are undefined if the script never
+        // touched them, in which case there is nothing to save.
 
         // pull the feature ptr from argument #0
         Feature* feature = reinterpret_cast<Feature*>(duk_require_pointer(ctx, 0));
 
-        // Fetch the feature data:
-        duk_push_global_object(ctx);                    
-        // [ptr, global]
-
-        if ( !duk_get_prop_string(ctx, -1, "feature") || !duk_is_object(ctx, -1))
-            return 0;
-
-         // [ptr, global, feature]
-
-        if ( duk_get_prop_string(ctx, -1, "properties") && duk_is_object(ctx, -1) )
+        if ( duk_is_object(ctx, 1) )
         {
-            // [ptr, global, feature, props]
-            duk_enum(ctx, -1, 0);                       
+            duk_enum(ctx, 1, 0);
         
-            // [ptr, global, feature, props, enum]
+            // [ptr, properties, geometry, enum]
             while( duk_next(ctx, -1, 1/*get_value=true*/) )
             {
                 std::string key( duk_get_string(ctx, -2) );
@@ -98,42 +91,254 @@ namespace
                  duk_pop_2(ctx);
             }
 
-            duk_pop_2(ctx);
-            // [ptr, global, feature]
-        }
-        else
-        {   // [ptr, global, feature, undefined]
             duk_pop(ctx);
-            // [ptr, global, feature]
+            // [ptr, properties, geometry]
         }
 
         // save the geometry, if set:
-        if ( duk_get_prop_string(ctx, -1, "geometry") )
+        if ( duk_is_object(ctx, 2) )
         {
-            if (duk_is_object(ctx, -1))
+            std::string json( duk_json_encode(ctx, 2) ); // [ptr, properties, json]
+            Geometry* newGeom = GeometryUtils::geometryFromGeoJSON(json);
+            if ( newGeom )
             {
-                // [ptr, global, feature, geometry]
-                std::string json( duk_json_encode(ctx, -1) ); // [ptr, global, feature, json]
-                Geometry* newGeom = GeometryUtils::geometryFromGeoJSON(json);
-                if ( newGeom )
-                {
-                    feature->setGeometry( newGeom );
-                }
-                duk_pop(ctx); // [ptr, global, feature]
+                feature->setGeometry( newGeom );
+            }
+        }
+        else if ( !duk_is_undefined(ctx, 2) )
+        {
+            feature->setGeometry(0L);
+        }
+
+        return 0;           // no return values.
+    }
+
+    //! Pushes the vertices of a geometry part as an array of [x,y,z] positions,
+    //! last vertex first, the same as GeometryUtils::geometryToGeoJSON.
+    void pushPositions(duk_context* ctx, const Geometry* part, duk_idx_t array_i, duk_uarridx_t& n)
+    {
+        for(int v = (int)part->size()-1; v >= 0; --v)
+        {
+            const osg::Vec3d& p = (*part)[v];
+            duk_idx_t point_i = duk_push_array(ctx);
+            duk_push_number(ctx, p.x());
+            duk_put_prop_index(ctx, point_i, 0);
+            duk_push_number(ctx, p.y());
+            duk_put_prop_index(ctx, point_i, 1);
+            duk_push_number(ctx, p.z());
+            duk_put_prop_index(ctx, point_i, 2);
+            duk_put_prop_index(ctx, array_i, n++);
+        }
+    }
+
+    //! Pushes a single (non-multi) geometry as a GeoJSON geometry object,
+    //! encoded as the given type. Returns false, pushing nothing, if the type
+    //! has no GeoJSON equivalent.
+    bool pushShape(duk_context* ctx, const Geometry* geom, Geometry::Type type)
+    {
+        const char* typeName =
+            type == Geometry::TYPE_POLYGON    ? "Polygon" :
+            type == Geometry::TYPE_LINESTRING ? "MultiLineString" :
+            type == Geometry::TYPE_POINTSET   ? "MultiPoint" :
+            0L;
+
+        if ( !typeName )
+            return false;
+
+        duk_idx_t geom_i = duk_push_object(ctx);
+        duk_push_string(ctx, typeName);
+        duk_put_prop_string(ctx, geom_i, "type");
+
+        duk_idx_t coords_i = duk_push_array(ctx);
+        duk_uarridx_t n = 0;
+
+        // polygons yield their outer ring and then their holes.
+        ConstGeometryIterator i(geom, true);
+        while( i.hasMore() )
+        {
+            const Geometry* part = i.next();
+            if ( type == Geometry::TYPE_POINTSET )
+            {
+                pushPositions(ctx, part, coords_i, n);
             }
             else
             {
-                feature->setGeometry(0L);
+                duk_idx_t part_i = duk_push_array(ctx);
+                duk_uarridx_t m = 0;
+                pushPositions(ctx, part, part_i, m);
+                duk_put_prop_index(ctx, coords_i, n++);
             }
         }
+        duk_put_prop_string(ctx, geom_i, "coordinates");
+        return true;
+    }
+
+    //! Pushes a GeoJSON geometry object built straight from a Geometry,
+    //! matching the layout of GeometryUtils::geometryToGeoJSON. Returns false,
+    //! pushing nothing, if there's no geometry to encode.
+    bool pushGeometry(duk_context* ctx, const Geometry* geom)
+    {
+        if ( !geom )
+            return false;
+
+        const MultiGeometry* multi = dynamic_cast<const MultiGeometry*>(geom);
+        if ( !multi )
+            return pushShape(ctx, geom, geom->getType());
+
+        duk_idx_t geom_i = duk_push_object(ctx);
+        duk_push_string(ctx, "GeometryCollection");
+        duk_put_prop_string(ctx, geom_i, "type");
+
+        duk_idx_t geoms_i = duk_push_array(ctx);
+        duk_uarridx_t n = 0;
+        Geometry::Type type = multi->getComponentType();
+        for(GeometryCollection::const_iterator i = multi->getComponents().begin(); i != multi->getComponents().end(); ++i)
+        {
+            if ( pushShape(ctx, i->get(), type) )
+                duk_put_prop_index(ctx, geoms_i, n++);
+        }
+        duk_put_prop_string(ctx, geom_i, "geometries");
+        return true;
+    }
+
+    //! Pushes the feature's attributes as a "properties" object.
+    void pushProperties(duk_context* ctx, const Feature* feature)
+    {
+        duk_idx_t props_i = duk_push_object(ctx);
+
+        const AttributeTable& attrs = feature->getAttrs();
+        for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+        {
+            if ( !a->second.second.set )
+            {
+                duk_push_null(ctx);
+            }
+            else switch(a->second.first)
+            {
+            case ATTRTYPE_DOUBLE: duk_push_number (ctx, a->second.getDouble()); break;
+            case ATTRTYPE_INT:    duk_push_int    (ctx, a->second.getInt()); break;
+            case ATTRTYPE_BOOL:   duk_push_boolean(ctx, a->second.getBool()); break;
+            case ATTRTYPE_STRING:
+            default:              duk_push_string (ctx, a->second.getString().c_str()); break;
+            }
+            duk_put_prop_string(ctx, props_i, a->first.c_str());
+        }
+    }
+
+    // Lazy members of the feature prototype; the function "magic" says which.
+    enum LazyProperty
+    {
+        LAZY_PROPERTIES,
+        LAZY_GEOMETRY
+    };
+
+    const char* lazyPropertyName(duk_int_t magic)
+    {
+        return magic == LAZY_PROPERTIES ? "properties" : "geometry";
+    }
+
+    // Turns the lazy property into a plain data property on the object at
+    // "obj_i", set to the value on top of the stack (which stays there).
+    void materialize(duk_context* ctx, duk_idx_t obj_i, duk_int_t magic)
+    {
+        duk_push_string(ctx, lazyPropertyName(magic));
+        duk_dup(ctx, -2);
+        duk_def_prop(ctx, obj_i,
+            DUK_DEFPROP_HAVE_VALUE |
+            DUK_DEFPROP_SET_WRITABLE |
+            DUK_DEFPROP_SET_ENUMERABLE |
+            DUK_DEFPROP_SET_CONFIGURABLE);
+    }
+
+    // Getter for feature.properties and feature.geometry. Reads the data from
+    // the native Feature on first access and stores it on the object, so later
+    // reads and any changes made by the script go to a plain property.
+    static duk_ret_t oe_duk_feature_get(duk_context* ctx)
+    {
+        duk_int_t magic = duk_get_current_magic(ctx);
+
+        duk_push_this(ctx);                                 // [this]
+        duk_idx_t this_i = duk_get_top_index(ctx);
+        duk_get_prop_string(ctx, this_i, "__ptr");          // [this, ptr]
+        const Feature* feature = reinterpret_cast<const Feature*>(duk_get_pointer(ctx, -1));
+        duk_pop(ctx);                                       // [this]
+
+        if ( !feature )
+            return 0;
+
+        if ( magic == LAZY_PROPERTIES )
+        {
+            pushProperties(ctx, feature);                   // [this, props]
+        }
         else
         {
-            // [ptr, global, feature, undefined]
+            if ( !pushGeometry(ctx, feature->getGeometry()) )
+                return 0;                                   // [this]
+
+            // [this, geometry]
+            duk_get_global_string(ctx, "oe_duk_bind_geometry_api"); // [this, geometry, func]
+            duk_dup(ctx, -2);                               // [this, geometry, func, geometry]
+            duk_pcall(ctx, 1);                              // [this, geometry, result]
+            duk_pop(ctx);                                   // [this, geometry]
         }
-        
-        // [ptr, global, feature]
-        duk_pop_2(ctx);     // [ptr] (as we found it)
-        return 0;           // no return values.
+
+        materialize(ctx, this_i, magic);
+        return 1;
+    }
+
+    // Setter for feature.properties and feature.geometry.
+    static duk_ret_t oe_duk_feature_set(duk_context* ctx)
+    {
+        // [value]
+        duk_push_this(ctx);                                 // [value, this]
+        duk_dup(ctx, 0);                                    // [value, this, value]
+        materialize(ctx, 1, duk_get_current_magic(ctx));
+        return 0;
+    }
+
+    void defineLazyProperty(duk_context* ctx, duk_idx_t proto_i, duk_int_t magic)
+    {
+        duk_push_string(ctx, lazyPropertyName(magic));
+        duk_push_c_function(ctx, oe_duk_feature_get, 0);
+        duk_set_magic(ctx, -1, magic);
+        duk_push_c_function(ctx, oe_duk_feature_set, 1);
+        duk_set_magic(ctx, -1, magic);
+        duk_def_prop(ctx, proto_i,
+            DUK_DEFPROP_HAVE_GETTER |
+            DUK_DEFPROP_HAVE_SETTER |
+            DUK_DEFPROP_SET_ENUMERABLE |
+            DUK_DEFPROP_SET_CONFIGURABLE);
+    }
+
+    // Builds the prototype of every "feature" object and keeps it in the
+    // global stash. Done once per heap so that nothing is compiled per feature.
+    void installFeaturePrototype(duk_context* ctx)
+    {
+        duk_push_global_stash(ctx);                             // [stash]
+        duk_idx_t proto_i = duk_push_object(ctx);               // [stash, proto]
+
+        duk_push_string(ctx, "Feature");
+        duk_put_prop_string(ctx, proto_i, "type");
+
+        defineLazyProperty(ctx, proto_i, LAZY_PROPERTIES);
+        defineLazyProperty(ctx, proto_i, LAZY_GEOMETRY);
+
+        // the "attributes" alias:
+        duk_push_string(ctx, "attributes");
+        duk_eval_string(ctx, "(function() { return this.properties; })");
+        duk_def_prop(ctx, proto_i, DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_SET_CONFIGURABLE);
+
+        // feature.save(); only passes along the parts the script accessed.
+        duk_eval_string(ctx,
+            "(function() {"
+            "    oe_duk_save_feature(this.__ptr,"
+            "        this.hasOwnProperty('properties') ? this.properties : undefined,"
+            "        this.hasOwnProperty('geometry') ? this.geometry : undefined);"
+            "})");
+        duk_put_prop_string(ctx, proto_i, "save");
+
+        duk_put_prop_string(ctx, -2, "oe_feature_prototype");  // [stash]
+        duk_pop(ctx);                                           // []
     }
 }
 
@@ -149,23 +354,19 @@ namespace
         // Complete profile: properties, geometry, and API bindings.
         if ( complete )
         {
-            std::string geojson = feature->getGeoJSON();
-            duk_push_string(ctx, geojson.c_str());               // [global, json]
-            duk_json_decode(ctx, -1);                            // [global, feature]
+            // Properties and geometry are read from the native feature on
+            // demand; see installFeaturePrototype.
+            duk_idx_t feature_i = duk_push_object(ctx);          // [global, feature]
+            duk_push_global_stash(ctx);                          // [global, feature, stash]
+            duk_get_prop_string(ctx, -1, "oe_feature_prototype");// [global, feature, stash, proto]
+            duk_set_prototype(ctx, feature_i);                   // [global, feature, stash]
+            duk_pop(ctx);                                        // [global, feature]
+
+            duk_push_number(ctx, (unsigned int)feature->getFID());
+            duk_put_prop_string(ctx, feature_i, "id");
             duk_push_pointer(ctx, (void*)feature);               // [global, feature, ptr]
-            duk_put_prop_string(ctx, -2, "__ptr");               // [global, feature]
+            duk_put_prop_string(ctx, feature_i, "__ptr");        // [global, feature]
             duk_put_prop_string(ctx, -2, "feature");             // [global]
-
-            // add the save() function and the "attributes" alias.
-            duk_eval_string_noresult(ctx,
-                "feature.save = function() {"
-                "    oe_duk_save_feature(this.__ptr);"
-                "} ");
-
-            duk_eval_string_noresult(ctx,
-                "Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});");
-
-            GeometryAPI::bindToFeature(ctx);
         }
 
         // Minimal profile: ID and properties only. MUCH faster!
@@ -239,13 +440,18 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
         if ( complete )
         {
             // feature.save() callback
-            duk_push_c_function(_ctx, oe_duk_save_feature, 1/*numargs*/); // [global, function]
+            duk_push_c_function(_ctx, oe_duk_save_feature, 3/*numargs*/); // [global, function]
             duk_put_prop_string(_ctx, -2, "oe_duk_save_feature");         // [global]
 
             GeometryAPI::install(_ctx);
         }
 
         duk_pop(_ctx); // []
+
+        if ( complete )
+        {
+            installFeaturePrototype(_ctx);
+        }
     }
 }
 
@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/AltitudeFilter>
+#include <osgEarthFeatures/FeatureBatch>
+#include <osgEarthFeatures/CompiledExpression>
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/GeoData>
 
@@ -44,17 +46,21 @@ AltitudeFilter::setPropertiesFromStyle( const Style& style )
     }
 }
 
-FilterContext
-AltitudeFilter::push( FeatureList& features, FilterContext& cx )
+bool
+AltitudeFilter::clampToMap( const FilterContext& cx ) const
 {
-    bool clampToMap = 
+    return
         _altitude.valid()                                          && 
         _altitude->clamping()  != AltitudeSymbol::CLAMP_NONE       &&
         _altitude->technique() == AltitudeSymbol::TECHNIQUE_MAP    &&
         cx.getSession()        != 0L                               &&
         cx.profile()           != 0L;
+}
 
-    if ( clampToMap )
+FilterContext
+AltitudeFilter::push( FeatureList& features, FilterContext& cx )
+{
+    if ( clampToMap(cx) )
         pushAndClamp( features, cx );
     else
         pushAndDontClamp( features, cx );
@@ -62,6 +68,23 @@ AltitudeFilter::push( FeatureList& features, FilterContext& cx )
     return cx;
 }
 
+bool
+AltitudeFilter::canPushBatch( const FilterContext& cx ) const
+{
+    // terrain clamping and symbol scripts need the full features.
+    return !clampToMap(cx) && !(_altitude.valid() && _altitude->script().isSet());
+}
+
+FilterContext
+AltitudeFilter::pushBatch( FeatureBatch& batch, FilterContext& cx )
+{
+    if ( !canPushBatch(cx) )
+        return FeatureFilter::pushBatch( batch, cx );
+
+    pushAndDontClamp( batch, cx );
+    return cx;
+}
+
 void
 AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
 {
@@ -144,6 +167,88 @@ AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
     }
 }
 
+void
+AltitudeFilter::pushAndDontClamp( FeatureBatch& batch, FilterContext& cx )
+{
+    std::vector<double> scales;
+    if ( _altitude.valid() && _altitude->verticalScale().isSet() )
+        CompiledNumericExpression( *_altitude->verticalScale() ).eval( batch, &cx, scales );
+
+    std::vector<double> offsets;
+    if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
+        CompiledNumericExpression( *_altitude->verticalOffset() ).eval( batch, &cx, offsets );
+
+    bool gpuClamping =
+        _altitude.valid() &&
+        _altitude->technique() == _altitude->TECHNIQUE_GPU;
+
+    bool ignoreZ =
+        gpuClamping && 
+        _altitude->clamping() == _altitude->CLAMP_TO_TERRAIN;
+
+    unsigned minHATColumn = batch.getOrCreateColumn( "__min_hat", ATTRTYPE_DOUBLE );
+    unsigned maxHATColumn = batch.getOrCreateColumn( "__max_hat", ATTRTYPE_DOUBLE );
+
+    unsigned scaleColumn = 0u, offsetColumn = 0u;
+    if ( gpuClamping )
+    {
+        scaleColumn  = batch.getOrCreateColumn( "__oe_verticalScale",  ATTRTYPE_DOUBLE );
+        offsetColumn = batch.getOrCreateColumn( "__oe_verticalOffset", ATTRTYPE_DOUBLE );
+    }
+
+    std::vector<osg::Vec3d>& points = batch.points();
+    const FeatureBatch::Parts& parts = batch.parts();
+
+    for( unsigned i = 0; i < batch.size(); ++i )
+    {
+        if ( !batch.hasGeometry(i) )
+            continue;
+
+        double minHAT =  DBL_MAX;
+        double maxHAT = -DBL_MAX;
+
+        double scaleZ  = scales.empty()  ? 1.0 : scales[i];
+        double offsetZ = offsets.empty() ? 0.0 : offsets[i];
+
+        for( unsigned p = batch.getFirstPart(i); p < batch.getFirstPart(i) + batch.getNumParts(i); ++p )
+        {
+            osg::Vec3d* g   = points.empty() ? 0L : &points[parts[p].offset];
+            osg::Vec3d* end = g + parts[p].size;
+            for( ; g != end; ++g )
+            {
+                if ( ignoreZ )
+                {
+                    g->z() = 0.0;
+                }
+
+                if ( !gpuClamping )
+                {
+                    g->z() *= scaleZ;
+                    g->z() += offsetZ;
+                }
+
+                if ( g->z() < minHAT )
+                    minHAT = g->z();
+                if ( g->z() > maxHAT )
+                    maxHAT = g->z();
+            }
+        }
+
+        if ( minHAT != DBL_MAX )
+        {
+            batch.set( i, minHATColumn, minHAT );
+            batch.set( i, maxHATColumn, maxHAT );
+        }
+
+        // encode the Z offset if
+        if ( gpuClamping )
+        {
+            batch.set( i, scaleColumn,  scaleZ );
+            batch.set( i, offsetColumn, offsetZ );
+        }
+    }
+}
+
 void
 AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
 {
@@ -0,0 +1,317 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/CompiledExpression>
+#include <osgEarthFeatures/FeatureBatch>
+#include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/Session>
+#include <osgEarthFeatures/ScriptEngine>
+#include <osgEarth/StringUtils>
+#include <algorithm>
+
+#define LC "[CompiledExpression] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+namespace
+{
+    // Assigns each variable to a slot, merging variables with the same name,
+    // and marks the slots that may name an attribute.
+    template<typename VARIABLES>
+    void bindSlots(const VARIABLES& vars, const FeatureSchema& schema, ExpressionSlots& slots, std::vector<unsigned>& varSlots)
+    {
+        varSlots.reserve( vars.size() );
+
+        for(typename VARIABLES::const_iterator v = vars.begin(); v != vars.end(); ++v)
+        {
+            unsigned s = 0;
+            while( s < slots.size() && slots[s].name != v->first )
+                ++s;
+
+            if ( s == slots.size() )
+            {
+                ExpressionSlot slot;
+                slot.name      = v->first;
+                slot.key       = toLower(v->first);
+                slot.attribute = schema.empty();
+
+                for(FeatureSchema::const_iterator f = schema.begin(); f != schema.end() && !slot.attribute; ++f)
+                {
+                    if ( ciEquals(f->first, v->first) )
+                        slot.attribute = true;
+                }
+                slots.push_back( slot );
+            }
+
+            varSlots.push_back( s );
+        }
+    }
+
+    // finds the batch column of each slot that may name an attribute.
+    void bindColumns(const ExpressionSlots& slots, const FeatureBatch& batch, std::vector<int>& columns)
+    {
+        columns.resize( slots.size() );
+        for(unsigned s=0; s<slots.size(); ++s)
+            columns[s] = slots[s].attribute ? batch.getColumn(slots[s].name) : -1;
+    }
+
+    ScriptEngine* getScriptEngine(const FilterContext* context)
+    {
+        const Session* session = context ? context->getSession() : 0L;
+        return session ? session->getScriptEngine() : 0L;
+    }
+}
+
+//------------------------------------------------------------------------
+
+CompiledNumericExpression::CompiledNumericExpression(const NumericExpression& expr,
+                                                     const FeatureSchema&     schema) :
+_expr( expr )
+{
+    bindSlots( _expr.variables(), schema, _slots, _varSlots );
+}
+
+double
+CompiledNumericExpression::run(const Feature*       feature,
+                               const FilterContext* context,
+                               Scratch&             scratch) const
+{
+    const AttributeTable* attrs  = feature ? &feature->getAttrs() : 0L;
+    ScriptEngine*         engine = 0L;
+
+    scratch.slots.resize( _slots.size() );
+
+    for(unsigned s=0; s<_slots.size(); ++s)
+    {
+        const ExpressionSlot& slot = _slots[s];
+        double val = 0.0;
+
+        // a feature without a value for the attribute falls through to the
+        // script engine, on a batch just as on a feature.
+        AttributeTable::const_iterator a;
+        if ( scratch.batch && scratch.columns[s] >= 0 && scratch.batch->isSet(scratch.index, scratch.columns[s]) )
+        {
+            val = scratch.batch->getDouble(scratch.index, scratch.columns[s]);
+        }
+        else if ( !scratch.batch && attrs && slot.attribute && (a = attrs->find(slot.key)) != attrs->end() )
+        {
+            val = a->second.getDouble(0.0);
+        }
+        else if ( engine || (engine = getScriptEngine(context)) != 0L )
+        {
+            //No attr found, look for script
+            ScriptResult result = engine->run(slot.name, feature, context);
+            if ( result.success() )
+                val = result.asDouble();
+            else
+                OE_WARN << LC << "Feature Script error on '" << _expr.expr() << "': " << result.message() << std::endl;
+        }
+
+        scratch.slots[s] = val;
+    }
+
+    scratch.vars.resize( _varSlots.size() );
+    for(unsigned v=0; v<_varSlots.size(); ++v)
+        scratch.vars[v] = scratch.slots[_varSlots[v]];
+
+    return _expr.eval( scratch.vars.empty() ? 0L : &scratch.vars[0], scratch.stack );
+}
+
+double
+CompiledNumericExpression::eval(const Feature* feature, const FilterContext* context) const
+{
+    Scratch scratch;
+    return run(feature, context, scratch);
+}
+
+void
+CompiledNumericExpression::eval(const FeatureList&   features,
+                                const FilterContext* context,
+                                std::vector<double>& output) const
+{
+    output.resize( features.size() );
+    if ( output.empty() )
+        return;
+
+    Scratch scratch;
+
+    // a constant expression only needs evaluating once.
+    if ( _slots.empty() )
+    {
+        std::fill( output.begin(), output.end(), _expr.eval(0L, scratch.stack) );
+        return;
+    }
+
+    double* out = &output[0];
+    for(FeatureList::const_iterator f = features.begin(); f != features.end(); ++f, ++out)
+    {
+        *out = run(f->get(), context, scratch);
+    }
+}
+
+void
+CompiledNumericExpression::eval(const FeatureBatch&  batch,
+                                const FilterContext* context,
+                                std::vector<double>& output) const
+{
+    output.resize( batch.size() );
+    if ( output.empty() )
+        return;
+
+    Scratch scratch;
+
+    if ( _slots.empty() )
+    {
+        std::fill( output.begin(), output.end(), _expr.eval(0L, scratch.stack) );
+        return;
+    }
+
+    scratch.batch = &batch;
+    bindColumns( _slots, batch, scratch.columns );
+
+    for(scratch.index = 0; scratch.index < batch.size(); ++scratch.index)
+    {
+        output[scratch.index] = run(batch.getFeature(scratch.index), context, scratch);
+    }
+}
+
+//------------------------------------------------------------------------
+
+CompiledStringExpression::CompiledStringExpression(const StringExpression& expr,
+                                                   const FeatureSchema&    schema) :
+_expr( expr )
+{
+    bindSlots( _expr.variables(), schema, _slots, _varSlots );
+}
+
+void
+CompiledStringExpression::run(const Feature*       feature,
+                              const FilterContext* context,
+                              Scratch&             scratch,
+                              std::string&         out) const
+{
+    const AttributeTable* attrs  = feature ? &feature->getAttrs() : 0L;
+    ScriptEngine*         engine = 0L;
+
+    scratch.slots.resize( _slots.size() );
+
+    for(unsigned s=0; s<_slots.size(); ++s)
+    {
+        const ExpressionSlot& slot = _slots[s];
+        std::string& val = scratch.slots[s];
+        val.clear();
+
+        // a feature without a value for the attribute falls through to the
+        // script engine, on a batch just as on a feature.
+        AttributeTable::const_iterator a;
+        if ( scratch.batch && scratch.columns[s] >= 0 && scratch.batch->isSet(scratch.index, scratch.columns[s]) )
+        {
+            val = scratch.batch->getString(scratch.index, scratch.columns[s]);
+        }
+        else if ( !scratch.batch && attrs && slot.attribute && (a = attrs->find(slot.key)) != attrs->end() )
+        {
+            val = a->second.getString();
+        }
+        else if ( engine || (engine = getScriptEngine(context)) != 0L )
+        {
+            //No attr found, look for script
+            ScriptResult result = engine->run(slot.name, feature, context);
+            if ( result.success() )
+            {
+                val = result.asString();
+            }
+            else
+            {
+                // Couldn't execute it as code, just take it as a string literal.
+                val = slot.name;
+                OE_DEBUG << LC << "Feature Script error on '" << _expr.expr() << "': " << result.message() << std::endl;
+            }
+        }
+    }
+
+    scratch.vars.resize( _varSlots.size() );
+    for(unsigned v=0; v<_varSlots.size(); ++v)
+        scratch.vars[v] = scratch.slots[_varSlots[v]];
+
+    _expr.eval( scratch.vars.empty() ? 0L : &scratch.vars[0], out );
+}
+
+std::string
+CompiledStringExpression::eval(const Feature* feature, const FilterContext* context) const
+{
+    Scratch scratch;
+    std::string out;
+    run(feature, context, scratch, out);
+    return out;
+}
+
+void
+CompiledStringExpression::eval(const FeatureList&        features,
+                               const FilterContext*      context,
+                               std::vector<std::string>& output) const
+{
+    output.resize( features.size() );
+    if ( output.empty() )
+        return;
+
+    Scratch scratch;
+
+    // a constant expression only needs evaluating once.
+    if ( _slots.empty() )
+    {
+        std::string value;
+        _expr.eval(0L, value);
+        std::fill( output.begin(), output.end(), value );
+        return;
+    }
+
+    std::vector<std::string>::iterator out = output.begin();
+    for(FeatureList::const_iterator f = features.begin(); f != features.end(); ++f, ++out)
+    {
+        run(f->get(), context, scratch, *out);
+    }
+}
+
+void
+CompiledStringExpression::eval(const FeatureBatch&       batch,
+                               const FilterContext*      context,
+                               std::vector<std::string>& output) const
+{
+    output.resize( batch.size() );
+    if ( output.empty() )
+        return;
+
+    Scratch scratch;
+
+    if ( _slots.empty() )
+    {
+        std::string value;
+        _expr.eval(0L, value);
+        std::fill( output.begin(), output.end(), value );
+        return;
+    }
+
+    scratch.batch = &batch;
+    bindColumns( _slots, batch, scratch.columns );
+
+    for(scratch.index = 0; scratch.index < batch.size(); ++scratch.index)
+    {
+        run(batch.getFeature(scratch.index), context, scratch, output[scratch.index]);
+    }
+}
@@ -18,6 +18,7 @@
  */
 #include <osgEarthFeatures/ExtrudeGeometryFilter>
 #include <osgEarthFeatures/Session>
+#include <osgEarthFeatures/CompiledExpression>
 #include <osgEarthFeatures/FeatureSourceIndexNode>
 
 #include <osgEarthSymbology/ResourceLibrary>
@@ -993,7 +994,18 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
     Random wallSkinPRNG( _wallSkinSymbol.valid()? *_wallSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
     Random roofSkinPRNG( _roofSkinSymbol.valid()? *_roofSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
 
-    for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
+    // evaluate the extrusion height of every feature up front, unless a
+    // symbol script could change the attributes along the way.
+    std::vector<double> heights;
+    if ( !_heightCallback.valid() && _heightExpr.isSet() &&
+         !(_polySymbol.valid() && _polySymbol->script().isSet()) &&
+         !_extrusionSymbol->script().isSet() )
+    {
+        CompiledNumericExpression( _heightExpr.get() ).eval( features, &context, heights );
+    }
+
+    unsigned featureIndex = 0;
+    for( FeatureList::iterator f = features.begin(); f != features.end(); ++f, ++featureIndex )
     {
         Feature* input = f->get();
 
@@ -1050,6 +1062,10 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
             {
                 height = _heightCallback->operator()(input, context);
             }
+            else if ( !heights.empty() )
+            {
+                height = heights[featureIndex];
+            }
             else if ( _heightExpr.isSet() )
             {
                 height = input->eval( _heightExpr.mutable_value(), &context );
@@ -0,0 +1,336 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FeatureBatch>
+
+#define LC "[FeatureBatch] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+namespace
+{
+    // reads a cell as an AttributeValue, so conversions follow the same
+    // rules as they do for a Feature.
+    AttributeValue getCell(const FeatureBatch::Column& column, unsigned i)
+    {
+        AttributeValue value;
+        value.first = (AttributeType)column.types[i];
+        value.second.set = column.set[i] != 0;
+        value.second.doubleValue = 0.0;
+        value.second.intValue = 0;
+        value.second.boolValue = false;
+
+        if ( value.second.set )
+        {
+            switch( value.first )
+            {
+            case ATTRTYPE_STRING: value.second.stringValue = column.strings[i]; break;
+            case ATTRTYPE_INT:    value.second.intValue    = (int)column.numbers[i]; break;
+            case ATTRTYPE_BOOL:   value.second.boolValue   = column.numbers[i] != 0.0; break;
+            default:              value.second.doubleValue = column.numbers[i]; break;
+            }
+        }
+        return value;
+    }
+
+    // writes a value into a cell, keeping the value's own type.
+    void setCell(FeatureBatch::Column& column, unsigned i, const AttributeValue& value)
+    {
+        column.types[i] = (unsigned char)value.first;
+
+        if ( !value.second.set )
+        {
+            column.set[i] = 0;
+            return;
+        }
+
+        switch( value.first )
+        {
+        case ATTRTYPE_STRING:
+            if ( column.strings.empty() )
+                column.strings.resize( column.set.size() );
+            column.strings[i] = value.second.stringValue;
+            break;
+        case ATTRTYPE_INT:  column.numbers[i] = (double)value.second.intValue; break;
+        case ATTRTYPE_BOOL: column.numbers[i] = value.second.boolValue ? 1.0 : 0.0; break;
+        default:            column.numbers[i] = value.second.doubleValue; break;
+        }
+        column.set[i] = 1;
+    }
+
+    void resize(FeatureBatch::Column& column, unsigned size)
+    {
+        if ( !column.strings.empty() )
+            column.strings.resize( size );
+        column.numbers.resize( size, 0.0 );
+        column.types.resize( size, (unsigned char)column.type );
+        column.set.resize( size, 0 );
+    }
+}
+
+//------------------------------------------------------------------------
+
+FeatureBatch::FeatureBatch()
+{
+    //nop
+}
+
+FeatureBatch::FeatureBatch(const FeatureList& features)
+{
+    add( features );
+}
+
+void
+FeatureBatch::clear()
+{
+    _features.clear();
+    _points.clear();
+    _parts.clear();
+    _columns.clear();
+    _columnIndex.clear();
+}
+
+void
+FeatureBatch::add(const FeatureList& features)
+{
+    _features.reserve( _features.size() + features.size() );
+    for(FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+    {
+        add( f->get() );
+    }
+}
+
+void
+FeatureBatch::add(Feature* feature)
+{
+    if ( !feature )
+        return;
+
+    unsigned i = _features.size();
+
+    Record record;
+    record._feature     = feature;
+    record._firstPart   = _parts.size();
+    record._numParts    = 0;
+    record._hasGeometry = feature->getGeometry() != 0L;
+    record._multi       = record._hasGeometry && feature->getGeometry()->getType() == Geometry::TYPE_MULTI;
+
+    if ( record._hasGeometry )
+        addParts( feature->getGeometry(), record );
+
+    _features.push_back( record );
+
+    for(Columns::iterator c = _columns.begin(); c != _columns.end(); ++c)
+        resize( *c, i+1 );
+
+    const AttributeTable& attrs = feature->getAttrs();
+    for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+    {
+        unsigned c = getOrCreateColumn( a->first, a->second.first );
+        setCell( _columns[c], i, a->second );
+    }
+}
+
+void
+FeatureBatch::addParts(const Geometry* geom, Record& record)
+{
+    if ( geom->getType() == Geometry::TYPE_MULTI )
+    {
+        const GeometryCollection& components = static_cast<const MultiGeometry*>(geom)->getComponents();
+        for(GeometryCollection::const_iterator c = components.begin(); c != components.end(); ++c)
+        {
+            if ( c->valid() )
+                addParts( c->get(), record );
+        }
+        return;
+    }
+
+    Part part;
+    part.offset = _points.size();
+    part.size   = geom->size();
+    part.type   = geom->getType();
+    part.hole   = false;
+    _points.insert( _points.end(), geom->begin(), geom->end() );
+    _parts.push_back( part );
+    ++record._numParts;
+
+    if ( part.type == Geometry::TYPE_POLYGON )
+    {
+        const RingCollection& holes = static_cast<const Polygon*>(geom)->getHoles();
+        for(RingCollection::const_iterator h = holes.begin(); h != holes.end(); ++h)
+        {
+            if ( !h->valid() )
+                continue;
+
+            Part hole;
+            hole.offset = _points.size();
+            hole.size   = (*h)->size();
+            hole.type   = Geometry::TYPE_RING;
+            hole.hole   = true;
+            _points.insert( _points.end(), (*h)->begin(), (*h)->end() );
+            _parts.push_back( hole );
+            ++record._numParts;
+        }
+    }
+}
+
+Geometry*
+FeatureBatch::createGeometry(const Record& record) const
+{
+    GeometryCollection shapes;
+    Polygon* polygon = 0L;
+
+    for(unsigned p = record._firstPart; p < record._firstPart + record._numParts; ++p)
+    {
+        const Part& part = _parts[p];
+        const osg::Vec3d* begin = part.size > 0 ? &_points[part.offset] : 0L;
+        const osg::Vec3d* end   = begin + part.size;
+
+        Geometry* geom = 0L;
+        if ( part.hole )
+        {
+            if ( !polygon )
+                continue;
+            Ring* hole = new Ring( part.size );
+            polygon->getHoles().push_back( hole );
+            geom = hole;
+        }
+        else
+        {
+            switch( part.type )
+            {
+            case Geometry::TYPE_POLYGON:    geom = polygon = new Polygon( part.size ); break;
+            case Geometry::TYPE_RING:       geom = new Ring( part.size ); break;
+            case Geometry::TYPE_LINESTRING: geom = new LineString( part.size ); break;
+            default:                        geom = new PointSet( part.size ); break;
+            }
+            if ( part.type != Geometry::TYPE_POLYGON )
+                polygon = 0L;
+            shapes.push_back( geom );
+        }
+
+        geom->insert( geom->end(), begin, end );
+    }
+
+    if ( shapes.size() == 1 && !record._multi )
+        return shapes.front().release();
+
+    return new MultiGeometry( shapes );
+}
+
+void
+FeatureBatch::toFeatures(FeatureList& output) const
+{
+    for(unsigned i = 0; i < _features.size(); ++i)
+    {
+        const Record& record = _features[i];
+        Feature* feature = record._feature.get();
+
+        if ( record._hasGeometry )
+            feature->setGeometry( createGeometry(record) );
+
+        for(Columns::const_iterator c = _columns.begin(); c != _columns.end(); ++c)
+        {
+            const AttributeValue value = getCell( *c, i );
+            if ( !value.second.set )
+            {
+                if ( feature->hasAttr(c->name) )
+                    feature->setNull( c->name );
+                continue;
+            }
+
+            switch( value.first )
+            {
+            case ATTRTYPE_STRING: feature->set( c->name, value.second.stringValue ); break;
+            case ATTRTYPE_INT:    feature->set( c->name, value.second.intValue ); break;
+            case ATTRTYPE_BOOL:   feature->set( c->name, value.second.boolValue ); break;
+            default:              feature->set( c->name, value.second.doubleValue ); break;
+            }
+        }
+
+        output.push_back( feature );
+    }
+}
+
+int
+FeatureBatch::getColumn(const std::string& name) const
+{
+    ColumnIndex::const_iterator i = _columnIndex.find( name );
+    return i != _columnIndex.end() ? (int)i->second : -1;
+}
+
+unsigned
+FeatureBatch::getOrCreateColumn(const std::string& name, AttributeType type)
+{
+    ColumnIndex::const_iterator i = _columnIndex.find( name );
+    if ( i != _columnIndex.end() )
+        return i->second;
+
+    unsigned c = _columns.size();
+    _columns.push_back( Column() );
+    _columns.back().name = name;
+    _columns.back().type = type;
+    resize( _columns.back(), _features.size() );
+    _columnIndex[name] = c;
+    return c;
+}
+
+double
+FeatureBatch::getDouble(unsigned i, unsigned column) const
+{
+    const Column& c = _columns[column];
+    if ( c.types[i] != ATTRTYPE_STRING )
+        return c.set[i] ? c.numbers[i] : 0.0;
+    return getCell( c, i ).getDouble();
+}
+
+std::string
+FeatureBatch::getString(unsigned i, unsigned column) const
+{
+    const Column& c = _columns[column];
+    if ( c.types[i] == ATTRTYPE_STRING )
+        return c.set[i] ? c.strings[i] : std::string();
+    return getCell( c, i ).getString();
+}
+
+void
+FeatureBatch::set(unsigned i, unsigned column, double value)
+{
+    AttributeValue v;
+    v.first = ATTRTYPE_DOUBLE;
+    v.second.doubleValue = value;
+    v.second.set = true;
+    setCell( _columns[column], i, v );
+}
+
+void
+FeatureBatch::set(unsigned i, unsigned column, const std::string& value)
+{
+    AttributeValue v;
+    v.first = ATTRTYPE_STRING;
+    v.second.stringValue = value;
+    v.second.set = true;
+    setCell( _columns[column], i, v );
+}
+
+void
+FeatureBatch::setNull(unsigned i, unsigned column)
+{
+    _columns[column].set[i] = 0;
+}
@@ -33,6 +33,7 @@
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/Utils>
 #include <osgEarth/GLUtils>
+#include <osgEarth/JobScheduler>
 
 #include <osg/CullFace>
 #include <osg/PagedLOD>
@@ -225,6 +226,33 @@ namespace
             node->getOrCreateStateSet()->addUniform( u );
         }
     };
+
+
+    // Compiles one chunk of a tile's features. Each chunk works on its own
+    // copy of the FilterContext. The copies still share the Session, its
+    // resource cache and the tile's FeatureSourceIndexNode; the node guards
+    // its FID map with a mutex, and the index behind it has its own lock.
+    struct CompileChunk : public TaskRequest
+    {
+        CompileChunk(FeatureNodeFactory* factory, const Style& style, const FilterContext& context) :
+            _factory( factory ), _style( style ), _context( context ), _ok( false ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            if ( progress && progress->isCanceled() )
+                return;
+
+            osg::ref_ptr<FeatureCursor> cursor = new FeatureListCursor( _features );
+            _ok = _factory->createOrUpdateNode( cursor.get(), _style, _context, _node );
+        }
+
+        FeatureNodeFactory*     _factory;
+        const Style&            _style;
+        FilterContext           _context;
+        FeatureList             _features;
+        osg::ref_ptr<osg::Node> _node;
+        bool                    _ok;
+    };
 }
 
 
@@ -1463,17 +1491,32 @@ FeatureModelGraph::createStyleGroup(const Style&          style,
     // finally, compile the features into a node.
     if ( workingSet.size() > 0 )
     {
-        osg::ref_ptr<osg::Node> node;
-        osg::ref_ptr<FeatureCursor> newCursor = new FeatureListCursor(workingSet);
+        std::vector< osg::ref_ptr<osg::Node> > nodes;
+        bool ok;
 
-        if ( createOrUpdateNode( newCursor.get(), style, context, readOptions, node ) )
+        unsigned numChunks = getNumCompileChunks( workingSet.size() );
+        if ( numChunks > 1u )
+        {
+            ok = compileInChunks( _factory.get(), style, workingSet, context, numChunks, nodes );
+        }
+        else
+        {
+            osg::ref_ptr<osg::Node> node;
+            osg::ref_ptr<FeatureCursor> newCursor = new FeatureListCursor(workingSet);
+
+            ok = createOrUpdateNode( newCursor.get(), style, context, readOptions, node );
+            if ( node.valid() )
+                nodes.push_back( node.get() );
+        }
+
+        if ( ok )
         {
             if ( !styleGroup )
                 styleGroup = getOrCreateStyleGroupFromFactory( style );
 
-            // if it returned a node, add it. (it doesn't necessarily have to)
-            if ( node.valid() )
-                styleGroup->addChild( node.get() );
+            // if it returned nodes, add them. (it doesn't necessarily have to)
+            for(unsigned i=0; i<nodes.size(); ++i)
+                styleGroup->addChild( nodes[i].get() );
         }
     }
 
@@ -1481,6 +1524,75 @@ FeatureModelGraph::createStyleGroup(const Style&          style,
 }
 
 
+unsigned
+FeatureModelGraph::getNumCompileChunks(unsigned numFeatures) const
+{
+    unsigned chunkSize = _options.parallelCompileChunkSize().get();
+    if ( chunkSize == 0u || numFeatures < 2u*chunkSize )
+        return 1u;
+
+    // A scheduler thread that blocked on its own chunks could starve the
+    // pool, so a tile built on one compiles serially.
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+    if ( !scheduler || scheduler->isWorkerThread() )
+        return 1u;
+
+    // the calling thread compiles one of the chunks itself.
+    return osg::minimum( numFeatures/chunkSize, scheduler->getNumThreads()+1u );
+}
+
+
+bool
+FeatureModelGraph::compileInChunks(FeatureNodeFactory*                     factory,
+                                   const Style&                            style,
+                                   FeatureList&                            workingSet,
+                                   const FilterContext&                    context,
+                                   unsigned                                numChunks,
+                                   std::vector< osg::ref_ptr<osg::Node> >& output)
+{
+    // Split the features into contiguous runs of (nearly) equal size, so that
+    // the merged result keeps the order of the working set.
+    std::vector< osg::ref_ptr<CompileChunk> > chunks( numChunks );
+    FeatureList::iterator f = workingSet.begin();
+    unsigned numFeatures = workingSet.size();
+
+    for(unsigned c=0; c<numChunks; ++c)
+    {
+        chunks[c] = new CompileChunk( factory, style, context );
+        unsigned count = numFeatures/numChunks + (c < numFeatures%numChunks ? 1u : 0u);
+        for(unsigned i=0; i<count; ++i, ++f)
+            chunks[c]->_features.push_back( f->get() );
+    }
+
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+    osg::ref_ptr<JobGroup> jobs = new JobGroup();
+
+    for(unsigned c=1; c<numChunks; ++c)
+        scheduler->add( chunks[c].get(), jobs.get() );
+
+    (*chunks[0])( 0L );
+
+    jobs->wait();
+
+    OE_DEBUG << LC << "Compiled " << numFeatures << " features in " << numChunks << " chunks\n";
+
+    // Collect the results in chunk order, so the output does not depend on
+    // which thread finished first.
+    bool ok = false;
+    for(unsigned c=0; c<numChunks; ++c)
+    {
+        if ( chunks[c]->_ok )
+        {
+            ok = true;
+            if ( chunks[c]->_node.valid() )
+                output.push_back( chunks[c]->_node.get() );
+        }
+    }
+
+    return ok;
+}
+
+
 osg::Group*
 FeatureModelGraph::createStyleGroup(const Style&          style, 
                                     const Query&          query, 
@@ -48,7 +48,8 @@ _clusterCulling    ( true ),
 _backfaceCulling   ( true ),
 _alphaBlending     ( true ),
 _sessionWideResourceCache( true ),
-_nodeCaching(false)
+_nodeCaching(false),
+_parallelCompileChunkSize(0u)
 {
     fromConfig(co.getConfig());
 }
@@ -70,6 +71,7 @@ FeatureModelOptions::fromConfig(const Config& conf)
     conf.get( "backface_culling", _backfaceCulling );
     conf.get( "alpha_blending",   _alphaBlending );
     conf.get( "node_caching",     _nodeCaching );
+    conf.get( "parallel_compile_chunk_size", _parallelCompileChunkSize );
     
     conf.get( "session_wide_resource_cache", _sessionWideResourceCache );
 
@@ -101,6 +103,7 @@ FeatureModelOptions::getConfig() const
     conf.set( "backface_culling", _backfaceCulling );
     conf.set( "alpha_blending",   _alphaBlending );
     conf.set( "node_caching",     _nodeCaching );
+    conf.set( "parallel_compile_chunk_size", _parallelCompileChunkSize );
     
     conf.set( "session_wide_resource_cache", _sessionWideResourceCache );
 
@@ -134,6 +137,7 @@ FeatureModelSourceOptions::fromConfig( const Config& conf )
     conf.get( "backface_culling", _backfaceCulling );
     conf.get( "alpha_blending",   _alphaBlending );
     conf.get( "node_caching",     _nodeCaching );
+    conf.get( "parallel_compile_chunk_size", _parallelCompileChunkSize );
     
     conf.get( "session_wide_resource_cache", _sessionWideResourceCache );
 }
@@ -162,6 +166,7 @@ FeatureModelSourceOptions::getConfig() const
     conf.set( "backface_culling", _backfaceCulling );
     conf.set( "alpha_blending",   _alphaBlending );
     conf.set( "node_caching",     _nodeCaching );
+    conf.set( "parallel_compile_chunk_size", _parallelCompileChunkSize );
     
     conf.set( "session_wide_resource_cache", _sessionWideResourceCache );
 
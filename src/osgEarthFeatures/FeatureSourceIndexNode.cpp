@@ -108,7 +108,11 @@ FeatureSourceIndexNode::tagDrawable(osg::Drawable* drawable, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
     RefIDPair* r = _index->tagDrawable( drawable, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
+    if ( r )
+    {
+        Threading::ScopedMutexLock lock( _fidsMutex );
+        _fids[ feature->getFID() ] = r;
+    }
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
@@ -117,7 +121,11 @@ FeatureSourceIndexNode::tagAllDrawables(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
     RefIDPair* r = _index->tagAllDrawables( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
+    if ( r )
+    {
+        Threading::ScopedMutexLock lock( _fidsMutex );
+        _fids[ feature->getFID() ] = r;
+    }
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
@@ -126,13 +134,18 @@ FeatureSourceIndexNode::tagNode(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
     RefIDPair* r = _index->tagNode( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
+    if ( r )
+    {
+        Threading::ScopedMutexLock lock( _fidsMutex );
+        _fids[ feature->getFID() ] = r;
+    }
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
 bool
 FeatureSourceIndexNode::getAllFIDs(std::vector<FeatureID>& output) const
 {
+    Threading::ScopedMutexLock lock( _fidsMutex );
     KeyIter<FIDMap> start( _fids.begin() );
     KeyIter<FIDMap> end  ( _fids.end() );
     for(KeyIter<FIDMap> i = start; i != end; ++i )
@@ -146,6 +159,7 @@ FeatureSourceIndexNode::getAllFIDs(std::vector<FeatureID>& output) const
 void
 FeatureSourceIndexNode::setFIDMap(const FeatureSourceIndexNode::FIDMap& fids)
 {
+    Threading::ScopedMutexLock lock( _fidsMutex );
     _fids = fids;
     //todo
 }
@@ -18,6 +18,7 @@
  */
 #include <osgEarthFeatures/Filter>
 #include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/FeatureBatch>
 #include <osgEarthSymbology/LineSymbol>
 #include <osgEarthSymbology/PointSymbol>
 #include <osgEarth/ECEF>
@@ -39,6 +40,19 @@ FeatureFilter::~FeatureFilter()
 {
 }
 
+FilterContext
+FeatureFilter::pushBatch( FeatureBatch& input, FilterContext& context )
+{
+    FeatureList features;
+    input.toFeatures( features );
+
+    FilterContext output = push( features, context );
+
+    input.clear();
+    input.add( features );
+    return output;
+}
+
 /********************************************************************************/
         
 #undef  LC
@@ -132,6 +146,14 @@ FeaturesToNodeFilter::~FeaturesToNodeFilter()
     //nop
 }
 
+osg::Node*
+FeaturesToNodeFilter::pushBatch( FeatureBatch& input, FilterContext& context )
+{
+    FeatureList features;
+    input.toFeatures( features );
+    return push( features, context );
+}
+
 void
 FeaturesToNodeFilter::computeLocalizers( const FilterContext& context )
 {
@@ -23,6 +23,7 @@
 #include <osgEarthFeatures/AltitudeFilter>
 #include <osgEarthFeatures/CentroidFilter>
 #include <osgEarthFeatures/ExtrudeGeometryFilter>
+#include <osgEarthFeatures/FeatureBatch>
 #include <osgEarthFeatures/ScatterFilter>
 #include <osgEarthFeatures/SubstituteModelFilter>
 #include <osgEarthFeatures/TessellateOperator>
@@ -310,19 +311,6 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         }
     }
 
-    // resample the geometry if necessary:
-    if (_options.resampleMode().isSet())
-    {
-        ResampleFilter resample;
-        resample.resampleMode() = *_options.resampleMode();        
-        if (_options.resampleMaxLength().isSet())
-        {
-            resample.maxLength() = *_options.resampleMaxLength();
-        }                   
-        sharedCX = resample.push( workingSet, sharedCX ); 
-        if ( trackHistory ) history.push_back( "resample" );
-    }    
-    
     // check whether we need to do elevation clamping:
     bool altRequired =
         _options.ignoreAltitudeSymbol() != true &&
@@ -332,6 +320,45 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             altitude->verticalScale().isSet() ||
             altitude->script().isSet() );    
 
+    // Extruded and simple geometry apply the altitude filter right after
+    // resampling. When that filter can work on a batch, the two run on one
+    // FeatureBatch so the points stay in a single buffer in between.
+    AltitudeFilter batchClamp;
+    bool clampInBatch = false;
+    if ( altRequired && !model && (extrusion || point || line || polygon) )
+    {
+        batchClamp.setPropertiesFromStyle( style );
+        clampInBatch = batchClamp.canPushBatch( sharedCX );
+    }
+
+    // resample the geometry if necessary:
+    if (_options.resampleMode().isSet() || clampInBatch)
+    {
+        osg::ref_ptr<FeatureBatch> batch = new FeatureBatch( workingSet );
+
+        if (_options.resampleMode().isSet())
+        {
+            ResampleFilter resample;
+            resample.resampleMode() = *_options.resampleMode();        
+            if (_options.resampleMaxLength().isSet())
+            {
+                resample.maxLength() = *_options.resampleMaxLength();
+            }                   
+            sharedCX = resample.pushBatch( *batch, sharedCX ); 
+            if ( trackHistory ) history.push_back( "resample" );
+        }
+
+        if ( clampInBatch )
+        {
+            sharedCX = batchClamp.pushBatch( *batch, sharedCX );
+            if ( trackHistory ) history.push_back( "altitude" );
+            altRequired = false;
+        }
+
+        workingSet.clear();
+        batch->toFeatures( workingSet );
+    }    
+
     // instance substitution (replaces marker)
     if ( model )
     {
@@ -18,9 +18,9 @@
  */
 #include <osgEarthFeatures/ResampleFilter>
 #include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/FeatureBatch>
 #include <osgEarth/GeoMath>
 #include <osg/io_utils>
-#include <list>
 #include <cstdlib>
 
 using namespace osgEarth;
@@ -55,129 +55,132 @@ ResampleFilterOptions( conf )
 }
 
 
-bool
-ResampleFilter::push( Feature* input, FilterContext& context )
+void
+ResampleFilter::resample( const osg::Vec3d* points, unsigned size, std::vector<osg::Vec3d>& output ) const
 {
-    if ( !input || !input->getGeometry() )
-        return true;
-
-    bool success = true;
-
-    GeometryIterator i( input->getGeometry() );
-    while( i.hasMore() )
-    {        
-        Geometry* part = i.next();
-
-        if ( part->size() < 2 ) continue;
-
-        unsigned int origSize = part->size();
-
-        // whether to resample the virtual segment that closes an open ring:
-        bool loop =
-            part->getComponentType() == Geometry::TYPE_RING &&
-            static_cast<Ring*>(part)->isOpen();
-
-        // copy the original part to a linked list. use a std::list since insert/erase
-        // will not invalidate iterators.
-        std::list<osg::Vec3d> plist;
-        plist.insert( plist.begin(), part->begin(), part->end() );
+    // walk the segments, dropping points that are too close to the previous
+    // one and inserting points into segments that are too long. "remaining"
+    // tracks the size of the resampled part so far, plus the unvisited points.
+    output.push_back( points[0] );
+    osg::Vec3d p0 = points[0];
+    unsigned remaining = size;
+
+    for( unsigned next = 1; next < size; )
+    {
+        const osg::Vec3d& p1 = points[next];
+        bool lastSeg = next == size-1;
+        osg::Vec3d seg = p1 - p0;
 
-        std::list<osg::Vec3d>::iterator v1 = plist.begin(); ++v1;
-        std::list<osg::Vec3d>::iterator v0 = plist.begin();
-        std::list<osg::Vec3d>::iterator last = plist.end(); --last;
+        osg::Vec3d p0Rad, p1Rad;
 
-        while( v0 != last )
+        if (resampleMode().value() == RESAMPLE_GREATCIRCLE || resampleMode().value() == RESAMPLE_RHUMB)
         {
-            bool increment = true;
-
-            osg::Vec3d& p0 = *v0;
-            osg::Vec3d& p1 = *v1;
-            bool lastSeg = v1 == last;
-            osg::Vec3d seg = p1 - p0;
+            p0Rad = osg::Vec3d(osg::DegreesToRadians(p0.x()), osg::DegreesToRadians(p0.y()), p0.z());
+            p1Rad = osg::Vec3d(osg::DegreesToRadians(p1.x()), osg::DegreesToRadians(p1.y()), p1.z());
+        }
 
-            osg::Vec3d p0Rad, p1Rad;
+        //Compute the length of the segment
+        double segLen = 0.0;
+        switch (resampleMode().value())
+        {
+        case RESAMPLE_LINEAR:
+            segLen = seg.length();
+            break;
+        case RESAMPLE_GREATCIRCLE:
+            segLen = GeoMath::distance(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+            break;
+        case RESAMPLE_RHUMB:
+            segLen = GeoMath::rhumbDistance(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+            break;
+        }
 
-            if (resampleMode().value() == RESAMPLE_GREATCIRCLE || resampleMode().value() == RESAMPLE_RHUMB)
-            {
-                p0Rad = osg::Vec3d(osg::DegreesToRadians(p0.x()), osg::DegreesToRadians(p0.y()), p0.z());
-                p1Rad = osg::Vec3d(osg::DegreesToRadians(p1.x()), osg::DegreesToRadians(p1.y()), p1.z());
-            }
-                       
-            //Compute the length of the segment
-            double segLen = 0.0;
+        if ( segLen < _minLen.value() && !lastSeg && remaining > 2 )
+        {
+            // drop p1.
+            ++next;
+            --remaining;
+        }
+        else if ( segLen > _maxLen.value() )
+        {
+            //Compute the number of divisions to make
+            int numDivs = (1 + (int)(segLen/_maxLen.value()));
+            double newSegLen = segLen/(double)numDivs;
+            seg.normalize();
+            osg::Vec3d newPt;
+            double newHeight;
             switch (resampleMode().value())
             {
             case RESAMPLE_LINEAR:
-                segLen = seg.length();
+                {
+                    newPt = p0 + seg * newSegLen;
+                }
                 break;
             case RESAMPLE_GREATCIRCLE:
-                segLen = GeoMath::distance(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+                {
+                    double bearing = GeoMath::bearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+                    double lat,lon;
+                    GeoMath::destination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
+                    newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
+                    newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
+                }
                 break;
             case RESAMPLE_RHUMB:
-                segLen = GeoMath::rhumbDistance(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+                {
+                    double bearing = GeoMath::rhumbBearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
+                    double lat,lon;
+                    GeoMath::rhumbDestination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
+                    newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
+                    newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
+                }
                 break;
             }
 
-            if ( segLen < _minLen.value() && !lastSeg && plist.size() > 2 )
+            if ( _perturbThresh.value() > 0.0 && _perturbThresh.value() < newSegLen )
             {
-                v1 = plist.erase( v1 );
-                increment = false;
-            }
-            else if ( segLen > _maxLen.value() )
-            {
-                //Compute the number of divisions to make
-                int numDivs = (1 + (int)(segLen/_maxLen.value()));
-                double newSegLen = segLen/(double)numDivs;
-                seg.normalize();
-                osg::Vec3d newPt;
-                double newHeight;
-                switch (resampleMode().value())
-                {
-                case RESAMPLE_LINEAR:
-                    {
-                        newPt = p0 + seg * newSegLen;
-                    }
-                    break;
-                case RESAMPLE_GREATCIRCLE:
-                    {
-                        double bearing = GeoMath::bearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
-                        double lat,lon;
-                        GeoMath::destination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
-                        newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
-                        newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
-                    }
-                    break;
-                case RESAMPLE_RHUMB:
-                    {
-                        double bearing = GeoMath::rhumbBearing(p0Rad.y(), p0Rad.x(), p1Rad.y(), p1Rad.x());
-                        double lat,lon;
-                        GeoMath::rhumbDestination(p0Rad.y(), p0Rad.x(), bearing, newSegLen, lat, lon);
-                        newHeight = p0Rad.z() + ( p1Rad.z() - p0Rad.z() ) / (double)numDivs;
-                        newPt = osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), newHeight);
-                    }
-                    break;
-                }
-                
-                if ( _perturbThresh.value() > 0.0 && _perturbThresh.value() < newSegLen )
-                {
-                    float r = 0.5 - (float)::rand()/(float)RAND_MAX;
-                    newPt.x() += r;
-                    newPt.y() += r;
-                }
-                v1 = plist.insert( v1, newPt );
+                float r = 0.5 - (float)::rand()/(float)RAND_MAX;
+                newPt.x() += r;
+                newPt.y() += r;
             }
 
-            if ( increment ) { ++v0; ++v1; }
+            // the new point starts the next segment, which ends at p1 again.
+            output.push_back( newPt );
+            p0 = newPt;
+            ++remaining;
+        }
+        else
+        {
+            output.push_back( p1 );
+            p0 = p1;
+            ++next;
         }
+    }
+}
+
+bool
+ResampleFilter::push( Feature* input, FilterContext& context )
+{
+    if ( !input || !input->getGeometry() )
+        return true;
+
+    std::vector<osg::Vec3d> resampled;
+
+    GeometryIterator i( input->getGeometry() );
+    while( i.hasMore() )
+    {        
+        Geometry* part = i.next();
+
+        if ( part->size() < 2 ) continue;
+
+        resampled.clear();
+        resample( &(*part)[0], part->size(), resampled );
 
         part->clear();
-        part->reserve( plist.size() );
-        part->insert( part->begin(), plist.begin(), plist.end() );
+        part->reserve( resampled.size() );
+        part->insert( part->begin(), resampled.begin(), resampled.end() );
     }
-    return success;
+    return true;
 }
 
-
 FilterContext
 ResampleFilter::push( FeatureList& input, FilterContext& context )
 {
@@ -194,3 +197,36 @@ ResampleFilter::push( FeatureList& input, FilterContext& context )
 
     return context;
 }
+
+FilterContext
+ResampleFilter::pushBatch( FeatureBatch& input, FilterContext& context )
+{
+    if ( !isSupported() )
+    {
+        OE_WARN << "ResampleFilter support not enabled" << std::endl;
+        return context;
+    }
+
+    // resample every part into a new coordinate buffer.
+    const std::vector<osg::Vec3d>& points = input.points();
+    std::vector<osg::Vec3d> resampled;
+    resampled.reserve( points.size() );
+
+    FeatureBatch::Parts& parts = input.parts();
+    for( FeatureBatch::Parts::iterator part = parts.begin(); part != parts.end(); ++part )
+    {
+        unsigned offset = resampled.size();
+
+        if ( part->size < 2 )
+            resampled.insert( resampled.end(), points.begin() + part->offset, points.begin() + part->offset + part->size );
+        else
+            resample( &points[part->offset], part->size, resampled );
+
+        part->offset = offset;
+        part->size   = resampled.size() - offset;
+    }
+
+    input.swapPoints( resampled );
+
+    return context;
+}
@@ -19,6 +19,7 @@
 #include <osgEarthFeatures/TransformFilter>
 #include <osgEarthFeatures/Feature>
 #include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/FeatureBatch>
 #include <osg/ClusterCullingCallback>
 
 #define LC "[TransformFilter] "
@@ -129,15 +130,7 @@ TransformFilter::push( FeatureList& input, FilterContext& incx )
         if ( !push( i->get(), incx ) )
             ok = false;
 
-    FilterContext outcx( incx );
-
-    if ( _outputSRS.valid() )
-    {
-        if ( incx.extent()->isValid() )
-            outcx.setProfile( new FeatureProfile( incx.extent()->transform( _outputSRS.get()) ) );
-        else
-            outcx.setProfile( new FeatureProfile( incx.profile()->getExtent().transform( _outputSRS.get()) ) );
-    }
+    FilterContext outcx = createOutputContext( incx );
 
     // set the reference frame to shift data to the centroid. This will
     // prevent floating point precision errors in the openGL pipeline for
@@ -158,3 +151,59 @@ TransformFilter::push( FeatureList& input, FilterContext& incx )
 
     return outcx;
 }
+
+FilterContext
+TransformFilter::pushBatch( FeatureBatch& input, FilterContext& incx )
+{
+    _bbox = osg::BoundingBoxd();
+
+    std::vector<osg::Vec3d>& points = input.points();
+
+    bool needsSRSXform =
+        _outputSRS.valid() &&
+        ( ! incx.profile()->getSRS()->isEquivalentTo( _outputSRS.get() ) );
+
+    // pre-transform the points before doing an SRS transformation.
+    if ( !_mat.isIdentity() )
+    {
+        for( std::vector<osg::Vec3d>::iterator p = points.begin(); p != points.end(); ++p )
+            *p = (*p) * _mat;
+    }
+
+    // transform every point of every feature in one go.
+    if ( needsSRSXform && !points.empty() )
+    {
+        incx.profile()->getSRS()->transform( points, _outputSRS.get() );
+    }
+
+    FilterContext outcx = createOutputContext( incx );
+
+    // shift the data to the centroid; see push(FeatureList&).
+    if ( _localize && !points.empty() )
+    {
+        for( std::vector<osg::Vec3d>::const_iterator p = points.begin(); p != points.end(); ++p )
+            _bbox.expandBy( *p );
+
+        const osg::Vec3d center = _bbox.center();
+        for( std::vector<osg::Vec3d>::iterator p = points.begin(); p != points.end(); ++p )
+            *p -= center;
+    }
+
+    return outcx;
+}
+
+FilterContext
+TransformFilter::createOutputContext( FilterContext& incx ) const
+{
+    FilterContext outcx( incx );
+
+    if ( _outputSRS.valid() )
+    {
+        if ( incx.extent()->isValid() )
+            outcx.setProfile( new FeatureProfile( incx.extent()->transform( _outputSRS.get()) ) );
+        else
+            outcx.setProfile( new FeatureProfile( incx.profile()->getExtent().transform( _outputSRS.get()) ) );
+    }
+
+    return outcx;
+}
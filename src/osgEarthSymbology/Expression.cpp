@@ -282,86 +282,62 @@ NumericExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stack<double> s;
+        std::vector<double> stack;
+        const_cast<NumericExpression*>(this)->_value = run( 0L, stack );
+        const_cast<NumericExpression*>(this)->_dirty = false;
+    }
+
+    return !osg::isNaN( _value ) ? _value : 0.0;
+}
+
+double
+NumericExpression::eval( const double* values, std::vector<double>& stack ) const
+{
+    double value = run( values, stack );
+    return !osg::isNaN( value ) ? value : 0.0;
+}
+
+double
+NumericExpression::run( const double* values, std::vector<double>& s ) const
+{
+    s.clear();
+
+    // variables appear in the RPN in the same order as in _vars.
+    unsigned var_i = 0;
+
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        const Atom& a = _rpn[i];
 
-        for( unsigned i=0; i<_rpn.size(); ++i )
+        if ( a.first == OPERAND )
         {
-            const Atom& a = _rpn[i];
+            s.push_back( a.second );
+        }
+        else if ( a.first == VARIABLE )
+        {
+            s.push_back( values ? values[var_i] : a.second );
+            ++var_i;
+        }
+        else if ( s.size() >= 2 )
+        {
+            double op2 = s.back(); s.pop_back();
+            double& op1 = s.back();
 
-            if ( a.first == ADD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 + op2 );
-                }
-            }
-            else if ( a.first == SUB )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 - op2 );
-                }
-            }
-            else if ( a.first == MULT )
+            switch( a.first )
             {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 * op2 );
-                }
-            }
-            else if ( a.first == DIV )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 / op2 );
-                }
-            }
-            else if ( a.first == MOD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( fmod(op1, op2) );
-                }
-            }
-            else if ( a.first == MIN )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( osg::minimum(op1, op2) );
-                }
-            }
-            else if ( a.first == MAX )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( osg::maximum(op1, op2) );
-                }
-            }
-            else // OPERAND or VARIABLE
-            {
-                s.push( a.second );
+            case ADD:  op1 = op1 + op2; break;
+            case SUB:  op1 = op1 - op2; break;
+            case MULT: op1 = op1 * op2; break;
+            case DIV:  op1 = op1 / op2; break;
+            case MOD:  op1 = fmod(op1, op2); break;
+            case MIN:  op1 = osg::minimum(op1, op2); break;
+            case MAX:  op1 = osg::maximum(op1, op2); break;
+            default:   break;
             }
         }
-
-        const_cast<NumericExpression*>(this)->_value = s.size() > 0 ? s.top() : 0.0;
-        const_cast<NumericExpression*>(this)->_dirty = false;
     }
 
-    return !osg::isNaN( _value ) ? _value : 0.0;
+    return s.size() > 0 ? s.back() : 0.0;
 }
 
 //------------------------------------------------------------------------
@@ -413,6 +389,9 @@ StringExpression::setLiteral( const std::string& expr )
     _src = "\"" + expr + "\"";
     _value = expr;
     _dirty = false;
+    _vars.clear();
+    _infix.clear();
+    _infix.push_back( Atom(OPERAND, expr) );
 }
 
 StringExpression::StringExpression( const Config& conf )
@@ -561,6 +540,23 @@ StringExpression::eval() const
     return _value;
 }
 
+void
+StringExpression::eval( const std::string* values, std::string& output ) const
+{
+    output.clear();
+
+    // variables appear in the infix in the same order as in _vars.
+    unsigned var_i = 0;
+
+    for( AtomVector::const_iterator i = _infix.begin(); i != _infix.end(); ++i )
+    {
+        if ( i->first == VARIABLE )
+            output.append( values[var_i++] );
+        else
+            output.append( i->second );
+    }
+}
+
 URI
 StringExpression::evalURI() const
 {
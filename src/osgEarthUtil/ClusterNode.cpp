@@ -1,12 +1,135 @@
 #include <osgEarthUtil/ClusterNode>
 
 #include <osgEarthUtil/kdbush.hpp>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/Registry>
+#include <OpenThreads/Atomic>
 
 typedef std::pair<int, int> TPoint;
 typedef std::vector< std::size_t > TIds;
 
 using namespace osgEarth::Util;
 
+namespace
+{
+    // Zoom levels of the cluster hierarchy. Above the last one every node stands on its own.
+    const unsigned int MAX_ZOOM = 20;
+
+    // Size of a tile in pixels; the world is TILE_SIZE * 2^zoom pixels wide at a zoom level.
+    const double TILE_SIZE = 256.0;
+
+    // The index stores mercator coordinates in [0..1] as integers of this scale.
+    const double INDEX_SCALE = 1073741824.0;
+
+    const double MAX_LATITUDE = 85.0511287798;
+
+    double lonToX(double lon)
+    {
+        return lon / 360.0 + 0.5;
+    }
+
+    double latToY(double lat)
+    {
+        double s = sin(osg::DegreesToRadians(osg::clampBetween(lat, -MAX_LATITUDE, MAX_LATITUDE)));
+        return 0.5 - 0.25 * log((1.0 + s) / (1.0 - s)) / osg::PI;
+    }
+
+    double xToLon(double x)
+    {
+        return (x - 0.5) * 360.0;
+    }
+
+    double yToLat(double y)
+    {
+        return osg::RadiansToDegrees(2.0 * atan(exp((0.5 - y) * 2.0 * osg::PI))) - 90.0;
+    }
+
+    int toIndex(double v)
+    {
+        return (int)(v * INDEX_SCALE);
+    }
+}
+
+struct ClusterNode::ClusterLevel
+{
+    // A node, or a cluster of nodes, at one zoom level.
+    struct Entry
+    {
+        double       x, y;          // web mercator position, in [0..1]
+        double       altitude;
+        osg::Vec3d   world;         // world position, for culling
+        unsigned int count;         // number of nodes in the entry
+        unsigned int node;          // index of its first node in _nodes
+        unsigned int firstChild;    // its entries of the next zoom level, in children
+        unsigned int numChildren;
+    };
+
+    ClusterLevel() : index(0L) { }
+    ~ClusterLevel() { delete index; }
+
+    void createIndex()
+    {
+        if (entries.empty())
+            return;
+
+        std::vector<TPoint> points;
+        points.reserve(entries.size());
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            points.push_back(TPoint(toIndex(entries[i].x), toIndex(entries[i].y)));
+        }
+        index = new kdbush::KDBush<TPoint>(points);
+    }
+
+    std::vector< Entry > entries;
+    std::vector< unsigned int > children;   // indices into the next zoom level, grouped by parent
+    kdbush::KDBush< TPoint >* index;        // entries by position
+};
+
+// The clusters of every zoom level for a snapshot of the nodes. Built on the
+// JobScheduler, and only read once ready.
+struct ClusterNode::ClusterIndex : public osg::Referenced
+{
+    ClusterIndex() : radius(50), maxAltitude(0.0), ready(0u) { }
+
+    ~ClusterIndex()
+    {
+        for (unsigned int i = 0; i < levels.size(); i++)
+        {
+            delete levels[i];
+        }
+    }
+
+    void build();
+    void buildLevel(unsigned int zoom);
+    void getLeaves(unsigned int zoom, unsigned int entry, osg::NodeList& out) const;
+
+    // Inputs, captured on the cull thread.
+    osg::NodeList nodes;
+    std::vector< osg::BoundingSphere > bounds;   // bounds of the nodes
+    osg::ref_ptr< const SpatialReference > mapSRS;
+    unsigned int radius;
+    osg::ref_ptr< CanClusterCallback > canClusterCallback;
+
+    // Results.
+    std::vector< ClusterLevel* > levels;   // one per zoom level, the last one holding the nodes
+    double maxAltitude;                    // highest node, for the horizon test
+    OpenThreads::Atomic ready;
+};
+
+struct ClusterNode::BuildIndex : public TaskRequest
+{
+    BuildIndex(ClusterIndex* index) : _index(index) { }
+
+    void operator()(ProgressCallback* progress)
+    {
+        _index->build();
+        _index->ready.exchange(1u);
+    }
+
+    osg::ref_ptr< ClusterIndex > _index;
+};
+
 ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _radius(50),
     _mapNode(mapNode),
@@ -21,6 +144,10 @@ ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _horizon = new Horizon();
 }
 
+ClusterNode::~ClusterNode()
+{
+}
+
 void ClusterNode::addNode(osg::Node* node)
 {
     _nodes.push_back(node);
@@ -55,6 +182,7 @@ void ClusterNode::setRadius(unsigned int radius)
 {
     _radius = radius;
     _dirty = true;
+    _dirtyIndex = true;
 }
 
 bool ClusterNode::getEnabled() const
@@ -106,158 +234,430 @@ void ClusterNode::setCanClusterCallback(ClusterNode::CanClusterCallback* callbac
 {
     _canClusterCallback = callback;
     _dirty = true;
+    _dirtyIndex = true;
 }
 
-bool boundSort(const osg::ref_ptr< osg::Node> &i, const osg::ref_ptr< osg::Node> &j)
+void ClusterNode::updateIndex()
 {
-    osg::BoundingSphere bsI = i->getBound();
-    osg::BoundingSphere bsJ = j->getBound();
+    // Swap in a finished index.
+    if (_nextIndex.valid() && (unsigned)_nextIndex->ready != 0u)
+    {
+        _index = _nextIndex.get();
+        _nextIndex = 0L;
+        _dirty = true;
+    }
 
-    return bsI.center().x() < bsJ.center().x();
+    // Only one index is built at a time; changes made while it builds are
+    // gathered into the next one.
+    if (!_dirtyIndex || _nextIndex.valid())
+    {
+        return;
+    }
+    _dirtyIndex = false;
+
+    osg::ref_ptr< ClusterIndex > index = createIndex();
+
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+    if (scheduler && scheduler->add(new BuildIndex(index.get())))
+    {
+        _nextIndex = index.get();
+    }
+    else
+    {
+        index->build();
+        _index = index.get();
+        _dirty = true;
+    }
+}
+
+ClusterNode::ClusterIndex* ClusterNode::createIndex() const
+{
+    ClusterIndex* index = new ClusterIndex();
+    index->nodes = _nodes;
+    index->mapSRS = _mapNode->getMapSRS();
+    index->radius = _radius;
+    index->canClusterCallback = _canClusterCallback.get();
+
+    index->bounds.reserve(_nodes.size());
+    for (unsigned int i = 0; i < _nodes.size(); i++)
+    {
+        index->bounds.push_back(_nodes[i]->getBound());
+    }
+    return index;
 }
 
+void ClusterNode::getClusterNodes(unsigned int zoom, std::vector< osg::NodeList >& out)
+{
+    if (!_mapNode.valid())
+    {
+        return;
+    }
+
+    // Bring the clusters up to date now, rather than waiting for a build.
+    if (_dirtyIndex || _nextIndex.valid())
+    {
+        osg::ref_ptr< ClusterIndex > index = createIndex();
+        index->build();
+        _index = index.get();
+        _nextIndex = 0L;
+        _dirtyIndex = false;
+        _dirty = true;
+    }
+
+    if (!_index.valid() || zoom >= _index->levels.size())
+    {
+        return;
+    }
+
+    const ClusterLevel* level = _index->levels[zoom];
+    for (unsigned int i = 0; i < level->entries.size(); i++)
+    {
+        out.push_back(osg::NodeList());
+        _index->getLeaves(zoom, i, out.back());
+    }
+}
 
-void ClusterNode::buildIndex()
+void ClusterNode::ClusterIndex::build()
 {
-    if (_dirtyIndex)
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    const SpatialReference* geoSRS = mapSRS->getGeographicSRS();
+
+    levels.resize(MAX_ZOOM + 2);
+    for (unsigned int i = 0; i < levels.size(); i++)
     {
-        _clusterIndex.clear();
+        levels[i] = new ClusterLevel();
+    }
 
-        std::sort(_nodes.begin(), _nodes.end(), boundSort);
+    // The last level holds the nodes themselves.
+    ClusterLevel* leaves = levels.back();
+    leaves->entries.reserve(nodes.size());
 
-        unsigned int maxNodes = 10000;
+    for (unsigned int i = 0; i < nodes.size(); i++)
+    {
+        const osg::BoundingSphere& bs = bounds[i];
+        if (!bs.valid())
+        {
+            continue;
+        }
 
-        osg::Group* currentGroup = 0;
+        ClusterLevel::Entry entry;
+        entry.world = bs.center();
 
-        for (unsigned int i = 0; i < _nodes.size(); i++)
+        GeoPoint position;
+        if (!position.fromWorld(mapSRS.get(), entry.world) || !position.transformInPlace(geoSRS))
         {
-            if (!currentGroup || currentGroup->getNumChildren() >= maxNodes)
-            {
-                currentGroup = new osg::Group;
-                _clusterIndex.push_back(currentGroup);
-            }
-            currentGroup->addChild(_nodes[i]);                      
+            continue;
         }
+
+        entry.x = lonToX(position.x());
+        entry.y = latToY(position.y());
+        entry.altitude = position.z();
+        entry.count = 1;
+        entry.node = i;
+        entry.firstChild = 0;
+        entry.numChildren = 0;
+        leaves->entries.push_back(entry);
+
+        maxAltitude = osg::maximum(maxAltitude, entry.altitude);
     }
-    _dirtyIndex = false;
-}
 
+    leaves->createIndex();
 
-void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
-{
-    _nextLabel = 0;
+    for (int zoom = MAX_ZOOM; zoom >= 0; --zoom)
+    {
+        buildLevel(zoom);
+    }
+}
 
-    osg::Camera* camera = cv->getCurrentCamera();
+void ClusterNode::ClusterIndex::buildLevel(unsigned int zoom)
+{
+    const ClusterLevel* source = levels[zoom + 1];
+    ClusterLevel* level = levels[zoom];
 
-    osg::Viewport* viewport = camera->getViewport();
-    if (!viewport)
+    if (!source->index)
     {
         return;
     }
 
-    osg::Matrixd mvpw = camera->getViewMatrix() *
-        camera->getProjectionMatrix() *
-        camera->getViewport()->computeWindowMatrix();
+    const SpatialReference* geoSRS = mapSRS->getGeographicSRS();
 
-    std::vector<TPoint> points;
+    // The cluster radius at this zoom, as a fraction of the world. A radius of
+    // half the world already reaches everything, and keeps the index in range.
+    double r = osg::minimum((double)radius / (TILE_SIZE * (double)(1u << zoom)), 0.5);
+    double r2 = r * r;
+    int indexRadius = (int)ceil(r * INDEX_SCALE);
 
-    osg::NodeList validPlaces;
+    const unsigned int NONE = ~0u;
+    std::vector< unsigned int > parents(source->entries.size(), NONE);
+    TIds indices;
 
-    buildIndex();
-
-    for (osg::NodeList::iterator itr = _clusterIndex.begin(); itr != _clusterIndex.end(); ++itr)
+    // Greedily merge each entry that is not yet part of a cluster with its free
+    // neighbors, placing the cluster at their weighted center.
+    for (unsigned int i = 0; i < source->entries.size(); i++)
     {
-        osg::Group* index = static_cast<osg::Group*>(itr->get());
-        if (cv->isCulled(index->getBound()))
+        if (parents[i] != NONE)
         {
             continue;
         }
 
-        for (unsigned int i = 0; i < index->getNumChildren(); i++)
-        {
-            osg::Node* node = index->getChild(i);
-            osg::Vec3d world = node->getBound().center();
+        const ClusterLevel::Entry& seed = source->entries[i];
+        unsigned int parent = level->entries.size();
+        parents[i] = parent;
+
+        double x = seed.x * seed.count;
+        double y = seed.y * seed.count;
+        double altitude = seed.altitude * seed.count;
+        unsigned int count = seed.count;
 
-            if (cv->isCulled(*node))
+        int ix = toIndex(seed.x);
+        int iy = toIndex(seed.y);
+
+        indices.clear();
+        source->index->range(ix - indexRadius, iy - indexRadius, ix + indexRadius, iy + indexRadius, indices);
+
+        for (unsigned int j = 0; j < indices.size(); j++)
+        {
+            unsigned int n = indices[j];
+            if (parents[n] != NONE)
             {
                 continue;
             }
 
-            if (!_horizon->isVisible(world))
+            const ClusterLevel::Entry& neighbor = source->entries[n];
+            double dx = neighbor.x - seed.x;
+            double dy = neighbor.y - seed.y;
+            if (dx*dx + dy*dy > r2)
             {
                 continue;
             }
 
-            osg::Vec3d screen = world * mvpw;
-
-            if (screen.x() >= 0 && screen.x() <= viewport->width() &&
-                screen.y() >= 0 && screen.y() <= viewport->height())
+            if (canClusterCallback.valid())
             {
-                validPlaces.push_back(node);
-                points.push_back(TPoint(screen.x(), screen.y()));
+                bool canCluster = (*canClusterCallback)(nodes[seed.node].get(), nodes[neighbor.node].get());
+                if (!canCluster) {
+                    continue;
+                }
             }
+
+            parents[n] = parent;
+            x += neighbor.x * neighbor.count;
+            y += neighbor.y * neighbor.count;
+            altitude += neighbor.altitude * neighbor.count;
+            count += neighbor.count;
         }
+
+        ClusterLevel::Entry cluster = seed;
+        if (count > seed.count)
+        {
+            cluster.x = x / count;
+            cluster.y = y / count;
+            cluster.altitude = altitude / count;
+            cluster.count = count;
+            GeoPoint(geoSRS, xToLon(cluster.x), yToLat(cluster.y), cluster.altitude, ALTMODE_ABSOLUTE).toWorld(cluster.world);
+        }
+        cluster.numChildren = 0;
+        level->entries.push_back(cluster);
+    }
+
+    // List the children of each entry, grouped by parent.
+    for (unsigned int i = 0; i < parents.size(); i++)
+    {
+        level->entries[parents[i]].numChildren++;
+    }
+
+    std::vector< unsigned int > next(level->entries.size());
+    unsigned int offset = 0;
+    for (unsigned int i = 0; i < level->entries.size(); i++)
+    {
+        level->entries[i].firstChild = offset;
+        next[i] = offset;
+        offset += level->entries[i].numChildren;
+    }
+
+    level->children.resize(parents.size());
+    for (unsigned int i = 0; i < parents.size(); i++)
+    {
+        level->children[next[parents[i]]++] = i;
+    }
+
+    level->createIndex();
+}
+
+void ClusterNode::ClusterIndex::getLeaves(unsigned int zoom, unsigned int entry, osg::NodeList& out) const
+{
+    const ClusterLevel* level = levels[zoom];
+    const ClusterLevel::Entry& e = level->entries[entry];
+
+    if (e.count == 1)
+    {
+        out.push_back(nodes[e.node]);
+        return;
+    }
+
+    for (unsigned int i = e.firstChild; i < e.firstChild + e.numChildren; i++)
+    {
+        getLeaves(zoom + 1, level->children[i], out);
+    }
+}
+
+unsigned int ClusterNode::getZoom(osg::Camera* camera, const GeoPoint& eye) const
+{
+    // Size of a pixel on the ground right below the eye.
+    double height = camera->getViewport()->height();
+    double metersPerPixel;
+    double fovy, aspect, left, right, bottom, top, zNear, zFar;
+
+    if (camera->getProjectionMatrixAsPerspective(fovy, aspect, zNear, zFar))
+    {
+        metersPerPixel = 2.0 * osg::maximum(eye.z(), 1.0) * tan(osg::DegreesToRadians(fovy * 0.5)) / height;
+    }
+    else if (camera->getProjectionMatrixAsOrtho(left, right, bottom, top, zNear, zFar))
+    {
+        metersPerPixel = (top - bottom) / height;
+    }
+    else
+    {
+        return MAX_ZOOM + 1;
+    }
+
+    // The zoom level at which a pixel is that size at the eye's latitude.
+    double worldMeters =
+        2.0 * osg::PI * _mapNode->getMapSRS()->getEllipsoid()->getRadiusEquator() *
+        cos(osg::DegreesToRadians(osg::clampBetween(eye.y(), -MAX_LATITUDE, MAX_LATITUDE)));
+
+    double zoom = log(worldMeters / (TILE_SIZE * metersPerPixel)) / log(2.0);
+    if (!(zoom > 0.0))
+    {
+        return 0;
+    }
+    return (unsigned int)osg::minimum(floor(zoom), (double)(MAX_ZOOM + 1));
+}
+
+
+void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
+{
+    _nextLabel = 0;
+
+    osg::Camera* camera = cv->getCurrentCamera();
+
+    osg::Viewport* viewport = camera->getViewport();
+    if (!viewport)
+    {
+        return;
+    }
+
+    const ClusterIndex* index = _index.get();
+    if (!index || index->levels.empty())
+    {
+        return;
     }
 
-    if (validPlaces.size() == 0) return;
+    osg::Matrixd mvpw = camera->getViewMatrix() *
+        camera->getProjectionMatrix() *
+        camera->getViewport()->computeWindowMatrix();
+
+    const SpatialReference* mapSRS = _mapNode->getMapSRS();
+    const SpatialReference* geoSRS = mapSRS->getGeographicSRS();
+
+    osg::Vec3d eye, center, up;
+    camera->getViewMatrixAsLookAt(eye, center, up);
+
+    GeoPoint eyePoint;
+    if (!eyePoint.fromWorld(mapSRS, eye) || !eyePoint.transformInPlace(geoSRS))
+    {
+        return;
+    }
 
-    kdbush::KDBush<TPoint> index(points);
-    std::set< unsigned int > clustered;
+    unsigned int zoom = getZoom(camera, eyePoint);
+    const ClusterLevel* level = index->levels[zoom];
+    if (!level->index)
+    {
+        return;
+    }
 
-    for (unsigned int i = 0; i < validPlaces.size(); i++)
+    // Bound the part of the world that can be above the horizon: the eye's
+    // horizon widened by that of the highest node.
+    double west = -180.0, east = 180.0, south = -MAX_LATITUDE, north = MAX_LATITUDE;
+    if (_mapNode->isGeocentric())
     {
-        TPoint &screen = points[i];
-        osg::Node* node = validPlaces[i].get();
+        double R = mapSRS->getEllipsoid()->getRadiusEquator();
+        double angle =
+            acos(R / (R + osg::maximum(eyePoint.z(), 0.0))) +
+            acos(R / (R + osg::maximum(index->maxAltitude, 0.0)));
+        double degrees = osg::RadiansToDegrees(angle);
+
+        south = osg::maximum(eyePoint.y() - degrees, -MAX_LATITUDE);
+        north = osg::minimum(eyePoint.y() + degrees, MAX_LATITUDE);
 
-        // If this thing is already part of a cluster then just continue.
-        if (clustered.find(i) != clustered.end())
+        if (fabs(eyePoint.y()) + degrees < 90.0)
         {
-            continue;
+            double halfWidth = osg::RadiansToDegrees(asin(sin(angle) / cos(osg::DegreesToRadians(eyePoint.y()))));
+            west = eyePoint.x() - halfWidth;
+            east = eyePoint.x() + halfWidth;
         }
+    }
 
-        osg::Vec3d world = node->getBound().center();
+    int minY = toIndex(latToY(north));
+    int maxY = toIndex(latToY(south));
 
-        // Get any matching indices that are part of this cluster.
-        TIds indices;
+    TIds indices;
 
-        index.range(screen.first - _radius, screen.second - _radius, screen.first + _radius, screen.second + _radius, indices);
+    // Split a range that crosses the antimeridian.
+    if (west < -180.0)
+    {
+        level->index->range(toIndex(lonToX(west + 360.0)), minY, toIndex(1.0), maxY, indices);
+        west = -180.0;
+    }
+    if (east > 180.0)
+    {
+        level->index->range(0, minY, toIndex(lonToX(east - 360.0)), maxY, indices);
+        east = 180.0;
+    }
+    level->index->range(toIndex(lonToX(west)), minY, toIndex(lonToX(east)), maxY, indices);
 
-        // Create a new cluster.
-        Cluster cluster;
+    for (unsigned int i = 0; i < indices.size(); i++)
+    {
+        const ClusterLevel::Entry& entry = level->entries[indices[i]];
 
-        unsigned int actualCount = 0;
+        if (entry.count == 1 ?
+            cv->isCulled(*index->nodes[entry.node]) :
+            cv->isCulled(osg::BoundingSphere(entry.world, 0.0f)))
+        {
+            continue;
+        }
 
-        // Add all of the points to the cluster.
-        for (unsigned int j = 0; j < indices.size(); j++)
+        if (!_horizon->isVisible(entry.world))
         {
-            if (clustered.find(indices[j]) == clustered.end())
-            {
-                if (_canClusterCallback.valid())
-                {
-                    bool canCluster = (*_canClusterCallback)(node, validPlaces[indices[j]].get());
-                    if (!canCluster) {
-                        continue;
-                    }
-                }
-                cluster.nodes.push_back(validPlaces[indices[j]]);
-                actualCount++;
-                clustered.insert(indices[j]);
-            }
+            continue;
+        }
+
+        osg::Vec3d screen = entry.world * mvpw;
+
+        if (screen.x() < 0 || screen.x() > viewport->width() ||
+            screen.y() < 0 || screen.y() > viewport->height())
+        {
+            continue;
         }
 
+        // Create a new cluster.
+        Cluster cluster;
+        index->getLeaves(zoom, indices[i], cluster.nodes);
+
         std::stringstream buf;
-        buf << actualCount << std::endl;
+        buf << entry.count << std::endl;
 
         PlaceNode* marker = getOrCreateLabel();
         GeoPoint markerPos;
-        markerPos.fromWorld(_mapNode->getMapSRS(), world);
+        markerPos.fromWorld(mapSRS, entry.world);
         marker->setPosition(markerPos);
         marker->setText(buf.str());
 
         cluster.marker = marker;
         out.push_back(cluster);
-
-        clustered.insert(i);
     }
 }
 
@@ -279,6 +679,8 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
         {
             if (_mapNode.valid())
             {
+                updateIndex();
+
                 const osg::Matrixd &currentViewMatrix = cv->getCurrentCamera()->getViewMatrix();
                 if (_lastViewMatrix != currentViewMatrix || _dirty)
                 {
@@ -49,7 +49,7 @@ public:
       {        
       }
 
-      const GeoExtent& getExtent() const
+      GeoExtent getExtent() const
       {
           return _key.getExtent();
       }
@@ -0,0 +1,132 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Async>
+#include <osg/Group>
+
+using namespace osgEarth;
+
+namespace AsyncTest
+{
+    // Content last seen at a frame and time.
+    AsyncNode* createContent(unsigned frame, double time)
+    {
+        AsyncNode* node = new AsyncNode();
+        node->_node = new osg::Group();
+        node->_lastFrameWeMet = frame;
+        node->_lastTimeWeMet = time;
+        return node;
+    }
+
+    // The manager is shared, so each section runs on frames and times
+    // later than any it has seen before.
+    unsigned nextFrame()
+    {
+        static unsigned frame = 1000u;
+        frame += 1000u;
+        return frame;
+    }
+
+    void update(unsigned frame, double time)
+    {
+        osg::ref_ptr<osg::FrameStamp> stamp = new osg::FrameStamp();
+        stamp->setFrameNumber(frame);
+        stamp->setReferenceTime(time);
+        AsyncResidencyManager::instance().update(stamp.get());
+    }
+}
+
+TEST_CASE( "AsyncResidencyManager" ) {
+
+    AsyncResidencyManager& manager = AsyncResidencyManager::instance();
+    manager.setMaxBytes(0);
+    manager.setExpirationFrames(60u);
+    manager.setExpirationTime(10.0);
+
+    unsigned frame = AsyncTest::nextFrame();
+    double now = (double)frame;
+
+    SECTION("Content expires once unseen for long enough") {
+        osg::ref_ptr<AsyncNode> old     = AsyncTest::createContent(frame - 100u, now - 20.0);
+        osg::ref_ptr<AsyncNode> recent  = AsyncTest::createContent(frame - 100u, now - 5.0);
+        osg::ref_ptr<AsyncNode> current = AsyncTest::createContent(frame - 1u,   now - 20.0);
+
+        manager.add(old.get(), 100u);
+        manager.add(recent.get(), 100u);
+        manager.add(current.get(), 100u);
+
+        AsyncTest::update(frame, now);
+
+        REQUIRE_FALSE(old->_node.valid());
+        REQUIRE(old->_needy);
+        REQUIRE(recent->_node.valid());
+        REQUIRE(current->_node.valid());
+        REQUIRE(manager.getNumResident() == 2u);
+        REQUIRE(manager.getTotalBytes() == 200u);
+
+        manager.remove(recent.get());
+        manager.remove(current.get());
+    }
+
+    SECTION("Over budget, the content seen least recently goes first") {
+        manager.setExpirationTime(0.0);
+        manager.setMaxBytes(250u);
+
+        osg::ref_ptr<AsyncNode> oldest  = AsyncTest::createContent(frame - 5u, now - 5.0);
+        osg::ref_ptr<AsyncNode> older   = AsyncTest::createContent(frame - 3u, now - 3.0);
+        osg::ref_ptr<AsyncNode> current = AsyncTest::createContent(frame - 1u, now - 1.0);
+
+        manager.add(oldest.get(), 100u);
+        manager.add(older.get(), 100u);
+        manager.add(current.get(), 100u);
+
+        AsyncTest::update(frame, now);
+
+        REQUIRE_FALSE(oldest->_node.valid());
+        REQUIRE(older->_node.valid());
+        REQUIRE(current->_node.valid());
+        REQUIRE(manager.getTotalBytes() == 200u);
+
+        manager.remove(older.get());
+        manager.remove(current.get());
+    }
+
+    SECTION("Content seen in the last frame stays, even over budget") {
+        manager.setExpirationTime(0.0);
+        manager.setMaxBytes(1u);
+
+        osg::ref_ptr<AsyncNode> current = AsyncTest::createContent(frame - 1u, now);
+        manager.add(current.get(), 100u);
+
+        AsyncTest::update(frame, now);
+
+        REQUIRE(current->_node.valid());
+        REQUIRE(manager.getTotalBytes() == 100u);
+
+        manager.remove(current.get());
+    }
+
+    manager.setMaxBytes(0);
+    manager.setExpirationTime(10.0);
+}
@@ -24,8 +24,15 @@
 #include <osgEarth/GeoData>
 #include <osgEarth/Registry>
 #include <osgEarth/Cache>
+#include <osgEarth/MemCache>
+#include <osgEarth/WriteBehindCacheBin>
+#include <osgEarth/HTTPClient>
+#include <osgEarthDrivers/cache_filesystem/FileSystemCache>
+#include <osgDB/FileNameUtils>
+#include <cstdio>
 
 using namespace osgEarth;
+using namespace osgEarth::Drivers;
 
 TEST_CASE( "Cache" ) {
 
@@ -83,3 +90,165 @@ TEST_CASE( "Cache" ) {
         REQUIRE(r2.failed());
     }  
 }
+
+TEST_CASE( "WriteBehindCacheBin" ) {
+
+    osg::ref_ptr<MemCache> cache = new MemCache();
+    osg::ref_ptr<CacheBin> target = cache->addBin("write_behind_bin");
+    REQUIRE(target.valid());
+
+    osg::ref_ptr<WriteBehindCacheBin> bin = new WriteBehindCacheBin(target.get());
+
+    SECTION("Queued writes are readable and reach the wrapped bin")
+    {
+        std::string key("string_key");
+        REQUIRE(bin->write(key, new StringObject("first"), 0L));
+
+        // Readable right away, whether or not it has been written yet
+        ReadResult r = bin->readString(key, 0L);
+        REQUIRE(r.succeeded());
+        REQUIRE(r.getString() == "first");
+
+        bin->flush();
+        REQUIRE(bin->getQueueSize() == 0u);
+
+        ReadResult r2 = target->readString(key, 0L);
+        REQUIRE(r2.succeeded());
+        REQUIRE(r2.getString() == "first");
+    }
+
+    SECTION("Last write to a key wins")
+    {
+        std::string key("coalesced_key");
+        REQUIRE(bin->write(key, new StringObject("old"), 0L));
+        REQUIRE(bin->write(key, new StringObject("new"), 0L));
+        bin->flush();
+
+        ReadResult r = target->readString(key, 0L);
+        REQUIRE(r.succeeded());
+        REQUIRE(r.getString() == "new");
+    }
+
+    SECTION("Remove cancels a queued write")
+    {
+        std::string key("removed_key");
+        REQUIRE(bin->write(key, new StringObject("value"), 0L));
+        REQUIRE(bin->remove(key));
+        bin->flush();
+
+        REQUIRE(bin->readString(key, 0L).failed());
+        REQUIRE(target->readString(key, 0L).failed());
+    }
+}
+
+TEST_CASE( "Packed cache bin" ) {
+
+    FileSystemCacheOptions options;
+    options.rootPath() = "osgearth_tests_packed_cache";
+    options.packed() = true;
+
+    osg::ref_ptr<Cache> cache = CacheFactory::create(options);
+    REQUIRE(cache.valid());
+    REQUIRE(cache->isOK());
+
+    osg::ref_ptr<CacheBin> bin = cache->addBin("packed_bin");
+    REQUIRE(bin.valid());
+    bin->clear();
+
+    SECTION("Write, read and remove")
+    {
+        REQUIRE(bin->write("string_key", new StringObject("value"), 0L));
+        osg::ref_ptr<osg::Image> image = ImageUtils::createOnePixelImage(osg::Vec4(1, 0, 0, 1));
+        REQUIRE(bin->write("image_key", image.get(), 0L));
+
+        ReadResult r = bin->readString("string_key", 0L);
+        REQUIRE(r.succeeded());
+        REQUIRE(r.getString() == "value");
+
+        ReadResult r2 = bin->readImage("image_key", 0L);
+        REQUIRE(r2.succeeded());
+        REQUIRE(ImageUtils::areEquivalent(r2.getImage(), image.get()));
+
+        // a second write to the same key replaces the first
+        REQUIRE(bin->write("string_key", new StringObject("new value"), 0L));
+        REQUIRE(bin->readString("string_key", 0L).getString() == "new value");
+
+        REQUIRE(bin->remove("string_key"));
+        REQUIRE(bin->getRecordStatus("string_key") == CacheBin::STATUS_NOT_FOUND);
+        REQUIRE(bin->readString("string_key", 0L).failed());
+        REQUIRE(bin->getRecordStatus("image_key") == CacheBin::STATUS_OK);
+    }
+
+    SECTION("Records survive reopening the cache")
+    {
+        REQUIRE(bin->write("kept", new StringObject("kept"), 0L));
+        REQUIRE(bin->write("removed", new StringObject("removed"), 0L));
+        REQUIRE(bin->remove("removed"));
+
+        bin = 0L;
+        cache = CacheFactory::create(options);
+        REQUIRE(cache.valid());
+        bin = cache->addBin("packed_bin");
+        REQUIRE(bin.valid());
+
+        ReadResult r = bin->readString("kept", 0L);
+        REQUIRE(r.succeeded());
+        REQUIRE(r.getString() == "kept");
+        REQUIRE(bin->readString("removed", 0L).failed());
+    }
+
+    SECTION("Writes after a partial record stay aligned and readable")
+    {
+        REQUIRE(bin->write("before", new StringObject("before"), 0L));
+        bin = 0L;
+        cache = 0L;
+
+        // leave an unaligned partial record at the end of the data file,
+        // as a crash or a write that could not be rolled back would.
+        std::string dataFile = osgDB::concatPaths(osgDB::concatPaths(*options.rootPath(), "packed_bin"), "data_0000.pack");
+        FILE* f = ::fopen(dataFile.c_str(), "ab");
+        REQUIRE(f != 0L);
+        ::fwrite("OEPR!", 1, 5, f);
+        ::fclose(f);
+
+        cache = CacheFactory::create(options);
+        REQUIRE(cache.valid());
+        bin = cache->addBin("packed_bin");
+        REQUIRE(bin.valid());
+
+        REQUIRE(bin->write("after", new StringObject("after"), 0L));
+        REQUIRE(bin->write("after2", new StringObject("after2"), 0L));
+
+        REQUIRE(bin->readString("before", 0L).getString() == "before");
+        REQUIRE(bin->readString("after", 0L).getString() == "after");
+        REQUIRE(bin->readString("after2", 0L).getString() == "after2");
+    }
+
+    bin->clear();
+}
+
+TEST_CASE( "HTTPRequest validators" ) {
+
+    SECTION("ETag and Last-Modified")
+    {
+        // response headers as stored with a cached copy
+        Config headers;
+        headers.set("etag", "\"33a64df5\"");
+        headers.set("Last-Modified", "Wed, 21 Oct 2015 07:28:00 GMT");
+
+        HTTPRequest req("http://example.com/tile.png");
+        REQUIRE(req.setValidators(headers));
+        REQUIRE(req.getHeaders().find("If-None-Match")->second == "\"33a64df5\"");
+        REQUIRE(req.getHeaders().find("If-Modified-Since")->second == "Wed, 21 Oct 2015 07:28:00 GMT");
+    }
+
+    SECTION("No validators")
+    {
+        Config headers;
+        headers.set("Content-Type", "image/png");
+
+        HTTPRequest req("http://example.com/tile.png");
+        REQUIRE_FALSE(req.setValidators(headers));
+        REQUIRE(req.getHeaders().empty());
+    }
+}
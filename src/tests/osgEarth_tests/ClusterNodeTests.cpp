@@ -0,0 +1,119 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarthUtil/ClusterNode>
+#include <osgEarth/MapNode>
+#include <osgEarth/GeoData>
+#include <osg/Group>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace ClusterNodeTest
+{
+    // A node whose bound sits at a geographic position.
+    osg::Node* createNode(const SpatialReference* mapSRS, double lon, double lat)
+    {
+        osg::Vec3d world;
+        GeoPoint(mapSRS->getGeographicSRS(), lon, lat, 0.0, ALTMODE_ABSOLUTE).toWorld(world);
+        osg::Group* node = new osg::Group();
+        node->setInitialBound(osg::BoundingSphere(world, 1.0f));
+        return node;
+    }
+
+    unsigned sizeOfClusterWith(const std::vector< osg::NodeList >& clusters, osg::Node* node)
+    {
+        for (unsigned i = 0; i < clusters.size(); ++i)
+            for (unsigned j = 0; j < clusters[i].size(); ++j)
+                if (clusters[i][j].get() == node)
+                    return clusters[i].size();
+        return 0u;
+    }
+
+    struct NeverCluster : public ClusterNode::CanClusterCallback
+    {
+        bool operator()(osg::Node* a, osg::Node* b) { return false; }
+    };
+}
+
+TEST_CASE( "ClusterNode" ) {
+
+    // no terrain engine is needed; the clusters only use the map's SRS.
+    osg::ref_ptr<MapNode> mapNode = new MapNode(new Map());
+    const SpatialReference* mapSRS = mapNode->getMapSRS();
+
+    // With the default radius of 50 pixels, "a" and "b" (0.1 degrees apart)
+    // are within the radius up to zoom 9 (world 131072 pixels wide, so 36
+    // pixels apart) and outside it from zoom 10 (73 pixels apart). "c" is a
+    // quarter of the world away and never joins them.
+    osg::ref_ptr<osg::Node> a = ClusterNodeTest::createNode(mapSRS, 0.0, 0.0);
+    osg::ref_ptr<osg::Node> b = ClusterNodeTest::createNode(mapSRS, 0.1, 0.0);
+    osg::ref_ptr<osg::Node> c = ClusterNodeTest::createNode(mapSRS, 90.0, 45.0);
+
+    osg::ref_ptr<ClusterNode> clusterNode = new ClusterNode(mapNode.get());
+    clusterNode->addNode(a.get());
+    clusterNode->addNode(b.get());
+    clusterNode->addNode(c.get());
+
+    SECTION("Nearby nodes cluster up to the expected zoom") {
+        for (unsigned zoom = 0; zoom <= 21; ++zoom)
+        {
+            std::vector< osg::NodeList > clusters;
+            clusterNode->getClusterNodes(zoom, clusters);
+
+            INFO("zoom " << zoom);
+            unsigned expected = zoom <= 9 ? 2u : 1u;
+            REQUIRE(clusters.size() == (zoom <= 9 ? 2u : 3u));
+            REQUIRE(ClusterNodeTest::sizeOfClusterWith(clusters, a.get()) == expected);
+            REQUIRE(ClusterNodeTest::sizeOfClusterWith(clusters, b.get()) == expected);
+            REQUIRE(ClusterNodeTest::sizeOfClusterWith(clusters, c.get()) == 1u);
+        }
+    }
+
+    SECTION("A larger radius clusters at higher zooms") {
+        // 200 pixels reaches 0.1 degrees up to zoom 11 (146 pixels apart).
+        clusterNode->setRadius(200);
+        std::vector< osg::NodeList > clusters;
+        clusterNode->getClusterNodes(11, clusters);
+        REQUIRE(ClusterNodeTest::sizeOfClusterWith(clusters, a.get()) == 2u);
+        clusters.clear();
+        clusterNode->getClusterNodes(12, clusters);
+        REQUIRE(ClusterNodeTest::sizeOfClusterWith(clusters, a.get()) == 1u);
+    }
+
+    SECTION("Changes show up in the clusters") {
+        clusterNode->removeNode(b.get());
+        std::vector< osg::NodeList > clusters;
+        clusterNode->getClusterNodes(0, clusters);
+        REQUIRE(clusters.size() == 2u);
+        REQUIRE(ClusterNodeTest::sizeOfClusterWith(clusters, b.get()) == 0u);
+    }
+
+    SECTION("CanClusterCallback keeps nodes apart") {
+        clusterNode->setCanClusterCallback(new ClusterNodeTest::NeverCluster());
+        std::vector< osg::NodeList > clusters;
+        clusterNode->getClusterNodes(0, clusters);
+        REQUIRE(clusters.size() == 3u);
+    }
+}
@@ -0,0 +1,189 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/TileSource>
+#include <osgEarth/Registry>
+
+using namespace osgEarth;
+
+namespace ElevationLayerTest
+{
+    typedef float (*HeightFunction)(double x, double y);
+
+    // Generates heightfields from a function of the location in the source's own SRS.
+    class FunctionTileSource : public TileSource
+    {
+    public:
+        FunctionTileSource(const Profile* profile, HeightFunction function) :
+            TileSource(TileSourceOptions()),
+            _profile(profile),
+            _function(function) { }
+
+        Status initialize(const osgDB::Options* dbOptions)
+        {
+            setProfile(_profile.get());
+            return STATUS_OK;
+        }
+
+        CachePolicy getCachePolicyHint(const Profile* profile) const
+        {
+            return CachePolicy::NO_CACHE;
+        }
+
+        osg::HeightField* createHeightField(const TileKey& key, ProgressCallback* progress)
+        {
+            const unsigned size = 33;
+            GeoExtent extent = key.getExtent();
+            osg::HeightField* hf = new osg::HeightField();
+            hf->allocate(size, size);
+            for (unsigned r = 0; r < size; ++r)
+            {
+                double y = extent.yMin() + extent.height() * (double)r / (double)(size-1);
+                for (unsigned c = 0; c < size; ++c)
+                {
+                    double x = extent.xMin() + extent.width() * (double)c / (double)(size-1);
+                    hf->setHeight(c, r, _function(x, y));
+                }
+            }
+            return hf;
+        }
+
+    private:
+        osg::ref_ptr<const Profile> _profile;
+        HeightFunction _function;
+    };
+
+    // geographic: a tilted plane under everything.
+    float baseHeight(double lon, double lat) { return 100.0f + 2.0f*(float)lon + 3.0f*(float)lat; }
+
+    // spherical mercator: no data west of 10 degrees.
+    float mercatorHeight(double x, double y) { return x < 1113194.9 ? NO_DATA_VALUE : 1000.0f + (float)(x*1e-4) - (float)(y*2e-5); }
+
+    // geographic: a ridge with no data west of 15 degrees.
+    float ridgeHeight(double lon, double lat) { return lon < 15.0 ? NO_DATA_VALUE : 2000.0f + 50.0f*sinf((float)lat); }
+
+    // geographic offset.
+    float offsetHeight(double lon, double lat) { return 5.0f + 0.1f*(float)lon; }
+
+    ElevationLayer* createLayer(const std::string& name, const Profile* profile, HeightFunction function, bool isOffset)
+    {
+        ElevationLayerOptions options(name);
+        options.tileSize() = 33;
+        options.offset() = isOffset;
+        options.cachePolicy() = CachePolicy::NO_CACHE;
+        ElevationLayer* layer = new ElevationLayer(options, new FunctionTileSource(profile, function));
+        layer->open();
+        return layer;
+    }
+
+    // The per-sample compositing that populateHeightFieldAndNormalMap must reproduce:
+    // the highest-priority layer with data wins, then the offset layers on top of it
+    // are added in.
+    float expectedElevation(const ElevationLayerVector& layers, const TileKey& key, double x, double y, ElevationInterpolation interp)
+    {
+        const SpatialReference* srs = key.getProfile()->getSRS();
+
+        float result = NO_DATA_VALUE;
+        int resolvedIndex = -1;
+        for (int i = layers.size()-1; i >= 0 && resolvedIndex < 0; --i)
+        {
+            if (layers[i]->isOffset())
+                continue;
+            GeoHeightField layerHF = layers[i]->createHeightField(key, 0L);
+            float elevation;
+            if (layerHF.valid() && layerHF.getElevation(srs, x, y, interp, srs, elevation) && elevation != NO_DATA_VALUE)
+            {
+                result = elevation;
+                resolvedIndex = i;
+            }
+        }
+
+        for (int i = layers.size()-1; i >= 0; --i)
+        {
+            if (!layers[i]->isOffset() || (resolvedIndex >= 0 && i < resolvedIndex))
+                continue;
+            GeoHeightField layerHF = layers[i]->createHeightField(key, 0L);
+            float elevation;
+            if (layerHF.valid() && layerHF.getElevation(srs, x, y, interp, srs, elevation) && elevation != NO_DATA_VALUE)
+                result += elevation;
+        }
+        return result;
+    }
+
+    void compare(const ElevationLayerVector& layers, const TileKey& key, const Profile* haeProfile, ElevationInterpolation interp)
+    {
+        const unsigned size = 33;
+        osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+        hf->allocate(size, size);
+        osg::ref_ptr<NormalMap> normalMap = new NormalMap(size, size);
+
+        REQUIRE(layers.populateHeightFieldAndNormalMap(hf.get(), normalMap.get(), key, haeProfile, interp, 0L));
+
+        TileKey keyToUse = haeProfile ? TileKey(key.getLOD(), key.getTileX(), key.getTileY(), haeProfile) : key;
+        GeoExtent extent = key.getExtent();
+        double dx = extent.width() / (double)(size-1);
+        double dy = extent.height() / (double)(size-1);
+
+        for (unsigned r = 0; r < size; ++r)
+        {
+            for (unsigned c = 0; c < size; ++c)
+            {
+                float expected = expectedElevation(layers, keyToUse, extent.xMin() + dx*(double)c, extent.yMin() + dy*(double)r, interp);
+                REQUIRE(fabs(hf->getHeight(c, r) - expected) < 0.01f);
+                REQUIRE(normalMap->getNormal(c, r).z() > 0.0f);
+            }
+        }
+    }
+}
+
+TEST_CASE( "ElevationLayerVector" ) {
+
+    using namespace ElevationLayerTest;
+
+    const Profile* geodetic = Registry::instance()->getGlobalGeodeticProfile();
+    const Profile* mercator = Registry::instance()->getSphericalMercatorProfile();
+
+    // lowest priority first.
+    ElevationLayerVector layers;
+    layers.push_back(createLayer("base",     geodetic, baseHeight,     false));
+    layers.push_back(createLayer("mercator", mercator, mercatorHeight, false));
+    layers.push_back(createLayer("offset",   geodetic, offsetHeight,   true));
+    layers.push_back(createLayer("ridge",    geodetic, ridgeHeight,    false));
+
+    // 0..22.5 east, 22.5..45 north: straddles the no-data edges of both upper layers.
+    TileKey key(3, 8, 2, geodetic);
+
+    SECTION("Composites layers like per-sample getElevation") {
+        compare(layers, key, 0L, INTERP_BILINEAR);
+        compare(layers, key, 0L, INTERP_NEAREST);
+    }
+
+    SECTION("Composites layers like per-sample getElevation with a vertical datum") {
+        osg::ref_ptr<const Profile> egm96 = Profile::create("epsg:4326", -180.0, -90.0, 180.0, 90.0, "egm96", 2, 1);
+        TileKey egm96Key(3, 8, 2, egm96.get());
+        compare(layers, egm96Key, 0L, INTERP_BILINEAR);
+        compare(layers, egm96Key, geodetic, INTERP_BILINEAR);
+    }
+}
@@ -0,0 +1,309 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/ElevationPool>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/TileSource>
+#include <osgEarth/Map>
+#include <osgEarth/JobScheduler>
+#include <OpenThreads/Atomic>
+
+using namespace osgEarth;
+
+namespace ElevationPoolTest
+{
+    typedef float (*HeightFunction)(double lon, double lat);
+
+    // Generates geographic heightfields from a function, with data up to
+    // a maximum level and optionally only within an extent.
+    class FunctionTileSource : public TileSource
+    {
+    public:
+        FunctionTileSource(HeightFunction function, const GeoExtent& extent, unsigned maxLevel) :
+            TileSource(TileSourceOptions()),
+            _function(function),
+            _extent(extent),
+            _maxLevel(maxLevel) { }
+
+        Status initialize(const osgDB::Options* dbOptions)
+        {
+            setProfile(Profile::create("global-geodetic"));
+            getDataExtents().push_back(DataExtent(_extent, 0u, _maxLevel));
+            return STATUS_OK;
+        }
+
+        CachePolicy getCachePolicyHint(const Profile* profile) const
+        {
+            return CachePolicy::NO_CACHE;
+        }
+
+        osg::HeightField* createHeightField(const TileKey& key, ProgressCallback* progress)
+        {
+            const unsigned size = 33;
+            GeoExtent extent = key.getExtent();
+            osg::HeightField* hf = new osg::HeightField();
+            hf->allocate(size, size);
+            for (unsigned r = 0; r < size; ++r)
+            {
+                double y = extent.yMin() + extent.height() * (double)r / (double)(size-1);
+                for (unsigned c = 0; c < size; ++c)
+                {
+                    double x = extent.xMin() + extent.width() * (double)c / (double)(size-1);
+                    hf->setHeight(c, r, _function(x, y));
+                }
+            }
+            return hf;
+        }
+
+    private:
+        HeightFunction _function;
+        GeoExtent _extent;
+        unsigned _maxLevel;
+    };
+
+    // coarse data everywhere.
+    float baseHeight(double lon, double lat) { return 100.0f + 2.0f*(float)lon + 3.0f*(float)lat; }
+
+    // detailed data over a small region, distinct from the base.
+    float detailHeight(double lon, double lat)
+    {
+        if (lon < 0.0 || lon > 10.0 || lat < 0.0 || lat > 10.0)
+            return NO_DATA_VALUE;
+        return 500.0f + 7.0f*(float)lon - 5.0f*(float)lat;
+    }
+
+    ElevationLayer* createLayer(const std::string& name, HeightFunction function, const GeoExtent& extent, unsigned maxLevel)
+    {
+        ElevationLayerOptions options(name);
+        options.tileSize() = 33;
+        options.cachePolicy() = CachePolicy::NO_CACHE;
+        ElevationLayer* layer = new ElevationLayer(options, new FunctionTileSource(function, extent, maxLevel));
+        layer->open();
+        return layer;
+    }
+
+    // A map whose tiles come from different levels: points in the detail
+    // region get tiles at the requested level, the others fall back on
+    // ancestor tiles of the base layer.
+    Map* createMap()
+    {
+        const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+        Map* map = new Map();
+        map->addLayer(createLayer("base", baseHeight, GeoExtent(wgs84, -180.0, -90.0, 180.0, 90.0), 3u));
+        map->addLayer(createLayer("detail", detailHeight, GeoExtent(wgs84, 0.0, 0.0, 10.0, 10.0), 8u));
+        return map;
+    }
+
+    // One point in the middle of each of count x count tiles at a level.
+    void createTileCenters(unsigned lod, unsigned count, std::vector<osg::Vec3d>& points)
+    {
+        double width = 180.0 / (double)(1u << lod);
+        for (unsigned j = 0; j < count; ++j)
+            for (unsigned i = 0; i < count; ++i)
+                points.push_back(osg::Vec3d(((double)i + 0.5)*width, ((double)j + 0.5)*width, 0.0));
+    }
+
+    // Samples the points through its own envelope and counts the wrong answers.
+    struct SampleJob : public TaskRequest
+    {
+        SampleJob(ElevationPool* pool, unsigned lod, const std::vector<osg::Vec3d>& points, OpenThreads::Atomic& errors) :
+            _pool(pool), _lod(lod), _points(points), _errors(errors) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<ElevationEnvelope> envelope = _pool->createEnvelope(SpatialReference::get("wgs84"), _lod);
+            for (unsigned i = 0; i < _points.size(); ++i)
+            {
+                float z = envelope->getElevation(_points[i].x(), _points[i].y());
+                if (fabs(z - baseHeight(_points[i].x(), _points[i].y())) > 0.01f)
+                    ++_errors;
+            }
+        }
+
+        ElevationPool* _pool;
+        unsigned _lod;
+        const std::vector<osg::Vec3d>& _points;
+        OpenThreads::Atomic& _errors;
+    };
+
+    // Points inside, outside and on the edges of the detail region.
+    void createPoints(std::vector<osg::Vec3d>& points)
+    {
+        for (double lat = -5.0; lat <= 15.0; lat += 0.625)
+            for (double lon = -5.0; lon <= 15.0; lon += 0.625)
+                points.push_back(osg::Vec3d(lon, lat, 0.0));
+
+        for (double t = 0.0; t <= 10.0; t += 0.1)
+        {
+            points.push_back(osg::Vec3d(t, 0.0, 0.0));
+            points.push_back(osg::Vec3d(t, 10.0, 0.0));
+            points.push_back(osg::Vec3d(0.0, t, 0.0));
+            points.push_back(osg::Vec3d(10.0, t, 0.0));
+        }
+    }
+
+    void compare(const std::vector<osg::Vec3d>& points, const std::vector<float>& batch, const std::vector<float>& single)
+    {
+        REQUIRE(batch.size() == single.size());
+        for (unsigned i = 0; i < points.size(); ++i)
+        {
+            INFO("point " << points[i].x() << ", " << points[i].y());
+            if (single[i] == NO_DATA_VALUE)
+                REQUIRE(batch[i] == NO_DATA_VALUE);
+            else
+                REQUIRE(fabs(batch[i] - single[i]) < 0.01f);
+        }
+    }
+}
+
+TEST_CASE( "ElevationEnvelope" ) {
+
+    osg::ref_ptr<Map> map = ElevationPoolTest::createMap();
+    osg::ref_ptr<ElevationPool> pool = new ElevationPool();
+    pool->setMap(map.get());
+    pool->setTileSize(33);
+
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    const unsigned lod = 6u;
+
+    std::vector<osg::Vec3d> points;
+    ElevationPoolTest::createPoints(points);
+
+    SECTION("Batch sampling matches point sampling") {
+        osg::ref_ptr<ElevationEnvelope> batchEnvelope = pool->createEnvelope(wgs84, lod);
+        std::vector<float> batch;
+        batchEnvelope->getElevations(points, batch);
+
+        osg::ref_ptr<ElevationEnvelope> singleEnvelope = pool->createEnvelope(wgs84, lod);
+        std::vector<float> single;
+        for (unsigned i = 0; i < points.size(); ++i)
+            single.push_back(singleEnvelope->getElevation(points[i].x(), points[i].y()));
+
+        ElevationPoolTest::compare(points, batch, single);
+    }
+
+    SECTION("Batch sampling matches point sampling over a filled query set") {
+        // sample points one by one first so the batch runs over tiles at
+        // several resolutions already in the envelope.
+        osg::ref_ptr<ElevationEnvelope> envelope = pool->createEnvelope(wgs84, lod);
+        std::vector<float> single;
+        for (unsigned i = 0; i < points.size(); ++i)
+            single.push_back(envelope->getElevation(points[i].x(), points[i].y()));
+
+        std::vector<float> batch;
+        envelope->getElevations(points, batch);
+
+        ElevationPoolTest::compare(points, batch, single);
+    }
+
+    SECTION("Points take the detail where there is some") {
+        osg::ref_ptr<ElevationEnvelope> envelope = pool->createEnvelope(wgs84, lod);
+        std::vector<osg::Vec3d> input;
+        input.push_back(osg::Vec3d(5.0, 5.0, 0.0));
+        input.push_back(osg::Vec3d(-3.0, -3.0, 0.0));
+        std::vector<float> output;
+        REQUIRE(envelope->getElevations(input, output) == 2u);
+        REQUIRE(fabs(output[0] - ElevationPoolTest::detailHeight(5.0, 5.0)) < 0.01f);
+        REQUIRE(fabs(output[1] - ElevationPoolTest::baseHeight(-3.0, -3.0)) < 0.01f);
+    }
+}
+
+TEST_CASE( "ElevationPool cache" ) {
+
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    osg::ref_ptr<Map> map = new Map();
+    map->addLayer(ElevationPoolTest::createLayer("base", ElevationPoolTest::baseHeight, GeoExtent(wgs84, -180.0, -90.0, 180.0, 90.0), 10u));
+
+    osg::ref_ptr<ElevationPool> pool = new ElevationPool();
+    pool->setMap(map.get());
+    pool->setTileSize(33);
+
+    // 256 distinct tiles
+    const unsigned lod = 6u;
+    std::vector<osg::Vec3d> points;
+    ElevationPoolTest::createTileCenters(lod, 16u, points);
+
+    SECTION("Holds every tile within budget") {
+        pool->setMaxEntries(1024u);
+        const unsigned tileBytes = pool->getMaxBytes() / 1024u;
+
+        osg::ref_ptr<ElevationEnvelope> envelope = pool->createEnvelope(wgs84, lod);
+        std::vector<float> output;
+        REQUIRE(envelope->getElevations(points, output) == points.size());
+
+        ElevationPool::Stats stats = pool->getStats();
+        REQUIRE(stats._misses == points.size());
+        REQUIRE(stats._entries == points.size());
+        REQUIRE(stats._bytes == points.size() * tileBytes);
+    }
+
+    SECTION("Evicts tiles to stay within the byte budget") {
+        pool->setMaxEntries(64u);
+        const unsigned maxBytes = pool->getMaxBytes();
+
+        osg::ref_ptr<ElevationEnvelope> envelope = pool->createEnvelope(wgs84, lod);
+        std::vector<float> output;
+        REQUIRE(envelope->getElevations(points, output) == points.size());
+
+        // the envelope still holds the evicted tiles, so every answer is right.
+        for (unsigned i = 0; i < points.size(); ++i)
+            REQUIRE(fabs(output[i] - ElevationPoolTest::baseHeight(points[i].x(), points[i].y())) < 0.01f);
+
+        ElevationPool::Stats stats = pool->getStats();
+        REQUIRE(stats._misses == points.size());
+        REQUIRE(stats._bytes <= maxBytes);
+        REQUIRE(stats._entries <= 64u);
+        REQUIRE(stats._entries > 0u);
+
+        // a new envelope refetches what the cache let go.
+        pool->resetStats();
+        osg::ref_ptr<ElevationEnvelope> envelope2 = pool->createEnvelope(wgs84, lod);
+        REQUIRE(envelope2->getElevations(points, output) == points.size());
+        stats = pool->getStats();
+        REQUIRE(stats._hits + stats._misses == points.size());
+        REQUIRE(stats._misses >= points.size() - 64u);
+        REQUIRE(stats._bytes <= maxBytes);
+    }
+
+    SECTION("Shares tiles between concurrent queries") {
+        osg::ref_ptr<JobScheduler> scheduler = new JobScheduler("test", 4u);
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+        OpenThreads::Atomic errors(0u);
+
+        const unsigned numJobs = 16u;
+        for (unsigned i = 0; i < numJobs; ++i)
+            scheduler->add(new ElevationPoolTest::SampleJob(pool.get(), lod, points, errors), group.get());
+        group->wait();
+
+        REQUIRE((unsigned)errors == 0u);
+
+        // every tile was fetched from the map once; the other lookups found
+        // it in the cache, possibly waiting for another job to fetch it.
+        ElevationPool::Stats stats = pool->getStats();
+        REQUIRE(stats._misses == points.size());
+        REQUIRE(stats._hits == (numJobs - 1u) * points.size());
+        REQUIRE(stats._waits <= stats._hits);
+        REQUIRE(stats._entries == points.size());
+    }
+}
@@ -23,7 +23,17 @@
 #include <osgEarth/catch.hpp>
 
 #include <osgEarthFeatures/Feature>
+#include <osgEarthFeatures/CompiledExpression>
+#include <osgEarthFeatures/FeatureBatch>
+#include <osgEarthFeatures/ResampleFilter>
+#include <osgEarthFeatures/TransformFilter>
 #include <osgEarthFeatures/GeometryUtils>
+#include <osgEarthFeatures/FeatureModelGraph>
+#include <osgEarthFeatures/FeatureSourceIndexNode>
+#include <osgEarthFeatures/FeatureCursor>
+#include <osgEarth/Registry>
+#include <osg/Geode>
+#include <osg/Geometry>
 
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
@@ -105,3 +115,281 @@ TEST_CASE("Feature handles attributes correctly.") {
         REQUIRE(feature->getBool("bool") == false);
     }
 }
+
+TEST_CASE("Compiled expressions match Feature::eval") {
+    FeatureList features;
+    for (int i = 0; i < 4; ++i)
+    {
+        osg::ref_ptr< Feature > feature = new Feature(new Geometry(), osgEarth::SpatialReference::create("wgs84"));
+        feature->set("height", 10.0 * i);
+        feature->set("levels", i);
+        feature->set("name", std::string("building"));
+        features.push_back(feature.get());
+    }
+
+    FeatureSchema schema;
+    schema["HEIGHT"] = ATTRTYPE_DOUBLE;
+    schema["levels"] = ATTRTYPE_INT;
+    schema["name"] = ATTRTYPE_STRING;
+
+    SECTION("Numeric expressions") {
+        NumericExpression expr("max([height], [levels] * 3) + [height] % 7");
+        CompiledNumericExpression compiled(expr, schema);
+
+        std::vector<double> output;
+        compiled.eval(features, 0L, output);
+        REQUIRE(output.size() == features.size());
+
+        unsigned i = 0;
+        for (FeatureList::iterator f = features.begin(); f != features.end(); ++f, ++i)
+        {
+            REQUIRE(output[i] == f->get()->eval(expr, (FilterContext*)0L));
+            REQUIRE(compiled.eval(f->get(), 0L) == output[i]);
+        }
+    }
+
+    SECTION("Constant numeric expressions") {
+        CompiledNumericExpression compiled(NumericExpression("(1 + 2) * 4"));
+        std::vector<double> output;
+        compiled.eval(features, 0L, output);
+        REQUIRE(output.size() == features.size());
+        REQUIRE(output.back() == 12.0);
+    }
+
+    SECTION("String expressions") {
+        StringExpression expr("[name] + \" with \" + [levels] + \" levels\"");
+        CompiledStringExpression compiled(expr, schema);
+
+        std::vector<std::string> output;
+        compiled.eval(features, 0L, output);
+        REQUIRE(output.size() == features.size());
+        REQUIRE(output[2] == "building with 2 levels");
+
+        unsigned i = 0;
+        for (FeatureList::iterator f = features.begin(); f != features.end(); ++f, ++i)
+        {
+            REQUIRE(output[i] == f->get()->eval(expr, (FilterContext*)0L));
+        }
+    }
+
+    SECTION("Variables missing from the schema are not read as attributes") {
+        CompiledNumericExpression compiled(NumericExpression("[height] + 1"), FeatureSchema());
+        REQUIRE(compiled.eval(features.back().get(), 0L) == 31.0);
+
+        FeatureSchema other;
+        other["width"] = ATTRTYPE_DOUBLE;
+        CompiledNumericExpression unbound(NumericExpression("[height] + 1"), other);
+        REQUIRE(unbound.eval(features.back().get(), 0L) == 1.0);
+    }
+
+    SECTION("Attribute names are not case sensitive") {
+        NumericExpression expr("[Height] + [LEVELS]");
+        CompiledNumericExpression compiled(expr, schema);
+        REQUIRE(compiled.eval(features.back().get(), 0L) == 33.0);
+        REQUIRE(compiled.eval(features.back().get(), 0L) == features.back()->eval(expr, (FilterContext*)0L));
+
+        CompiledStringExpression name(StringExpression("[Name]"), schema);
+        REQUIRE(name.eval(features.back().get(), 0L) == "building");
+    }
+}
+
+TEST_CASE("FeatureBatch") {
+    const SpatialReference* wgs84 = SpatialReference::create("wgs84");
+
+    FeatureList features;
+    features.push_back(new Feature(GeometryUtils::geometryFromWKT("POLYGON((0 0, 10 0, 10 10, 0 10), (2 2, 4 2, 4 4))"), wgs84));
+    features.push_back(new Feature(GeometryUtils::geometryFromWKT("MULTILINESTRING((0 0, 1 1), (2 2, 3 3, 4 4))"), wgs84));
+    features.push_back(new Feature(0L, wgs84));
+
+    features.front()->set("name", std::string("first"));
+    features.front()->set("height", 12.5);
+    features.back()->set("height", 3);
+
+    SECTION("Stores geometry and attributes in columns") {
+        unsigned numPoints =
+            features.front()->getGeometry()->getTotalPointCount() +
+            (*++features.begin())->getGeometry()->getTotalPointCount();
+
+        osg::ref_ptr<FeatureBatch> batch = new FeatureBatch(features);
+        REQUIRE(batch->size() == 3);
+        REQUIRE(batch->points().size() == numPoints);
+        REQUIRE(batch->parts().size() == 4);
+        REQUIRE(batch->getNumParts(0) == 2);
+        REQUIRE(batch->parts()[1].hole == true);
+        REQUIRE(batch->hasGeometry(2) == false);
+
+        int height = batch->getColumn("HEIGHT");
+        REQUIRE(height >= 0);
+        REQUIRE(batch->getDouble(0, height) == 12.5);
+        REQUIRE(batch->isSet(1, height) == false);
+        REQUIRE(batch->getDouble(2, height) == 3.0);
+        REQUIRE(batch->getString(0, batch->getColumn("name")) == "first");
+    }
+
+    SECTION("Writes changes back to the features") {
+        unsigned outerSize = features.front()->getGeometry()->size();
+
+        osg::ref_ptr<FeatureBatch> batch = new FeatureBatch(features);
+        batch->points()[0].z() = 100.0;
+        batch->set(1, batch->getOrCreateColumn("name", ATTRTYPE_STRING), std::string("second"));
+
+        FeatureList output;
+        batch->toFeatures(output);
+        REQUIRE(output.size() == 3);
+
+        Polygon* polygon = dynamic_cast<Polygon*>(output.front()->getGeometry());
+        REQUIRE(polygon != 0L);
+        REQUIRE(polygon->size() == outerSize);
+        REQUIRE(polygon->getHoles().size() == 1);
+        REQUIRE((*polygon)[0].z() == 100.0);
+
+        FeatureList::iterator second = ++output.begin();
+        REQUIRE((*second)->getGeometry()->getType() == Geometry::TYPE_MULTI);
+        REQUIRE((*second)->getGeometry()->getNumComponents() == 2);
+        REQUIRE((*second)->getString("name") == "second");
+        REQUIRE(output.back()->getGeometry() == 0L);
+    }
+
+    SECTION("Keeps the type of each value") {
+        FeatureList mixed;
+        mixed.push_back(new Feature(0L, wgs84));
+        mixed.push_back(new Feature(0L, wgs84));
+        mixed.push_back(new Feature(0L, wgs84));
+        mixed.front()->set("count", 12);
+        (*++mixed.begin())->set("count", 12.5);
+        mixed.back()->set("count", std::string("many"));
+
+        osg::ref_ptr<FeatureBatch> batch = new FeatureBatch(mixed);
+        int count = batch->getColumn("count");
+        REQUIRE(count >= 0);
+        REQUIRE(batch->getDouble(1, count) == 12.5);
+        REQUIRE(batch->getString(2, count) == "many");
+
+        FeatureList output;
+        batch->toFeatures(output);
+        FeatureList::iterator f = output.begin();
+        REQUIRE((*f)->getAttrs().find("count")->second.first == ATTRTYPE_INT);
+        REQUIRE((*f)->getInt("count") == 12);
+        ++f;
+        REQUIRE((*f)->getAttrs().find("count")->second.first == ATTRTYPE_DOUBLE);
+        REQUIRE((*f)->getDouble("count") == 12.5);
+        ++f;
+        REQUIRE((*f)->getAttrs().find("count")->second.first == ATTRTYPE_STRING);
+        REQUIRE((*f)->getString("count") == "many");
+    }
+
+    SECTION("Filters give the same results on a batch") {
+        FeatureList copies;
+        for (FeatureList::iterator f = features.begin(); f != features.end(); ++f)
+            copies.push_back(new Feature(*f->get()));
+
+        FilterContext context;
+        ResampleFilter resample(0.0, 0.75);
+        TransformFilter transform(osg::Matrixd::translate(1.0, 2.0, 3.0));
+
+        osg::ref_ptr<FeatureBatch> batch = new FeatureBatch(copies);
+        resample.pushBatch(*batch, context);
+        transform.pushBatch(*batch, context);
+        FeatureList batched;
+        batch->toFeatures(batched);
+
+        resample.push(features, context);
+        transform.push(features, context);
+
+        FeatureList::iterator a = features.begin();
+        FeatureList::iterator b = batched.begin();
+        for (; a != features.end(); ++a, ++b)
+        {
+            if ((*a)->getGeometry() == 0L)
+            {
+                REQUIRE((*b)->getGeometry() == 0L);
+                continue;
+            }
+
+            ConstGeometryIterator ai((*a)->getGeometry());
+            ConstGeometryIterator bi((*b)->getGeometry());
+            while (ai.hasMore())
+            {
+                REQUIRE(bi.hasMore());
+                const Geometry* ap = ai.next();
+                const Geometry* bp = bi.next();
+                REQUIRE(ap->asVector() == bp->asVector());
+            }
+            REQUIRE_FALSE(bi.hasMore());
+        }
+    }
+}
+
+namespace
+{
+    // Tags one small geometry per feature, the way the geometry filters do.
+    struct TaggingNodeFactory : public FeatureNodeFactory
+    {
+        bool createOrUpdateNode(FeatureCursor* cursor, const Style& style, const FilterContext& context, osg::ref_ptr<osg::Node>& node)
+        {
+            FilterContext cx(context);
+            osg::Geode* geode = new osg::Geode();
+            while (cursor->hasMore())
+            {
+                Feature* feature = cursor->nextFeature();
+                osg::Geometry* geom = new osg::Geometry();
+                osg::Vec3Array* verts = new osg::Vec3Array();
+                verts->push_back(osg::Vec3(0,0,0));
+                verts->push_back(osg::Vec3(1,0,0));
+                verts->push_back(osg::Vec3(1,1,0));
+                geom->setVertexArray(verts);
+                geom->setName(Stringify() << feature->getFID());
+                cx.featureIndex()->tagDrawable(geom, feature);
+                geode->addDrawable(geom);
+            }
+            node = geode;
+            return true;
+        }
+    };
+}
+
+TEST_CASE("Chunked compilation with feature indexing") {
+    JobScheduler* scheduler = Registry::instance()->getJobScheduler();
+    REQUIRE(scheduler != 0L);
+
+    osg::ref_ptr<FeatureSourceIndex> index = new FeatureSourceIndex(0L, Registry::objectIndex(), FeatureSourceIndexOptions());
+    osg::ref_ptr<FeatureSourceIndexNode> indexNode = new FeatureSourceIndexNode(index.get());
+
+    const unsigned numFeatures = 4000u;
+    FeatureList features;
+    for (unsigned i = 0; i < numFeatures; ++i)
+        features.push_back(new Feature(0L, 0L, Style(), i+1));
+
+    osg::ref_ptr<TaggingNodeFactory> factory = new TaggingNodeFactory();
+    FilterContext context(0L, 0L, GeoExtent::INVALID, indexNode.get());
+    unsigned numChunks = scheduler->getNumThreads() + 1u;
+
+    std::vector< osg::ref_ptr<osg::Node> > nodes;
+    REQUIRE(FeatureModelGraph::compileInChunks(factory.get(), Style(), features, context, numChunks, nodes));
+    REQUIRE(nodes.size() == numChunks);
+
+    // every feature made it into the node's map exactly once
+    std::vector<FeatureID> fids;
+    indexNode->getAllFIDs(fids);
+    REQUIRE(fids.size() == numFeatures);
+    REQUIRE(index->size() == (int)numFeatures);
+
+    // and every drawable carries the object ID of its own feature
+    unsigned numTagged = 0u;
+    for (unsigned n = 0; n < nodes.size(); ++n)
+    {
+        osg::Geode* geode = nodes[n]->asGeode();
+        REQUIRE(geode != 0L);
+        for (unsigned d = 0; d < geode->getNumDrawables(); ++d)
+        {
+            osg::Drawable* drawable = geode->getDrawable(d);
+            std::set<ObjectID> oids;
+            REQUIRE(Registry::objectIndex()->getObjectIDs(drawable, oids));
+            REQUIRE(oids.size() == 1u);
+            FeatureID fid = as<FeatureID>(drawable->getName(), 0);
+            REQUIRE(*oids.begin() == index->getObjectID(fid));
+            ++numTagged;
+        }
+    }
+    REQUIRE(numTagged == numFeatures);
+}
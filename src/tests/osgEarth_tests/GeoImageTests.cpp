@@ -0,0 +1,102 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/GeoData>
+#include <osgEarth/ImageUtils>
+
+using namespace osgEarth;
+
+TEST_CASE( "GeoImage" ) {
+
+    const SpatialReference* WGS84 = SpatialReference::get("wgs84");
+    const SpatialReference* MERC  = SpatialReference::get("spherical-mercator");
+
+    SECTION("Native geographic to mercator reprojection matches the exact transform") {
+
+        // each pixel stores its own column (red) and row (green).
+        const int size = 256;
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        for (int t = 0; t < size; ++t)
+        {
+            for (int s = 0; s < size; ++s)
+            {
+                unsigned char* p = image->data(s, t);
+                p[0] = (unsigned char)s;
+                p[1] = (unsigned char)t;
+                p[2] = 0;
+                p[3] = 255;
+            }
+        }
+
+        GeoExtent srcExtent(WGS84, -10.0, -10.0, 10.0, 10.0);
+        GeoImage geoImage(image.get(), srcExtent);
+
+        // nearest-neighbor, so every output pixel names the source pixel it came from.
+        // big enough to be resampled in parallel bands.
+        GeoImage result = geoImage.reproject(MERC, 0L, size, size, false);
+        REQUIRE(result.valid());
+        REQUIRE(result.getImage()->s() == size);
+        REQUIRE(result.getImage()->t() == size);
+
+        // reproduce manualReproject's mapping: transform each destination pixel
+        // center into the source SRS and round to the nearest source pixel.
+        const GeoExtent& destExtent = result.getExtent();
+        double dx = destExtent.width() / (double)size;
+        double dy = destExtent.height() / (double)size;
+        double xfac = (size - 1) / srcExtent.width();
+        double yfac = (size - 1) / srcExtent.height();
+
+        int checked = 0, exact = 0, offByOne = 0;
+        for (int r = 0; r < size; ++r)
+        {
+            for (int c = 0; c < size; ++c)
+            {
+                osg::Vec3d in(destExtent.xMin() + (c + 0.5)*dx, destExtent.yMin() + (r + 0.5)*dy, 0.0), out;
+                REQUIRE(MERC->transform(in, WGS84, out));
+
+                if (out.x() < srcExtent.xMin() || out.x() > srcExtent.xMax() ||
+                    out.y() < srcExtent.yMin() || out.y() > srcExtent.yMax())
+                {
+                    continue;
+                }
+
+                int col = osg::clampBetween((int)osg::round((out.x() - srcExtent.xMin()) * xfac), 0, size-1);
+                int row = osg::clampBetween((int)osg::round((out.y() - srcExtent.yMin()) * yfac), 0, size-1);
+
+                const unsigned char* p = result.getImage()->data(c, r);
+                ++checked;
+                if (p[0] == col && p[1] == row)
+                    ++exact;
+                else if (abs((int)p[0] - col) <= 1 && abs((int)p[1] - row) <= 1 && p[3] == 255)
+                    ++offByOne;
+            }
+        }
+
+        // the control grid interpolates to within 1/8 of a source pixel, which can
+        // only tip pixel centers that sit on a rounding boundary.
+        REQUIRE(checked > size*size/2);
+        REQUIRE(exact + offByOne == checked);
+        REQUIRE(exact >= checked * 95 / 100);
+    }
+}
@@ -0,0 +1,203 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/HTTPClient>
+#include <osgEarth/StringUtils>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Atomic>
+
+// The local server below uses BSD sockets.
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cstring>
+
+using namespace osgEarth;
+
+namespace HTTPClientTest
+{
+    /**
+     * Minimal HTTP server on a loopback port. Answers "GET /path" with the
+     * body "hello /path", one request per connection. A request for "/stall"
+     * gets no answer until the server stops.
+     */
+    class LocalServer : public OpenThreads::Thread
+    {
+    public:
+        LocalServer() : _socket(-1), _port(0), _done(false), _requests(0u) { }
+
+        ~LocalServer() { stop(); }
+
+        bool listen()
+        {
+            _socket = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (_socket < 0)
+                return false;
+
+            int on = 1;
+            ::setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+            sockaddr_in addr;
+            ::memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = 0;
+            if (::bind(_socket, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(_socket, 64) != 0)
+                return false;
+
+            socklen_t len = sizeof(addr);
+            ::getsockname(_socket, (sockaddr*)&addr, &len);
+            _port = ntohs(addr.sin_port);
+
+            start();
+            return true;
+        }
+
+        void stop()
+        {
+            if (_socket >= 0)
+            {
+                _done = true;
+                join();
+                ::close(_socket);
+                _socket = -1;
+            }
+        }
+
+        std::string getURL(const std::string& path) const
+        {
+            return Stringify() << "http://127.0.0.1:" << _port << path;
+        }
+
+        unsigned getNumRequests() const { return (unsigned)_requests; }
+
+        void run()
+        {
+            while (!_done)
+            {
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(_socket, &fds);
+                timeval timeout = { 0, 50000 };
+                if (::select(_socket+1, &fds, 0L, 0L, &timeout) <= 0)
+                    continue;
+
+                int conn = ::accept(_socket, 0L, 0L);
+                if (conn >= 0)
+                {
+                    serve(conn);
+                    ::close(conn);
+                }
+            }
+        }
+
+    private:
+        void serve(int conn)
+        {
+            std::string request;
+            char buf[1024];
+            while (request.find("\r\n\r\n") == std::string::npos)
+            {
+                ssize_t n = ::recv(conn, buf, sizeof(buf), 0);
+                if (n <= 0)
+                    return;
+                request.append(buf, n);
+            }
+            ++_requests;
+
+            // "GET /path HTTP/1.1"
+            std::string::size_type start = request.find(' ') + 1;
+            std::string path = request.substr(start, request.find(' ', start) - start);
+
+            if (path == "/stall")
+            {
+                while (!_done)
+                    OpenThreads::Thread::microSleep(10000);
+                return;
+            }
+
+            std::string body = "hello " + path;
+            std::string response = Stringify()
+                << "HTTP/1.1 200 OK\r\n"
+                << "Content-Type: text/plain\r\n"
+                << "Content-Length: " << body.size() << "\r\n"
+                << "Connection: close\r\n"
+                << "\r\n"
+                << body;
+            ::send(conn, response.data(), response.size(), 0);
+        }
+
+        int                 _socket;
+        int                 _port;
+        volatile bool       _done;
+        OpenThreads::Atomic _requests;
+    };
+}
+
+TEST_CASE( "HTTPClient" ) {
+
+    HTTPClientTest::LocalServer server;
+    REQUIRE(server.listen());
+
+    SECTION("Asynchronous requests all complete") {
+        const unsigned count = 20u;
+        std::vector<HTTPClient::ResponseFuture> futures;
+        for (unsigned i = 0; i < count; ++i)
+            futures.push_back(HTTPClient::getAsync(HTTPRequest(server.getURL(Stringify() << "/tile/" << i))));
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            HTTPClient::AsyncResponse* result = futures[i].get();
+            REQUIRE(result != 0L);
+            REQUIRE(result->response.isOK());
+            REQUIRE(result->response.getPartAsString(0) == std::string(Stringify() << "hello /tile/" << i));
+        }
+        REQUIRE(server.getNumRequests() == count);
+    }
+
+    SECTION("Reads run on the asynchronous engine") {
+        ReadResult result = HTTPClient::readString(HTTPRequest(server.getURL("/string")));
+        REQUIRE(result.succeeded());
+        REQUIRE(result.getString() == "hello /string");
+    }
+
+    SECTION("Canceling the progress aborts a transfer") {
+        osg::ref_ptr<ProgressCallback> progress = new ProgressCallback();
+        HTTPClient::ResponseFuture future = HTTPClient::getAsync(HTTPRequest(server.getURL("/stall")), 0L, progress.get());
+        progress->cancel();
+
+        HTTPClient::AsyncResponse* result = future.get();
+        REQUIRE(result != 0L);
+        REQUIRE(result->response.isCancelled());
+    }
+
+    server.stop();
+}
+
+#endif // _WIN32
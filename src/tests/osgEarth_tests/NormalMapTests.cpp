@@ -0,0 +1,188 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/GeoData>
+#include <osgEarth/ImageUtils>
+#include <osgDB/Registry>
+#include <osg/Timer>
+#include <iostream>
+
+using namespace osgEarth;
+
+namespace NormalMapTest
+{
+    // A smoothly varying field of unit normals.
+    osg::Vec3 normalAt(int s, int t)
+    {
+        osg::Vec3 n(0.4f*sinf(0.05f*s), 0.4f*cosf(0.03f*t), 1.0f);
+        n.normalize();
+        return n;
+    }
+
+    void fill(NormalMap* map)
+    {
+        for (int t = 0; t < map->t(); ++t)
+            for (int s = 0; s < map->s(); ++s)
+                map->set(s, t, normalAt(s, t));
+    }
+
+    // Decodes texel i (0..15) of a BC4 block written by ImageUtils::encodeRGTC2,
+    // which always uses the 8-value palette.
+    unsigned char decodeBC4(const unsigned char* block, int i)
+    {
+        int hi = block[0], lo = block[1];
+        unsigned long long bits = 0;
+        for (int k = 0; k < 6; ++k)
+            bits |= (unsigned long long)block[2+k] << (8*k);
+        int index = (int)((bits >> (3*i)) & 7);
+        if (index == 0 || hi <= lo) return hi;
+        if (index == 1) return lo;
+        return (unsigned char)(((8-index)*hi + (index-1)*lo) / 7);
+    }
+}
+
+TEST_CASE( "NormalMap" ) {
+
+    osg::ref_ptr<NormalMap> map = new NormalMap(257, 257);
+
+    SECTION("Defaults to straight up") {
+        osg::Vec3 n = map->getNormal(128, 200);
+        REQUIRE(fabs(n.x()) < 0.01f);
+        REQUIRE(fabs(n.y()) < 0.01f);
+        REQUIRE(n.z() > 0.99f);
+    }
+
+    SECTION("Stores normals and curvature") {
+        osg::Vec3 n(0.6f, -0.48f, 0.64f);
+        map->set(3, 250, n, -0.5f);
+        REQUIRE((map->getNormal(3, 250) - n).length() < 0.02f);
+        REQUIRE(fabs(map->getCurvature(3, 250) + 0.5f) < 0.01f);
+    }
+
+    SECTION("Saturates values out of range") {
+        map->set(10, 10, osg::Vec3(0.0f, 0.0f, 1.0f), 3.0f);
+        REQUIRE(map->data(10, 10)[3] == 255);
+        map->set(10, 10, osg::Vec3(0.0f, 0.0f, 1.0f), -3.0f);
+        REQUIRE(map->data(10, 10)[3] == 0);
+    }
+}
+
+TEST_CASE( "ImageUtils::encodeRGTC2" ) {
+
+    osg::ref_ptr<NormalMap> map = new NormalMap(257, 257);
+    NormalMapTest::fill(map.get());
+
+    osg::ref_ptr<osg::Image> encoded = ImageUtils::encodeRGTC2(map.get());
+    REQUIRE(encoded.valid());
+    REQUIRE(encoded->getPixelFormat() == GL_COMPRESSED_RED_GREEN_RGTC2_EXT);
+    REQUIRE(encoded->s() == 257);
+    REQUIRE(encoded->t() == 257);
+
+    SECTION("Builds a full mipmap chain") {
+        // 257, 128, 64, 32, 16, 8, 4, 2, 1
+        REQUIRE(encoded->getNumMipmapLevels() == 9u);
+    }
+
+    SECTION("Decodes to the source X and Y") {
+        const unsigned char* blocks = encoded->data();
+        int blocksPerRow = (257 + 3) / 4;
+        int worst = 0;
+        for (int t = 0; t < 257; ++t)
+        {
+            for (int s = 0; s < 257; ++s)
+            {
+                const unsigned char* block = blocks + ((t/4)*blocksPerRow + (s/4)) * 16;
+                int i = (t%4)*4 + (s%4);
+                const unsigned char* source = map->data(s, t);
+                worst = osg::maximum(worst, abs((int)NormalMapTest::decodeBC4(block,   i) - (int)source[0]));
+                worst = osg::maximum(worst, abs((int)NormalMapTest::decodeBC4(block+8, i) - (int)source[1]));
+            }
+        }
+        REQUIRE(worst <= 2);
+    }
+
+    SECTION("Rejects unsupported formats") {
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(16, 16, 1, GL_LUMINANCE, GL_FLOAT);
+        REQUIRE(ImageUtils::encodeRGTC2(image.get()) == 0L);
+    }
+}
+
+// Hidden; run with: osgEarth_tests "[.benchmark]"
+TEST_CASE( "Normal map encoding benchmark", "[.benchmark]" ) {
+
+    const int iterations = 100;
+    osg::Timer_t start;
+
+    // Previous path: fill an RGBA8 image through PixelWriter.
+    start = osg::Timer::instance()->tick();
+    for (int i = 0; i < iterations; ++i)
+    {
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(257, 257, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        ImageUtils::PixelWriter write(image.get());
+        for (int t = 0; t < 257; ++t)
+            for (int s = 0; s < 257; ++s)
+            {
+                osg::Vec3 n = NormalMapTest::normalAt(s, t);
+                write(osg::Vec4(0.5f*(n.x()+1.0f), 0.5f*(n.y()+1.0f), 0.5f*(n.z()+1.0f), 0.5f), s, t);
+            }
+    }
+    double writerMs = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) / iterations;
+
+    // Current path: NormalMap writes its bytes directly.
+    osg::ref_ptr<NormalMap> map;
+    start = osg::Timer::instance()->tick();
+    for (int i = 0; i < iterations; ++i)
+    {
+        map = new NormalMap(257, 257);
+        NormalMapTest::fill(map.get());
+    }
+    double fillMs = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) / iterations;
+
+    start = osg::Timer::instance()->tick();
+    for (int i = 0; i < iterations; ++i)
+    {
+        osg::ref_ptr<osg::Image> encoded = ImageUtils::encodeRGTC2(map.get());
+    }
+    double encodeMs = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) / iterations;
+
+    std::cout << "Normal map 257x257, average of " << iterations << " runs:" << std::endl
+        << "  PixelWriter fill:    " << writerMs << " ms" << std::endl
+        << "  NormalMap fill:      " << fillMs << " ms" << std::endl
+        << "  encodeRGTC2:         " << encodeMs << " ms" << std::endl;
+
+    // Previous compression path, when an image processor plugin is available.
+    osgDB::ImageProcessor* ip = osgDB::Registry::instance()->getImageProcessor();
+    if (ip)
+    {
+        start = osg::Timer::instance()->tick();
+        for (int i = 0; i < iterations; ++i)
+        {
+            osg::ref_ptr<osg::Image> copy = ImageUtils::cloneImage(map.get());
+            ip->compress(*copy.get(), osg::Texture::USE_RGTC2_COMPRESSION, true, true, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::NORMAL);
+        }
+        double ipMs = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) / iterations;
+        std::cout << "  ImageProcessor RGTC2: " << ipMs << " ms" << std::endl;
+    }
+}
@@ -0,0 +1,141 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/ObjectIndex>
+#include <algorithm>
+
+using namespace osgEarth;
+
+namespace ObjectIndexTest
+{
+    struct Thing : public osg::Referenced
+    {
+        Thing(unsigned n) : _n(n) { }
+        unsigned _n;
+    };
+
+    typedef std::vector< osg::ref_ptr<Thing> > Things;
+
+    void createThings(unsigned count, Things& output)
+    {
+        for (unsigned i = 0; i < count; ++i)
+            output.push_back(new Thing(output.size()));
+    }
+
+    bool contains(const std::vector<ObjectID>& ids, ObjectID id)
+    {
+        return std::find(ids.begin(), ids.end(), id) != ids.end();
+    }
+
+    // One insert lands in each shard.
+    void insertOnePerShard(ObjectIndex* index, Things& things, std::vector<ObjectID>& ids)
+    {
+        for (unsigned i = 0; i < 16; ++i)
+        {
+            things.push_back(new Thing(things.size()));
+            ids.push_back(index->insert(things.back().get()));
+        }
+    }
+}
+
+TEST_CASE( "ObjectIndex" ) {
+
+    osg::ref_ptr<ObjectIndex> index = new ObjectIndex();
+
+    ObjectIndexTest::Things things;
+    ObjectIndexTest::createThings(100, things);
+
+    SECTION("Batch insert indexes every object") {
+        std::vector<ObjectID> ids;
+        index->insert(things.begin(), things.end(), ids);
+
+        REQUIRE(ids.size() == things.size());
+        REQUIRE(index->size() == things.size());
+        for (unsigned i = 0; i < ids.size(); ++i)
+        {
+            REQUIRE(ids[i] != OSGEARTH_OBJECTID_EMPTY);
+            REQUIRE(ids[i] != OSGEARTH_OBJECTID_TERRAIN);
+            REQUIRE(index->get<ObjectIndexTest::Thing>(ids[i]).get() == things[i].get());
+        }
+
+        std::vector<ObjectID> sorted(ids);
+        std::sort(sorted.begin(), sorted.end());
+        REQUIRE(std::unique(sorted.begin(), sorted.end()) == sorted.end());
+    }
+
+    SECTION("Batch remove forgets every object") {
+        std::vector<ObjectID> ids;
+        index->insert(things.begin(), things.end(), ids);
+
+        index->remove(ids.begin(), ids.begin() + 50);
+        REQUIRE(index->size() == 50u);
+
+        std::vector<ObjectID> rest(ids.begin() + 50, ids.end());
+        index->remove(rest);
+        REQUIRE(index->size() == 0u);
+
+        for (unsigned i = 0; i < ids.size(); ++i)
+            REQUIRE_FALSE(index->get<ObjectIndexTest::Thing>(ids[i]).valid());
+    }
+
+    SECTION("Objects that go away are not returned") {
+        std::vector<ObjectID> ids;
+        index->insert(things.begin(), things.end(), ids);
+        things[7] = 0L;
+        REQUIRE_FALSE(index->get<ObjectIndexTest::Thing>(ids[7]).valid());
+        REQUIRE(index->get<ObjectIndexTest::Thing>(ids[8]).valid());
+    }
+
+    SECTION("Removed IDs are reused only after 1024 more removals") {
+        // a batch lands in one shard.
+        ObjectIndexTest::Things batch;
+        ObjectIndexTest::createThings(1025, batch);
+        std::vector<ObjectID> batchIDs;
+        index->insert(batch.begin(), batch.end(), batchIDs);
+
+        // 1024 removed IDs wait in the shard; none comes back yet.
+        index->remove(batchIDs.begin(), batchIDs.begin() + 1024);
+        std::vector<ObjectID> ids;
+        ObjectIndexTest::insertOnePerShard(index.get(), things, ids);
+        for (unsigned i = 0; i < ids.size(); ++i)
+            REQUIRE_FALSE(ObjectIndexTest::contains(batchIDs, ids[i]));
+
+        // one more removal, and the oldest removed ID goes back into service.
+        index->remove(batchIDs[1024]);
+        ids.clear();
+        ObjectIndexTest::insertOnePerShard(index.get(), things, ids);
+        REQUIRE(ObjectIndexTest::contains(ids, batchIDs[0]));
+        for (unsigned i = 0; i < ids.size(); ++i)
+        {
+            if (ids[i] != batchIDs[0])
+                REQUIRE_FALSE(ObjectIndexTest::contains(batchIDs, ids[i]));
+        }
+
+        // the reused ID now finds its new object.
+        osg::ref_ptr<ObjectIndexTest::Thing> thing = index->get<ObjectIndexTest::Thing>(batchIDs[0]);
+        REQUIRE(thing.valid());
+        REQUIRE(thing.get() != batch[0].get());
+        REQUIRE(index->size() == 32u);
+    }
+}
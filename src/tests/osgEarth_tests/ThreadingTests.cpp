@@ -22,6 +22,9 @@
 
 #include <osgEarth/catch.hpp>
 #include <osgEarth/ThreadingUtils>
+#include <osgEarth/JobScheduler>
+#include <osgEarth/SingleFlight>
+#include <OpenThreads/Atomic>
 
 using namespace osgEarth;
 
@@ -132,4 +135,175 @@ TEST_CASE( "ReadWriteMutex can handle multiple read locks from the same thread w
     REQUIRE(!thread2.isRunning());
     REQUIRE(elapsedTime < maxTimeSeconds);
 }
-*/
\ No newline at end of file
+*/
+
+namespace JobSchedulerTest
+{
+    struct CountJob : public TaskRequest
+    {
+        CountJob(OpenThreads::Atomic& count, JobScheduler* spawnOn =0L, JobGroup* group =0L) :
+            _count(count), _spawnOn(spawnOn), _group(group) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            ++_count;
+
+            // jobs queued from a worker land on that worker and get stolen by the others.
+            if (_spawnOn)
+            {
+                for (unsigned i = 0; i < 10; ++i)
+                    _spawnOn->add(new CountJob(_count), _group);
+            }
+        }
+
+        OpenThreads::Atomic& _count;
+        JobScheduler* _spawnOn;
+        JobGroup* _group;
+    };
+}
+
+TEST_CASE( "JobScheduler" ) {
+
+    osg::ref_ptr<JobScheduler> scheduler = new JobScheduler("test", 4u);
+
+    SECTION("Runs every job in a group") {
+        OpenThreads::Atomic count(0u);
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+        for (unsigned i = 0; i < 100; ++i)
+            scheduler->add(new JobSchedulerTest::CountJob(count, scheduler.get(), group.get()), group.get());
+        group->wait();
+        REQUIRE(group->getNumJobs() == 0u);
+        REQUIRE((unsigned)count == 1100u);
+    }
+
+    SECTION("Discards jobs in a canceled group") {
+        OpenThreads::Atomic count(0u);
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+        group->cancel();
+        osg::ref_ptr<TaskRequest> job = new JobSchedulerTest::CountJob(count);
+        REQUIRE(scheduler->add(job.get(), group.get()) == false);
+        REQUIRE(job->isCompleted());
+        REQUIRE(job->wasCanceled());
+        REQUIRE((unsigned)count == 0u);
+    }
+}
+
+namespace ThreadExitTest
+{
+    struct RecordExit : public Threading::ThreadExitCallback
+    {
+        RecordExit(unsigned& exitedId) : _exitedId(exitedId) { }
+        void onThreadExit(unsigned threadId) { _exitedId = threadId; }
+        unsigned& _exitedId;
+    };
+
+    struct RegisteringThread : public OpenThreads::Thread
+    {
+        RegisteringThread(unsigned& exitedId) : _exitedId(exitedId), _id(0u) { }
+
+        void run()
+        {
+            _id = Threading::getCurrentThreadId();
+            Threading::addThreadExitCallback(new RecordExit(_exitedId));
+        }
+
+        unsigned& _exitedId;
+        unsigned  _id;
+    };
+}
+
+TEST_CASE( "Thread exit callbacks run when the thread exits" ) {
+    unsigned exitedId = 0u;
+    ThreadExitTest::RegisteringThread thread(exitedId);
+    thread.start();
+    thread.join();
+    REQUIRE(thread._id != 0u);
+    REQUIRE(exitedId == thread._id);
+}
+
+namespace SingleFlightTest
+{
+    // A waiter polls its progress for cancelation while it waits, so the
+    // first poll means it has joined the flight. Counts joined waiters and
+    // sets an event once all of them have.
+    struct JoinProgress : public ProgressCallback
+    {
+        JoinProgress(OpenThreads::Atomic& joined, unsigned numWaiters, Threading::Event& allJoined) :
+            _joined(joined), _numWaiters(numWaiters), _allJoined(allJoined), _polled(false) { }
+
+        bool isCanceled()
+        {
+            if (!_polled)
+            {
+                _polled = true;
+                if (++_joined == _numWaiters)
+                    _allJoined.set();
+            }
+            return false;
+        }
+
+        OpenThreads::Atomic& _joined;
+        unsigned _numWaiters;
+        Threading::Event& _allJoined;
+        bool _polled;
+    };
+
+    struct FetchJob : public TaskRequest
+    {
+        FetchJob(SingleFlight<int, std::string>& flights, OpenThreads::Atomic& fetches, OpenThreads::Atomic& joined,
+                 unsigned numWaiters, Threading::Event& allJoined, std::string& result) :
+            _flights(flights), _fetches(fetches), _allJoined(allJoined), _result(result),
+            _progress(new JoinProgress(joined, numWaiters, allJoined)) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            SingleFlight<int, std::string>::Scope flight(_flights, 42, _progress.get());
+            if (!flight.isLeader())
+            {
+                _result = flight.get();
+                return;
+            }
+
+            // stay in flight until every other job has joined.
+            ++_fetches;
+            if (_allJoined.wait(30000u))
+                _result = "data";
+            flight.resolve(_result);
+        }
+
+        SingleFlight<int, std::string>& _flights;
+        OpenThreads::Atomic& _fetches;
+        Threading::Event& _allJoined;
+        std::string& _result;
+        osg::ref_ptr<JoinProgress> _progress;
+    };
+}
+
+TEST_CASE( "SingleFlight" ) {
+
+    SingleFlight<int, std::string> flights;
+
+    SECTION("Concurrent callers share one result") {
+        osg::ref_ptr<JobScheduler> scheduler = new JobScheduler("test", 4u);
+        osg::ref_ptr<JobGroup> group = new JobGroup();
+        OpenThreads::Atomic fetches(0u), joined(0u);
+        Threading::Event allJoined;
+        std::string results[4];
+        for (unsigned i = 0; i < 4; ++i)
+            scheduler->add(new SingleFlightTest::FetchJob(flights, fetches, joined, 3u, allJoined, results[i]), group.get());
+        group->wait();
+        REQUIRE((unsigned)fetches == 1u);
+        for (unsigned i = 0; i < 4; ++i)
+            REQUIRE(results[i] == "data");
+    }
+
+    SECTION("A later caller leads a new flight") {
+        {
+            SingleFlight<int, std::string>::Scope flight(flights, 1, 0L);
+            REQUIRE(flight.isLeader());
+            flight.resolve("first");
+        }
+        SingleFlight<int, std::string>::Scope flight(flights, 1, 0L);
+        REQUIRE(flight.isLeader());
+    }
+}
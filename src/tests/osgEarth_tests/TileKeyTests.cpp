@@ -0,0 +1,101 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/TileKey>
+#include <osgEarth/Registry>
+
+using namespace osgEarth;
+
+TEST_CASE( "TileKey" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    SECTION("Components round-trip through the packed identifier") {
+        TileKey key(18, 123456, 54321, profile);
+        REQUIRE(key.valid());
+        REQUIRE(key.getLOD() == 18u);
+        REQUIRE(key.getTileX() == 123456u);
+        REQUIRE(key.getTileY() == 54321u);
+        REQUIRE(key.str() == "18/123456/54321");
+    }
+
+    SECTION("Ordering is by LOD, then X, then Y") {
+        REQUIRE(TileKey(1, 3, 0, profile) < TileKey(2, 0, 0, profile));
+        REQUIRE(TileKey(2, 0, 3, profile) < TileKey(2, 1, 0, profile));
+        REQUIRE(TileKey(2, 1, 0, profile) < TileKey(2, 1, 1, profile));
+        REQUIRE_FALSE(TileKey(2, 1, 1, profile) < TileKey(2, 1, 1, profile));
+    }
+
+    SECTION("Equal keys have equal hashes") {
+        TileKey a(5, 10, 12, profile);
+        TileKey b(5, 10, 12, profile);
+        REQUIRE(a == b);
+        REQUIRE(a.hash() == b.hash());
+        REQUIRE(a != TileKey(5, 12, 10, profile));
+    }
+
+    SECTION("Extent is computed from the profile") {
+        TileKey key(0, 1, 0, profile);
+        GeoExtent ex = key.getExtent();
+        REQUIRE(ex.xMin() == 0.0);
+        REQUIRE(ex.xMax() == 180.0);
+        REQUIRE(ex.yMin() == -90.0);
+        REQUIRE(ex.yMax() == 90.0);
+    }
+
+    SECTION("Parent and child keys") {
+        TileKey key(3, 5, 6, profile);
+        REQUIRE(key.createParentKey() == TileKey(2, 2, 3, profile));
+        REQUIRE(key.createChildKey(3) == TileKey(4, 11, 13, profile));
+        REQUIRE(key.getQuadrant() == 1u);
+    }
+
+    SECTION("Invalid keys") {
+        REQUIRE_FALSE(TileKey::INVALID.valid());
+        REQUIRE(TileKey::INVALID.str() == "invalid");
+        REQUIRE_FALSE(TileKey(TileKey::MAX_LOD + 1, 0, 0, profile).valid());
+    }
+
+    SECTION("Deep geodetic keys are valid") {
+        // the last column and row of a global geodetic profile at LOD 29.
+        TileKey key(29, (2u << 29) - 1u, (1u << 29) - 1u, profile);
+        REQUIRE(key.valid());
+        REQUIRE(key.getTileX() == (2u << 29) - 1u);
+        REQUIRE(key.getTileY() == (1u << 29) - 1u);
+        REQUIRE(key.getExtent().xMax() == Approx(180.0));
+    }
+
+    SECTION("Copies share the extent and string") {
+        TileKey key(4, 9, 3, profile);
+        TileKey copy(key);
+        REQUIRE(copy.str() == "4/9/3");
+        REQUIRE(key.str() == "4/9/3");
+        TileKey assigned;
+        assigned = key;
+        REQUIRE(assigned.getExtent() == key.getExtent());
+        assigned = TileKey(0, 0, 0, profile);
+        REQUIRE(assigned.getExtent().xMin() == -180.0);
+        REQUIRE(key.getExtent().xMin() == -180.0 + 9 * 11.25);
+    }
+}